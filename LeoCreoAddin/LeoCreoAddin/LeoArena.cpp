@@ -0,0 +1,122 @@
+#include "stdafx.h"
+#include "LeoArena.h"
+#include <algorithm>
+
+RequestArena::RequestArena(size_t initialBlockSize)
+    : m_currentBlock(0)
+    , m_offset(0)
+    , m_initialBlockSize(initialBlockSize)
+    , m_totalBlockAllocations(0)
+{
+}
+
+RequestArena::~RequestArena()
+{
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        ::operator delete(m_blocks[i].Data);
+    }
+}
+
+void* RequestArena::Allocate(size_t bytes, size_t alignment)
+{
+    if (bytes == 0) {
+        bytes = 1;
+    }
+
+    if (m_currentBlock >= m_blocks.size() && !AdvanceBlock(bytes, alignment)) {
+        throw std::bad_alloc();
+    }
+
+    // Align the bump pointer, moving to the next (or a new) block if the request does not fit.
+    // The address is aligned, not the offset: blocks themselves are only max_align_t aligned.
+    Block* block = &m_blocks[m_currentBlock];
+    size_t aligned = AlignedOffset(*block, m_offset, alignment);
+    if (aligned + bytes > block->Size) {
+        if (!AdvanceBlock(bytes, alignment)) {
+            throw std::bad_alloc();
+        }
+        block = &m_blocks[m_currentBlock];
+        aligned = AlignedOffset(*block, 0, alignment);
+    }
+
+    m_stats.Allocations++;
+    m_stats.BytesAllocated += (aligned - m_offset) + bytes;
+    m_offset = aligned + bytes;
+    return block->Data + aligned;
+}
+
+size_t RequestArena::AlignedOffset(const Block& block, size_t offset, size_t alignment)
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(block.Data) + offset;
+    uintptr_t aligned = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    return offset + static_cast<size_t>(aligned - address);
+}
+
+bool RequestArena::AdvanceBlock(size_t bytes, size_t alignment)
+{
+    // Reuse a retained block from an earlier cycle when it is large enough
+    size_t next = m_blocks.empty() ? 0 : m_currentBlock + 1;
+    while (next < m_blocks.size()) {
+        if (m_blocks[next].Size >= bytes + alignment) {
+            m_currentBlock = next;
+            m_offset = 0;
+            return true;
+        }
+        ++next;
+    }
+
+    // Grow geometrically so many small allocations cost O(log n) block allocations. An
+    // allocation past the next step (a whole request body, its structural index) gets a block
+    // of exactly its size that the steps ignore; doubling from it would give the next
+    // allocation twice the largest body.
+    size_t size = m_initialBlockSize;
+    for (size_t i = m_blocks.size(); i-- > 0;) {
+        if (!m_blocks[i].Dedicated) {
+            size = m_blocks[i].Size * 2;
+            break;
+        }
+    }
+    bool dedicated = size < bytes + alignment;
+    if (dedicated) {
+        size = bytes + alignment;
+    }
+
+    Block block;
+    block.Data = static_cast<char*>(::operator new(size, std::nothrow));
+    if (!block.Data) {
+        return false;
+    }
+    block.Size = size;
+    block.Dedicated = dedicated;
+
+    m_blocks.push_back(block);
+    m_currentBlock = m_blocks.size() - 1;
+    m_offset = 0;
+
+    m_stats.BlockAllocations++;
+    m_stats.Capacity += size;
+    m_totalBlockAllocations++;
+    return true;
+}
+
+void RequestArena::Reset(size_t retainBytes)
+{
+    // A large request leaves blocks the size of its body and index behind, which would
+    // otherwise stay pinned for as long as the arena lives
+    size_t limit = (std::max)(retainBytes, m_initialBlockSize);
+    size_t capacity = 0;
+    size_t kept = 0;
+    while (kept < m_blocks.size() && capacity + m_blocks[kept].Size <= limit) {
+        capacity += m_blocks[kept].Size;
+        ++kept;
+    }
+    for (size_t i = kept; i < m_blocks.size(); ++i) {
+        ::operator delete(m_blocks[i].Data);
+    }
+    m_blocks.resize(kept);
+
+    m_currentBlock = 0;
+    m_offset = 0;
+    m_stats = ArenaStats();
+    m_stats.Capacity = capacity;
+}
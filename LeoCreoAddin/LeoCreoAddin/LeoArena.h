@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Allocation counters for one arena cycle (between two Reset calls)
+struct ArenaStats {
+    size_t Allocations;         // Allocate calls served
+    size_t BytesAllocated;      // Bytes handed out, including alignment padding
+    size_t BlockAllocations;    // Blocks obtained from the heap during this cycle
+    size_t Capacity;            // Total bytes held across all retained blocks
+
+    ArenaStats() : Allocations(0), BytesAllocated(0), BlockAllocations(0), Capacity(0) {}
+};
+
+// Monotonic per-request arena.
+// Allocation is a pointer bump inside the current block; individual frees are no-ops.
+// Reset releases everything at once but keeps the leading blocks up to retainBytes, so once
+// the arena has grown to fit a typical request, later requests are served without touching
+// the heap, while the doubled blocks of a rare huge request go back to it.
+class RequestArena {
+public:
+    explicit RequestArena(size_t initialBlockSize = 64 * 1024);
+    ~RequestArena();
+
+    void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    // Empties the arena; blocks are kept in order while their total stays within retainBytes
+    // (a block of the initial size always fits)
+    void Reset(size_t retainBytes = DEFAULT_RETAIN_BYTES);
+
+    static const size_t DEFAULT_RETAIN_BYTES = 1024 * 1024;
+
+    const ArenaStats& GetStats() const { return m_stats; }
+    size_t GetTotalBlockAllocations() const { return m_totalBlockAllocations; }
+
+private:
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    struct Block {
+        char* Data;
+        size_t Size;
+        bool Dedicated;         // Sized for one allocation larger than the next growth step
+    };
+
+    bool AdvanceBlock(size_t bytes, size_t alignment);
+    static size_t AlignedOffset(const Block& block, size_t offset, size_t alignment);
+
+    std::vector<Block> m_blocks;
+    size_t m_currentBlock;
+    size_t m_offset;
+    size_t m_initialBlockSize;
+    size_t m_totalBlockAllocations;
+    ArenaStats m_stats;
+};
+
+// Standard allocator over a RequestArena; a null arena falls back to the global heap,
+// so containers typed with it still work outside request handling.
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    ArenaAllocator() : m_arena(nullptr) {}
+    explicit ArenaAllocator(RequestArena* arena) : m_arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.GetArena()) {}
+
+    T* allocate(size_t count)
+    {
+        if (m_arena) {
+            return static_cast<T*>(m_arena->Allocate(count * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t)
+    {
+        if (!m_arena) {
+            ::operator delete(ptr);
+        }
+    }
+
+    RequestArena* GetArena() const { return m_arena; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.GetArena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.GetArena(); }
+
+private:
+    RequestArena* m_arena;
+};
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,386 @@
+#include "stdafx.h"
+#include "LeoAsyncClient.h"
+#include "LeoTrace.h"
+#include <algorithm>
+
+LeoAsyncClient::LeoAsyncClient(LeoWebClient& client, LeoUiDispatcher& dispatcher)
+    : m_client(client)
+    , m_dispatcher(dispatcher)
+    , m_shouldStop(false)
+    , m_nextId(1)
+    , m_supersededCount(0)
+{
+}
+
+LeoAsyncClient::~LeoAsyncClient()
+{
+    Stop();
+}
+
+void LeoAsyncClient::Start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_worker.joinable()) {
+        return;
+    }
+
+    m_shouldStop = false;
+    m_worker = std::thread(&LeoAsyncClient::WorkerThread, this);
+    LogMessage(_T("I/O thread started"));
+}
+
+void LeoAsyncClient::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_worker.joinable()) {
+            return;
+        }
+        m_shouldStop = true;
+    }
+
+    CancelAll();
+    m_wakeUp.notify_all();
+    m_worker.join();
+    LogMessage(_T("I/O thread stopped"));
+}
+
+LeoAsyncClient::RequestId LeoAsyncClient::Submit(RequestWork work,
+                                                 SuccessCallback successCallback,
+                                                 ErrorCallback errorCallback,
+                                                 CandidateCallback candidateCallback,
+                                                 int deadlineMs,
+                                                 int delayMs)
+{
+    auto request = std::make_shared<Request>();
+    request->Work = work;
+    request->OnSuccess = successCallback;
+    request->OnError = errorCallback;
+    request->OnCandidate = candidateCallback;
+    request->DeadlineMs = deadlineMs;
+    request->NotBefore = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+    request->Deadline = request->NotBefore + std::chrono::milliseconds(deadlineMs);
+
+    return Enqueue(request);
+}
+
+LeoAsyncClient::RequestId LeoAsyncClient::SubmitLatest(Channel channel,
+                                                       int debounceMs,
+                                                       RequestWork work,
+                                                       SuccessCallback successCallback,
+                                                       ErrorCallback errorCallback,
+                                                       CandidateCallback candidateCallback,
+                                                       int deadlineMs)
+{
+    auto request = std::make_shared<Request>();
+    request->Work = work;
+    request->OnSuccess = successCallback;
+    request->OnError = errorCallback;
+    request->OnCandidate = candidateCallback;
+    request->CoalesceChannel = channel;
+    request->DeadlineMs = deadlineMs;
+
+    // The deadline starts once the debounce window has closed
+    request->NotBefore = std::chrono::steady_clock::now() + std::chrono::milliseconds(debounceMs);
+    request->Deadline = request->NotBefore + std::chrono::milliseconds(deadlineMs);
+
+    return Enqueue(request);
+}
+
+LeoAsyncClient::RequestId LeoAsyncClient::Enqueue(const std::shared_ptr<Request>& request)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_worker.joinable() || m_shouldStop) {
+            return INVALID_REQUEST;
+        }
+        if (request->CoalesceChannel != NO_CHANNEL) {
+            SupersedeChannel(request->CoalesceChannel);
+        }
+        request->Id = m_nextId++;
+        m_queue.push_back(request);
+    }
+
+    // Arrow from the caller's span to the I/O thread's and on to the delivery on the UI thread
+    LeoTrace::FlowBegin("Leo request", request->Id);
+    m_wakeUp.notify_one();
+    return request->Id;
+}
+
+void LeoAsyncClient::SupersedeChannel(Channel channel)
+{
+    int superseded = 0;
+
+    for (auto it = m_queue.begin(); it != m_queue.end();) {
+        if ((*it)->CoalesceChannel == channel) {
+            DropQueued(**it);
+            it = m_queue.erase(it);
+            superseded++;
+        } else {
+            ++it;
+        }
+    }
+
+    // A stale query already taken by the I/O thread is aborted through its own token, so it is
+    // stopped even if it has not reached the network yet, and Leo stops working on it if it has
+    if (m_current && m_current->CoalesceChannel == channel && !m_current->Cancelled) {
+        CancelRequest(*m_current);
+        superseded++;
+    }
+
+    if (superseded > 0) {
+        m_supersededCount += superseded;
+        CString msg;
+        msg.Format(_T("Superseded %d stale request(s), %d in total"), superseded, m_supersededCount);
+        LogMessage(msg);
+    }
+}
+
+std::shared_ptr<LeoAsyncClient::Request> LeoAsyncClient::NextReadyRequest()
+{
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+        if ((*it)->NotBefore <= now) {
+            std::shared_ptr<Request> request = *it;
+            m_queue.erase(it);
+            return request;
+        }
+    }
+    return nullptr;
+}
+
+LeoAsyncClient::RequestId LeoAsyncClient::SendFaceMeasurementDataAsync(const MeasurementData& data,
+                                                                       SuccessCallback successCallback,
+                                                                       ErrorCallback errorCallback,
+                                                                       CandidateCallback candidateCallback,
+                                                                       int deadlineMs)
+{
+    // The measurement is copied; the caller's struct may go away as soon as this returns
+    return Submit(
+        [data](LeoWebClient& client, SuccessCallback onSuccess, ErrorCallback onError) {
+            return client.SendFaceMeasurementData(data, onSuccess, onError);
+        },
+        successCallback, errorCallback, candidateCallback, deadlineMs);
+}
+
+LeoAsyncClient::RequestId LeoAsyncClient::SendLatestFaceMeasurementDataAsync(const MeasurementData& data,
+                                                                             SuccessCallback successCallback,
+                                                                             ErrorCallback errorCallback,
+                                                                             CandidateCallback candidateCallback,
+                                                                             int debounceMs,
+                                                                             int deadlineMs)
+{
+    return SubmitLatest(FACE_QUERY_CHANNEL, debounceMs,
+        [data](LeoWebClient& client, SuccessCallback onSuccess, ErrorCallback onError) {
+            return client.SendFaceMeasurementData(data, onSuccess, onError);
+        },
+        successCallback, errorCallback, candidateCallback, deadlineMs);
+}
+
+LeoAsyncClient::RequestId LeoAsyncClient::SendLatestFaceMeasurementBatchAsync(const std::vector<MeasurementData>& faces,
+                                                                              SuccessCallback successCallback,
+                                                                              ErrorCallback errorCallback,
+                                                                              CandidateCallback candidateCallback,
+                                                                              int debounceMs,
+                                                                              int deadlineMs)
+{
+    // Shared rather than copied again each time the work is passed on
+    auto batch = std::make_shared<const std::vector<MeasurementData>>(faces);
+    return SubmitLatest(FACE_QUERY_CHANNEL, debounceMs,
+        [batch](LeoWebClient& client, SuccessCallback onSuccess, ErrorCallback onError) {
+            return client.SendFaceMeasurementBatch(*batch, onSuccess, onError);
+        },
+        successCallback, errorCallback, candidateCallback, deadlineMs);
+}
+
+bool LeoAsyncClient::Cancel(RequestId id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+        if ((*it)->Id == id) {
+            DropQueued(**it);
+            m_queue.erase(it);
+            return true;
+        }
+    }
+
+    if (m_current && m_current->Id == id) {
+        CancelRequest(*m_current);
+        return true;
+    }
+
+    return false;
+}
+
+void LeoAsyncClient::CancelAll()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto& request : m_queue) {
+        DropQueued(*request);
+    }
+    m_queue.clear();
+
+    if (m_current) {
+        CancelRequest(*m_current);
+    }
+}
+
+void LeoAsyncClient::WorkerThread()
+{
+    LeoTrace::NameThread("Leo I/O");
+
+    while (true) {
+        std::shared_ptr<Request> request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_shouldStop && !(request = NextReadyRequest())) {
+                if (m_queue.empty()) {
+                    m_wakeUp.wait(lock);
+                    continue;
+                }
+
+                // Only debounced or delayed requests are left: sleep until the first one is due
+                auto wakeAt = m_queue.front()->NotBefore;
+                for (const auto& pending : m_queue) {
+                    wakeAt = (std::min)(wakeAt, pending->NotBefore);
+                }
+                m_wakeUp.wait_until(lock, wakeAt);
+            }
+            if (m_shouldStop) {
+                break;
+            }
+            m_current = request;
+        }
+
+        try {
+            Execute(request);
+        } catch (const std::exception& e) {
+            DeliverError(request, L"Exception in async request: " + CString(e.what()));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_current.reset();
+    }
+}
+
+void LeoAsyncClient::Execute(const std::shared_ptr<Request>& request)
+{
+    LEO_SPAN(Http, "LeoAsyncClient::Execute");
+    LeoTrace::FlowStep("Leo request", request->Id);
+
+    // Cancelled between leaving the queue and getting here: nothing is sent and nothing delivered
+    if (request->Cancelled) {
+        LeoTrace::FlowEnd("Leo request", request->Id);
+        return;
+    }
+
+    // A request that waited in the queue past its deadline is not sent at all
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        request->Deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0) {
+        CString error;
+        error.Format(L"Request deadline of %d ms expired before it was sent", request->DeadlineMs);
+        DeliverError(request, error);
+        return;
+    }
+
+    // Hard deadline for the whole exchange: the timer aborts the blocked WinHTTP call
+    HANDLE timer = NULL;
+    if (!CreateTimerQueueTimer(&timer, NULL, &LeoAsyncClient::OnDeadline, this,
+                               static_cast<DWORD>(remaining), 0, WT_EXECUTEONLYONCE)) {
+        timer = NULL;
+    }
+
+    // The request's own token: a cancel from here on, or one that already landed, aborts the exchange
+    m_client.SetCancelToken(request->CancelToken);
+
+    // Candidates reach the UI thread while the rest of the response is still arriving
+    std::weak_ptr<Request> weakRequest = request;
+    if (request->OnCandidate) {
+        m_client.SetCandidateCallback([this, weakRequest](const CandidatePart& candidate) {
+            m_dispatcher.Post([weakRequest, candidate]() {
+                auto pending = weakRequest.lock();
+                if (pending && !pending->Cancelled) {
+                    pending->OnCandidate(candidate);
+                }
+            });
+        });
+    }
+
+    HttpResponse response;
+    CString error;
+    bool success = request->Work(m_client,
+        [&response](const HttpResponse& result) { response = result; },
+        [&error](const CString& message) { error = message; });
+
+    // Waits for a running deadline callback, so nothing fires after this point
+    if (timer) {
+        DeleteTimerQueueTimer(NULL, timer, INVALID_HANDLE_VALUE);
+    }
+    m_client.SetCandidateCallback(nullptr);
+    m_client.SetCancelToken(nullptr);
+
+    if (request->Cancelled) {
+        LogMessage(_T("Request cancelled"));
+        LeoTrace::FlowEnd("Leo request", request->Id);
+        return;
+    }
+
+    if (!success) {
+        if (request->TimedOut) {
+            error.Format(L"Leo did not answer within the %d ms deadline", request->DeadlineMs);
+        }
+        DeliverError(request, error);
+        return;
+    }
+
+    m_dispatcher.Post([request, response]() {
+        LEO_SPAN(General, "Deliver Leo response");
+        LeoTrace::FlowEnd("Leo request", request->Id);
+        if (!request->Cancelled && request->OnSuccess) {
+            request->OnSuccess(response);
+        }
+    });
+}
+
+void LeoAsyncClient::DeliverError(const std::shared_ptr<Request>& request, const CString& error)
+{
+    LogMessage(error);
+    m_dispatcher.Post([request, error]() {
+        LEO_SPAN(General, "Deliver Leo error");
+        LeoTrace::FlowEnd("Leo request", request->Id);
+        if (!request->Cancelled && request->OnError) {
+            request->OnError(error);
+        }
+    });
+}
+
+VOID CALLBACK LeoAsyncClient::OnDeadline(PVOID context, BOOLEAN timerFired)
+{
+    LeoAsyncClient* self = static_cast<LeoAsyncClient*>(context);
+    std::lock_guard<std::mutex> lock(self->m_mutex);
+    if (self->m_current) {
+        self->m_current->TimedOut = true;
+        self->m_current->CancelToken->Cancel();
+    }
+}
+
+void LeoAsyncClient::CancelRequest(Request& request)
+{
+    request.Cancelled = true;
+    request.CancelToken->Cancel();
+}
+
+void LeoAsyncClient::DropQueued(Request& request)
+{
+    // It never reaches Execute, so its trace flow ends here
+    CancelRequest(request);
+    LeoTrace::FlowEnd("Leo request", request.Id);
+}
+
+void LeoAsyncClient::LogMessage(const CString& message)
+{
+    LEO_INFO(Http, _T("LeoAsyncClient: %s"), (LPCTSTR)message);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "LeoWebClient.h"
+#include "LeoUiDispatcher.h"
+
+// Non-blocking front end for LeoWebClient.
+// Requests are queued and executed on one background I/O thread; success, error and
+// candidate callbacks are marshalled back to Creo's UI thread through LeoUiDispatcher.
+// Every request has a deadline covering the whole exchange: when it expires the in-flight
+// WinHTTP call is aborted and the error callback reports the timeout. Each request carries
+// its own cancel token from submission on, so a cancel or deadline that lands while the
+// request is between the queue and the network still stops it. Cancelled requests never
+// call back.
+// Requests submitted on a channel are latest-wins: each one supersedes (cancels) the
+// previous request on that channel, queued or in flight, and waits out a short debounce
+// window so a burst of clicks sends only the last one.
+class LeoAsyncClient {
+public:
+    typedef uint64_t RequestId;
+    static const RequestId INVALID_REQUEST = 0;
+
+    typedef int Channel;
+    static const Channel NO_CHANNEL = 0;
+    static const Channel FACE_QUERY_CHANNEL = 1;
+
+    // Runs the blocking exchange on the I/O thread using the client's synchronous API
+    using RequestWork = std::function<bool(LeoWebClient&, SuccessCallback, ErrorCallback)>;
+
+    LeoAsyncClient(LeoWebClient& client, LeoUiDispatcher& dispatcher);
+    ~LeoAsyncClient();
+
+    void Start();
+    void Stop();        // Cancels everything and joins the I/O thread
+
+    // delayMs holds the request back that long (a retry's backoff); its deadline starts after it
+    RequestId Submit(RequestWork work,
+                     SuccessCallback successCallback,
+                     ErrorCallback errorCallback,
+                     CandidateCallback candidateCallback = nullptr,
+                     int deadlineMs = DEFAULT_DEADLINE_MS,
+                     int delayMs = 0);
+
+    RequestId SubmitLatest(Channel channel,
+                           int debounceMs,
+                           RequestWork work,
+                           SuccessCallback successCallback,
+                           ErrorCallback errorCallback,
+                           CandidateCallback candidateCallback = nullptr,
+                           int deadlineMs = DEFAULT_DEADLINE_MS);
+
+    RequestId SendFaceMeasurementDataAsync(const MeasurementData& data,
+                                           SuccessCallback successCallback,
+                                           ErrorCallback errorCallback,
+                                           CandidateCallback candidateCallback = nullptr,
+                                           int deadlineMs = DEFAULT_DEADLINE_MS);
+
+    // Find Component: latest-wins on FACE_QUERY_CHANNEL, so only the newest selection reaches Leo
+    RequestId SendLatestFaceMeasurementDataAsync(const MeasurementData& data,
+                                                 SuccessCallback successCallback,
+                                                 ErrorCallback errorCallback,
+                                                 CandidateCallback candidateCallback = nullptr,
+                                                 int debounceMs = LEO_FACE_QUERY_DEBOUNCE_MS,
+                                                 int deadlineMs = DEFAULT_DEADLINE_MS);
+
+    // Several faces as one query, on the same channel: a batch and a single face supersede each other
+    RequestId SendLatestFaceMeasurementBatchAsync(const std::vector<MeasurementData>& faces,
+                                                  SuccessCallback successCallback,
+                                                  ErrorCallback errorCallback,
+                                                  CandidateCallback candidateCallback = nullptr,
+                                                  int debounceMs = LEO_FACE_QUERY_DEBOUNCE_MS,
+                                                  int deadlineMs = DEFAULT_DEADLINE_MS);
+
+    bool Cancel(RequestId id);
+    void CancelAll();
+
+    static const int DEFAULT_DEADLINE_MS = 8000;
+
+private:
+    LeoAsyncClient(const LeoAsyncClient&) = delete;
+    LeoAsyncClient& operator=(const LeoAsyncClient&) = delete;
+
+    struct Request {
+        RequestId Id;
+        RequestWork Work;
+        SuccessCallback OnSuccess;
+        ErrorCallback OnError;
+        CandidateCallback OnCandidate;
+        Channel CoalesceChannel;                            // NO_CHANNEL unless submitted latest-wins
+        int DeadlineMs;
+        std::chrono::steady_clock::time_point NotBefore;    // End of the debounce window
+        std::chrono::steady_clock::time_point Deadline;
+        std::atomic<bool> Cancelled;                        // Suppresses the callbacks
+        std::atomic<bool> TimedOut;
+        std::shared_ptr<HttpCancelToken> CancelToken;       // Aborts the exchange; handed to the client for this request only
+
+        Request()
+            : Id(INVALID_REQUEST), CoalesceChannel(NO_CHANNEL), DeadlineMs(0), Cancelled(false), TimedOut(false)
+            , CancelToken(std::make_shared<HttpCancelToken>())
+        {
+        }
+    };
+
+    RequestId Enqueue(const std::shared_ptr<Request>& request);
+    void SupersedeChannel(Channel channel);         // Caller holds m_mutex
+    std::shared_ptr<Request> NextReadyRequest();    // Caller holds m_mutex; null if nothing is due yet
+
+    void WorkerThread();
+    void Execute(const std::shared_ptr<Request>& request);
+    void DeliverError(const std::shared_ptr<Request>& request, const CString& error);
+    static VOID CALLBACK OnDeadline(PVOID context, BOOLEAN timerFired);
+    static void CancelRequest(Request& request);    // Suppresses the callbacks and aborts the exchange
+    static void DropQueued(Request& request);       // Cancels a request being removed from the queue
+    void LogMessage(const CString& message);
+
+    LeoWebClient& m_client;
+    LeoUiDispatcher& m_dispatcher;
+
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::deque<std::shared_ptr<Request>> m_queue;
+    std::shared_ptr<Request> m_current;
+    bool m_shouldStop;
+    RequestId m_nextId;
+    int m_supersededCount;
+};
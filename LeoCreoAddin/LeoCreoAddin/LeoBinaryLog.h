@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Layout of the binary log (log.format=binary), shared by LogFileWriter and the LeoLogDecode tool.
+// Header only and free of MFC so the decoder builds on its own.
+//
+// File:    "LEOBLOG2" once, then records.
+// Record:  type byte, body length (varint), body.
+//   Session  start time (int64, microseconds since 1970, little-endian), process id (varint).
+//            Starts a new dictionary: format ids and times below are relative to it.
+//   Format   id (varint), level (byte), category (byte), UTF-8 format string as written at the call site.
+//   Event    time (zigzag varint, microseconds after the session start), thread id (varint), id (varint), arguments.
+//   Text     time (zigzag varint), thread id (varint), UTF-8 line logged with WriteLog.
+// Argument: tag byte, then
+//   'i' zigzag varint   'u' varint   'd' 8-byte IEEE double   'p' varint address
+//   's' varint length + UTF-8 bytes   'n' null string
+// All multi-byte integers are little-endian base-128 varints unless noted.
+namespace LeoBinaryLog {
+
+const char MAGIC[] = "LEOBLOG2";    // LEOBLOG1 had second timestamps and no thread ids
+const size_t MAGIC_LENGTH = 8;
+
+enum RecordType : uint8_t {
+    RECORD_SESSION = 1,
+    RECORD_FORMAT = 2,
+    RECORD_EVENT = 3,
+    RECORD_TEXT = 4
+};
+
+const char ARG_SIGNED = 'i';
+const char ARG_UNSIGNED = 'u';
+const char ARG_DOUBLE = 'd';
+const char ARG_POINTER = 'p';
+const char ARG_STRING = 's';
+const char ARG_NULL_STRING = 'n';
+
+// Indexed by LEO_LOG_LEVEL_* and LogCategory
+const char* const LEVEL_NAMES[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "OFF" };
+const char* const CATEGORY_NAMES[] = { "General", "Geometry", "Http", "Server", "Config" };
+const int LEVEL_COUNT = 6;
+const int CATEGORY_COUNT = 5;
+
+// Flight recorder file (LeoCreoAddin.flight), kept mapped by the add-in so the newest records
+// survive a crash of the process:
+//   FLIGHT_HEADER_BYTES starting with a FlightHeader, then FLIGHT_FORMAT_BYTES of format
+//   records (encoded as in the binary log, appended once per id), then SlotCount FlightSlots
+//   used as a ring. A record takes one slot plus Continues more, at consecutive sequences.
+// A slot's Sequence is stored last; FLIGHT_WRITING marks one that was being written when the
+// process died, and 0 one that was never written.
+//   Text       UTF-8 line, as logged
+//   Event      format id (varint), arguments
+//   SpanBegin  category (byte), UTF-8 span name
+//   SpanEnd    duration in counter ticks (varint), category (byte), UTF-8 span name
+const char FLIGHT_MAGIC[] = "LEOFLT01";
+const uint32_t FLIGHT_VERSION = 1;
+const size_t FLIGHT_HEADER_BYTES = 4096;
+const size_t FLIGHT_FORMAT_BYTES = 256 * 1024;
+const size_t FLIGHT_SLOT_BYTES = 256;
+const uint64_t FLIGHT_WRITING = ~0ULL;
+
+enum FlightState : uint32_t {
+    FLIGHT_OPEN = 1,            // The add-in was running; still set after a crash
+    FLIGHT_CLOSED = 2           // user_terminate ran
+};
+
+enum FlightKind : uint8_t {
+    FLIGHT_CONTINUATION = 0,
+    FLIGHT_TEXT = 1,
+    FLIGHT_EVENT = 2,
+    FLIGHT_SPAN_BEGIN = 3,
+    FLIGHT_SPAN_END = 4
+};
+
+struct FlightHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t ProcessId;
+    uint32_t State;             // FlightState
+    uint32_t SlotCount;
+    uint32_t FormatBytes;       // Used part of the format area
+    uint32_t Reserved;
+    int64_t Frequency;          // Counter ticks per second
+    int64_t AnchorTicks;        // Counter and wall clock (microseconds since 1970) read together
+    int64_t AnchorMicros;
+};
+
+struct FlightSlot {
+    uint64_t Sequence;          // Ring position + 1
+    int64_t Ticks;              // Performance counter
+    uint32_t Thread;
+    uint16_t Length;            // Bytes of Data used
+    uint8_t Kind;               // FlightKind
+    uint8_t Continues;          // First slot of a record: how many slots after it belong to it
+    char Data[FLIGHT_SLOT_BYTES - 24];
+};
+
+static_assert(sizeof(FlightSlot) == FLIGHT_SLOT_BYTES, "FlightSlot must stay 256 bytes");
+static_assert(sizeof(FlightHeader) <= FLIGHT_HEADER_BYTES, "FlightHeader must fit its page");
+
+// Writes value into out (at least 10 bytes); returns the bytes used
+inline size_t PutVarint(uint64_t value, char* out)
+{
+    size_t used = 0;
+    while (value >= 0x80) {
+        out[used++] = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out[used++] = static_cast<char>(value);
+    return used;
+}
+
+inline void AppendVarint(std::string& out, uint64_t value)
+{
+    char bytes[10];
+    out.append(bytes, PutVarint(value, bytes));
+}
+
+// Small magnitudes of either sign stay short
+inline uint64_t ZigZag(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// False on truncated or overlong input; pos is advanced past the varint
+inline bool GetVarint(const char* data, size_t length, size_t& pos, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < length; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(data[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,132 @@
+#include "stdafx.h"
+#include "LeoBodyStream.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+
+ChunkedBodyWriter::ChunkedBodyWriter(BodyChunkSink sink, size_t chunkSize)
+    : m_sink(sink)
+    , m_chunkSize(chunkSize)
+    , m_bytesWritten(0)
+    , m_chunksSent(0)
+    , m_failed(false)
+{
+    if (m_sink) {
+        m_buffer.reserve(m_chunkSize);
+    }
+}
+
+void ChunkedBodyWriter::Write(const char* data, size_t length)
+{
+    m_bytesWritten += length;
+    if (!m_sink || m_failed) {
+        return;
+    }
+
+    // Large pieces go straight out instead of being copied through the buffer
+    if (length >= m_chunkSize) {
+        Flush();
+        Send(data, length);
+        return;
+    }
+
+    if (m_buffer.size() + length > m_chunkSize) {
+        Flush();
+    }
+    m_buffer.append(data, length);
+}
+
+void ChunkedBodyWriter::Write(const char* text)
+{
+    Write(text, strlen(text));
+}
+
+void ChunkedBodyWriter::Put(char c)
+{
+    m_bytesWritten++;
+    if (!m_sink || m_failed) {
+        return;
+    }
+
+    if (m_buffer.size() >= m_chunkSize) {
+        Flush();
+    }
+    m_buffer.push_back(c);
+}
+
+bool ChunkedBodyWriter::Flush()
+{
+    if (m_sink && !m_failed && !m_buffer.empty()) {
+        Send(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+    return !m_failed;
+}
+
+bool ChunkedBodyWriter::Send(const char* data, size_t length)
+{
+    if (m_failed) {
+        return false;
+    }
+    if (!m_sink(data, length)) {
+        m_failed = true;
+        return false;
+    }
+    m_chunksSent++;
+    return true;
+}
+
+void WriteJsonString(ChunkedBodyWriter& out, const char* utf8, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out.Put('"');
+
+    // Copy runs of plain bytes in one go; only quotes, backslashes and control characters are escaped
+    size_t runStart = 0;
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = static_cast<unsigned char>(utf8[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        out.Write(utf8 + runStart, i - runStart);
+        runStart = i + 1;
+
+        switch (c) {
+            case '"': out.Write("\\\"", 2); break;
+            case '\\': out.Write("\\\\", 2); break;
+            case '\n': out.Write("\\n", 2); break;
+            case '\r': out.Write("\\r", 2); break;
+            case '\t': out.Write("\\t", 2); break;
+            default: {
+                char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                out.Write(escape, sizeof(escape));
+                break;
+            }
+        }
+    }
+    out.Write(utf8 + runStart, length - runStart);
+
+    out.Put('"');
+}
+
+void WriteJsonNumber(ChunkedBodyWriter& out, double value)
+{
+    // JSON has no NaN or infinity
+    if (!std::isfinite(value)) {
+        out.Write("null", 4);
+        return;
+    }
+
+    // 15 digits reads nicely for typical coordinates; fall back to 17 when that loses bits
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%.15g", value);
+    if (strtod(text, nullptr) != value) {
+        length = snprintf(text, sizeof(text), "%.17g", value);
+    }
+    if (length > 0) {
+        out.Write(text, static_cast<size_t>(length));
+    }
+}
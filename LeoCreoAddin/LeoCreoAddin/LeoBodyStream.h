@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+// Receives one chunk of a serialized request body; returns false to abort the upload
+using BodyChunkSink = std::function<bool(const char* data, size_t length)>;
+
+// Fixed-size staging buffer between a serializer and the network.
+// Serializers append small pieces; every time the buffer fills up it is handed to the sink
+// (WinHttpWriteData) and reused, so a body of any size is never held in memory at once.
+// Writes larger than the chunk size bypass the buffer. With a null sink the writer only
+// counts bytes, which is how the Content-Length of a streamed body is measured up front.
+class ChunkedBodyWriter {
+public:
+    explicit ChunkedBodyWriter(BodyChunkSink sink, size_t chunkSize = 64 * 1024);
+
+    void Write(const char* data, size_t length);
+    void Write(const std::string& data) { Write(data.data(), data.size()); }
+    void Write(const char* text);
+    void Put(char c);
+
+    bool Flush();                       // Hands over what is buffered; false once the sink has failed
+    bool Failed() const { return m_failed; }
+    uint64_t BytesWritten() const { return m_bytesWritten; }
+    size_t ChunksSent() const { return m_chunksSent; }
+
+private:
+    ChunkedBodyWriter(const ChunkedBodyWriter&) = delete;
+    ChunkedBodyWriter& operator=(const ChunkedBodyWriter&) = delete;
+
+    bool Send(const char* data, size_t length);
+
+    BodyChunkSink m_sink;
+    std::string m_buffer;
+    size_t m_chunkSize;
+    uint64_t m_bytesWritten;
+    size_t m_chunksSent;
+    bool m_failed;
+};
+
+// Writes a request body into the writer. It may run more than once per request (length
+// pass, send pass, retries), so it must produce the same bytes every time.
+using BodyProducer = std::function<void(ChunkedBodyWriter&)>;
+
+// JSON helpers for streaming serializers
+void WriteJsonString(ChunkedBodyWriter& out, const char* utf8, size_t length);     // Quoted and escaped
+void WriteJsonNumber(ChunkedBodyWriter& out, double value);                         // Round-trips a double
@@ -0,0 +1,166 @@
+#include "stdafx.h"
+#include "LeoCircuitBreaker.h"
+#include "LogFileWriter.h"
+
+LeoCircuitBreaker::LeoCircuitBreaker(int failureThreshold, int initialOpenMs, int maxOpenMs)
+    : m_failureThreshold(failureThreshold)
+    , m_initialOpenMs(initialOpenMs)
+    , m_maxOpenMs(maxOpenMs)
+    , m_shouldStop(false)
+    , m_state(State::Closed)
+    , m_consecutiveFailures(0)
+    , m_openMs(initialOpenMs)
+    , m_tripCount(0)
+{
+}
+
+LeoCircuitBreaker::~LeoCircuitBreaker()
+{
+    Shutdown();
+}
+
+void LeoCircuitBreaker::SetProbe(std::function<bool()> probe)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_probe = probe;
+}
+
+bool LeoCircuitBreaker::AllowRequest()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_state == State::Closed;
+}
+
+void LeoCircuitBreaker::RecordSuccess()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_state != State::Closed) {
+        LEO_INFO(Http, "LeoCircuitBreaker: Leo answered, circuit closed");
+    }
+    m_state = State::Closed;
+    m_consecutiveFailures = 0;
+    m_openMs = m_initialOpenMs;
+}
+
+void LeoCircuitBreaker::RecordFailure()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_consecutiveFailures++;
+    if (m_state == State::Closed && m_consecutiveFailures >= m_failureThreshold) {
+        m_tripCount++;
+        OpenLocked(lock);
+    }
+}
+
+void LeoCircuitBreaker::OpenLocked(std::unique_lock<std::mutex>& lock)
+{
+    m_state = State::Open;
+    m_openUntil = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_openMs);
+
+    LEO_WARN(Http, "LeoCircuitBreaker: Circuit open (%d consecutive failures), next probe in %d ms",
+             m_consecutiveFailures, m_openMs);
+
+    // The probe thread is started on first use and then just woken up
+    if (!m_probeThread.joinable() && !m_shouldStop) {
+        m_probeThread = std::thread(&LeoCircuitBreaker::ProbeThread, this);
+    }
+    lock.unlock();
+    m_wakeUp.notify_all();
+    lock.lock();
+}
+
+void LeoCircuitBreaker::ProbeThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_shouldStop) {
+        if (m_state != State::Open) {
+            m_wakeUp.wait(lock);
+            continue;
+        }
+
+        // Wait out the open interval (woken early only for shutdown)
+        if (m_wakeUp.wait_until(lock, m_openUntil, [this]() { return m_shouldStop; })) {
+            break;
+        }
+        if (m_state != State::Open || std::chrono::steady_clock::now() < m_openUntil) {
+            continue;
+        }
+
+        m_state = State::HalfOpen;
+        std::function<bool()> probe = m_probe;
+        lock.unlock();
+
+        bool alive = probe ? probe() : true;
+
+        lock.lock();
+        if (m_shouldStop) {
+            break;
+        }
+        if (m_state != State::HalfOpen) {
+            continue;   // A regular call already settled the state
+        }
+        if (alive) {
+            m_state = State::Closed;
+            m_consecutiveFailures = 0;
+            m_openMs = m_initialOpenMs;
+            LEO_INFO(Http, "LeoCircuitBreaker: Probe succeeded, circuit closed");
+        } else {
+            m_consecutiveFailures++;
+            m_openMs = (std::min)(m_openMs * 2, m_maxOpenMs);
+            OpenLocked(lock);
+        }
+    }
+}
+
+LeoCircuitBreaker::State LeoCircuitBreaker::GetState() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_state;
+}
+
+int LeoCircuitBreaker::GetRetryAfterMs() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return RetryAfterMsLocked();
+}
+
+int LeoCircuitBreaker::RetryAfterMsLocked() const
+{
+    if (m_state != State::Open) {
+        return 0;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        m_openUntil - std::chrono::steady_clock::now()).count();
+    return remaining > 0 ? static_cast<int>(remaining) : 0;
+}
+
+CString LeoCircuitBreaker::Describe() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CString text;
+    text.Format(_T("circuit=%s consecutiveFailures=%d trips=%d openIntervalMs=%d retryAfterMs=%d"),
+                StateName(m_state), m_consecutiveFailures, m_tripCount, m_openMs, RetryAfterMsLocked());
+    return text;
+}
+
+void LeoCircuitBreaker::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shouldStop = true;
+    }
+    m_wakeUp.notify_all();
+    if (m_probeThread.joinable()) {
+        m_probeThread.join();
+    }
+}
+
+const TCHAR* LeoCircuitBreaker::StateName(State state)
+{
+    switch (state) {
+        case State::Closed: return _T("closed");
+        case State::Open: return _T("open");
+        case State::HalfOpen: return _T("half-open");
+        default: return _T("unknown");
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Circuit breaker for calls to the Leo desktop app.
+// Closed: calls go through. After FailureThreshold consecutive failures it opens and
+// every call fails fast. A background thread waits out the open interval, moves to
+// half-open and runs the probe; success closes the circuit, failure reopens it with the
+// interval doubled (up to MaxOpenMs). Callers never pay a timeout while Leo is down.
+class LeoCircuitBreaker {
+public:
+    enum class State {
+        Closed,
+        Open,
+        HalfOpen
+    };
+
+    LeoCircuitBreaker(int failureThreshold = 3, int initialOpenMs = 2000, int maxOpenMs = 30000);
+    ~LeoCircuitBreaker();
+
+    // Probe run on the background thread while half-open; returns true when Leo answers
+    void SetProbe(std::function<bool()> probe);
+
+    bool AllowRequest();
+    void RecordSuccess();
+    void RecordFailure();
+
+    State GetState() const;
+    int GetRetryAfterMs() const;        // Time until the next probe while open, 0 otherwise
+    CString Describe() const;           // One-line state summary for diagnostics
+
+    void Shutdown();                    // Stop and join the probe thread
+
+private:
+    LeoCircuitBreaker(const LeoCircuitBreaker&) = delete;
+    LeoCircuitBreaker& operator=(const LeoCircuitBreaker&) = delete;
+
+    void OpenLocked(std::unique_lock<std::mutex>& lock);
+    int RetryAfterMsLocked() const;
+    void ProbeThread();
+    static const TCHAR* StateName(State state);
+
+    const int m_failureThreshold;
+    const int m_initialOpenMs;
+    const int m_maxOpenMs;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::thread m_probeThread;
+    std::function<bool()> m_probe;
+    bool m_shouldStop;
+
+    State m_state;
+    int m_consecutiveFailures;
+    int m_openMs;                       // Current open interval; doubles on each failed probe
+    int m_tripCount;
+    std::chrono::steady_clock::time_point m_openUntil;
+};
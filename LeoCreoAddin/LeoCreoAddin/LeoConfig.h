@@ -1,27 +1,98 @@
 #pragma once
 
 // Leo AI Configuration
-#define LEO_DESKTOP_PORT 3000
-#define LEO_DESKTOP_HOST L"localhost:4000"
+#define LEO_DESKTOP_PORT 4000                 // Defaults; local.properties overrides them
+#define LEO_DESKTOP_HOST L"localhost"
+#define LEO_WEB_SERVER_PORT 4100              // The add-in's own server for part opening requests
 #define LEO_SEARCH_ENDPOINT L"/receive-data"
 #define LEO_OPEN_PART_ENDPOINT L"/api/open-part"
 #define LEO_FACE_SEARCH_ENDPOINT L"/api/face-search"
 
 // HTTP Request Headers
 #define HTTP_CONTENT_TYPE L"Content-Type: application/json"
+#define HTTP_CONTENT_TYPE_MSGPACK L"Content-Type: application/msgpack"
+#define HTTP_ACCEPT_MSGPACK L"Accept: application/msgpack, application/json"
+#define MIME_TYPE_MSGPACK "application/msgpack"
 #define HTTP_USER_AGENT L"LeoCreoAddin/1.0"
 
 // Timeout settings
 #define HTTP_TIMEOUT_MS 5000
 #define HTTP_RETRY_COUNT 3
+#define HTTP_RETRY_BASE_DELAY_MS 250        // First backoff; doubles per attempt, jittered
+#define HTTP_RETRY_MAX_DELAY_MS 2000
+#define HTTP_BODY_CHUNK_SIZE (64 * 1024)     // Request bodies are streamed in chunks of this size
+
+// Circuit breaker for calls to the Leo desktop app
+#define LEO_CIRCUIT_FAILURE_THRESHOLD 3     // Consecutive failed calls before the circuit opens
+#define LEO_CIRCUIT_OPEN_MS 2000            // First wait before a background probe
+#define LEO_CIRCUIT_MAX_OPEN_MS 30000       // Cap for the doubling probe interval
+
+// Liveness probe for the Leo desktop app (TCP connect, no HTTP request)
+#define LEO_PROBE_MIN_INTERVAL_MS 250       // Spacing right after a state change
+#define LEO_PROBE_FAST_INTERVAL_MS 500      // Spacing cap while a launch or a caller waits for readiness
+#define LEO_PROBE_MAX_INTERVAL_MS 10000     // Spacing cap while the state is stable
+#define LEO_PROBE_TTL_MS 2000               // Age after which IsLeoAppRunning() probes inline
+#define LEO_PROBE_CONNECT_TIMEOUT_MS 300
+#define LEO_LAUNCH_READY_TIMEOUT_MS 30000   // How long LaunchLeoDesktopApp() waits for Leo to come up
+
+// Find Component: clicks within this window collapse into one query for the newest face
+#define LEO_FACE_QUERY_DEBOUNCE_MS 150
+
+// Durable outbox for non-interactive messages (assembly uploads) while Leo is down
+#define LEO_OUTBOX_FILE L"LeoOutbox.journal"   // Under %LOCALAPPDATA%\Leo
+#define LEO_OUTBOX_INITIAL_BYTES (1024 * 1024)
+#define LEO_OUTBOX_MAX_BYTES (64 * 1024 * 1024)   // Posting fails once pending messages fill this
+#define LEO_OUTBOX_RETRY_MS 1000            // First wait before a failed message is retried; doubles per failure
+#define LEO_OUTBOX_RETRY_MAX_MS 60000       // Cap for the retry wait
+#define LEO_OUTBOX_DEADLINE_MS 30000        // Per replayed message, queueing included
+#define LEO_OUTBOX_MAX_REJECTS 3            // 4xx answers before a message is dropped
+
+// Logging (LogFileWriter)
+#define LOG_DIRECTORY_NAME L"Logs"          // Default folder, under %LOCALAPPDATA%\Leo; log.dir= overrides it
+#define LOG_FILE_NAME L"LeoCreoAddin.log"   // The binary log (log.format=binary) is the same name with .blog
+#define LOG_RING_SLOTS 1024                 // Per logging thread; power of two, a line takes one slot per LOG_SLOT_BYTES
+#define LOG_SLOT_BYTES 232                  // Keeps a slot at 256 bytes
+#define LOG_MAX_RECORD_SLOTS 64             // Longer lines are truncated (about 14 KB)
+#define LOG_FLUSH_INTERVAL_MS 50            // The writer drains at least this often
+#define LOG_OVERFLOW_WAIT_MS 2              // How long a caller waits for room before dropping its line
+#define LOG_BINARY_ARGS_BYTES 512           // Encoded arguments per binary record; long strings are cut
+#define LOG_ROTATE_MB 10                    // log.rotate.mb; a file is rotated once it passes this (0: never)
+#define LOG_ROTATE_HOURS 24                 // log.rotate.hours; or once it is this old (0: never)
+#define LOG_KEEP_FILES 10                   // log.keep.files; rotated files kept per log
+#define LOG_KEEP_DAYS 14                    // log.keep.days; older rotated files are deleted (0: no age limit)
+#define LOG_COMPRESS_ROTATED true           // log.compress; NTFS-compress rotated files
+#define LOG_SITE_RATE 50                    // log.rate; lines a second per LEO_* statement once past its burst (0: no limit)
+#define LOG_SITE_BURST 500                  // log.burst; lines a statement may log in a row before the rate applies
+#define LOG_TRACE_SAMPLE_PERCENT 100        // log.sample.trace; share of TRACE statements written
+#define LOG_SUPPRESSED_REPORT_MS 1000       // How often the writer reports lines suppressed by the rate limit
+
+// Span tracing (LeoTrace), switched on with trace=true
+#define LEO_TRACE_FILE_PREFIX L"LeoCreoAddin.trace."  // Written to the log folder as <prefix><yyyyMMdd-HHmmss>.json
+#define LEO_TRACE_EVENTS_PER_THREAD 32768   // Spans and flow steps kept per thread per trace (32 bytes each)
+
+// Flight recorder (LeoFlightRecorder): the newest log records and spans in a mapped file that survives a crash
+#define LEO_FLIGHT_FILE L"LeoCreoAddin.flight"  // Under %LOCALAPPDATA%\Leo; crash copies go next to it
+#define LEO_FLIGHT_KB 4096                  // log.flight.kb; ring size, rounded down to a power of two of 256-byte slots (0: off; read at startup)
+#define LEO_FLIGHT_MIN_SLOTS 64             // Power of two
+#define LEO_FLIGHT_MAX_RECORD_SLOTS 8       // Longer records are cut (about 1.8 KB)
+#define LEO_FLIGHT_KEEP_CRASHES 5           // Crash copies kept
 
 // Assembly data settings
 #define MAX_ASSEMBLY_COMPONENTS 1000
-#define MAX_FACE_MEASUREMENTS 100
+#define MAX_FACE_MEASUREMENTS 100           // Faces analysed and sent to Leo in one Find Component query
+
+// Worker pool (LeoWorkerPool) for CPU-only work on face batches
+#define LEO_WORKER_THREADS 4                // Cap; the pool also leaves one core to the thread that hands it work
+#define LEO_WORKER_MIN_ITEMS 4              // Smaller batches run on the calling thread
 
 // File paths
 #define LEO_DESKTOP_EXE L"C:\\Program Files\\Leo\\Leo.exe"
-#define LEO_CONFIG_FILE L"leo_config.json"
+#define LEO_CONFIG_FILE L"local.properties"
+
+// local.properties is watched while Creo runs
+#define LEO_CONFIG_RELOAD_DEBOUNCE_MS 200   // Quiet time after a change before the file is re-read
+#define LEO_CONFIG_POLL_INTERVAL_MS 2000    // Fallback check when the folder cannot be watched
+#define LEO_CONFIG_MAX_BYTES (64 * 1024)
 
 // Error messages
 #define ERROR_LEO_APP_NOT_RUNNING L"Leo Desktop App is not running. Please start it first."
@@ -0,0 +1,458 @@
+#include "stdafx.h"
+#include "LeoConfigService.h"
+#include "LeoConfig.h"
+#include "LogFileWriter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <vector>
+
+LeoSettings::LeoSettings()
+    : Host(LEO_DESKTOP_HOST)
+    , Port(LEO_DESKTOP_PORT)
+    , TimeoutMs(HTTP_TIMEOUT_MS)
+    , ServerPort(LEO_WEB_SERVER_PORT)
+    , LogLevel(LEO_LOG_LEVEL_INFO)
+    , BinaryLog(false)
+    , LogRotateMb(LOG_ROTATE_MB)
+    , LogRotateHours(LOG_ROTATE_HOURS)
+    , LogKeepFiles(LOG_KEEP_FILES)
+    , LogKeepDays(LOG_KEEP_DAYS)
+    , LogCompress(LOG_COMPRESS_ROTATED)
+    , LogRate(LOG_SITE_RATE)
+    , LogBurst(LOG_SITE_BURST)
+    , LogTraceSample(LOG_TRACE_SAMPLE_PERCENT)
+    , LogFlightKb(LEO_FLIGHT_KB)
+    , Trace(false)
+    , Generation(0)
+{
+}
+
+int LeoSettings::TimeoutFor(const CString& endpoint, int fallbackMs) const
+{
+    if (SiteTimeoutsMs.empty()) {
+        return fallbackMs;
+    }
+
+    // "/api/face-search" -> "face-search"
+    std::string site(CT2CA(endpoint, CP_UTF8));
+    size_t slash = site.find_last_of('/');
+    if (slash != std::string::npos) {
+        site.erase(0, slash + 1);
+    }
+    std::transform(site.begin(), site.end(), site.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+
+    std::map<std::string, int>::const_iterator it = SiteTimeoutsMs.find(site);
+    return it != SiteTimeoutsMs.end() ? it->second : fallbackMs;
+}
+
+LeoConfigService::LeoConfigService()
+    : m_current(std::make_shared<LeoSettings>())
+    , m_generation(0)
+    , m_stopEvent(NULL)
+    , m_reloadCount(0)
+    , m_failedReloads(0)
+    , m_nextSubscription(1)
+{
+}
+
+LeoConfigService::~LeoConfigService()
+{
+    StopWatching();
+
+    if (m_stopEvent) {
+        CloseHandle(m_stopEvent);
+        m_stopEvent = NULL;
+    }
+}
+
+bool LeoConfigService::Load(const CString& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_path = path;
+    }
+    return Reload();
+}
+
+void LeoConfigService::StartWatching()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread.joinable() || m_path.IsEmpty()) {
+        return;
+    }
+    if (!m_stopEvent) {
+        m_stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (!m_stopEvent) {
+            LogMessage(_T("Cannot create the stop event; local.properties will not be watched"));
+            return;
+        }
+    }
+    ResetEvent(m_stopEvent);
+    m_thread = std::thread(&LeoConfigService::WatchThread, this);
+}
+
+void LeoConfigService::StopWatching()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        thread.swap(m_thread);
+        if (m_stopEvent) {
+            SetEvent(m_stopEvent);
+        }
+    }
+
+    if (thread.joinable()) {
+        thread.join();
+        LogMessage(_T("Stopped watching ") + m_path);
+    }
+}
+
+LeoConfigService::Snapshot LeoConfigService::Current() const
+{
+    return std::atomic_load(&m_current);
+}
+
+LeoConfigService::SubscriptionId LeoConfigService::Subscribe(ChangeCallback callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SubscriptionId id = m_nextSubscription++;
+    m_subscribers[id] = callback;
+    return id;
+}
+
+void LeoConfigService::Unsubscribe(SubscriptionId id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_subscribers.erase(id);
+}
+
+CString LeoConfigService::Describe() const
+{
+    Snapshot settings = Current();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CString text;
+    text.Format(L"config=%s gen=%u reloads=%d failedReloads=%d",
+                settings->SourcePath.IsEmpty() ? L"defaults" : (LPCTSTR)settings->SourcePath,
+                settings->Generation, m_reloadCount, m_failedReloads);
+    return text;
+}
+
+CString LeoConfigService::FindConfigFile()
+{
+    std::vector<CString> candidates;
+
+    wchar_t appData[MAX_PATH] = { 0 };
+    DWORD length = GetEnvironmentVariableW(L"APPDATA", appData, MAX_PATH);
+    if (length > 0 && length < MAX_PATH) {
+        CString base(appData);
+        base.TrimRight(L'\\');
+        candidates.push_back(base + L"\\leo-ai\\" + LEO_CONFIG_FILE);      // Production
+        candidates.push_back(base + L"\\Electron\\" + LEO_CONFIG_FILE);    // Development
+    }
+
+    wchar_t module[MAX_PATH] = { 0 };
+    length = GetModuleFileNameW(NULL, module, MAX_PATH);
+    if (length > 0 && length < MAX_PATH) {
+        CString folder(module);
+        folder = folder.Left(folder.ReverseFind(L'\\') + 1);
+        candidates.push_back(folder + LEO_CONFIG_FILE);
+    }
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        DWORD attributes = GetFileAttributesW(candidates[i]);
+        if (attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            return candidates[i];
+        }
+    }
+    return candidates.empty() ? CString(LEO_CONFIG_FILE) : candidates.front();
+}
+
+void LeoConfigService::ParseProperties(const std::string& text, LeoSettings& settings, std::string& warnings)
+{
+    // Accepts 1..max, anything else is reported and the default stays
+    auto parseInt = [&warnings](const std::string& key, const std::string& value, int maxValue, int& out) {
+        char* end = nullptr;
+        long parsed = strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || parsed < 1 || parsed > maxValue) {
+            warnings += (warnings.empty() ? "" : "; ") + key + "='" + value + "' ignored";
+            return;
+        }
+        out = static_cast<int>(parsed);
+    };
+    // Same, but 0 is allowed and turns the limit off
+    auto parseLimit = [&warnings](const std::string& key, const std::string& value, int maxValue, int& out) {
+        char* end = nullptr;
+        long parsed = strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || parsed < 0 || parsed > maxValue) {
+            warnings += (warnings.empty() ? "" : "; ") + key + "='" + value + "' ignored";
+            return;
+        }
+        out = static_cast<int>(parsed);
+    };
+    auto parseFlag = [&warnings](const std::string& key, const std::string& value, bool& out) {
+        std::string flag = value;
+        std::transform(flag.begin(), flag.end(), flag.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+        if (flag == "true" || flag == "false") {
+            out = flag == "true";
+        } else {
+            warnings += (warnings.empty() ? "" : "; ") + key + "='" + value + "' ignored";
+        }
+    };
+    auto trim = [](const std::string& s) {
+        size_t first = s.find_first_not_of(" \t\f\r");
+        if (first == std::string::npos) {
+            return std::string();
+        }
+        return s.substr(first, s.find_last_not_of(" \t\f\r") - first + 1);
+    };
+
+    size_t pos = 0;
+    if (text.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+        pos = 3;        // UTF-8 BOM written by Notepad
+    }
+
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos) {
+            eol = text.size();
+        }
+        std::string line = trim(text.substr(pos, eol - pos));
+        pos = eol + 1;
+
+        if (line.empty() || line[0] == '#' || line[0] == '!') {
+            continue;
+        }
+
+        size_t separator = line.find_first_of("=:");
+        if (separator == std::string::npos) {
+            continue;
+        }
+        std::string key = trim(line.substr(0, separator));
+        std::string value = trim(line.substr(separator + 1));
+        std::transform(key.begin(), key.end(), key.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+
+        if (key == "host") {
+            if (value.empty()) {
+                warnings += (warnings.empty() ? "" : "; ") + std::string("empty host ignored");
+            } else {
+                settings.Host = CString(CA2W(value.c_str(), CP_UTF8));
+            }
+        } else if (key == "port") {
+            parseInt(key, value, 65535, settings.Port);
+        } else if (key == "server.port") {
+            parseInt(key, value, 65535, settings.ServerPort);
+        } else if (key == "timeout") {
+            parseInt(key, value, 600000, settings.TimeoutMs);
+        } else if (key == "log.level" || (key.compare(0, 10, "log.level.") == 0 && key.size() > 10)) {
+            std::string category = key.size() > 10 ? key.substr(10) : std::string();
+            LogCategory unused;
+            int level = LogFileWriter::ParseLevel(value.c_str());
+            if (level < 0 || (!category.empty() && !LogFileWriter::ParseCategory(category.c_str(), unused))) {
+                warnings += (warnings.empty() ? "" : "; ") + key + "='" + value + "' ignored";
+            } else if (category.empty()) {
+                settings.LogLevel = level;
+            } else {
+                settings.CategoryLogLevels[category] = level;
+            }
+        } else if (key == "log.format") {
+            std::string format = value;
+            std::transform(format.begin(), format.end(), format.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+            if (format == "binary" || format == "text") {
+                settings.BinaryLog = format == "binary";
+            } else {
+                warnings += (warnings.empty() ? "" : "; ") + key + "='" + value + "' ignored";
+            }
+        } else if (key == "log.dir") {
+            settings.LogDirectory = CString(CA2W(value.c_str(), CP_UTF8));
+        } else if (key == "log.rotate.mb") {
+            parseLimit(key, value, 1024 * 1024, settings.LogRotateMb);
+        } else if (key == "log.rotate.hours") {
+            parseLimit(key, value, 24 * 365, settings.LogRotateHours);
+        } else if (key == "log.keep.files") {
+            parseLimit(key, value, 10000, settings.LogKeepFiles);
+        } else if (key == "log.keep.days") {
+            parseLimit(key, value, 3650, settings.LogKeepDays);
+        } else if (key == "log.compress") {
+            parseFlag(key, value, settings.LogCompress);
+        } else if (key == "log.rate") {
+            parseLimit(key, value, 1000000, settings.LogRate);
+        } else if (key == "log.burst") {
+            parseInt(key, value, 1000000, settings.LogBurst);
+        } else if (key == "log.sample.trace") {
+            parseLimit(key, value, 100, settings.LogTraceSample);
+        } else if (key == "log.flight.kb") {
+            parseLimit(key, value, 1024 * 1024, settings.LogFlightKb);
+        } else if (key == "trace") {
+            parseFlag(key, value, settings.Trace);
+        } else if (key.compare(0, 8, "timeout.") == 0 && key.size() > 8) {
+            int timeoutMs = 0;
+            parseInt(key, value, 600000, timeoutMs);
+            if (timeoutMs > 0) {
+                settings.SiteTimeoutsMs[key.substr(8)] = timeoutMs;
+            }
+        }
+    }
+}
+
+bool LeoConfigService::Reload()
+{
+    CString path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        path = m_path;
+    }
+
+    FileStamp stamp = StampOf(path);
+    std::unique_ptr<LeoSettings> settings(new LeoSettings());
+
+    if (stamp.Exists) {
+        // Share everything: an editor may still have the file open
+        HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        std::string text;
+        DWORD readError = ERROR_SUCCESS;
+        if (file == INVALID_HANDLE_VALUE) {
+            readError = ::GetLastError();
+        } else {
+            text.resize(static_cast<size_t>((std::min)(stamp.Size, static_cast<unsigned long long>(LEO_CONFIG_MAX_BYTES))));
+            DWORD bytesRead = 0;
+            if (!text.empty() && !ReadFile(file, &text[0], static_cast<DWORD>(text.size()), &bytesRead, NULL)) {
+                readError = ::GetLastError();
+            }
+            text.resize(bytesRead);
+            CloseHandle(file);
+        }
+
+        if (readError != ERROR_SUCCESS) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_failedReloads++;
+            CString error;
+            error.Format(L"Cannot read %s (error %lu); keeping the current settings", (LPCTSTR)path, readError);
+            LogMessage(error);
+            return false;
+        }
+
+        std::string warnings;
+        ParseProperties(text, *settings, warnings);
+        if (!warnings.empty()) {
+            LogMessage(_T("Ignored in ") + path + _T(": ") + CString(CA2W(warnings.c_str(), CP_UTF8)));
+        }
+        settings->SourcePath = path;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stamp = stamp;
+        m_reloadCount++;
+    }
+    Publish(settings.release());
+    return stamp.Exists;
+}
+
+void LeoConfigService::Publish(LeoSettings* settings)
+{
+    Snapshot snapshot;
+    std::vector<ChangeCallback> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        settings->Generation = m_generation.load(std::memory_order_relaxed) + 1;
+        snapshot.reset(settings);
+
+        // Snapshot first: a reader that sees the new generation must also see the new settings
+        std::atomic_store(&m_current, snapshot);
+        m_generation.store(settings->Generation, std::memory_order_release);
+
+        for (std::map<SubscriptionId, ChangeCallback>::const_iterator it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+            subscribers.push_back(it->second);
+        }
+    }
+
+    CString summary;
+    summary.Format(L"Settings gen %u from %s: host=%s port=%d timeout=%dms server.port=%d site timeouts=%d",
+                   snapshot->Generation,
+                   snapshot->SourcePath.IsEmpty() ? L"defaults" : (LPCTSTR)snapshot->SourcePath,
+                   (LPCTSTR)snapshot->Host, snapshot->Port, snapshot->TimeoutMs, snapshot->ServerPort,
+                   static_cast<int>(snapshot->SiteTimeoutsMs.size()));
+    LogMessage(summary);
+
+    for (size_t i = 0; i < subscribers.size(); ++i) {
+        subscribers[i](snapshot);
+    }
+}
+
+void LeoConfigService::WatchThread()
+{
+    CString path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        path = m_path;
+    }
+    CString folder = path.Left((std::max)(path.ReverseFind(L'\\'), 0));
+    if (folder.IsEmpty()) {
+        folder = L".";
+    }
+
+    // Only the folder can be watched; unrelated changes in it are filtered out by the stamp
+    HANDLE change = FindFirstChangeNotificationW(folder, FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    if (change == INVALID_HANDLE_VALUE) {
+        CString msg;
+        msg.Format(L"Cannot watch %s; checking %s every %d ms", (LPCTSTR)folder, (LPCTSTR)path, LEO_CONFIG_POLL_INTERVAL_MS);
+        LogMessage(msg);
+    } else {
+        LogMessage(_T("Watching ") + path);
+    }
+
+    for (;;) {
+        HANDLE handles[2] = { m_stopEvent, change };
+        DWORD count = (change != INVALID_HANDLE_VALUE) ? 2 : 1;
+        DWORD wait = WaitForMultipleObjects(count, handles, FALSE, LEO_CONFIG_POLL_INTERVAL_MS);
+        if (wait == WAIT_OBJECT_0) {
+            break;
+        }
+
+        if (wait == WAIT_OBJECT_0 + 1) {
+            // Re-arm first so writes during the quiet time wake us again; editors often save
+            // in several steps (truncate, write, rename)
+            FindNextChangeNotification(change);
+            if (WaitForSingleObject(m_stopEvent, LEO_CONFIG_RELOAD_DEBOUNCE_MS) == WAIT_OBJECT_0) {
+                break;
+            }
+        }
+
+        // The timeout path also retries a reload that failed on a locked file
+        FileStamp stamp = StampOf(path);
+        bool changed = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            changed = !(stamp == m_stamp);
+        }
+        if (changed) {
+            Reload();
+        }
+    }
+
+    if (change != INVALID_HANDLE_VALUE) {
+        FindCloseChangeNotification(change);
+    }
+}
+
+LeoConfigService::FileStamp LeoConfigService::StampOf(const CString& path)
+{
+    FileStamp stamp;
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (GetFileAttributesExW(path, GetFileExInfoStandard, &data) && !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        stamp.Exists = true;
+        stamp.Size = (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        stamp.WriteTime = (static_cast<unsigned long long>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+                          data.ftLastWriteTime.dwLowDateTime;
+    }
+    return stamp;
+}
+
+void LeoConfigService::LogMessage(const CString& message)
+{
+    LEO_INFO(Config, _T("LeoConfigService: %s"), (LPCTSTR)message);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// One parsed local.properties. Never modified once published; a reload builds a new one,
+// so readers can keep a snapshot for as long as they like without locking.
+struct LeoSettings {
+    CString Host;                               // host=
+    int Port;                                   // port=
+    int TimeoutMs;                              // timeout=, per connect/send/receive step
+    int ServerPort;                             // server.port=, the add-in's own web server (read at startup)
+    std::map<std::string, int> SiteTimeoutsMs;  // timeout.<site>=, e.g. timeout.face-search=2000
+    int LogLevel;                               // log.level=trace|debug|info|warn|error|off
+    std::map<std::string, int> CategoryLogLevels;  // log.level.<category>=, e.g. log.level.geometry=trace
+    bool BinaryLog;                             // log.format=text|binary
+    CString LogDirectory;                       // log.dir=, may use %VARIABLES%; empty for %LOCALAPPDATA%\Leo\Logs
+    int LogRotateMb;                            // log.rotate.mb=, 0 turns size rotation off
+    int LogRotateHours;                         // log.rotate.hours=, 0 turns age rotation off
+    int LogKeepFiles;                           // log.keep.files=, rotated files kept per log
+    int LogKeepDays;                            // log.keep.days=, 0 keeps them regardless of age
+    bool LogCompress;                           // log.compress=true|false
+    int LogRate;                                // log.rate=, lines a second per LEO_* statement past the burst, 0 turns it off
+    int LogBurst;                               // log.burst=
+    int LogTraceSample;                         // log.sample.trace=, percent of TRACE statements written
+    int LogFlightKb;                            // log.flight.kb=, flight recorder ring (read at startup), 0 turns it off
+    bool Trace;                                 // trace=true|false, span tracing to a Chrome trace file
+    CString SourcePath;                         // File the values came from; empty for built-in defaults
+    unsigned Generation;                        // Bumped on every publish
+
+    LeoSettings();
+
+    // Timeout for an endpoint: timeout.<last path segment> if present, else fallbackMs
+    int TimeoutFor(const CString& endpoint, int fallbackMs) const;
+};
+
+// Loads local.properties once into an immutable LeoSettings and swaps in a new snapshot
+// when the file changes on disk. Current() never touches the file; callers that read on
+// every request compare GetGeneration() first and reload their copy only when it moved.
+// A file that cannot be read or parsed leaves the previous snapshot in place.
+class LeoConfigService {
+public:
+    typedef std::shared_ptr<const LeoSettings> Snapshot;
+    using ChangeCallback = std::function<void(const Snapshot& settings)>;
+    typedef int SubscriptionId;
+
+    LeoConfigService();
+    ~LeoConfigService();
+
+    // Parses path and publishes the result; built-in defaults (and false) if it does not exist
+    bool Load(const CString& path);
+
+    // Watches the loaded file from a background thread; changes are published within
+    // LEO_CONFIG_RELOAD_DEBOUNCE_MS of the last write
+    void StartWatching();
+    void StopWatching();
+
+    Snapshot Current() const;
+    unsigned GetGeneration() const { return m_generation.load(std::memory_order_acquire); }
+
+    // Called after every publish, on the publishing thread (the watcher's, once watching)
+    SubscriptionId Subscribe(ChangeCallback callback);
+    void Unsubscribe(SubscriptionId id);
+
+    CString Describe() const;           // One-line summary for diagnostics
+
+    // First existing of %APPDATA%\leo-ai, %APPDATA%\Electron and the executable's folder;
+    // the production path if none exists yet, so the watcher picks the file up once created
+    static CString FindConfigFile();
+
+    // key=value / key: value lines, # and ! comments; unknown keys are ignored.
+    // Bad values keep their default and are described in warnings.
+    static void ParseProperties(const std::string& text, LeoSettings& settings, std::string& warnings);
+
+private:
+    LeoConfigService(const LeoConfigService&) = delete;
+    LeoConfigService& operator=(const LeoConfigService&) = delete;
+
+    // Size and last write time; a reload happens only when this changes
+    struct FileStamp {
+        unsigned long long Size;
+        unsigned long long WriteTime;
+        bool Exists;
+
+        FileStamp() : Size(0), WriteTime(0), Exists(false) {}
+        bool operator==(const FileStamp& other) const
+        {
+            return Exists == other.Exists && Size == other.Size && WriteTime == other.WriteTime;
+        }
+    };
+
+    bool Reload();                      // Parse m_path and publish; false keeps the current snapshot
+    void Publish(LeoSettings* settings);
+    void WatchThread();
+    static FileStamp StampOf(const CString& path);
+    void LogMessage(const CString& message);
+
+    Snapshot m_current;                 // Accessed only through std::atomic_load/atomic_store
+    std::atomic<unsigned> m_generation;
+
+    mutable std::mutex m_mutex;         // Guards everything below
+    std::thread m_thread;
+    HANDLE m_stopEvent;                 // Wakes the watcher out of its change-notification wait
+
+    CString m_path;
+    FileStamp m_stamp;
+    int m_reloadCount;
+    int m_failedReloads;
+
+    std::map<SubscriptionId, ChangeCallback> m_subscribers;
+    SubscriptionId m_nextSubscription;
+};
@@ -7,6 +7,13 @@
 #include "LeoWebClient.h"
 #include "LeoHelper.h"
 #include "LeoWebServer.h"
+#include "LeoUiDispatcher.h"
+#include "LeoAsyncClient.h"
+#include "LeoOutbox.h"
+#include "LeoConfigService.h"
+#include "LeoTrace.h"
+#include "LeoFlightRecorder.h"
+#include "LeoWorkerPool.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -34,12 +41,81 @@ CLeoCreoAddinApp::CLeoCreoAddinApp()
 
 LeoHelper leoHelper;
 
+// Settings from local.properties; declared before the objects that read them so it outlives them
+LeoConfigService leoConfig;
+
+// CPU-only work on face batches (filling in measurements, encoding them); outlives its users
+LeoWorkerPool leoWorkerPool;
+
 // Global web server instance
 LeoWebServer leoWebServer;
 
+// Global web client; keeps its WinHTTP session and keep-alive connection across face queries
+LeoWebClient leoWebClient;
+
+// Marshals background results onto Creo's UI thread
+LeoUiDispatcher leoUiDispatcher;
+
+// Runs Leo requests on a background I/O thread so the UI thread never blocks on Leo
+LeoAsyncClient leoAsyncClient(leoWebClient, leoUiDispatcher);
+
+// Journals non-interactive Leo messages on disk and replays them once Leo is up
+LeoOutbox leoOutbox(leoAsyncClient, leoWebClient.GetLivenessProbe());
+
+// log.dir, log.rotate.* and log.keep.* place and rotate the files; log.format picks text or
+// binary logging; log.rate, log.burst and log.sample.trace bound what a single statement can log;
+// log.level sets every category and log.level.<category> then overrides single ones.
+// trace=true starts a span trace, and setting it back to false writes it next to the log files.
+void ApplyLogSettings(const LeoConfigService::Snapshot& settings)
+{
+	LogFileOptions options;
+	options.Directory = (LPCWSTR)settings->LogDirectory;
+	options.RotateBytes = static_cast<unsigned long long>(settings->LogRotateMb) * 1024 * 1024;
+	options.RotateHours = settings->LogRotateHours;
+	options.KeepFiles = settings->LogKeepFiles;
+	options.KeepDays = settings->LogKeepDays;
+	options.Compress = settings->LogCompress;
+	LogFileWriter::Configure(options);
+
+	LogFileWriter::SetBinary(settings->BinaryLog);
+	LogFileWriter::SetRateLimit(settings->LogRate, settings->LogBurst);
+	LogFileWriter::SetTraceSampling(settings->LogTraceSample);
+	LogFileWriter::SetLevel(settings->LogLevel);
+	for (std::map<std::string, int>::const_iterator it = settings->CategoryLogLevels.begin(); it != settings->CategoryLogLevels.end(); ++it) {
+		LogCategory category;
+		if (LogFileWriter::ParseCategory(it->first.c_str(), category)) {
+			LogFileWriter::SetLevel(category, it->second);
+		}
+	}
+
+	if (settings->Trace && !LeoTrace::IsEnabled()) {
+		LeoTrace::Start();
+	} else if (!settings->Trace && LeoTrace::IsEnabled()) {
+		LeoTrace::Stop(LeoTrace::DefaultPath());
+	}
+}
+
+// log.flight.kb > 0 keeps the newest log records and spans in a mapped file that survives a
+// crash; a file left by a session that crashed is kept aside first
+void OpenFlightRecorder(int ringKb)
+{
+	if (ringKb <= 0) {
+		return;
+	}
+	std::wstring path = LeoFlightRecorder::DefaultPath();
+	std::wstring crashCopy;
+	if (!LeoFlightRecorder::Open(path, static_cast<size_t>(ringKb) * 1024, crashCopy)) {
+		LEO_WARN(General, L"LeoFlightRecorder: cannot map %s (another Creo session may be using it), recording is off", path.c_str());
+	}
+	if (!crashCopy.empty()) {
+		LEO_WARN(General, L"LeoFlightRecorder: the previous session ended without shutting down; its last records are in %s (read them with LeoLogDecode)", crashCopy.c_str());
+	}
+}
+
 // File processing callback function for the web server
 void OnFileProcessingRequest(const FileDownloadInfo& fileInfo)
 {
+	LEO_SPAN(General, "OnFileProcessingRequest");
 	try {
 		LogFileWriter::WriteLog("=== File Processing Request Received ===");
 
@@ -108,6 +184,7 @@ void OnFileProcessingRequest(const FileDownloadInfo& fileInfo)
 // Function to open a file in new window in Creo using Pro/ENGINEER Toolkit
 ProError OpenFileInCreoNewWindow(const CString& filePath)
 {
+	LEO_SPAN(Geometry, "OpenFileInCreoNewWindow");
 	ProError status;
 	
 	try {
@@ -268,6 +345,7 @@ ProError OpenFileInCreoNewWindow(const CString& filePath)
 // Function to open a file in Creo using Pro/ENGINEER Toolkit
 ProError OpenFileInCreo(const CString& filePath, const LocationInfo& locationInfo)
 {
+	LEO_SPAN(Geometry, "OpenFileInCreo");
 	ProError status;
 	
 	try {
@@ -392,7 +470,10 @@ ProError OpenFileInCreo(const CString& filePath, const LocationInfo& locationInf
 				LogFileWriter::WriteLog("Loading model by name...");
 				
 				// First, retrieve the model handle using ProMdlnameRetrieve
-				status = ProMdlnameRetrieve(modelName, fileType, &model);
+				{
+					LEO_SPAN(Geometry, "ProMdlnameRetrieve");
+					status = ProMdlnameRetrieve(modelName, fileType, &model);
+				}
 				if (status == PRO_TK_NO_ERROR) {
 					LogFileWriter::WriteLog("SUCCESS: ProMdlnameRetrieve - Model handle retrieved");
 					
@@ -455,29 +536,34 @@ ProError OpenFileInCreo(const CString& filePath, const LocationInfo& locationInf
 							initPos[3][3] = 1.0;
 							
 							// Log the transformation matrix values
-							char logMsg[512];
-							sprintf_s(logMsg, "SUCCESS: Transformation matrix created - Location: [%.3f, %.3f, %.3f], Orientation: [%.3f,%.3f,%.3f; %.3f,%.3f,%.3f; %.3f,%.3f,%.3f]", 
+							LEO_DEBUG(Geometry, "SUCCESS: Transformation matrix created - Location: [%.3f, %.3f, %.3f], Orientation: [%.3f,%.3f,%.3f; %.3f,%.3f,%.3f; %.3f,%.3f,%.3f]", 
 								locX, locY, locZ,
 								orient[0][0], orient[0][1], orient[0][2],
 								orient[1][0], orient[1][1], orient[1][2],
 								orient[2][0], orient[2][1], orient[2][2]);
-							LogFileWriter::WriteLog(logMsg);
 							
 							// Add the component to the current assembly
 							ProAsmcomp newComponent;
-							status = ProAsmcompAssemble((ProAssembly)currentAssembly, (ProSolid)model, initPos, &newComponent);
+							{
+								LEO_SPAN(Geometry, "ProAsmcompAssemble");
+								status = ProAsmcompAssemble((ProAssembly)currentAssembly, (ProSolid)model, initPos, &newComponent);
+							}
 							if (status == PRO_TK_NO_ERROR) {
 								LogFileWriter::WriteLog("SUCCESS: ProAsmcompAssemble - Component added to assembly");
 								
 								// Regenerate the assembly to update the display
-								status = ProAsmcompRegenerate(&newComponent, PRO_B_FALSE);
+								{
+									LEO_SPAN(Geometry, "ProAsmcompRegenerate");
+									status = ProAsmcompRegenerate(&newComponent, PRO_B_FALSE);
+								}
 								if (status == PRO_TK_NO_ERROR) {
 									LogFileWriter::WriteLog("SUCCESS: ProAsmcompRegenerate - Assembly regenerated");
 								} else {
 									LogFileWriter::WriteLog("WARNING: ProAsmcompRegenerate failed, but component is added");
 								}
 								
-								// Refresh the model tree to show the new component
+								// Refresh the model tree to show the new component; the span runs to the end of this branch
+								LEO_SPAN(Geometry, "Repaint and refresh");
 								status = ProWindowRepaint(PRO_VALUE_UNUSED);
 								if (status == PRO_TK_NO_ERROR) {
 									LogFileWriter::WriteLog("SUCCESS: ProWindowRepaint - Model tree refreshed");
@@ -618,53 +704,47 @@ ProError OpenFileInCreo(const CString& filePath, const LocationInfo& locationInf
 ProError ApplyLocationAndOrientation(ProMdl model, const LocationInfo& locationInfo)
 {
 	try {
-		LogFileWriter::WriteLog("=== Applying Location and Orientation ===");
+		LEO_DEBUG(Geometry, "=== Applying Location and Orientation ===");
 		
 		// Validate input parameters
 		if (model == NULL) {
-			LogFileWriter::WriteLog("ERROR: Invalid model handle provided");
+			LEO_ERROR(Geometry, "Invalid model handle provided");
 			return PRO_TK_BAD_INPUTS;
 		}
 		
 		// Log the location information
-		CString locationMsg;
-		locationMsg.Format(_T("Location: X=%.6f, Y=%.6f, Z=%.6f"), 
+		LEO_DEBUG(Geometry, _T("Location: X=%.6f, Y=%.6f, Z=%.6f"),
 			locationInfo.Loc.X, locationInfo.Loc.Y, locationInfo.Loc.Z);
-		LogFileWriter::WriteLog((const char*)CT2A(locationMsg));
 		
 		// Validate and log the orientation matrix
-		LogFileWriter::WriteLog("Orientation Matrix:");
+		LEO_TRACE(Geometry, "Orientation Matrix:");
 		bool validMatrix = true;
 		if (locationInfo.Orientation.size() < 3) {
-			LogFileWriter::WriteLog("WARNING: Orientation matrix has less than 3 rows");
+			LEO_WARN(Geometry, "Orientation matrix has less than 3 rows");
 			validMatrix = false;
 		}
 		
 		for (size_t i = 0; i < locationInfo.Orientation.size() && i < 3; i++) {
 			if (locationInfo.Orientation[i].size() < 3) {
-				CString warningMsg;
-				warningMsg.Format(_T("WARNING: Orientation matrix row %d has less than 3 columns"), (int)i);
-				LogFileWriter::WriteLog((const char*)CT2A(warningMsg));
+				LEO_WARN(Geometry, _T("Orientation matrix row %d has less than 3 columns"), (int)i);
 				validMatrix = false;
 			} else {
-				CString matrixMsg;
-				matrixMsg.Format(_T("  [%.6f, %.6f, %.6f]"),
+				LEO_TRACE(Geometry, _T("  [%.6f, %.6f, %.6f]"),
 					locationInfo.Orientation[i][0],
 					locationInfo.Orientation[i][1],
 					locationInfo.Orientation[i][2]);
-				LogFileWriter::WriteLog((const char*)CT2A(matrixMsg));
 			}
 		}
 		
 		if (!validMatrix) {
-			LogFileWriter::WriteLog("WARNING: Orientation matrix is not valid 3x3 matrix");
+			LEO_WARN(Geometry, "Orientation matrix is not valid 3x3 matrix");
 		}
 		
 		// Check if this is an assembly model and we need to add it as a component
 		ProMdlType modelType;
 		ProError status = ProMdlTypeGet(model, &modelType);
 		if (status != PRO_TK_NO_ERROR) {
-			LogFileWriter::WriteLog("ERROR: Failed to get model type");
+			LEO_ERROR(Geometry, "Failed to get model type");
 			return status;
 		}
 		
@@ -675,7 +755,7 @@ ProError ApplyLocationAndOrientation(ProMdl model, const LocationInfo& locationI
 			ProMdlType currentModelType;
 			status = ProMdlTypeGet(currentModel, &currentModelType);
 			if (status == PRO_TK_NO_ERROR && currentModelType == PRO_MDL_ASSEMBLY) {
-				LogFileWriter::WriteLog("Current model is an assembly - position could be applied as component placement");
+				LEO_DEBUG(Geometry, "Current model is an assembly - position could be applied as component placement");
 				// Note: Component placement with specific location/orientation would require
 				// more complex Pro/ENGINEER Toolkit implementation using constraint-based assembly
 			}
@@ -688,26 +768,25 @@ ProError ApplyLocationAndOrientation(ProMdl model, const LocationInfo& locationI
 		// 3. Apply the location and orientation as component placement constraints using Pro/ENGINEER placement constraints
 		// 4. Use ProAsmcompConstraint functions to create precise positioning constraints
 		
-		LogFileWriter::WriteLog("Location and orientation information processed successfully");
+		LEO_DEBUG(Geometry, "Location and orientation information processed successfully");
 		
 		// Log implementation notes for future development
-		LogFileWriter::WriteLog("IMPLEMENTATION NOTES:");
-		LogFileWriter::WriteLog("- File opened and displayed in Creo successfully");
-		LogFileWriter::WriteLog("- Location and orientation data captured and validated");
-		LogFileWriter::WriteLog("- For component placement in assemblies, additional implementation needed:");
-		LogFileWriter::WriteLog("  * Use ProAsmcompMdlnameCreateCopy to add as assembly component");
-		LogFileWriter::WriteLog("  * Use constraint-based placement system for precise positioning");
-		LogFileWriter::WriteLog("  * Apply transformation matrix from orientation data");
-		LogFileWriter::WriteLog("=====================================");
+		LEO_TRACE(Geometry, "IMPLEMENTATION NOTES:");
+		LEO_TRACE(Geometry, "- File opened and displayed in Creo successfully");
+		LEO_TRACE(Geometry, "- Location and orientation data captured and validated");
+		LEO_TRACE(Geometry, "- For component placement in assemblies, additional implementation needed:");
+		LEO_TRACE(Geometry, "  * Use ProAsmcompMdlnameCreateCopy to add as assembly component");
+		LEO_TRACE(Geometry, "  * Use constraint-based placement system for precise positioning");
+		LEO_TRACE(Geometry, "  * Apply transformation matrix from orientation data");
+		LEO_TRACE(Geometry, "=====================================");
 		
 		return PRO_TK_NO_ERROR;
 		
 	} catch (const std::exception& e) {
-		LogFileWriter::WriteLog("ERROR: Exception in ApplyLocationAndOrientation: ");
-		LogFileWriter::WriteLog((const char*)CT2A(CString(e.what())));
+		LEO_ERROR(Geometry, "Exception in ApplyLocationAndOrientation: %s", e.what());
 		return PRO_TK_GENERAL_ERROR;
 	} catch (...) {
-		LogFileWriter::WriteLog("ERROR: Unknown exception in ApplyLocationAndOrientation");
+		LEO_ERROR(Geometry, "Unknown exception in ApplyLocationAndOrientation");
 		return PRO_TK_GENERAL_ERROR;
 	}
 }
@@ -716,15 +795,17 @@ ProError ApplyLocationAndOrientation(ProMdl model, const LocationInfo& locationI
 void CheckWebServerStatus()
 {
 	if (leoWebServer.IsRunning()) {
+		CString portMsg;
+		portMsg.Format(_T("Port: %d"), leoWebServer.GetPort());
 		LogFileWriter::WriteLog("Leo Web Server is running and healthy");
-		LogFileWriter::WriteLog("Port: 4100");
+		LogFileWriter::WriteLog((const char*)CT2A(portMsg));
 		LogFileWriter::WriteLog("Status: Active and listening for requests");
 	} else {
 		LogFileWriter::WriteLog("Leo Web Server is not running");
 		LogFileWriter::WriteLog("Attempting to restart web server...");
 		
-		// Try to restart the web server
-		if (leoWebServer.StartServer(4100)) {
+		// Try to restart the web server; a server.port edited since startup takes effect here
+		if (leoWebServer.StartServer(leoConfig.Current()->ServerPort)) {
 			LogFileWriter::WriteLog("Web server restarted successfully");
 		} else {
 			LogFileWriter::WriteLog("Failed to restart web server");
@@ -788,6 +869,9 @@ void OpenLeoAppAct()
 		return;
 	}
 	LogFileWriter::WriteLog("Leo desktop app launched successfully\n");
+
+	// Non-blocking: the liveness probe logs the time-to-ready once Leo accepts connections
+	leoWebClient.GetLivenessProbe().NotifyLaunched();
 /*
 	LeoWebClient *pWebclient = new LeoWebClient();
 	int res = pWebclient->LaunchLeoDesktopApp(L"LeoCreoAddin launched from Creo");
@@ -809,11 +893,12 @@ void OpenLeoAppAct()
 */
 }
 
-void ProcessSelectedFace(int modelType, MeasurementData measureData)
+void ProcessSelectedFaces(int modelType, const std::vector<MeasurementData>& faces)
 {
+	LEO_SPAN(General, "ProcessSelectedFaces");
 	// Convert int to string before passing to WriteLog
 
-	LeoWebClient* webClient = new LeoWebClient();
+	LeoWebClient* webClient = &leoWebClient;
 
 	// Optional: Configure custom settings
 	//webClient->SetPort(4000);
@@ -839,37 +924,60 @@ void ProcessSelectedFace(int modelType, MeasurementData measureData)
 	//	}
 	//}
 
-	webClient->SendFaceMeasurementData(measureData,
-		[](const HttpResponse& response) {
-			AFX_MANAGE_STATE(AfxGetStaticModuleState());
-			CString responseMsg;
-			responseMsg.Format(_T("Measurement data sent successfully"));
+	// The HTTP exchange runs on the I/O thread so this returns immediately;
+	// all three callbacks are delivered back on Creo's UI thread.
+	// Latest wins: a newer selection within the debounce window, or while this query
+	// is still in flight, cancels it without a callback
+	// One face keeps the single-face request; several go to Leo together as one query
+	SuccessCallback onSuccess = [](const HttpResponse& response) {
+		AFX_MANAGE_STATE(AfxGetStaticModuleState());
+		CString responseMsg;
+		responseMsg.Format(_T("Measurement data sent successfully"));
+		LogFileWriter::WriteLog((const char*)CT2A(responseMsg));
+
+		responseMsg.Format(_T("Response: %s"), response.Body.GetString());
+		LogFileWriter::WriteLog((const char*)CT2A(responseMsg));
+
+		if (response.Data.IsValid) {
+			responseMsg.Format(_T("Response status: %s, %d candidate(s)"), response.Data.Status.GetString(), static_cast<int>(response.Data.Candidates.size()));
 			LogFileWriter::WriteLog((const char*)CT2A(responseMsg));
-
-			// Convert response.Body (std::string) to CString
-			CString responseBody(CW2T(response.Body));
-			responseMsg.Format(_T("Response: %s"), responseBody.GetString());
-			LogFileWriter::WriteLog((const char*)CT2A(responseMsg));
-		},
-		[](const CString& error) {
-			AFX_MANAGE_STATE(AfxGetStaticModuleState());
-			CString errorMsg;
-			errorMsg.Format(_T("Error sending measurement data: %s"), error.GetString());
-			LogFileWriter::WriteLog((const char*)CT2A(errorMsg));
 		}
-	);
+	};
+	ErrorCallback onError = [](const CString& error) {
+		AFX_MANAGE_STATE(AfxGetStaticModuleState());
+		CString errorMsg;
+		errorMsg.Format(_T("Error sending measurement data: %s"), error.GetString());
+		LogFileWriter::WriteLog((const char*)CT2A(errorMsg));
+	};
+	// Candidate parts are reported as they are decoded, ahead of the complete response
+	CandidateCallback onCandidate = [](const CandidatePart& candidate) {
+		AFX_MANAGE_STATE(AfxGetStaticModuleState());
+		CString candidateMsg;
+		candidateMsg.Format(_T("Candidate: %s (score %.3f) %s"), candidate.Name.GetString(), candidate.Score, candidate.Path.GetString());
+		LogFileWriter::WriteLog((const char*)CT2A(candidateMsg));
+	};
+
+	LeoAsyncClient::RequestId requestId = faces.size() == 1
+		? leoAsyncClient.SendLatestFaceMeasurementDataAsync(faces[0], onSuccess, onError, onCandidate)
+		: leoAsyncClient.SendLatestFaceMeasurementBatchAsync(faces, onSuccess, onError, onCandidate);
+
+	if (requestId == LeoAsyncClient::INVALID_REQUEST) {
+		LogFileWriter::WriteLog("Leo async client is not running, face query dropped");
+	}
 }
 
 
 void FindComponentAct()
 {
-	MeasurementData measureData;
+	LEO_SPAN(General, "FindComponent");
+	std::vector<MeasurementData> faces;
 
 	LogFileWriter::WriteLog((const char*)CT2A(_T("Start!!")));
 	
-	int modelType = leoHelper.IsFaceSelected(&measureData);
+	// Every selected face, up to MAX_FACE_MEASUREMENTS, goes into one query
+	int modelType = leoHelper.AnalyzeSelectedFaces(faces, MAX_FACE_MEASUREMENTS, true);
 	if (modelType == PRO_PART || modelType == PRO_SURFACE || modelType == PRO_ASSEMBLY) {
-		ProcessSelectedFace(modelType, measureData);
+		ProcessSelectedFaces(modelType, faces);
 	}else
 	{
 		LogFileWriter::WriteLog("User needs to select a face but No faces selected");
@@ -1019,6 +1127,8 @@ extern "C" int user_initialize()
 	uiCmdCmdId LeoOpenMenuID;
 	uiCmdCmdId FindComponentMenuID;
 
+	LeoTrace::NameThread("Creo UI");
+
 	status = ProMenubarMenuAdd("LeoCreoAddin", "LeoCreoAddin", "Help", PRO_B_TRUE, MSGFILE);
 
 	// Open Leo App
@@ -1040,6 +1150,31 @@ extern "C" int user_initialize()
 		LogFileWriter::WriteLog("WARNING: Failed to create Find Component toolbar button");
 	}
 
+	// Read local.properties once; later edits reach the web client without restarting Creo
+	leoConfig.Load(LeoConfigService::FindConfigFile());
+	ApplyLogSettings(leoConfig.Current());
+	OpenFlightRecorder(leoConfig.Current()->LogFlightKb);
+	leoConfig.Subscribe(ApplyLogSettings);
+	leoConfig.StartWatching();
+	leoWebClient.SetConfigService(&leoConfig);
+
+	// Face batches are filled in and encoded on the worker pool
+	leoWorkerPool.Start();
+	leoHelper.SetWorkerPool(&leoWorkerPool);
+	leoWebClient.SetWorkerPool(&leoWorkerPool);
+
+	// Async Leo client: dispatcher window lives on this (UI) thread, requests run on the I/O thread
+	if (!leoUiDispatcher.Initialize()) {
+		LogFileWriter::WriteLog("WARNING: UI dispatcher unavailable, Leo callbacks will run on the I/O thread");
+	}
+	leoAsyncClient.Start();
+
+	// Keep a cached view of whether Leo is up; the probe only opens a TCP connection
+	leoWebClient.GetLivenessProbe().Start();
+
+	// Pending messages from an earlier session go out as soon as Leo answers
+	leoOutbox.Open(LeoOutbox::DefaultPath());
+
 	//Register right-click menu listener event, function is the same as normal menu
 	status = ProNotificationSet(PRO_POPUPMENU_CREATE_POST, (ProFunction)ProPopupMenuNotification);
 
@@ -1047,20 +1182,29 @@ extern "C" int user_initialize()
 	//status = ProRibbonDefinitionfileLoad(L"LeoCreoAddin.rbn");
 
 	// Start the web server for receiving part opening requests
+	int serverPort = leoConfig.Current()->ServerPort;
+	CString portMsg;
+	portMsg.Format(_T("Port: %d"), serverPort);
 	LogFileWriter::WriteLog("=== Starting Leo Web Server ===");
-	LogFileWriter::WriteLog("Port: 4100");
+	LogFileWriter::WriteLog((const char*)CT2A(portMsg));
 	LogFileWriter::WriteLog("Purpose: Receive part opening requests from external applications");
 	
 	// Set the file processing callback
 	leoWebServer.SetFileProcessingCallback(OnFileProcessingRequest);
 	LogFileWriter::WriteLog("File processing callback registered");
+
+	// Report the Leo client's circuit breaker and outbox state on GET /health
+	leoWebServer.SetDiagnosticsProvider([]() {
+		return leoWebClient.GetDiagnostics() + _T(" ") + leoOutbox.Describe() + _T(" ") + leoConfig.Describe();
+	});
 	
-	if (leoWebServer.StartServer(4100)) {
-		LogFileWriter::WriteLog("Leo Web Server started successfully on port 4100");
+	if (leoWebServer.StartServer(serverPort)) {
+		portMsg.Format(_T("Leo Web Server started successfully on port %d"), serverPort);
+		LogFileWriter::WriteLog((const char*)CT2A(portMsg));
 		LogFileWriter::WriteLog("Web server is now listening for part opening requests");
 		LogFileWriter::WriteLog("Available endpoints:");
 		LogFileWriter::WriteLog("  - POST / : Part opening requests (JSON format)");
-		LogFileWriter::WriteLog("  - GET /health : Health check endpoint");
+		LogFileWriter::WriteLog("  - GET /health : Health check endpoint (includes Leo circuit breaker state)");
 		LogFileWriter::WriteLog("Performance optimizations:");
 		LogFileWriter::WriteLog("  - Zero-latency connection acceptance");
 		LogFileWriter::WriteLog("  - Minimal 0.1ms polling interval");
@@ -1085,9 +1229,39 @@ extern "C" void user_terminate()
 	status = ProNotificationUnset(PRO_POPUPMENU_CREATE_POST);
 	
 	// Stop the web server
+	CString portMsg;
+	portMsg.Format(_T("Port %d released"), leoWebServer.GetPort());
 	LogFileWriter::WriteLog("=== Stopping Leo Web Server ===");
 	leoWebServer.StopServer();
 	LogFileWriter::WriteLog("Leo Web Server stopped successfully");
-	LogFileWriter::WriteLog("Port 4100 released");
+	LogFileWriter::WriteLog((const char*)CT2A(portMsg));
 	LogFileWriter::WriteLog("================================");
+
+	// Cancel outstanding Leo requests and join the I/O thread before anything it uses goes away
+	leoAsyncClient.Stop();
+	leoUiDispatcher.Shutdown();
+
+	// Nothing hands it work once the I/O thread has stopped and no command is running
+	leoWorkerPool.Stop();
+
+	// No more reloads once nothing sends requests
+	leoConfig.StopWatching();
+
+	// Unsent messages stay in the journal for the next session
+	leoOutbox.Close();
+
+	// Release the pooled Leo connection before the DLL unloads
+	leoWebClient.Shutdown();
+	LogFileWriter::WriteLog("Leo web client connection closed");
+
+	// A trace still running is written out while the log folder is known
+	if (LeoTrace::IsEnabled()) {
+		LeoTrace::Stop(LeoTrace::DefaultPath());
+	}
+
+	// Write out queued log lines and stop the writer thread before the DLL unloads
+	LogFileWriter::Shutdown();
+
+	// Last, so the flight record of a session that hangs while shutting down reads as a crash
+	LeoFlightRecorder::Close();
 }
\ No newline at end of file
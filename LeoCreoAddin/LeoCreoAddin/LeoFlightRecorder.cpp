@@ -0,0 +1,329 @@
+#include "stdafx.h"
+#include "LeoFlightRecorder.h"
+#include "LeoBinaryLog.h"
+#include "LeoConfig.h"
+#include "LogFileWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+using namespace LeoBinaryLog;
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "FlightSlot::Sequence is used as an atomic");
+static_assert(LEO_FLIGHT_MAX_RECORD_SLOTS <= 255, "FlightSlot::Continues is 8 bits");
+static_assert((LEO_FLIGHT_MIN_SLOTS & (LEO_FLIGHT_MIN_SLOTS - 1)) == 0, "LEO_FLIGHT_MIN_SLOTS must be a power of two");
+
+std::atomic<bool> LeoFlightRecorder::s_enabled(false);
+
+namespace {
+
+const size_t SLOT_DATA_BYTES = sizeof(FlightSlot::Data);
+
+struct RecorderState {
+    std::mutex ControlMutex;            // Serializes Open and Close
+    HANDLE File;
+    HANDLE Mapping;
+    FlightHeader* Header;
+    char* Formats;                      // FLIGHT_FORMAT_BYTES after the header
+    FlightSlot* Slots;
+    uint64_t SlotCount;
+    std::atomic<uint64_t> Next;         // Ring position of the next record
+
+    std::mutex FormatsMutex;            // Appends to the format area
+
+    RecorderState()
+        : File(INVALID_HANDLE_VALUE)
+        , Mapping(NULL)
+        , Header(NULL)
+        , Formats(NULL)
+        , Slots(NULL)
+        , SlotCount(0)
+        , Next(0)
+    {
+    }
+};
+
+RecorderState& State()
+{
+    static RecorderState state;
+    return state;
+}
+
+std::wstring DirectoryOf(const std::wstring& path)
+{
+    size_t separator = path.find_last_of(L"\\/");
+    return separator == std::wstring::npos ? std::wstring(L".") : path.substr(0, separator);
+}
+
+// "LeoCreoAddin" for "...\LeoCreoAddin.flight"
+std::wstring StemOf(const std::wstring& path)
+{
+    size_t separator = path.find_last_of(L"\\/");
+    std::wstring name = separator == std::wstring::npos ? path : path.substr(separator + 1);
+    size_t dot = name.rfind(L'.');
+    return dot == std::wstring::npos ? name : name.substr(0, dot);
+}
+
+// Keeps the newest LEO_FLIGHT_KEEP_CRASHES crash copies; the stamp in the name sorts by age
+void PruneCrashCopies(const std::wstring& path)
+{
+    std::wstring directory = DirectoryOf(path);
+    std::wstring pattern = directory + L"\\" + StemOf(path) + L".*.crash.flight";
+    std::vector<std::wstring> names;
+    WIN32_FIND_DATAW found;
+    HANDLE find = FindFirstFileW(pattern.c_str(), &found);
+    if (find == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+            names.push_back(found.cFileName);
+        }
+    } while (FindNextFileW(find, &found));
+    FindClose(find);
+
+    std::sort(names.begin(), names.end());
+    for (size_t i = 0; i + LEO_FLIGHT_KEEP_CRASHES < names.size(); ++i) {
+        DeleteFileW((directory + L"\\" + names[i]).c_str());
+    }
+}
+
+// A file whose header still says FLIGHT_OPEN belongs to a session that never reached Close().
+// Moved aside under the time that session started; empty if there was nothing to keep or the
+// file is still in use by another session.
+std::wstring KeepCrashedFile(const std::wstring& path)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::wstring();
+    }
+    FlightHeader header;
+    DWORD read = 0;
+    bool crashed = ReadFile(file, &header, sizeof(header), &read, NULL) && read == sizeof(header)
+        && memcmp(header.Magic, FLIGHT_MAGIC, sizeof(header.Magic)) == 0
+        && header.State == FLIGHT_OPEN;
+    CloseHandle(file);
+    if (!crashed) {
+        return std::wstring();
+    }
+
+    time_t started = static_cast<time_t>(header.AnchorMicros / 1000000);
+    struct tm local;
+    wchar_t stamp[32] = { 0 };
+    if (localtime_s(&local, &started) == 0) {
+        wcsftime(stamp, sizeof(stamp) / sizeof(stamp[0]), L"%Y%m%d-%H%M%S", &local);
+    }
+    std::wstring copy = DirectoryOf(path) + L"\\" + StemOf(path) + L"." + stamp + L".crash.flight";
+    if (!MoveFileExW(path.c_str(), copy.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        return std::wstring();
+    }
+    PruneCrashCopies(path);
+    return copy;
+}
+
+void Unmap(RecorderState& state)
+{
+    if (state.Header) {
+        UnmapViewOfFile(state.Header);
+        state.Header = NULL;
+    }
+    if (state.Mapping) {
+        CloseHandle(state.Mapping);
+        state.Mapping = NULL;
+    }
+    if (state.File != INVALID_HANDLE_VALUE) {
+        CloseHandle(state.File);
+        state.File = INVALID_HANDLE_VALUE;
+    }
+}
+
+std::atomic<uint64_t>& SequenceOf(FlightSlot& slot)
+{
+    return *reinterpret_cast<std::atomic<uint64_t>*>(&slot.Sequence);
+}
+
+// Span records: [duration varint] category byte, name
+void AppendSpan(uint8_t kind, const char* name, uint8_t category, int64_t ticks, const int64_t* duration)
+{
+    char data[SLOT_DATA_BYTES];
+    size_t length = 0;
+    if (duration) {
+        length = PutVarint(static_cast<uint64_t>(*duration < 0 ? 0 : *duration), data);
+    }
+    data[length++] = static_cast<char>(category);
+    size_t nameLength = strlen(name);
+    if (nameLength > sizeof(data) - length) {
+        nameLength = sizeof(data) - length;
+    }
+    memcpy(data + length, name, nameLength);
+    LeoFlightRecorder::Append(kind, ticks, static_cast<uint32_t>(GetCurrentThreadId()), data, length + nameLength);
+}
+
+} // namespace
+
+bool LeoFlightRecorder::Open(const std::wstring& path, size_t ringBytes, std::wstring& crashCopy)
+{
+    RecorderState& state = State();
+    std::lock_guard<std::mutex> lock(state.ControlMutex);
+    crashCopy.clear();
+    if (state.Header) {
+        return false;
+    }
+
+    crashCopy = KeepCrashedFile(path);
+
+    // A power of two, so finding a slot is a mask rather than a division
+    uint64_t slotCount = LEO_FLIGHT_MIN_SLOTS;
+    while (slotCount * 2 * FLIGHT_SLOT_BYTES <= ringBytes) {
+        slotCount *= 2;
+    }
+    LARGE_INTEGER size;
+    size.QuadPart = static_cast<LONGLONG>(FLIGHT_HEADER_BYTES + FLIGHT_FORMAT_BYTES + slotCount * FLIGHT_SLOT_BYTES);
+
+    // Created fresh, so every slot starts out zero (never written). Another session keeps the
+    // file open without sharing writes, which makes this fail there instead of mixing records.
+    state.File = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (state.File == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    state.Mapping = CreateFileMappingW(state.File, NULL, PAGE_READWRITE, size.HighPart, size.LowPart, NULL);
+    char* view = state.Mapping ? static_cast<char*>(MapViewOfFile(state.Mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0)) : NULL;
+    if (!view) {
+        Unmap(state);
+        return false;
+    }
+
+    // Touch every page now, so the first lap of the ring does not take page faults on Creo's
+    // UI thread
+    memset(view, 0, static_cast<size_t>(size.QuadPart));
+
+    state.Header = reinterpret_cast<FlightHeader*>(view);
+    state.Formats = view + FLIGHT_HEADER_BYTES;
+    state.Slots = reinterpret_cast<FlightSlot*>(view + FLIGHT_HEADER_BYTES + FLIGHT_FORMAT_BYTES);
+    state.SlotCount = slotCount;
+    state.Next.store(0, std::memory_order_relaxed);
+
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER ticks;
+    FILETIME now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&ticks);
+    GetSystemTimePreciseAsFileTime(&now);
+    unsigned long long hundreds = (static_cast<unsigned long long>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+
+    FlightHeader& header = *state.Header;
+    memcpy(header.Magic, FLIGHT_MAGIC, sizeof(header.Magic));
+    header.Version = FLIGHT_VERSION;
+    header.ProcessId = GetCurrentProcessId();
+    header.State = FLIGHT_OPEN;
+    header.SlotCount = static_cast<uint32_t>(slotCount);
+    header.FormatBytes = 0;
+    header.Frequency = frequency.QuadPart;
+    header.AnchorTicks = ticks.QuadPart;
+    header.AnchorMicros = static_cast<int64_t>(hundreds / 10) - 11644473600000000LL;
+    s_enabled.store(true, std::memory_order_release);
+
+    // Formats registered before now; a format registered meanwhile may land twice, which the
+    // decoder takes in its stride
+    std::vector<std::string> formats = LogFileWriter::GetFormats();
+    for (size_t i = 0; i < formats.size(); ++i) {
+        AddFormat(formats[i].data(), formats[i].size());
+    }
+    return true;
+}
+
+void LeoFlightRecorder::Close()
+{
+    RecorderState& state = State();
+    std::lock_guard<std::mutex> lock(state.ControlMutex);
+    if (!state.Header || !s_enabled.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+    state.Header->State = FLIGHT_CLOSED;
+    FlushViewOfFile(state.Header, sizeof(FlightHeader));
+}
+
+std::wstring LeoFlightRecorder::DefaultPath()
+{
+    wchar_t base[MAX_PATH] = { 0 };
+    DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", base, MAX_PATH);
+    if (length == 0 || length >= MAX_PATH) {
+        length = GetTempPathW(MAX_PATH, base);
+    }
+
+    std::wstring directory(base);
+    while (!directory.empty() && directory[directory.size() - 1] == L'\\') {
+        directory.erase(directory.size() - 1);
+    }
+    directory += L"\\Leo";
+    CreateDirectoryW(directory.c_str(), NULL);
+    return directory + L"\\" + LEO_FLIGHT_FILE;
+}
+
+void LeoFlightRecorder::Append(uint8_t kind, int64_t ticks, uint32_t thread, const char* data, size_t length)
+{
+    if (!IsEnabled()) {
+        return;
+    }
+    RecorderState& state = State();
+    const size_t maxLength = SLOT_DATA_BYTES * LEO_FLIGHT_MAX_RECORD_SLOTS;
+    if (length > maxLength) {
+        length = maxLength;
+    }
+    uint64_t count = length == 0 ? 1 : (length + SLOT_DATA_BYTES - 1) / SLOT_DATA_BYTES;
+    uint64_t position = state.Next.fetch_add(count, std::memory_order_relaxed);
+
+    for (uint64_t i = 0; i < count; ++i) {
+        FlightSlot& slot = state.Slots[(position + i) & (state.SlotCount - 1)];
+        std::atomic<uint64_t>& sequence = SequenceOf(slot);
+
+        // Invalidate before overwriting, so a crash halfway leaves a slot the decoder skips
+        // rather than an old sequence over half-new data. x86/x64 keep stores in order; the
+        // fence stops the compiler from moving the copy above the invalidation.
+        sequence.store(FLIGHT_WRITING, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        size_t chunk = length < SLOT_DATA_BYTES ? length : SLOT_DATA_BYTES;
+        memcpy(slot.Data, data, chunk);
+        slot.Ticks = ticks;
+        slot.Thread = thread;
+        slot.Length = static_cast<uint16_t>(chunk);
+        slot.Kind = i == 0 ? kind : static_cast<uint8_t>(FLIGHT_CONTINUATION);
+        slot.Continues = static_cast<uint8_t>(i == 0 ? count - 1 : 0);
+        sequence.store(position + i + 1, std::memory_order_release);
+
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void LeoFlightRecorder::AddFormat(const char* record, size_t length)
+{
+    if (!IsEnabled()) {
+        return;
+    }
+    RecorderState& state = State();
+    std::lock_guard<std::mutex> lock(state.FormatsMutex);
+    FlightHeader& header = *state.Header;
+    if (header.FormatBytes + length > FLIGHT_FORMAT_BYTES) {
+        return;     // Events of later formats decode as unknown ids
+    }
+    memcpy(state.Formats + header.FormatBytes, record, length);
+    std::atomic_thread_fence(std::memory_order_release);
+    header.FormatBytes += static_cast<uint32_t>(length);
+}
+
+void LeoFlightRecorder::SpanBegin(const char* name, uint8_t category, int64_t begin)
+{
+    AppendSpan(FLIGHT_SPAN_BEGIN, name, category, begin, NULL);
+}
+
+void LeoFlightRecorder::SpanEnd(const char* name, uint8_t category, int64_t begin, int64_t end)
+{
+    int64_t duration = end - begin;
+    AppendSpan(FLIGHT_SPAN_END, name, category, end, &duration);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Crash-surviving copy of the newest log records and spans (the "flight recorder").
+// Every log line, binary log event and LEO_SPAN begin/end is also copied into a fixed-size ring
+// of slots in a memory-mapped file. Appending is a memcpy into the mapping: no file I/O and no
+// lock, only one atomic add to claim the slots. The pages belong to the file, so when Creo
+// dies the OS still writes them out, and the last few thousand records of the session are on
+// disk even though the log writer thread never got to flush its queue.
+// Open() moves a file left behind by a session that never reached Close() aside as
+// <name>.<yyyyMMdd-HHmmss>.crash.flight; LeoLogDecode turns either into text. The layout is in
+// LeoBinaryLog.h.
+// A power cut can still lose what the OS had not written yet; the recorder covers crashes and
+// kills of the Creo process, not of the machine.
+class LeoFlightRecorder {
+public:
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Creates and maps path with a ring of ringBytes. crashCopy receives the path a crashed
+    // session's file was moved to, or stays empty. False if the file could not be mapped (for
+    // example because another Creo session holds it); recording then stays off.
+    static bool Open(const std::wstring& path, size_t ringBytes, std::wstring& crashCopy);
+
+    // Marks the file as cleanly closed. Recording stops, but the view stays mapped until the
+    // process ends so a call already past IsEnabled() never writes into unmapped memory.
+    static void Close();
+
+    static std::wstring DefaultPath();      // %LOCALAPPDATA%\Leo\LEO_FLIGHT_FILE
+
+    // kind is a LeoBinaryLog::FlightKind; data longer than LEO_FLIGHT_MAX_RECORD_SLOTS slots
+    // is cut
+    static void Append(uint8_t kind, int64_t ticks, uint32_t thread, const char* data, size_t length);
+
+    // A binary log format record, so events in the ring can be decoded on their own
+    static void AddFormat(const char* record, size_t length);
+
+    static void SpanBegin(const char* name, uint8_t category, int64_t begin);
+    static void SpanEnd(const char* name, uint8_t category, int64_t begin, int64_t end);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
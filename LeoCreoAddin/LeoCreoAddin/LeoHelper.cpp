@@ -1,337 +1,246 @@
 #include "stdafx.h"
 #include "LeoHelper.h"
 #include "LogFileWriter.h"
-
-LeoHelper::LeoHelper()
+#include "LeoTrace.h"
+#include "LeoWorkerPool.h"
+
+// What the analyzers share for one face. The query half of each analyzer fills it on Creo's UI
+// thread; the fill half only reads it, so faces can be filled in on the worker pool.
+struct FaceAnalysis {
+	ProGeomitem Item;
+	ProUvParam ClickParam;				// Where the user picked the face
+	ProSurface Surface;
+	ProSrftype SurfType;
+	ProUvParam UvMin;
+	ProUvParam UvMax;
+	ProSurfaceOrient Orient;
+	ProSurfaceshapedata Shape;			// Only the cylinder member is read
+
+	double Area;						// FACE_ANALYZE_AREA
+	bool HasArea;
+	ProVector ClickPoint;				// FACE_ANALYZE_CLICK_POINT
+	ProVector Normal;
+	bool HasClickPoint;
+	double Depth;						// FACE_ANALYZE_CYLINDER; length along the axis
+	bool HasDepth;
+	bool IsHole;						// FACE_ANALYZE_HOLE
+	bool IsHoleFeature;					// FACE_ANALYZE_HOLE_INFO; belongs to a hole or shaft feature
+
+	LONGLONG Ticks[FACE_ANALYZER_COUNT];	// Counter ticks per analyzer, when timed
+};
+
+// Query: Pro/TOOLKIT calls, UI thread only. Fill: turns the results into MeasurementData
+// fields, any thread.
+typedef void (*FaceQueryFn)(FaceAnalysis& face);
+typedef void (*FaceFillFn)(const FaceAnalysis& face, MeasurementData* measureData);
+
+struct FaceAnalyzerEntry {
+	unsigned Id;						// FaceAnalyzer bit
+	unsigned Needs;						// Analyzers whose results this one reads
+	const char* Name;					// Span and timing name
+	FaceQueryFn Query;					// Null if the analyzer needs nothing from Creo
+	FaceFillFn Fill;
+};
+
+static void GuessHoleInfo(ProSrftype surfType, double diameter, double area, HoleInfo& holeInfo);
+
+static void QueryArea(FaceAnalysis& face)
 {
+	face.HasArea = ProSurfaceAreaEval(face.Surface, &face.Area) == PRO_TK_NO_ERROR;
 }
 
-LeoHelper::~LeoHelper()
+static void FillArea(const FaceAnalysis& face, MeasurementData* measureData)
 {
-}
+	CString areaMsg;
+	areaMsg.Format(_T("%lf"), face.HasArea ? face.Area : 0.0);
+	LEO_DEBUG(Geometry, _T("Final Surface Area Result: %s"), (LPCTSTR)areaMsg);
 
-void LeoHelper::GetFaceDataAction() {
+	measureData->Area = areaMsg;
+}
 
+static void QueryClickPoint(FaceAnalysis& face)
+{
+	ProVector deriv1[2], deriv2[3];
+	face.HasClickPoint = ProSurfaceXyzdataEval(face.Surface, face.ClickParam, face.ClickPoint, deriv1, deriv2, face.Normal) == PRO_TK_NO_ERROR;
 }
 
-int LeoHelper::GetCurrentFaceSelection(MeasurementData *measureData)
+// Click location, the normal there, and the center point: the cylinder's axis origin, or the
+// click location for any other surface
+static void FillClickPoint(const FaceAnalysis& face, MeasurementData* measureData)
 {
-	ProError err;
-	ProMdl currMdl;
+	const double* xyz_point = face.ClickPoint;
+	const double* normal = face.Normal;
 
-	err = ProMdlCurrentGet(&currMdl);
-	if (err != PRO_TK_NO_ERROR) return err;
+	if (face.HasClickPoint) {
+		CString xStr, yStr, zStr;
+		xStr.Format(_T("%lf"), xyz_point[0]);
+		yStr.Format(_T("%lf"), xyz_point[1]);
+		zStr.Format(_T("%lf"), xyz_point[2]);
+		measureData->ClickLocation = Point3D(xStr, yStr, zStr);
 
-	ProMdlType mDltype = PRO_MDL_UNUSED;
-	err = ProMdlTypeGet(currMdl, &mDltype);
+		LEO_TRACE(Geometry, _T("Click location (Point3D): [%lf, %lf, %lf]"), xyz_point[0], xyz_point[1], xyz_point[2]);
 
-	// Get current selections from selection buffer without prompting user
-	ProSelection *sels;
-	err = ProSelbufferSelectionsGet(&sels);
-	
-	if (err != PRO_TK_NO_ERROR) {
-		LogFileWriter::WriteLog("Failed to get current selections from buffer");
-		return err;
-	}
+		// Store normal vector (outward normal to the surface)
+		CString normalMsg;
+		normalMsg.Format(_T("%lf, %lf, %lf"), normal[0], normal[1], normal[2]);
+		measureData->Normal = normalMsg;
 
-	// Count the selections
-	int nSels = 0;
-	ProArraySizeGet((ProArray)sels, &nSels);
-	
-	CString nSelsMsg;
-	nSelsMsg.Format(_T("Found %d objects in current selection buffer"), nSels);
-	LogFileWriter::WriteLog((const char*)CT2A(nSelsMsg));
-		
-	if (nSels <= 0 || sels == NULL) {
-		LogFileWriter::WriteLog("No objects currently selected");
-		ProSelectionarrayFree(sels);
-		return PRO_TK_E_NOT_FOUND;
+		LEO_TRACE(Geometry, _T("Surface normal vector: %s"), (LPCTSTR)normalMsg);
 	}
 
-	// Find the first face selection
-	ProSelection* sel = NULL;
-	for (int i = 0; i < nSels; i++) {
-		ProGeomitem selectedItem;
-		err = ProSelectionModelitemGet(sels[i], &selectedItem);
-		if (err == PRO_TK_NO_ERROR) {
-			// Check if this is a face-type item
-			CString nSelsType;
-			nSelsType.Format(_T("Selected Item type is %d"), selectedItem.type);
-			LogFileWriter::WriteLog((const char*)CT2A(nSelsType));
-			if (selectedItem.type == PRO_SURFACE || selectedItem.type == PRO_QUILT) {
-				sel = &sels[i];
-				break;
-			}
-		}
-	}
+	if (face.SurfType == PRO_SRF_CYL) {
+		const double* axisOrigin = face.Shape.cylinder.origin;
 
-	if (sel == NULL) {
-		LogFileWriter::WriteLog("No face-type objects found in current selections");
-		ProSelectionarrayFree(sels);
-		return PRO_TK_E_NOT_FOUND;
-	}
+		CString centerXStr, centerYStr, centerZStr;
+		centerXStr.Format(_T("%lf"), axisOrigin[0]);
+		centerYStr.Format(_T("%lf"), axisOrigin[1]);
+		centerZStr.Format(_T("%lf"), axisOrigin[2]);
+		measureData->CenterPoint = Point3D(centerXStr, centerYStr, centerZStr);
 
-	// Process the selected face (reuse existing logic)
-	ProGeomitem selectedItem;
-	err = ProSelectionModelitemGet(*sel, &selectedItem);
-	if (err != PRO_TK_NO_ERROR) {
-		ProSelectionarrayFree(sels);
-		return err;
+		LEO_TRACE(Geometry, _T("Surface center point (Point3D): [%lf, %lf, %lf]"), axisOrigin[0], axisOrigin[1], axisOrigin[2]);
+	} else if (face.HasClickPoint) {
+		measureData->CenterPoint = measureData->ClickLocation;
+
+		LEO_TRACE(Geometry, _T("Surface center point (using click location): [%lf, %lf, %lf]"), xyz_point[0], xyz_point[1], xyz_point[2]);
 	}
+}
 
-	ProUvParam paramAtselection;
-	err = ProSelectionUvParamGet(*sel, paramAtselection);
-	if (err != PRO_TK_NO_ERROR) {
-		ProSelectionarrayFree(sels);
-		return err;
+// Depth of a cylinder between its uv bounds
+static void QueryCylinder(FaceAnalysis& face)
+{
+	if (face.SurfType != PRO_SRF_CYL) {
+		return;
 	}
 
-	ProSurface selectedSurf;
-	err = ProGeomitemToSurface(&selectedItem, &selectedSurf);
+	ProVector startPoint, endPoint, normal;
+	ProVector deriv1[2], deriv2[3];
+	ProUvParam uvStart = { face.UvMin[0], face.UvMin[1] };	// Start of cylinder along axis
+	ProUvParam uvEnd = { face.UvMax[0], face.UvMax[1] };	// End of cylinder along axis
+
+	ProError err = ProSurfaceXyzdataEval(face.Surface, uvStart, startPoint, deriv1, deriv2, normal);
 	if (err != PRO_TK_NO_ERROR) {
-		ProSelectionarrayFree(sels);
-		return err;
+		LEO_WARN(Geometry, "Failed to evaluate start point for hole depth");
+		return;
 	}
-
-	ProGeomitemdata* geomData;
-	ProSurfacedata* surfaceData;
-	err = ProSurfaceDataGet(selectedSurf, &geomData);
+	err = ProSurfaceXyzdataEval(face.Surface, uvEnd, endPoint, deriv1, deriv2, normal);
 	if (err != PRO_TK_NO_ERROR) {
-		ProSelectionarrayFree(sels);
-		return err;
+		LEO_WARN(Geometry, "Failed to evaluate end point for hole depth");
+		return;
 	}
 
-	ProSrftype surfType = PRO_SRF_NONE;
-	ProUvParam uvMin, uvMax, Origin;
-	ProSurfaceOrient surfOrient;
-	ProSurfaceshapedata surfShape;
-	int surfId = -1;
+	// Project the vector between the ends onto the axis
+	const double* axisDir = face.Shape.cylinder.origin;
+	double delta[3];
+	for (int i = 0; i < 3; i++) {
+		delta[i] = endPoint[i] - startPoint[i];
+	}
+	face.Depth = fabs(delta[0] * axisDir[0] + delta[1] * axisDir[1] + delta[2] * axisDir[2]);
+	face.HasDepth = true;
 
-	HoleInfo holeInfo;
+	LEO_TRACE(Geometry, _T("Hole depth: %lf"), face.Depth);
+}
 
-	err = ProSurfacedataGet(geomData->data.p_surface_data, &surfType, uvMin, uvMax, &surfOrient, &surfShape, &surfId);
-	if (err != PRO_TK_NO_ERROR) {
-		ProSelectionarrayFree(sels);
-		return err;
-	}
+// Radius, diameter and perimeter of a cylinder; "0.0" for other surfaces
+static void FillCylinder(const FaceAnalysis& face, MeasurementData* measureData)
+{
+	CString radiusMsg = _T("0.0");
+	CString diameterMsg = _T("0.0");
+	CString perimeterMsg = _T("0.0");
 
-	// Check if surface type supports area calculation
-	double area = 0.0;
-	err = ProSurfaceAreaEval(selectedSurf, &area);
+	double radius = face.SurfType == PRO_SRF_CYL ? face.Shape.cylinder.radius : 0.0;
+	if (radius > 0.0) {
+		radiusMsg.Format(_T("%lf"), radius);
+		diameterMsg.Format(_T("%lf"), radius * 2.0);
+		perimeterMsg.Format(_T("%lf"), 2.0 * M_PI * radius);
 
-	// Final area log with enhanced information
-	CString areaMsg;
-	areaMsg.Format(_T("%lf"), area);
-	LogFileWriter::WriteLog((const char*)CT2A(_T("Final Surface Area Result: " + areaMsg)));
+		LEO_TRACE(Geometry, _T("Cylindrical surface radius: %s"), (LPCTSTR)radiusMsg);
+		LEO_TRACE(Geometry, _T("Cylindrical surface diameter: %s"), (LPCTSTR)diameterMsg);
+		LEO_TRACE(Geometry, _T("Cylindrical surface perimeter: %s"), (LPCTSTR)perimeterMsg);
+	}
 
-	measureData->Area = areaMsg;
+	measureData->Perimeter = perimeterMsg;
+	measureData->Radius = radiusMsg;
+	measureData->Diameter = diameterMsg;
+}
 
-	// Test section: Determine if the selected surface is a hole
-	bool isHole = false;
-	CString holeDetectionLog;
-	
-	LogFileWriter::WriteLog("Starting hole detection analysis...");
-	
-	// Method 1: Check if surface is cylindrical and oriented inward
-	if (surfType == PRO_SRF_CYL) {
-		LogFileWriter::WriteLog("Surface is cylindrical - checking orientation for hole detection");
-		
-		// Check surface orientation - holes typically have inward-facing normals
-		if (surfOrient == PRO_SURF_ORIENT_IN) {
-			isHole = true;
+// Holes are cylinders whose normals point inward. Decided during the queries because the
+// hole info query only runs for holes.
+static void QueryHole(FaceAnalysis& face)
+{
+	face.IsHole = face.SurfType == PRO_SRF_CYL && face.Orient == PRO_SURF_ORIENT_IN;
+}
 
-			holeDetectionLog = _T("Detected as HOLE: Cylindrical surface with inward orientation");
-			LogFileWriter::WriteLog((const char*)CT2A(holeDetectionLog));
+static void FillHole(const FaceAnalysis& face, MeasurementData* measureData)
+{
+	if (face.SurfType == PRO_SRF_CYL) {
+		if (face.IsHole) {
+			LEO_TRACE(Geometry, _T("Detected as HOLE: Cylindrical surface with inward orientation"));
 		} else {
-			holeDetectionLog = _T("Cylindrical surface but outward orientation - likely external cylinder");
-			LogFileWriter::WriteLog((const char*)CT2A(holeDetectionLog));
+			LEO_TRACE(Geometry, _T("Cylindrical surface but outward orientation - likely external cylinder"));
 		}
 	}
-	
-	// Method 2: Get surface geometry information (click location, normal vector, center point)
-	ProVector xyz_point, normal;
-	ProVector deriv1[2], deriv2[3];
-	
-	// Evaluate surface normal at the selection point (click location)
-	ProError normalErr = ProSurfaceXyzdataEval(selectedSurf, paramAtselection, xyz_point, deriv1, deriv2, normal);
-	
-	if (normalErr == PRO_TK_NO_ERROR) {
-		// Store click location (Point3D where user clicked)
-		CString xStr, yStr, zStr;
-		xStr.Format(_T("%lf"), xyz_point[0]);
-		yStr.Format(_T("%lf"), xyz_point[1]);
-		zStr.Format(_T("%lf"), xyz_point[2]);
-		measureData->ClickLocation = Point3D(xStr, yStr, zStr);
-		
-		CString clickLog;
-		clickLog.Format(_T("Click location (Point3D): [%lf, %lf, %lf]"), xyz_point[0], xyz_point[1], xyz_point[2]);
-		LogFileWriter::WriteLog((const char*)CT2A(clickLog));
-		
-		// Store normal vector (outward normal to the surface)
-		CString normalMsg;
-		normalMsg.Format(_T("%lf, %lf, %lf"), normal[0], normal[1], normal[2]);
-		measureData->Normal = normalMsg;
-		
-		CString normalLog;
-		normalLog.Format(_T("Surface normal vector: %s"), (LPCTSTR)normalMsg);
-		LogFileWriter::WriteLog((const char*)CT2A(normalLog));
-	}
-	
-	// Get surface center point for cylindrical surfaces
-	if (surfType == PRO_SRF_CYL) {
-		// For cylindrical surfaces, get the axis origin as center point
-		ProVector axisOrigin = {surfShape.cylinder.origin[0], surfShape.cylinder.origin[1], surfShape.cylinder.origin[2]};
-		
-		// Store center point (axis origin for cylinder) as Point3D
-		CString centerXStr, centerYStr, centerZStr;
-		centerXStr.Format(_T("%lf"), axisOrigin[0]);
-		centerYStr.Format(_T("%lf"), axisOrigin[1]);
-		centerZStr.Format(_T("%lf"), axisOrigin[2]);
-		measureData->CenterPoint = Point3D(centerXStr, centerYStr, centerZStr);
-		
-		CString centerLog;
-		centerLog.Format(_T("Surface center point (Point3D): [%lf, %lf, %lf]"), axisOrigin[0], axisOrigin[1], axisOrigin[2]);
-		LogFileWriter::WriteLog((const char*)CT2A(centerLog));
-	} else {
-		// For non-cylindrical surfaces, use the click location as center point
-		if (normalErr == PRO_TK_NO_ERROR) {
-			// Use the same Point3D as click location for center point
-			measureData->CenterPoint = measureData->ClickLocation;
-			
-			CString centerLog;
-			centerLog.Format(_T("Surface center point (using click location): [%lf, %lf, %lf]"), xyz_point[0], xyz_point[1], xyz_point[2]);
-			LogFileWriter::WriteLog((const char*)CT2A(centerLog));
-		}
+
+	measureData->IsHole = face.IsHole;
+	LEO_DEBUG(Geometry, _T("Final hole detection result: %s"), face.IsHole ? _T("TRUE - This is a HOLE") : _T("FALSE - This is NOT a hole"));
+}
+
+static void QueryHoleInfo(FaceAnalysis& face)
+{
+	if (!face.IsHole) {
+		return;
 	}
-	
-	// Method 3: Check if surface is part of a hole feature
-	if (isHole) {
-		ProFeature parentFeature;
-		ProError featErr = ProGeomitemFeatureGet(&selectedItem, &parentFeature);
-		
-		// Log the feature retrieval result
-		CString featErrMsg;
-		featErrMsg.Format(_T("ProGeomitemFeatureGet returned: %d"), featErr);
-		LogFileWriter::WriteLog((const char*)CT2A(featErrMsg));
-		
-		if (featErr == PRO_TK_NO_ERROR) {
-			LogFileWriter::WriteLog("Successfully retrieved parent feature - checking feature type");
-			
-			ProFeattype featType;
-			ProError typeErr = ProFeatureTypeGet(&parentFeature, &featType);
-			
-			if (typeErr == PRO_TK_NO_ERROR) {
-				CString featTypeMsg;
-				featTypeMsg.Format(_T("Parent feature type: %d"), featType); 
-				LogFileWriter::WriteLog((const char*)CT2A(featTypeMsg));
-				
-				// Check if parent feature is a hole-type feature
-				if (featType == PRO_FEAT_HOLE || featType == PRO_FEAT_SHAFT) {
-					isHole = true;
-					holeDetectionLog = _T("Detected as HOLE: Surface belongs to hole/shaft feature");
-					LogFileWriter::WriteLog((const char*)CT2A(holeDetectionLog));
-					
-					// Extract detailed hole information directly from the selected surface
-					ExtractHoleInfoFromSurface(&selectedItem, holeInfo);
-				} else {
-					CString nonHoleMsg;
-					nonHoleMsg.Format(_T("Parent feature is not a hole type (type: %d)"), featType);
-					LogFileWriter::WriteLog((const char*)CT2A(nonHoleMsg));
-				}
+
+	ProFeature parentFeature;
+	ProError featErr = ProGeomitemFeatureGet(&face.Item, &parentFeature);
+
+	LEO_TRACE(Geometry, _T("ProGeomitemFeatureGet returned: %d"), featErr);
+
+	if (featErr == PRO_TK_NO_ERROR) {
+		ProFeattype featType;
+		ProError typeErr = ProFeatureTypeGet(&parentFeature, &featType);
+
+		if (typeErr == PRO_TK_NO_ERROR) {
+			LEO_TRACE(Geometry, _T("Parent feature type: %d"), featType);
+
+			if (featType == PRO_FEAT_HOLE || featType == PRO_FEAT_SHAFT) {
+				face.IsHoleFeature = true;
+				LEO_TRACE(Geometry, _T("Detected as HOLE: Surface belongs to hole/shaft feature"));
 			} else {
-				CString typeErrMsg;
-				typeErrMsg.Format(_T("Failed to get feature type, error: %d"), typeErr);
-				LogFileWriter::WriteLog((const char*)CT2A(typeErrMsg));
+				LEO_TRACE(Geometry, _T("Parent feature is not a hole type (type: %d)"), featType);
 			}
-		} else if (featErr == PRO_TK_BAD_INPUTS) {
-			LogFileWriter::WriteLog("ProGeomitemFeatureGet returned PRO_TK_BAD_INPUTS - surface may not have a parent feature");
 		} else {
-			CString featErrMsg;
-			featErrMsg.Format(_T("ProGeomitemFeatureGet failed with error: %d"), featErr);
-			LogFileWriter::WriteLog((const char*)CT2A(featErrMsg));
-		}
-	}
-	CString radiusMsg = _T("0.0");
-	CString diameterMsg = _T("0.0");
-	CString perimeterMsg = _T("0.0");
-
-	// Method 4: Geometric analysis for hole detection
-	if (surfType == PRO_SRF_CYL) {
-		// For cylindrical surfaces, check if it's enclosed (typical of holes)
-		double radius = surfShape.cylinder.radius;
-
-		if (radius > 0.0) {
-			radiusMsg.Format(_T("%lf"), radius);
-			diameterMsg.Format(_T("%lf"), radius * 2.0);
-			perimeterMsg.Format(_T("%lf"), 2.0 * M_PI * radius);
-
-			LogFileWriter::WriteLog((const char*)CT2A(_T("Cylindrical surface radius: " + radiusMsg)));
-			LogFileWriter::WriteLog((const char*)CT2A(_T("Cylindrical surface diameter: " + diameterMsg)));
-			LogFileWriter::WriteLog((const char*)CT2A(_T("Cylindrical surface perimeter: " + perimeterMsg)));
-
-			// Additional heuristic: small cylindrical surfaces with inward orientation are likely holes
-			if (radius < 50.0 && surfOrient == PRO_SURF_ORIENT_IN) { // Assuming units are mm
-				isHole = true;
-				holeDetectionLog = _T("Detected as HOLE: Small cylindrical surface with inward orientation");
-				LogFileWriter::WriteLog((const char*)CT2A(holeDetectionLog));
-			}
+			LEO_WARN(Geometry, _T("Failed to get feature type, error: %d"), typeErr);
 		}
+	} else if (featErr == PRO_TK_BAD_INPUTS) {
+		LEO_TRACE(Geometry, "ProGeomitemFeatureGet returned PRO_TK_BAD_INPUTS - surface may not have a parent feature");
+	} else {
+		LEO_WARN(Geometry, _T("ProGeomitemFeatureGet failed with error: %d"), featErr);
 	}
+}
 
-	// Calculate hole depth
-	double depth = 0.0;
-	ProVector startPoint, endPoint;
-	ProUvParam uvStart = { uvMin[0], uvMin[1] }; // Start of cylinder along axis
-	ProUvParam uvEnd = { uvMax[0], uvMax[1] };   // End of cylinder along axis
-
-	// Evaluate points at the UV bounds
-	err = ProSurfaceXyzdataEval(selectedSurf, uvStart, startPoint, deriv1, deriv2, normal);
-	if (err != PRO_TK_NO_ERROR) {
-		LogFileWriter::WriteLog("Failed to evaluate start point for hole depth");
+// Hole details, set only for a hole. Thread and type guesses are made when the surface belongs
+// to a hole or shaft feature; diameter and depth always come from the cylinder.
+static void FillHoleInfo(const FaceAnalysis& face, MeasurementData* measureData)
+{
+	if (!face.IsHole) {
+		return;
 	}
-	else {
-		err = ProSurfaceXyzdataEval(selectedSurf, uvEnd, endPoint, deriv1, deriv2, normal);
-		if (err != PRO_TK_NO_ERROR) {
-			LogFileWriter::WriteLog("Failed to evaluate end point for hole depth");
-		}
-		else {
-			// Compute depth as the distance along the cylinder axis
-			ProVector axisDir = { surfShape.cylinder.origin[0], surfShape.cylinder.origin[1], surfShape.cylinder.origin[2] };
-			double delta[3];
-			for (int i = 0; i < 3; i++) {
-				delta[i] = endPoint[i] - startPoint[i];
-			}
-			// Project the vector onto the axis direction
-			depth = fabs(delta[0] * axisDir[0] + delta[1] * axisDir[1] + delta[2] * axisDir[2]);
 
-			CString depthMsg;
-			depthMsg.Format(_T("%lf"), depth);
-			holeInfo.HoleDepth = depthMsg;
-			LogFileWriter::WriteLog((const char*)CT2A(_T("Hole depth: " + depthMsg)));
-		}
+	HoleInfo holeInfo;
+	if (face.IsHoleFeature) {
+		GuessHoleInfo(face.SurfType, face.Shape.cylinder.radius * 2.0, face.HasArea ? face.Area : -1.0, holeInfo);
 	}
-
-	// Store radius and diameter in measurement data
-	measureData->Perimeter = perimeterMsg;
-	measureData->Radius = radiusMsg;
-	measureData->Diameter = diameterMsg;
-
-	holeInfo.HoleDiameter = diameterMsg;
-
-	// Set hole detection result in measurement data
-	measureData->IsHole = isHole;
-	if (isHole == true) {
-		measureData->HoleInfo = holeInfo; // Only set hole info if it's a hole
+	if (face.HasDepth) {
+		holeInfo.HoleDepth.Format(_T("%lf"), face.Depth);
 	}
+	holeInfo.HoleDiameter = measureData->Diameter;
+	measureData->HoleInfo = holeInfo;
+}
 
-	// Log final hole detection result
-	CString finalHoleMsg;
-	finalHoleMsg.Format(_T("Final hole detection result: %s"), isHole ? _T("TRUE - This is a HOLE") : _T("FALSE - This is NOT a hole"));
-	LogFileWriter::WriteLog((const char*)CT2A(finalHoleMsg));
-
-	// Set surface type information
+static void FillSurfaceType(const FaceAnalysis& face, MeasurementData* measureData)
+{
 	CString surfaceTypeMsg;
-	switch (surfType) {
+	switch (face.SurfType) {
 	case PRO_SRF_PLANE:
 		surfaceTypeMsg = _T("Plane");
 		break;
@@ -377,395 +286,328 @@ int LeoHelper::GetCurrentFaceSelection(MeasurementData *measureData)
 	}
 	measureData->SurfaceType = surfaceTypeMsg;
 
-	CString surfTypeLog;
-	surfTypeLog.Format(_T("Surface type: %s"), (LPCTSTR)surfaceTypeMsg);
-	LogFileWriter::WriteLog(CT2A(surfTypeLog));
+	LEO_DEBUG(Geometry, _T("Surface type: %s"), (LPCTSTR)surfaceTypeMsg);
+}
+
+// The registered analyzers, each listed after the ones it needs so one pass in this order
+// always has their results ready
+static const FaceAnalyzerEntry s_faceAnalyzers[] = {
+	{ FACE_ANALYZE_AREA, 0, "Face area", QueryArea, FillArea },
+	{ FACE_ANALYZE_CLICK_POINT, 0, "Face click point", QueryClickPoint, FillClickPoint },
+	{ FACE_ANALYZE_CYLINDER, 0, "Face cylinder", QueryCylinder, FillCylinder },
+	{ FACE_ANALYZE_HOLE, 0, "Face hole detection", QueryHole, FillHole },
+	{ FACE_ANALYZE_HOLE_INFO, FACE_ANALYZE_HOLE | FACE_ANALYZE_CYLINDER | FACE_ANALYZE_AREA, "Face hole info", QueryHoleInfo, FillHoleInfo },
+	{ FACE_ANALYZE_SURFACE_TYPE, 0, "Face surface type", NULL, FillSurfaceType },
+};
+
+static_assert(_countof(s_faceAnalyzers) == FACE_ANALYZER_COUNT, "Every FaceAnalyzer needs an entry");
+
+// Adds what the requested analyzers need; walking the table backwards picks up needs of needs
+static unsigned ResolveFaceAnalyzers(unsigned analyzers)
+{
+	for (int i = _countof(s_faceAnalyzers) - 1; i >= 0; i--) {
+		if (analyzers & s_faceAnalyzers[i].Id) {
+			analyzers |= s_faceAnalyzers[i].Needs;
+		}
+	}
+	return analyzers;
+}
+
+// The selected surface and the data every analyzer starts from
+static ProError ReadFace(ProSelection selection, FaceAnalysis& face)
+{
+	ProError err;
+
+	err = ProSelectionModelitemGet(selection, &face.Item);
+	if (err != PRO_TK_NO_ERROR) return err;
+
+	err = ProSelectionUvParamGet(selection, face.ClickParam);
+	if (err != PRO_TK_NO_ERROR) return err;
+
+	err = ProGeomitemToSurface(&face.Item, &face.Surface);
+	if (err != PRO_TK_NO_ERROR) return err;
+
+	ProGeomitemdata* geomData;
+	err = ProSurfaceDataGet(face.Surface, &geomData);
+	if (err != PRO_TK_NO_ERROR) return err;
+
+	int surfId = -1;
+	face.SurfType = PRO_SRF_NONE;
+	err = ProSurfacedataGet(geomData->data.p_surface_data, &face.SurfType, face.UvMin, face.UvMax, &face.Orient, &face.Shape, &surfId);
+	ProGeomitemdataFree(&geomData);
+	return err;
+}
 
-	// Reset error status - area calculation failure shouldn't prevent model type return
-	LogFileWriter::WriteLog("Resetting error status for model type determination");
-	ProSelectionarrayFree(sels);
+// Faces and quilts among the first count selections, up to maxFaces of them
+static void CollectFaceSelections(ProSelection* sels, int count, int maxFaces, std::vector<ProSelection>& faces)
+{
+	for (int i = 0; i < count && static_cast<int>(faces.size()) < maxFaces; i++) {
+		ProGeomitem selectedItem;
+		if (ProSelectionModelitemGet(sels[i], &selectedItem) == PRO_TK_NO_ERROR) {
+			LEO_TRACE(Geometry, _T("Selected Item type is %d"), selectedItem.type);
+			if (selectedItem.type == PRO_SURFACE || selectedItem.type == PRO_QUILT) {
+				faces.push_back(sels[i]);
+			}
+		}
+	}
+}
 
-	err = PRO_TK_NO_ERROR;
-	if (mDltype == PRO_PART) {
-		LogFileWriter::WriteLog("The current model is a PART");
+// PRO_PART, PRO_SURFACE or PRO_ASSEMBLY for those models, 0 for any other
+static int ModelTypeResult(ProMdlType mdlType)
+{
+	if (mdlType == PRO_PART) {
+		LEO_DEBUG(Geometry, "The current model is a PART");
 		return PRO_PART;
 	}
 
-	if (mDltype == PRO_SURFACE) {
-		LogFileWriter::WriteLog("The current model is SURFACE");
+	if (mdlType == PRO_SURFACE) {
+		LEO_DEBUG(Geometry, "The current model is SURFACE");
 		return PRO_SURFACE;
 	}
 
-	if (mDltype == PRO_ASSEMBLY) {
-		LogFileWriter::WriteLog("The current model is ASSEMBLY");
+	if (mdlType == PRO_ASSEMBLY) {
+		LEO_DEBUG(Geometry, "The current model is ASSEMBLY");
 		return PRO_ASSEMBLY;
 	}
-	// Return the model type
-	return err;
+	return 0;
 }
 
-int LeoHelper::IsFaceSelected(MeasurementData *measureData)
+LeoHelper::LeoHelper()
+	: m_workerPool(NULL)
 {
-	// First try to get current face selection without prompting user
-	int result = GetCurrentFaceSelection(measureData);
-	if (result == PRO_TK_NO_ERROR || result == PRO_PART || result == PRO_SURFACE || result == PRO_ASSEMBLY) {
-		LogFileWriter::WriteLog("Successfully processed current face selection without prompting user");
-		return result;
-	}
+}
 
-	// If no current selection, fall back to prompting user
-	LogFileWriter::WriteLog("No current face selection found, prompting user to select face");
-	
-	ProError err;
-	ProMdl currMdl;
+LeoHelper::~LeoHelper()
+{
+}
 
-	err = ProMdlCurrentGet(&currMdl);
-	if (err != PRO_TK_NO_ERROR) return err;
+void LeoHelper::GetFaceDataAction() {
 
-	ProMdlType mDltype = PRO_MDL_UNUSED;
-	err = ProMdlTypeGet(currMdl, &mDltype);
+}
 
-	int nSels;
-	ProSelection *sels;
-	err = ProSelect("datum,surface,sldface,qltface,csys", 1, NULL, NULL, NULL, NULL, &sels, &nSels);
+void LeoHelper::SetWorkerPool(LeoWorkerPool* pool)
+{
+	m_workerPool = pool;
+}
 
-	CString nSelsMsg;
-	nSelsMsg.Format(_T("Selected %d Objects"), nSels);
-	LogFileWriter::WriteLog((const char*)CT2A(nSelsMsg));
-		
-	if (err != PRO_TK_NO_ERROR || nSels <= 0 || sels == NULL) {
-		return err; // or appropriate error code
+int LeoHelper::AnalyzeFace(ProSelection selection, MeasurementData* measureData, unsigned analyzers)
+{
+	std::vector<MeasurementData> faces;
+	int err = AnalyzeFaces(std::vector<ProSelection>(1, selection), faces, analyzers);
+	if (err == PRO_TK_NO_ERROR) {
+		*measureData = faces[0];
 	}
+	return err;
+}
 
-	// Now safe to use sels[0]
-	ProSelection* sel = &sels[0];
+int LeoHelper::AnalyzeFaces(const std::vector<ProSelection>& selections, std::vector<MeasurementData>& faces, unsigned analyzers)
+{
+	LEO_SPAN(Geometry, "LeoHelper::AnalyzeFaces");
+	unsigned wanted = ResolveFaceAnalyzers(analyzers);
+	LEO_TRACE(Geometry, _T("Face analyzers requested 0x%x, running 0x%x"), analyzers, wanted);
+
+	// Per-analyzer times for one summary line; the counter is only read when it is logged
+	bool timed = LEO_LOG_COMPILED_LEVEL <= LEO_LOG_LEVEL_DEBUG && LogFileWriter::IsEnabled(LEO_LOG_LEVEL_DEBUG, LogCategory::Geometry);
+
+	// Pro/TOOLKIT only works on this thread, so every query runs here, one face after another
+	std::vector<FaceAnalysis> analyses;
+	analyses.reserve(selections.size());
+	ProError err = PRO_TK_E_NOT_FOUND;
+	for (size_t i = 0; i < selections.size(); i++) {
+		FaceAnalysis face = {};
+		err = ReadFace(selections[i], face);
+		if (err != PRO_TK_NO_ERROR) {
+			LEO_WARN(Geometry, _T("Skipping selected face %d, error %d"), static_cast<int>(i), err);
+			continue;
+		}
 
-	ProGeomitem selectedItem;
-	err = ProSelectionModelitemGet(*sel, &selectedItem);
-	if (err != PRO_TK_NO_ERROR) return err;
+		for (int a = 0; a < FACE_ANALYZER_COUNT; a++) {
+			const FaceAnalyzerEntry& analyzer = s_faceAnalyzers[a];
+			if ((wanted & analyzer.Id) == 0 || analyzer.Query == NULL) {
+				continue;
+			}
+			LARGE_INTEGER start, end;
+			if (timed) {
+				QueryPerformanceCounter(&start);
+			}
+			{
+				LEO_SPAN(Geometry, analyzer.Name);
+				analyzer.Query(face);
+			}
+			if (timed) {
+				QueryPerformanceCounter(&end);
+				face.Ticks[a] += end.QuadPart - start.QuadPart;
+			}
+		}
+		analyses.push_back(face);
+	}
 
-	ProUvParam paramAtselection;
-	err = ProSelectionUvParamGet(*sel, paramAtselection);
-	if (err != PRO_TK_NO_ERROR) return err;
+	if (analyses.empty()) {
+		return err;
+	}
 
-	ProSurface selectedSurf;
-	err = ProGeomitemToSurface(&selectedItem, &selectedSurf);
-	if (err != PRO_TK_NO_ERROR) return err;
+	// Filling in only formats what the queries read, so the faces are spread over the pool
+	size_t first = faces.size();
+	faces.resize(first + analyses.size());
+	auto fill = [&](size_t i) {
+		FaceAnalysis& face = analyses[i];
+		for (int a = 0; a < FACE_ANALYZER_COUNT; a++) {
+			const FaceAnalyzerEntry& analyzer = s_faceAnalyzers[a];
+			if ((wanted & analyzer.Id) == 0) {
+				continue;
+			}
+			LARGE_INTEGER start, end;
+			if (timed) {
+				QueryPerformanceCounter(&start);
+			}
+			{
+				LEO_SPAN(Geometry, analyzer.Name);
+				analyzer.Fill(face, &faces[first + i]);
+			}
+			if (timed) {
+				QueryPerformanceCounter(&end);
+				face.Ticks[a] += end.QuadPart - start.QuadPart;
+			}
+		}
+	};
+	if (m_workerPool != NULL) {
+		m_workerPool->ParallelFor(analyses.size(), fill);
+	} else {
+		for (size_t i = 0; i < analyses.size(); i++) {
+			fill(i);
+		}
+	}
 
-	ProGeomitemdata* geomData;
-	ProSurfacedata* surfaceData;
-	err = ProSurfaceDataGet(selectedSurf, &geomData);
-	if (err != PRO_TK_NO_ERROR) return err;
+	if (timed) {
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		CString timings;
+		for (int a = 0; a < FACE_ANALYZER_COUNT; a++) {
+			if ((wanted & s_faceAnalyzers[a].Id) == 0) {
+				continue;
+			}
+			LONGLONG ticks = 0;
+			for (const FaceAnalysis& face : analyses) {
+				ticks += face.Ticks[a];
+			}
+			timings.AppendFormat(_T("%s%s %.3f ms"), timings.IsEmpty() ? _T("") : _T(", "), (LPCTSTR)CString(s_faceAnalyzers[a].Name),
+				ticks * 1000.0 / frequency.QuadPart);
+		}
+		LEO_DEBUG(Geometry, _T("Face analysis of %d face(s): %s"), static_cast<int>(analyses.size()), (LPCTSTR)timings);
+	}
 
-	ProSrftype surfType = PRO_SRF_NONE;
-	ProUvParam uvMin, uvMax, Origin;
-	ProSurfaceOrient surfOrient;
-	ProSurfaceshapedata surfShape;
-	int surfId = -1;
+	return PRO_TK_NO_ERROR;
+}
 
-	HoleInfo holeInfo;
+int LeoHelper::AnalyzeSelectedFaces(std::vector<MeasurementData>& faces, int maxFaces, bool prompt, unsigned analyzers)
+{
+	LEO_SPAN(Geometry, "LeoHelper::AnalyzeSelectedFaces");
+	ProError err;
+	ProMdl currMdl;
+
+	faces.clear();
 
-	err = ProSurfacedataGet(geomData->data.p_surface_data, &surfType, uvMin, uvMax, &surfOrient, &surfShape, &surfId);
+	err = ProMdlCurrentGet(&currMdl);
 	if (err != PRO_TK_NO_ERROR) return err;
 
-	// Check if surface type supports area calculation
-	double area = 0.0;
-	err = ProSurfaceAreaEval(selectedSurf, &area);
+	ProMdlType mDltype = PRO_MDL_UNUSED;
+	err = ProMdlTypeGet(currMdl, &mDltype);
 
-	// Final area log with enhanced information
-	CString areaMsg;
-	areaMsg.Format(_T("%lf"), area);
-	LogFileWriter::WriteLog((const char*)CT2A(_T("Final Surface Area Result: " + areaMsg)));
+	// Get current selections from selection buffer without prompting user
+	ProSelection *sels;
+	err = ProSelbufferSelectionsGet(&sels);
 
-	measureData->Area = areaMsg;
+	if (err != PRO_TK_NO_ERROR) {
+		LEO_WARN(Geometry, "Failed to get current selections from buffer");
+	} else {
+		int nSels = 0;
+		ProArraySizeGet((ProArray)sels, &nSels);
 
-	// Test section: Determine if the selected surface is a hole
-	bool isHole = false;
-	CString holeDetectionLog;
-	
-	LogFileWriter::WriteLog("Starting hole detection analysis...");
-	
-	// Method 1: Check if surface is cylindrical and oriented inward
-	if (surfType == PRO_SRF_CYL) {
-		LogFileWriter::WriteLog("Surface is cylindrical - checking orientation for hole detection");
-		
-		// Check surface orientation - holes typically have inward-facing normals
-		if (surfOrient == PRO_SURF_ORIENT_IN) {
-			isHole = true;
+		LEO_DEBUG(Geometry, _T("Found %d objects in current selection buffer"), nSels);
 
-			holeDetectionLog = _T("Detected as HOLE: Cylindrical surface with inward orientation");
-			LogFileWriter::WriteLog((const char*)CT2A(holeDetectionLog));
+		std::vector<ProSelection> faceSels;
+		if (nSels <= 0 || sels == NULL) {
+			LEO_INFO(Geometry, "No objects currently selected");
+			err = PRO_TK_E_NOT_FOUND;
 		} else {
-			holeDetectionLog = _T("Cylindrical surface but outward orientation - likely external cylinder");
-			LogFileWriter::WriteLog((const char*)CT2A(holeDetectionLog));
-		}
-	}
-	
-	// Method 2: Get surface geometry information (click location, normal vector, center point)
-	ProVector xyz_point, normal;
-	ProVector deriv1[2], deriv2[3];
-	
-	// Evaluate surface normal at the selection point (click location)
-	ProError normalErr = ProSurfaceXyzdataEval(selectedSurf, paramAtselection, xyz_point, deriv1, deriv2, normal);
-	
-	if (normalErr == PRO_TK_NO_ERROR) {
-		// Store click location (Point3D where user clicked)
-		CString xStr, yStr, zStr;
-		xStr.Format(_T("%lf"), xyz_point[0]);
-		yStr.Format(_T("%lf"), xyz_point[1]);
-		zStr.Format(_T("%lf"), xyz_point[2]);
-		measureData->ClickLocation = Point3D(xStr, yStr, zStr);
-		
-		CString clickLog;
-		clickLog.Format(_T("Click location (Point3D): [%lf, %lf, %lf]"), xyz_point[0], xyz_point[1], xyz_point[2]);
-		LogFileWriter::WriteLog((const char*)CT2A(clickLog));
-		
-		// Store normal vector (outward normal to the surface)
-		CString normalMsg;
-		normalMsg.Format(_T("%lf, %lf, %lf"), normal[0], normal[1], normal[2]);
-		measureData->Normal = normalMsg;
-		
-		CString normalLog;
-		normalLog.Format(_T("Surface normal vector: %s"), (LPCTSTR)normalMsg);
-		LogFileWriter::WriteLog((const char*)CT2A(normalLog));
-	}
-	
-	// Get surface center point for cylindrical surfaces
-	if (surfType == PRO_SRF_CYL) {
-		// For cylindrical surfaces, get the axis origin as center point
-		ProVector axisOrigin = {surfShape.cylinder.origin[0], surfShape.cylinder.origin[1], surfShape.cylinder.origin[2]};
-		
-		// Store center point (axis origin for cylinder) as Point3D
-		CString centerXStr, centerYStr, centerZStr;
-		centerXStr.Format(_T("%lf"), axisOrigin[0]);
-		centerYStr.Format(_T("%lf"), axisOrigin[1]);
-		centerZStr.Format(_T("%lf"), axisOrigin[2]);
-		measureData->CenterPoint = Point3D(centerXStr, centerYStr, centerZStr);
-		
-		CString centerLog;
-		centerLog.Format(_T("Surface center point (Point3D): [%lf, %lf, %lf]"), axisOrigin[0], axisOrigin[1], axisOrigin[2]);
-		LogFileWriter::WriteLog((const char*)CT2A(centerLog));
-	} else {
-		// For non-cylindrical surfaces, use the click location as center point
-		if (normalErr == PRO_TK_NO_ERROR) {
-			// Use the same Point3D as click location for center point
-			measureData->CenterPoint = measureData->ClickLocation;
-			
-			CString centerLog;
-			centerLog.Format(_T("Surface center point (using click location): [%lf, %lf, %lf]"), xyz_point[0], xyz_point[1], xyz_point[2]);
-			LogFileWriter::WriteLog((const char*)CT2A(centerLog));
-		}
-	}
-	
-	// Method 3: Check if surface is part of a hole feature
-	if (isHole) {
-		ProFeature parentFeature;
-		ProError featErr = ProGeomitemFeatureGet(&selectedItem, &parentFeature);
-		
-		// Log the feature retrieval result
-		CString featErrMsg;
-		featErrMsg.Format(_T("ProGeomitemFeatureGet returned: %d"), featErr);
-		LogFileWriter::WriteLog((const char*)CT2A(featErrMsg));
-		
-		if (featErr == PRO_TK_NO_ERROR) {
-			LogFileWriter::WriteLog("Successfully retrieved parent feature - checking feature type");
-			
-			ProFeattype featType;
-			ProError typeErr = ProFeatureTypeGet(&parentFeature, &featType);
-			
-			if (typeErr == PRO_TK_NO_ERROR) {
-				CString featTypeMsg;
-				featTypeMsg.Format(_T("Parent feature type: %d"), featType); 
-				LogFileWriter::WriteLog((const char*)CT2A(featTypeMsg));
-				
-				// Check if parent feature is a hole-type feature
-				if (featType == PRO_FEAT_HOLE || featType == PRO_FEAT_SHAFT) {
-					isHole = true;
-					holeDetectionLog = _T("Detected as HOLE: Surface belongs to hole/shaft feature");
-					LogFileWriter::WriteLog((const char*)CT2A(holeDetectionLog));
-					
-					// Extract detailed hole information directly from the selected surface
-					ExtractHoleInfoFromSurface(&selectedItem, holeInfo);
-				} else {
-					CString nonHoleMsg;
-					nonHoleMsg.Format(_T("Parent feature is not a hole type (type: %d)"), featType);
-					LogFileWriter::WriteLog((const char*)CT2A(nonHoleMsg));
-				}
+			CollectFaceSelections(sels, nSels, maxFaces, faceSels);
+			if (faceSels.empty()) {
+				LEO_INFO(Geometry, "No face-type objects found in current selections");
+				err = PRO_TK_E_NOT_FOUND;
 			} else {
-				CString typeErrMsg;
-				typeErrMsg.Format(_T("Failed to get feature type, error: %d"), typeErr);
-				LogFileWriter::WriteLog((const char*)CT2A(typeErrMsg));
+				err = (ProError)AnalyzeFaces(faceSels, faces, analyzers);
 			}
-		} else if (featErr == PRO_TK_BAD_INPUTS) {
-			LogFileWriter::WriteLog("ProGeomitemFeatureGet returned PRO_TK_BAD_INPUTS - surface may not have a parent feature");
-		} else {
-			CString featErrMsg;
-			featErrMsg.Format(_T("ProGeomitemFeatureGet failed with error: %d"), featErr);
-			LogFileWriter::WriteLog((const char*)CT2A(featErrMsg));
 		}
-	}
-	
-	CString radiusMsg = _T("0.0");
-	CString diameterMsg = _T("0.0");
-	CString perimeterMsg = _T("0.0");
+		ProSelectionarrayFree(sels);
 
-	// Method 4: Geometric analysis for hole detection
-	if (surfType == PRO_SRF_CYL) {
-		// For cylindrical surfaces, check if it's enclosed (typical of holes)
-		double radius = surfShape.cylinder.radius;
-
-		if (radius > 0.0) {
-			radiusMsg.Format(_T("%lf"), radius);
-			diameterMsg.Format(_T("%lf"), radius * 2.0);
-			perimeterMsg.Format(_T("%lf"), 2.0 * M_PI * radius);
-
-			LogFileWriter::WriteLog((const char*)CT2A(_T("Cylindrical surface radius: " + radiusMsg)));
-			LogFileWriter::WriteLog((const char*)CT2A(_T("Cylindrical surface diameter: " + diameterMsg)));
-			LogFileWriter::WriteLog((const char*)CT2A(_T("Cylindrical surface perimeter: " + perimeterMsg)));
-			
-			// Additional heuristic: small cylindrical surfaces with inward orientation are likely holes
-			if (radius < 50.0 && surfOrient == PRO_SURF_ORIENT_IN) { // Assuming units are mm
-				isHole = true;
-				holeDetectionLog = _T("Detected as HOLE: Small cylindrical surface with inward orientation");
-				LogFileWriter::WriteLog((const char*)CT2A(holeDetectionLog));
-			}
+		if (!faces.empty()) {
+			LEO_DEBUG(Geometry, _T("Processed %d face(s) from the current selection without prompting user"), static_cast<int>(faces.size()));
+			return ModelTypeResult(mDltype);
 		}
 	}
 
-	// Calculate hole depth
-	double depth = 0.0;
-	ProVector startPoint, endPoint;
-	ProUvParam uvStart = { uvMin[0], uvMin[1] }; // Start of cylinder along axis
-	ProUvParam uvEnd = { uvMax[0], uvMax[1] };   // End of cylinder along axis
-
-	// Evaluate points at the UV bounds
-	err = ProSurfaceXyzdataEval(selectedSurf, uvStart, startPoint, deriv1, deriv2, normal);
-	if (err != PRO_TK_NO_ERROR) {
-		LogFileWriter::WriteLog("Failed to evaluate start point for hole depth");
+	if (!prompt) {
+		return err;
 	}
-	else {
-		err = ProSurfaceXyzdataEval(selectedSurf, uvEnd, endPoint, deriv1, deriv2, normal);
-		if (err != PRO_TK_NO_ERROR) {
-			LogFileWriter::WriteLog("Failed to evaluate end point for hole depth");
-		}
-		else {
-			// Compute depth as the distance along the cylinder axis
-			ProVector axisDir = { surfShape.cylinder.origin[0], surfShape.cylinder.origin[1], surfShape.cylinder.origin [2]};
-			double delta[3];
-			for (int i = 0; i < 3; i++) {
-				delta[i] = endPoint[i] - startPoint[i];
-			}
-			// Project the vector onto the axis direction
-			depth = fabs(delta[0] * axisDir[0] + delta[1] * axisDir[1] + delta[2] * axisDir[2]);
 
-			CString depthMsg;
-			depthMsg.Format(_T("%lf"), depth);
-			holeInfo.HoleDepth = depthMsg;
-			LogFileWriter::WriteLog((const char*)CT2A(_T("Hole depth: " + depthMsg)));
-		}
+	// If no current selection, fall back to prompting user
+	LEO_INFO(Geometry, "No current face selection found, prompting user to select face");
+
+	int nSels = 0;
+	{
+		LEO_SPAN(Geometry, "ProSelect (waiting for the user)");
+		err = ProSelect("datum,surface,sldface,qltface,csys", maxFaces, NULL, NULL, NULL, NULL, &sels, &nSels);
 	}
 
-	// Store radius and diameter in measurement data
-	measureData->Perimeter = perimeterMsg;
-	measureData->Radius = radiusMsg;
-	measureData->Diameter = diameterMsg;
+	LEO_DEBUG(Geometry, _T("Selected %d Objects"), nSels);
 
-	holeInfo.HoleDiameter = diameterMsg;
-	
-	// Set hole detection result in measurement data
-	measureData->IsHole = isHole;
-	if ( isHole == true ) {
-		measureData->HoleInfo = holeInfo; // Only set hole info if it's a hole
+	if (err != PRO_TK_NO_ERROR || nSels <= 0 || sels == NULL) {
+		return err; // or appropriate error code
 	}
-	
-	// Log final hole detection result
-	CString finalHoleMsg;
-	finalHoleMsg.Format(_T("Final hole detection result: %s"), isHole ? _T("TRUE - This is a HOLE") : _T("FALSE - This is NOT a hole"));
-	LogFileWriter::WriteLog((const char*)CT2A(finalHoleMsg));
-	
-	// Set surface type information
-	CString surfaceTypeMsg;
-	switch (surfType) {
-		case PRO_SRF_PLANE:
-			surfaceTypeMsg = _T("Plane");
-			break;
-		case PRO_SRF_CYL:
-			surfaceTypeMsg = _T("Cylinder");
-			break;
-		case PRO_SRF_CONE:
-			surfaceTypeMsg = _T("Cone");
-			break;
-		case PRO_SRF_TORUS:
-			surfaceTypeMsg = _T("Torus");
-			break;
-		case PRO_SRF_SPL:
-			surfaceTypeMsg = _T("SPLINESR");
-			break;
-		case PRO_SRF_FIL:
-			surfaceTypeMsg = _T("FILSRF");
-			break;
-		case PRO_SRF_RUL:
-			surfaceTypeMsg = _T("RULSRF");
-			break;
-		case PRO_SRF_REV:
-			surfaceTypeMsg = _T("REV");
-			break;
-		case PRO_SRF_TABCYL:
-			surfaceTypeMsg = _T("TABCYL");
-			break;
-		case PRO_SRF_B_SPL:
-			surfaceTypeMsg = _T("B_SPL");
-			break;
-		case PRO_SRF_FOREIGN:
-			surfaceTypeMsg = _T("FOREIGN");
-			break;
-		case PRO_SRF_CYL_SPL:
-			surfaceTypeMsg = _T("CYL_SPL");
-			break;
-		case PRO_SRF_SPL2DER:
-			surfaceTypeMsg = _T("SPL2DER");
-			break;
-		default:
-			surfaceTypeMsg = _T("OTHER");
-			break;
+
+	// ProSelect owns sels; it is not freed here
+	std::vector<ProSelection> faceSels;
+	CollectFaceSelections(sels, nSels, maxFaces, faceSels);
+	if (faceSels.empty()) {
+		LEO_INFO(Geometry, "No face-type objects among the picked objects");
+		return PRO_TK_E_NOT_FOUND;
 	}
-	measureData->SurfaceType = surfaceTypeMsg;
-	
-	CString surfTypeLog;
-	surfTypeLog.Format(_T("Surface type: %s"), (LPCTSTR)surfaceTypeMsg);
-	LogFileWriter::WriteLog(CT2A(surfTypeLog));
+	err = (ProError)AnalyzeFaces(faceSels, faces, analyzers);
+	if (err != PRO_TK_NO_ERROR) return err;
 
-	// Reset error status - area calculation failure shouldn't prevent model type return
-	LogFileWriter::WriteLog("Resetting error status for model type determination");
+	return ModelTypeResult(mDltype);
+}
 
-	err = PRO_TK_NO_ERROR;
-	if (mDltype == PRO_PART) {
-		LogFileWriter::WriteLog("The current model is a PART");
-		return PRO_PART;
+int LeoHelper::GetCurrentFaceSelection(MeasurementData *measureData, unsigned analyzers)
+{
+	std::vector<MeasurementData> faces;
+	int result = AnalyzeSelectedFaces(faces, 1, false, analyzers);
+	if (!faces.empty()) {
+		*measureData = faces[0];
 	}
+	return result;
+}
 
-	if (mDltype == PRO_SURFACE) {
-		LogFileWriter::WriteLog("The current model is SURFACE");
-		return PRO_SURFACE;
-	}
-	
-	if (mDltype == PRO_ASSEMBLY) {
-		LogFileWriter::WriteLog("The current model is ASSEMBLY");
-		return PRO_ASSEMBLY;
+int LeoHelper::IsFaceSelected(MeasurementData *measureData, unsigned analyzers)
+{
+	std::vector<MeasurementData> faces;
+	int result = AnalyzeSelectedFaces(faces, 1, true, analyzers);
+	if (!faces.empty()) {
+		*measureData = faces[0];
 	}
-	return 0;
-
+	return result;
 }
 
 void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
 {
+	LEO_SPAN(Geometry, "LeoHelper::ExtractHoleInfo");
     ProError err;
     ProElement elemTree = NULL;
     
     // Extract the feature element tree
     err = ProFeatureElemtreeExtract(holeFeature, NULL, PRO_FEAT_EXTRACT_NO_OPTS, &elemTree);
     if (err != PRO_TK_NO_ERROR) {
-        LogFileWriter::WriteLog("Failed to extract hole feature element tree");
+        LEO_WARN(Geometry, "Failed to extract hole feature element tree");
         return;
     }
     
@@ -773,7 +615,7 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
     ProMdl model;
     err = ProMdlCurrentGet(&model);
     if (err != PRO_TK_NO_ERROR) {
-        LogFileWriter::WriteLog("Failed to get current model for hole info extraction");
+        LEO_WARN(Geometry, "Failed to get current model for hole info extraction");
         ProFeatureElemtreeFree(holeFeature, elemTree);
         return;
     }
@@ -784,10 +626,10 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
     if (err == PRO_TK_NO_ERROR && threadSeries != NULL) {
         holeInfo.ThreadSize = CString(threadSeries);
         ProWstringFree(threadSeries);
-        LogFileWriter::WriteLog((const char*)CT2A(_T("Thread Size: " + holeInfo.ThreadSize)));
+        LEO_DEBUG(Geometry, _T("Thread Size: %s"), (LPCTSTR)holeInfo.ThreadSize);
     } else {
         holeInfo.ThreadSize = _T("N/A");
-        LogFileWriter::WriteLog("Thread Size: Not available");
+        LEO_TRACE(Geometry, "Thread Size: Not available");
     }
     
     // Extract screw size (ThreadSize alternative)
@@ -798,7 +640,7 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
             holeInfo.ThreadSize = CString(screwSize);
         }
         ProWstringFree(screwSize);
-        LogFileWriter::WriteLog((const char*)CT2A(_T("Screw Size: " + holeInfo.ThreadSize)));
+        LEO_DEBUG(Geometry, _T("Screw Size: %s"), (LPCTSTR)holeInfo.ThreadSize);
     }
     
     // Extract hole information by traversing the element tree
@@ -813,9 +655,7 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
             currentElem = childElems[numChildren];
         }
         
-        CString numChildrenMsg;
-        numChildrenMsg.Format(_T("Number of child elements: %d"), numChildren);
-        LogFileWriter::WriteLog((const char*)CT2A(numChildrenMsg));
+        LEO_TRACE(Geometry, _T("Number of child elements: %d"), numChildren);
         
         for (int i = 0; i < numChildren; i++) {
             ProElement childElem = childElems[i];
@@ -823,9 +663,7 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
                 ProElemId elemId;
                 err = ProElementIdGet(childElem, &elemId);
                 if (err == PRO_TK_NO_ERROR) {
-                    CString elemIdMsg;
-                    elemIdMsg.Format(_T("Element ID: %d"), elemId);
-                    LogFileWriter::WriteLog((const char*)CT2A(elemIdMsg));
+                    LEO_TRACE(Geometry, _T("Element ID: %d"), elemId);
                     
                     // Check for feature form (hole type)
                     if (elemId == PRO_E_FEATURE_FORM) {
@@ -849,7 +687,7 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
                                     holeInfo.HoleType = _T("Unknown");
                                     break;
                             }
-                            LogFileWriter::WriteLog((const char*)CT2A(_T("Hole Type: " + holeInfo.HoleType)));
+                            LEO_DEBUG(Geometry, _T("Hole Type: %s"), (LPCTSTR)holeInfo.HoleType);
                         }
                     }
                     // Check for standard type
@@ -874,7 +712,7 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
                                     holeInfo.Standard = _T("Unknown");
                                     break;
                             }
-                            LogFileWriter::WriteLog((const char*)CT2A(_T("Standard: " + holeInfo.Standard)));
+                            LEO_DEBUG(Geometry, _T("Standard: %s"), (LPCTSTR)holeInfo.Standard);
                         }
                     }
                     // Check for fit type (thread class)
@@ -896,7 +734,7 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
                                     holeInfo.ThreadClass = _T("N/A");
                                     break;
                             }
-                            LogFileWriter::WriteLog((const char*)CT2A(_T("Thread Class: " + holeInfo.ThreadClass)));
+                            LEO_DEBUG(Geometry, _T("Thread Class: %s"), (LPCTSTR)holeInfo.ThreadClass);
                         }
                     }
                 }
@@ -907,16 +745,16 @@ void LeoHelper::ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo)
     	// Clean up
 	ProFeatureElemtreeFree(holeFeature, elemTree);
 }
-
 void LeoHelper::ExtractHoleInfoFromSurface(ProGeomitem* selectedItem, HoleInfo& holeInfo)
 {
+	LEO_SPAN(Geometry, "LeoHelper::ExtractHoleInfoFromSurface");
 	ProError err;
 	
 	// Convert ProGeomitem to ProSurface
 	ProSurface selectedSurf;
 	err = ProGeomitemToSurface(selectedItem, &selectedSurf);
 	if (err != PRO_TK_NO_ERROR) {
-		LogFileWriter::WriteLog("Failed to convert ProGeomitem to ProSurface");
+		LEO_WARN(Geometry, "Failed to convert ProGeomitem to ProSurface");
 		return;
 	}
 	
@@ -924,50 +762,57 @@ void LeoHelper::ExtractHoleInfoFromSurface(ProGeomitem* selectedItem, HoleInfo&
 	ProSrftype surfType;
 	err = ProSurfaceTypeGet(selectedSurf, &surfType);
 	if (err != PRO_TK_NO_ERROR) {
-		LogFileWriter::WriteLog("Failed to get surface type");
+		LEO_WARN(Geometry, "Failed to get surface type");
 		return;
 	}
 	
-	// Check if it's a cylindrical surface (typical of holes)
+	double diameter = 0.0;
+	double surfaceArea = -1.0;
 	if (surfType == PRO_SRF_CYL || surfType == PRO_SRF_TABCYL || surfType == PRO_SRF_CYL_SPL) {
 		// Get hole diameter using ProSurfaceDiameterEval
 		ProUvParam uvPoint = {0.0, 0.0}; // Use origin point for diameter evaluation
-		double diameter;
 		err = ProSurfaceDiameterEval(selectedSurf, uvPoint, &diameter);
-		if (err == PRO_TK_NO_ERROR) {
-			// Convert double to CString for HoleDiameter
+		if (err != PRO_TK_NO_ERROR) {
+			diameter = 0.0;
+			LEO_WARN(Geometry, "Failed to get hole diameter");
+		}
+		
+		// Get surface area to help estimate depth
+		err = ProSurfaceAreaEval(selectedSurf, &surfaceArea);
+		if (err != PRO_TK_NO_ERROR) {
+			surfaceArea = -1.0;
+			LEO_WARN(Geometry, "Failed to get surface area for depth estimation");
+		}
+	}
+	
+	GuessHoleInfo(surfType, diameter, surfaceArea, holeInfo);
+}
+
+// Hole type, standard and thread guesses from the surface's type and size. diameter is 0 and
+// area negative when they could not be evaluated.
+static void GuessHoleInfo(ProSrftype surfType, double diameter, double area, HoleInfo& holeInfo)
+{
+	// Check if it's a cylindrical surface (typical of holes)
+	if (surfType == PRO_SRF_CYL || surfType == PRO_SRF_TABCYL || surfType == PRO_SRF_CYL_SPL) {
+		if (diameter > 0.0) {
 			CString diameterStr;
 			diameterStr.Format(_T("%.3f"), diameter);
 			holeInfo.HoleDiameter = diameterStr;
-			CString diameterMsg;
-			diameterMsg.Format(_T("Hole Diameter: %.3f"), diameter);
-			LogFileWriter::WriteLog((const char*)CT2A(diameterMsg));
+			LEO_TRACE(Geometry, _T("Hole Diameter: %.3f"), diameter);
 		} else {
 			holeInfo.HoleDiameter = _T("0.0");
-			LogFileWriter::WriteLog("Failed to get hole diameter");
 		}
 		
-		// Get surface area to help estimate depth
-		double surfaceArea;
-		err = ProSurfaceAreaEval(selectedSurf, &surfaceArea);
-		if (err == PRO_TK_NO_ERROR) {
-					// Estimate depth from surface area and diameter
+		// Estimate depth from surface area and diameter
 		// For a cylinder: Area = π * diameter * height
-		if (diameter > 0.0) {
-			double estimatedDepth = surfaceArea / (M_PI * diameter);
-			// Convert double to CString for HoleDepth
+		if (area >= 0.0 && diameter > 0.0) {
+			double estimatedDepth = area / (M_PI * diameter);
 			CString depthStr;
 			depthStr.Format(_T("%.3f"), estimatedDepth);
 			holeInfo.HoleDepth = depthStr;
-			CString depthMsg;
-			depthMsg.Format(_T("Estimated Hole Depth: %.3f"), estimatedDepth);
-			LogFileWriter::WriteLog((const char*)CT2A(depthMsg));
-		} else {
-			holeInfo.HoleDepth = _T("0.0");
-		}
+			LEO_TRACE(Geometry, _T("Estimated Hole Depth: %.3f"), estimatedDepth);
 		} else {
 			holeInfo.HoleDepth = _T("0.0");
-			LogFileWriter::WriteLog("Failed to get surface area for depth estimation");
 		}
 		
 		// Set hole type based on surface type
@@ -1004,7 +849,7 @@ void LeoHelper::ExtractHoleInfoFromSurface(ProGeomitem* selectedItem, HoleInfo&
 			holeInfo.ThreadSize = _T("N/A");
 		}
 		
-		LogFileWriter::WriteLog("Successfully extracted hole information from surface");
+		LEO_TRACE(Geometry, "Successfully extracted hole information from surface");
 	} else {
 		// Not a cylindrical surface, set default values
 		holeInfo.HoleType = _T("Non-Cylindrical");
@@ -1013,6 +858,6 @@ void LeoHelper::ExtractHoleInfoFromSurface(ProGeomitem* selectedItem, HoleInfo&
 		holeInfo.ThreadSize = _T("N/A");
 		holeInfo.HoleDiameter = _T("0.0");
 		holeInfo.HoleDepth = _T("0.0");
-		LogFileWriter::WriteLog("Surface is not cylindrical - cannot extract hole information");
+		LEO_TRACE(Geometry, "Surface is not cylindrical - cannot extract hole information");
 	}
 }
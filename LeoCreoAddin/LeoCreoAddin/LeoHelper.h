@@ -1,20 +1,59 @@
 #pragma once
 
+#include <vector>
 #include "LeoWebClient.h"
 
+class LeoWorkerPool;
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+// Analyzers of the face-analysis pipeline (LeoHelper::AnalyzeFace). Callers ask for the
+// results they need; the analyzers those read from run too, each at most once per face.
+enum FaceAnalyzer {
+	FACE_ANALYZE_AREA = 1 << 0,				// Area
+	FACE_ANALYZE_CLICK_POINT = 1 << 1,		// ClickLocation, Normal, CenterPoint
+	FACE_ANALYZE_CYLINDER = 1 << 2,			// Radius, Diameter, Perimeter
+	FACE_ANALYZE_HOLE = 1 << 3,				// IsHole
+	FACE_ANALYZE_HOLE_INFO = 1 << 4,		// HoleInfo; needs hole, cylinder and area
+	FACE_ANALYZE_SURFACE_TYPE = 1 << 5,		// SurfaceType
+	FACE_ANALYZE_ALL = (1 << 6) - 1,
+	FACE_ANALYZER_COUNT = 6					// Entries in the analyzer table
+};
+
 class LeoHelper
 {
 public:
 	LeoHelper();	
 	~LeoHelper();
 	void GetFaceDataAction();
-	int GetCurrentFaceSelection(MeasurementData* measureData);
-	int IsFaceSelected(MeasurementData* measureDate);
+
+	// Filling in MeasurementData from what Creo returned runs on this pool when one is set
+	void SetWorkerPool(LeoWorkerPool* pool);
+
+	// Reads the selected surface once and runs the requested analyzers on it, each in its own
+	// LEO_SPAN; a DEBUG line lists their times. PRO_TK_NO_ERROR, or the error that stopped it
+	// before any analyzer ran.
+	int AnalyzeFace(ProSelection selection, MeasurementData* measureData, unsigned analyzers = FACE_ANALYZE_ALL);
+
+	// As AnalyzeFace, for several faces at once: Creo is queried for each face in turn on the
+	// calling (UI) thread, then the faces are filled in in parallel. Faces that cannot be read
+	// are skipped; one entry per face analysed is appended to faces, in selection order. An error
+	// only if none could be.
+	int AnalyzeFaces(const std::vector<ProSelection>& selections, std::vector<MeasurementData>& faces, unsigned analyzers = FACE_ANALYZE_ALL);
+
+	// Up to maxFaces faces from Creo's selection buffer; if it holds none and prompt is set,
+	// the user picks them. The model type (PRO_PART, ...) or an error.
+	int AnalyzeSelectedFaces(std::vector<MeasurementData>& faces, int maxFaces, bool prompt, unsigned analyzers = FACE_ANALYZE_ALL);
+
+	// The first face in Creo's selection buffer; the model type (PRO_PART, ...) or an error
+	int GetCurrentFaceSelection(MeasurementData* measureData, unsigned analyzers = FACE_ANALYZE_ALL);
+	// As above, prompting the user to pick a face when none is selected
+	int IsFaceSelected(MeasurementData* measureDate, unsigned analyzers = FACE_ANALYZE_ALL);
 	void ExtractHoleInfo(ProFeature* holeFeature, HoleInfo& holeInfo);
 	void ExtractHoleInfoFromSurface(ProGeomitem* selectedItem, HoleInfo& holeInfo);
-};
 
+private:
+	LeoWorkerPool* m_workerPool;
+};
@@ -0,0 +1,218 @@
+#include "stdafx.h"
+#include "LeoHttpRequest.h"
+#include "LeoConfig.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+CString HttpUtf8ToCString(const char* data, size_t length)
+{
+    CString result;
+    if (length == 0) {
+        return result;
+    }
+
+    int wideLen = MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(length), NULL, 0);
+    if (wideLen > 0) {
+        MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(length), result.GetBuffer(wideLen), wideLen);
+        result.ReleaseBuffer(wideLen);
+    } else {
+        result = CString(CStringA(data, static_cast<int>(length)));
+    }
+    return result;
+}
+
+// Append the UTF-8 encoding of a CString to an arena-backed byte buffer
+static void AppendUtf8(ArenaString& out, const CString& text)
+{
+    if (text.IsEmpty()) {
+        return;
+    }
+
+    int byteLen = WideCharToMultiByte(CP_UTF8, 0, text, text.GetLength(), NULL, 0, NULL, NULL);
+    if (byteLen <= 0) {
+        return;
+    }
+
+    size_t offset = out.size();
+    out.resize(offset + byteLen);
+    WideCharToMultiByte(CP_UTF8, 0, text, text.GetLength(), &out[offset], byteLen, NULL, NULL);
+}
+
+HttpRequestReader::HttpRequestReader(HttpRequest& request, size_t maxRequestSize)
+    : m_request(request)
+    , m_maxRequestSize(maxRequestSize)
+    , m_headLength(std::string::npos)
+    , m_expectedLength(std::string::npos)
+{
+    m_request.RawBody.clear();
+}
+
+bool HttpRequestReader::Append(const char* data, size_t length)
+{
+    ArenaString& buffer = m_request.RawBody;
+    size_t searchFrom = buffer.size() < 3 ? 0 : buffer.size() - 3;     // The blank line may straddle two segments
+    buffer.append(data, length);
+
+    if (buffer.size() > m_maxRequestSize) {
+        return false; // Oversized request, drop the connection
+    }
+
+    if (m_headLength == std::string::npos) {
+        // Split head and body on the raw bytes so binary bodies are never run through a text conversion
+        m_headLength = buffer.find("\r\n\r\n", searchFrom);
+        if (m_headLength == std::string::npos) {
+            return true;
+        }
+
+        // Request line and headers are decoded from UTF-8
+        CString rawHead = HttpUtf8ToCString(buffer.data(), m_headLength);
+        if (!ParseHttpHead(rawHead, m_request)) {
+            return false;
+        }
+
+        auto it = m_request.Headers.find(_T("content-length"));
+        size_t contentLength = (it != m_request.Headers.end()) ? static_cast<size_t>(_ttoi64(it->second)) : 0;
+        m_expectedLength = m_headLength + 4 + contentLength;
+
+        // Room for the whole body at once: grown segment by segment, every doubling of the
+        // arena-backed buffer would leave the previous copy behind until the request ends
+        buffer.reserve((std::min)(m_expectedLength, m_maxRequestSize));
+    }
+
+    return true;
+}
+
+bool HttpRequestReader::IsComplete() const
+{
+    return m_expectedLength != std::string::npos && m_request.RawBody.size() >= m_expectedLength;
+}
+
+bool HttpRequestReader::Finish()
+{
+    ArenaString& buffer = m_request.RawBody;
+    if (m_headLength == std::string::npos) {
+        if (buffer.empty()) {
+            return false;
+        }
+
+        // No blank line seen: treat everything as head, as before
+        CString rawHead = HttpUtf8ToCString(buffer.data(), buffer.size());
+        buffer.clear();
+        return ParseHttpHead(rawHead, m_request);
+    }
+
+    buffer.erase(0, m_headLength + 4);
+    return true;
+}
+
+bool ParseHttpHead(const CString& rawRequest, HttpRequest& request)
+{
+    // Simple HTTP request parsing
+    // Find first line (method and path)
+    int lineEnd = rawRequest.Find(_T("\r\n"));
+    if (lineEnd < 0) {
+        lineEnd = rawRequest.Find(_T("\n"));
+    }
+
+    if (lineEnd < 0) {
+        return false;
+    }
+
+    CString firstLine = rawRequest.Left(lineEnd);
+
+    // Parse method and path
+    int space1 = firstLine.Find(_T(" "));
+    if (space1 < 0) {
+        return false;
+    }
+
+    int space2 = firstLine.Find(_T(" "), space1 + 1);
+    if (space2 < 0) {
+        return false;
+    }
+
+    request.Method = firstLine.Left(space1);
+    request.Path = firstLine.Mid(space1 + 1, space2 - space1 - 1);
+
+    // Parse header lines ("Name: value"), storing names lower-case for lookup
+    int lineStart = lineEnd;
+    while (lineStart < rawRequest.GetLength()) {
+        // Skip the line terminator of the previous line
+        while (lineStart < rawRequest.GetLength() &&
+               (rawRequest[lineStart] == _T('\r') || rawRequest[lineStart] == _T('\n'))) {
+            lineStart++;
+        }
+        if (lineStart >= rawRequest.GetLength()) {
+            break;
+        }
+
+        int nextEnd = rawRequest.Find(_T("\r\n"), lineStart);
+        if (nextEnd < 0) {
+            nextEnd = rawRequest.GetLength();
+        }
+
+        CString headerLine = rawRequest.Mid(lineStart, nextEnd - lineStart);
+        int colon = headerLine.Find(_T(':'));
+        if (colon > 0) {
+            CString name = headerLine.Left(colon);
+            CString value = headerLine.Mid(colon + 1);
+            name.Trim();
+            name.MakeLower();
+            value.Trim();
+            request.Headers[name] = value;
+        }
+
+        lineStart = nextEnd;
+    }
+
+    return true;
+}
+
+bool IsMsgPackRequest(const HttpRequest& request)
+{
+    auto it = request.Headers.find(_T("content-type"));
+    if (it == request.Headers.end()) {
+        return false;
+    }
+
+    CString contentType = it->second;
+    contentType.MakeLower();
+    return contentType.Find(_T(MIME_TYPE_MSGPACK)) >= 0 || contentType.Find(_T("application/x-msgpack")) >= 0;
+}
+
+void CreateHttpResponse(const WebServerResponse& response, ArenaString& httpResponse)
+{
+    // Status line
+    const char* statusText;
+    switch (response.StatusCode) {
+        case 200: statusText = "OK"; break;
+        case 400: statusText = "Bad Request"; break;
+        case 404: statusText = "Not Found"; break;
+        case 500: statusText = "Internal Server Error"; break;
+        default: statusText = "Unknown"; break;
+    }
+
+    // Encode the body first so Content-Length counts bytes, not characters
+    ArenaString body(httpResponse.get_allocator());
+    AppendUtf8(body, response.Body);
+
+    char line[128];
+    httpResponse.reserve(body.size() + 256);
+    sprintf_s(line, "HTTP/1.1 %d %s\r\n", response.StatusCode, statusText);
+    httpResponse += line;
+
+    // Headers
+    httpResponse += "Content-Type: ";
+    AppendUtf8(httpResponse, response.ContentType);
+    httpResponse += "\r\n";
+    sprintf_s(line, "Content-Length: %u\r\n", static_cast<unsigned>(body.size()));
+    httpResponse += line;
+    httpResponse += "Connection: close\r\n";
+
+    // Empty line before body
+    httpResponse += "\r\n";
+
+    // Body
+    httpResponse += body;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include "LeoArena.h"
+
+// HTTP/1.1 framing for LeoWebServer: the request head and body as they come off the socket,
+// and the response bytes that go back. Holds no socket, so LeoTests feeds it the same bytes
+// the server receives and measures the request path on every platform.
+
+// HTTP request structure
+struct HttpRequest {
+    CString Method;
+    CString Path;
+    CString Body;                           // UTF-8 decoded body, only filled for custom request handlers
+    ArenaString RawBody;                    // Body bytes exactly as received, in the request arena
+    std::map<CString, CString> Headers;     // Header names are stored lower-case
+
+    explicit HttpRequest(RequestArena* arena = nullptr) : RawBody(ArenaAllocator<char>(arena)) {}
+};
+
+// Web server response structure
+struct WebServerResponse {
+    int StatusCode;
+    CString Body;
+    CString ContentType;
+
+    WebServerResponse() : StatusCode(200), ContentType(_T("text/html")) {}
+};
+
+// Collects one request from the received segments. Large bodies (placement lists, batches)
+// arrive in several segments; bytes land directly in request.RawBody (arena-backed) and the
+// head is cut off in place once the socket has nothing more to give.
+class HttpRequestReader {
+public:
+    HttpRequestReader(HttpRequest& request, size_t maxRequestSize);
+
+    // Adds one received segment; false if the request is oversized or its head is malformed
+    bool Append(const char* data, size_t length);
+
+    // The head is parsed and Content-Length bytes of body are in
+    bool IsComplete() const;
+
+    // Called once no more bytes arrive. A body shorter than Content-Length is passed on as-is
+    // (the JSON/MessagePack parsers reject truncation); without a blank line everything is head.
+    bool Finish();
+
+private:
+    HttpRequestReader(const HttpRequestReader&) = delete;
+    HttpRequestReader& operator=(const HttpRequestReader&) = delete;
+
+    HttpRequest& m_request;
+    size_t m_maxRequestSize;
+    size_t m_headLength;                    // npos until the blank line is seen
+    size_t m_expectedLength;                // Head, blank line and Content-Length bytes
+};
+
+// Request line and "Name: value" headers; names are stored lower-case for lookup
+bool ParseHttpHead(const CString& rawRequest, HttpRequest& request);
+
+// Content-Type announces MessagePack (application/msgpack or application/x-msgpack)
+bool IsMsgPackRequest(const HttpRequest& request);
+
+// Status line, headers and UTF-8 body, appended to an arena-backed buffer
+void CreateHttpResponse(const WebServerResponse& response, ArenaString& httpResponse);
+
+// UTF-8 to CString, falling back to ANSI if the bytes are not valid UTF-8
+CString HttpUtf8ToCString(const char* data, size_t length);
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include "LeoBodyStream.h"
+
+// Platform-neutral seam between LeoWebClient and the network. Everything above it
+// (serialization, retries, circuit breaker, response decoding) is shared; a transport only
+// moves one POST and its response over a kept-alive connection. Only standard types cross
+// this interface, so transports and body encoders build without MFC or WinHTTP.
+
+// Cancellation of one request, shared between the thread running it and any thread that may
+// cancel it. Once cancelled it stays cancelled, so a cancel that arrives before the transport
+// has opened anything is still seen when it gets there. The transport arms an abort around
+// its blocking calls; Cancel() runs it under the token's lock, so after Disarm() returns no
+// abort is running or will run.
+class HttpCancelToken {
+public:
+    HttpCancelToken() : m_cancelled(false) {}
+
+    void Cancel()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_cancelled) {
+                return;
+            }
+            m_cancelled = true;
+            if (m_abort) {
+                m_abort();
+            }
+        }
+        m_signal.notify_all();
+    }
+
+    bool IsCancelled() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_cancelled;
+    }
+
+    // Registers how to abort the blocking call in progress; false, and nothing kept, if already cancelled
+    bool Arm(std::function<void()> abort)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cancelled) {
+            return false;
+        }
+        m_abort = std::move(abort);
+        return true;
+    }
+
+    void Disarm()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_abort = nullptr;
+    }
+
+    // Sleeps up to timeoutMs; true if the token was cancelled before or during the wait
+    bool WaitFor(int timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_signal.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return m_cancelled; });
+    }
+
+private:
+    HttpCancelToken(const HttpCancelToken&) = delete;
+    HttpCancelToken& operator=(const HttpCancelToken&) = delete;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_signal;
+    bool m_cancelled;
+    std::function<void()> m_abort;      // Runs with m_mutex held; must not call back into the token
+};
+
+// One request as the transport sees it
+struct HttpTransportRequest {
+    std::string Path;                   // UTF-8, e.g. "/receive-data"
+    std::string Headers;                // Extra header lines, each ending in "\r\n"
+    const BodyProducer* Body;           // Run once to measure Content-Length, once to send
+    HttpCancelToken* CancelToken;       // Null if the request cannot be cancelled
+
+    HttpTransportRequest() : Body(nullptr), CancelToken(nullptr) {}
+};
+
+// Receives the response while it arrives; the body goes straight into sink-owned memory
+class HttpResponseSink {
+public:
+    virtual ~HttpResponseSink() {}
+    virtual void OnStatus(int statusCode, const std::string& contentType) = 0;
+    virtual char* PrepareBody(size_t bytes) = 0;       // Room for the next read; may be asked again before a commit
+    virtual void CommitBody(size_t bytes) = 0;
+};
+
+struct HttpTransportResult {
+    bool Completed;                     // A whole response was read, whatever its status
+    bool Cancelled;                     // The request's cancel token aborted the exchange
+    std::string Error;                  // Set when not completed
+
+    HttpTransportResult() : Completed(false), Cancelled(false) {}
+};
+
+// Execute() and the setters are called from one thread at a time; the request's cancel token
+// may be cancelled from any thread.
+class LeoHttpTransport {
+public:
+    virtual ~LeoHttpTransport() {}
+
+    virtual void SetTarget(const std::string& host, int port) = 0;     // Drops the pooled connection
+    virtual void SetTimeout(int timeoutMs) = 0;                         // Per connect, send and receive step
+    virtual HttpTransportResult Execute(const HttpTransportRequest& request, HttpResponseSink& sink) = 0;
+    virtual void Reset() = 0;           // Drops the pooled connection; the next Execute() reconnects
+    virtual const char* Name() const = 0;
+};
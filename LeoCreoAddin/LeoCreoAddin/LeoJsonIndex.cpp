@@ -0,0 +1,679 @@
+#include "stdafx.h"
+#include "LeoJsonIndex.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LEO_JSON_HAS_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define LEO_JSON_HAS_AVX2 0
+#endif
+
+// MSVC accepts AVX2 intrinsics in any function; GCC/Clang need the target attribute
+#if LEO_JSON_HAS_AVX2 && defined(__GNUC__)
+#define LEO_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LEO_TARGET_AVX2
+#endif
+
+static inline bool IsStructuralOperator(char c)
+{
+    return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
+}
+
+static inline bool IsJsonWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool IsBlank(const char* text, const char* end)
+{
+    while (text < end && IsJsonWhitespace(*text)) {
+        ++text;
+    }
+    return text == end;
+}
+
+static inline bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool IsHexDigit(char c)
+{
+    return IsDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? and nothing else
+static bool IsJsonNumber(const char* text, size_t length)
+{
+    const char* end = text + length;
+    if (text < end && *text == '-') {
+        ++text;
+    }
+    if (text == end || !IsDigit(*text)) {
+        return false;
+    }
+    if (*text++ != '0') {
+        while (text < end && IsDigit(*text)) {
+            ++text;
+        }
+    }
+    if (text < end && *text == '.') {
+        if (++text == end || !IsDigit(*text)) {
+            return false;
+        }
+        while (text < end && IsDigit(*text)) {
+            ++text;
+        }
+    }
+    if (text < end && (*text == 'e' || *text == 'E')) {
+        if (++text < end && (*text == '+' || *text == '-')) {
+            ++text;
+        }
+        if (text == end || !IsDigit(*text)) {
+            return false;
+        }
+        while (text < end && IsDigit(*text)) {
+            ++text;
+        }
+    }
+    return text == end;
+}
+
+// A number, true, false or null, possibly padded with whitespace
+static bool IsJsonScalar(const char* text, const char* end)
+{
+    while (text < end && IsJsonWhitespace(*text)) {
+        ++text;
+    }
+    while (end > text && IsJsonWhitespace(end[-1])) {
+        --end;
+    }
+    size_t length = end - text;
+    return (length == 4 && memcmp(text, "true", 4) == 0) ||
+           (length == 5 && memcmp(text, "false", 5) == 0) ||
+           (length == 4 && memcmp(text, "null", 4) == 0) ||
+           IsJsonNumber(text, length);
+}
+
+// String contents between the quotes: no raw control characters, only the escapes JSON defines
+static bool IsJsonStringBody(const char* text, const char* end)
+{
+    for (; text < end; ++text) {
+        unsigned char c = static_cast<unsigned char>(*text);
+        if (c < 0x20) {
+            return false;
+        }
+        if (c != '\\') {
+            continue;
+        }
+        if (++text == end) {
+            return false;
+        }
+        switch (*text) {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                break;
+            case 'u':
+                if (end - text < 5 || !IsHexDigit(text[1]) || !IsHexDigit(text[2]) ||
+                    !IsHexDigit(text[3]) || !IsHexDigit(text[4])) {
+                    return false;
+                }
+                text += 4;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+static inline int TrailingZeros64(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index = 0;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index = 0;
+    if (_BitScanForward(&index, static_cast<unsigned long>(value))) {
+        return static_cast<int>(index);
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+    return static_cast<int>(index) + 32;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+static inline int PopCount64(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<int>(__popcnt64(value));
+#elif defined(_MSC_VER)
+    return static_cast<int>(__popcnt(static_cast<unsigned int>(value)) + __popcnt(static_cast<unsigned int>(value >> 32)));
+#else
+    return __builtin_popcountll(value);
+#endif
+}
+
+// Bit i of the result is the XOR of bits 0..i of the input (inside-string mask from quote bits)
+static inline uint64_t PrefixXor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+// Marks characters preceded by an odd-length run of backslashes, i.e. escaped characters.
+// carry holds whether the previous block ended in such a run.
+static inline uint64_t FindEscapedCharacters(uint64_t backslashes, uint64_t& carry)
+{
+    const uint64_t evenBits = 0x5555555555555555ULL;
+    const uint64_t oddBits = ~evenBits;
+
+    uint64_t startEdges = backslashes & ~(backslashes << 1);
+    uint64_t evenStartMask = evenBits ^ carry;
+    uint64_t evenStarts = startEdges & evenStartMask;
+    uint64_t oddStarts = startEdges & ~evenStartMask;
+
+    uint64_t evenCarries = backslashes + evenStarts;
+    uint64_t oddCarries = backslashes + oddStarts;
+    bool overflow = oddCarries < backslashes;
+    oddCarries |= carry;
+    carry = overflow ? 1ULL : 0ULL;
+
+    uint64_t evenCarryEnds = evenCarries & ~backslashes;
+    uint64_t oddCarryEnds = oddCarries & ~backslashes;
+    return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+}
+
+// JsonStructuralIndex implementation
+
+JsonStructuralIndex::JsonStructuralIndex(RequestArena* arena)
+    : m_data(nullptr)
+    , m_length(0)
+    , m_usedAvx2(false)
+    , m_arena(arena)
+    , m_positions(ArenaAllocator<uint32_t>(arena))
+    , m_matches(ArenaAllocator<uint32_t>(arena))
+{
+}
+
+bool JsonStructuralIndex::IsAvx2Supported()
+{
+#if LEO_JSON_HAS_AVX2 && defined(_MSC_VER)
+    static const bool supported = []() {
+        int info[4] = { 0 };
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+    return supported;
+#elif LEO_JSON_HAS_AVX2
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
+
+bool JsonStructuralIndex::Build(const char* data, size_t length, Pass pass)
+{
+    m_data = data;
+    m_length = length;
+    m_positions.clear();
+    m_matches.clear();
+
+    // Offsets are 32-bit; request bodies are capped far below this
+    if (length >= 0xFFFFFFFFULL) {
+        return false;
+    }
+
+    // Typical placement payloads have roughly one structural per 6-8 bytes
+    m_positions.reserve(length / 6 + 16);
+
+    m_usedAvx2 = pass != Pass::Scalar && IsAvx2Supported();
+    bool ok = m_usedAvx2 ? BuildAvx2(data, length, m_positions)
+                         : BuildScalar(data, length, m_positions);
+
+#ifdef _DEBUG
+    // Differential self-check: the vector and scalar paths must agree exactly
+    if (m_usedAvx2) {
+        ArenaVector<uint32_t> reference;
+        bool referenceOk = BuildScalar(data, length, reference);
+        ASSERT(referenceOk == ok && (!ok || reference == m_positions));
+    }
+#endif
+
+    return ok && BuildMatches();
+}
+
+bool JsonStructuralIndex::BuildScalar(const char* data, size_t length, ArenaVector<uint32_t>& positions)
+{
+    bool inString = false;
+    bool escaped = false;
+
+    // Backslash runs escape the following quote wherever they occur, exactly as in the vector path,
+    // so both paths agree even on malformed input
+    for (size_t i = 0; i < length; ++i) {
+        char c = data[i];
+        bool isEscaped = escaped;
+        escaped = (c == '\\') && !isEscaped;
+
+        if (c == '"' && !isEscaped) {
+            positions.push_back(static_cast<uint32_t>(i));
+            inString = !inString;
+        } else if (!inString && IsStructuralOperator(c)) {
+            positions.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    return !inString;
+}
+
+#if LEO_JSON_HAS_AVX2
+
+LEO_TARGET_AVX2 static inline uint64_t MatchByte(__m256i lo, __m256i hi, char c)
+{
+    __m256i needle = _mm256_set1_epi8(c);
+    uint32_t loMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle)));
+    uint32_t hiMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)));
+    return static_cast<uint64_t>(loMask) | (static_cast<uint64_t>(hiMask) << 32);
+}
+
+LEO_TARGET_AVX2 bool JsonStructuralIndex::BuildAvx2(const char* data, size_t length, ArenaVector<uint32_t>& positions)
+{
+    uint64_t escapeCarry = 0;
+    uint64_t inStringCarry = 0;
+    char tail[64];
+
+    for (size_t offset = 0; offset < length; offset += 64) {
+        const char* block = data + offset;
+        size_t blockLength = length - offset;
+
+        // Pad the final partial block with spaces so it never yields structurals
+        if (blockLength < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, blockLength);
+            block = tail;
+        }
+
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+
+        uint64_t backslashes = MatchByte(lo, hi, '\\');
+        uint64_t quotes = MatchByte(lo, hi, '"') & ~FindEscapedCharacters(backslashes, escapeCarry);
+        uint64_t operators = MatchByte(lo, hi, '{') | MatchByte(lo, hi, '}') |
+                             MatchByte(lo, hi, '[') | MatchByte(lo, hi, ']') |
+                             MatchByte(lo, hi, ':') | MatchByte(lo, hi, ',');
+
+        uint64_t inString = PrefixXor(quotes) ^ inStringCarry;
+        inStringCarry = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+
+        uint64_t structurals = (operators & ~inString) | quotes;
+        if (structurals) {
+            // Grow once per block, then write the set bit offsets directly
+            size_t base = positions.size();
+            positions.resize(base + PopCount64(structurals));
+            uint32_t* out = positions.data() + base;
+            while (structurals) {
+                *out++ = static_cast<uint32_t>(offset + TrailingZeros64(structurals));
+                structurals &= structurals - 1;
+            }
+        }
+    }
+
+    return inStringCarry == 0;
+}
+
+#else
+
+bool JsonStructuralIndex::BuildAvx2(const char* data, size_t length, ArenaVector<uint32_t>& positions)
+{
+    return BuildScalar(data, length, positions);
+}
+
+#endif
+
+bool JsonStructuralIndex::BuildMatches()
+{
+    m_matches.assign(m_positions.size(), 0);
+    ArenaVector<uint32_t> stack((ArenaAllocator<uint32_t>(m_arena)));
+    stack.reserve(32);
+
+    for (uint32_t i = 0; i < m_positions.size(); ++i) {
+        char c = m_data[m_positions[i]];
+        switch (c) {
+            case '{':
+            case '[':
+                stack.push_back(i);
+                break;
+            case '}':
+            case ']': {
+                if (stack.empty()) {
+                    return false;
+                }
+                uint32_t open = stack.back();
+                stack.pop_back();
+                if ((c == '}') != (m_data[m_positions[open]] == '{')) {
+                    return false;
+                }
+                m_matches[open] = i;
+                m_matches[i] = open;
+                break;
+            }
+            case '"':
+                // Quotes always come in pairs in the index
+                if (i + 1 >= m_positions.size()) {
+                    return false;
+                }
+                m_matches[i] = i + 1;
+                m_matches[i + 1] = i;
+                ++i;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return stack.empty();
+}
+
+// JsonIndexReader implementation
+
+JsonIndexReader::JsonIndexReader(const JsonStructuralIndex& index)
+    : m_index(index)
+{
+}
+
+bool JsonIndexReader::Root(JsonValue& value) const
+{
+    if (m_index.Size() == 0) {
+        return false;
+    }
+
+    char c = m_index.CharAt(0);
+    if (c != '{' && c != '[') {
+        return false;
+    }
+
+    value.Kind = c;
+    value.Begin = 0;
+    value.End = m_index.Match(0);
+    value.Text = nullptr;
+    value.TextLength = 0;
+    return true;
+}
+
+bool JsonIndexReader::IsWellFormed() const
+{
+    // What the next token may be; kValue also admits a scalar in the gap before it
+    enum Expect { kValue, kKey, kColon, kNext };
+
+    size_t count = m_index.Size();
+    if (count == 0 || (m_index.CharAt(0) != '{' && m_index.CharAt(0) != '[')) {
+        return false;
+    }
+
+    const char* data = m_index.Data();
+    ArenaVector<char> open((ArenaAllocator<char>(m_index.Arena())));
+    open.reserve(32);
+    Expect expect = kValue;
+    bool opened = false;            // The previous token opened a container, which may close at once
+    const char* gap = data;         // First byte after the previous token
+
+    for (size_t i = 0; i < count; ++i) {
+        const char* token = data + m_index.Position(i);
+        char c = *token;
+
+        if (!IsBlank(gap, token)) {
+            // Text between structurals is only allowed where a value goes, and must be a whole scalar
+            if (expect != kValue || open.empty() || !IsJsonScalar(gap, token)) {
+                return false;
+            }
+            expect = kNext;
+            opened = false;
+        }
+        gap = token + 1;
+
+        switch (c) {
+            case '"': {
+                // Build() pairs every opening quote with the next entry
+                if (expect != kValue && expect != kKey) {
+                    return false;
+                }
+                const char* close = data + m_index.Position(++i);
+                if (!IsJsonStringBody(token + 1, close)) {
+                    return false;
+                }
+                gap = close + 1;
+                expect = (expect == kKey) ? kColon : kNext;
+                opened = false;
+                break;
+            }
+            case '{':
+            case '[':
+                if (expect != kValue) {
+                    return false;
+                }
+                open.push_back(c);
+                expect = (c == '{') ? kKey : kValue;
+                opened = true;
+                break;
+            case '}':
+            case ']':
+                // Build() has already matched the bracket kinds
+                if (expect != kNext && !(opened && expect == (c == '}' ? kKey : kValue))) {
+                    return false;
+                }
+                open.pop_back();
+                if (open.empty() && i + 1 != count) {
+                    return false;       // Something follows the root
+                }
+                expect = kNext;
+                opened = false;
+                break;
+            case ':':
+                if (expect != kColon) {
+                    return false;
+                }
+                expect = kValue;
+                break;
+            case ',':
+                if (expect != kNext || open.empty()) {
+                    return false;
+                }
+                expect = (open.back() == '{') ? kKey : kValue;
+                opened = false;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    return open.empty() && IsBlank(gap, data + m_index.Length());
+}
+
+bool JsonIndexReader::ValueAfter(uint32_t separator, JsonValue& value) const
+{
+    if (separator + 1 >= m_index.Size()) {
+        return false;
+    }
+
+    const char* data = m_index.Data();
+    uint32_t start = m_index.Position(separator) + 1;
+    uint32_t nextPos = m_index.Position(separator + 1);
+
+    // Skip whitespace between the separator and the value
+    while (start < nextPos && IsJsonWhitespace(data[start])) {
+        ++start;
+    }
+
+    if (start == nextPos) {
+        char c = data[nextPos];
+        if (c == '{' || c == '[' || c == '"') {
+            value.Kind = c;
+            value.Begin = separator + 1;
+            value.End = m_index.Match(separator + 1);
+            if (c == '"') {
+                value.Text = data + nextPos + 1;
+                value.TextLength = m_index.Position(value.End) - nextPos - 1;
+            } else {
+                value.Text = nullptr;
+                value.TextLength = 0;
+            }
+            return true;
+        }
+    }
+
+    // Scalar: trim trailing whitespace before the next structural
+    uint32_t end = nextPos;
+    while (end > start && IsJsonWhitespace(data[end - 1])) {
+        --end;
+    }
+
+    value.Kind = 's';
+    value.Begin = separator;
+    value.End = separator;
+    value.Text = data + start;
+    value.TextLength = end - start;
+    return true;
+}
+
+uint32_t JsonIndexReader::NextAfter(const JsonValue& value) const
+{
+    return value.Kind == 's' ? value.Begin + 1 : value.End + 1;
+}
+
+static void AppendUtf8(ArenaString& out, uint32_t codePoint)
+{
+    if (codePoint < 0x80) {
+        out.push_back(static_cast<char>(codePoint));
+    } else if (codePoint < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+static bool ParseHex4(const char* text, uint32_t& value)
+{
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = text[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+bool JsonIndexReader::GetString(const JsonValue& value, ArenaString& out) const
+{
+    if (value.Kind != '"') {
+        return false;
+    }
+
+    out.clear();
+    out.reserve(value.TextLength);
+
+    const char* text = value.Text;
+    const char* end = value.Text + value.TextLength;
+    while (text < end) {
+        // Copy unescaped runs in one go
+        const char* backslash = static_cast<const char*>(memchr(text, '\\', end - text));
+        if (!backslash) {
+            out.append(text, end);
+            break;
+        }
+        out.append(text, backslash);
+        text = backslash + 1;
+        if (text >= end) {
+            return false;
+        }
+
+        switch (*text) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t codePoint = 0;
+                if (end - text < 5 || !ParseHex4(text + 1, codePoint)) {
+                    return false;
+                }
+                text += 4;
+                // Combine UTF-16 surrogate pairs
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF && end - text >= 7 &&
+                    text[1] == '\\' && text[2] == 'u') {
+                    uint32_t low = 0;
+                    if (ParseHex4(text + 3, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                        text += 6;
+                    }
+                }
+                AppendUtf8(out, codePoint);
+                break;
+            }
+            default:
+                return false;
+        }
+        ++text;
+    }
+
+    return true;
+}
+
+bool JsonIndexReader::GetDouble(const JsonValue& value, double& out) const
+{
+    if ((value.Kind != 's' && value.Kind != '"') || !IsJsonNumber(value.Text, value.TextLength)) {
+        return false;
+    }
+
+    // strtod needs a terminator; literals too long for the stack buffer are rare enough to copy
+    char buffer[64];
+    std::string longText;
+    const char* text = buffer;
+    if (value.TextLength < sizeof(buffer)) {
+        memcpy(buffer, value.Text, value.TextLength);
+        buffer[value.TextLength] = '\0';
+    } else {
+        longText.assign(value.Text, value.TextLength);
+        text = longText.c_str();
+    }
+
+    char* parseEnd = nullptr;
+    out = strtod(text, &parseEnd);
+    return parseEnd == text + value.TextLength;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "LeoArena.h"
+
+// Stage 1 of a simdjson-style parser: a structural index over a UTF-8 JSON document.
+// Records the byte offset of every quote, brace, bracket, colon and comma that is not
+// inside a string literal. Built with AVX2 (64 bytes per step) when the CPU supports it,
+// otherwise with a scalar pass producing the identical index.
+// With an arena the index storage comes from the request arena instead of the heap.
+class JsonStructuralIndex {
+public:
+    explicit JsonStructuralIndex(RequestArena* arena = nullptr);
+
+    // Auto takes the AVX2 pass when the CPU has it; Scalar forces the scalar pass, so tests and
+    // benchmarks can compare the two
+    enum class Pass { Auto, Scalar };
+
+    // Build the index. Returns false for unterminated strings or unbalanced brackets; the rest of
+    // the grammar is left to JsonIndexReader::IsWellFormed.
+    bool Build(const char* data, size_t length, Pass pass = Pass::Auto);
+
+    const char* Data() const { return m_data; }
+    size_t Length() const { return m_length; }
+    size_t Size() const { return m_positions.size(); }
+    uint32_t Position(size_t index) const { return m_positions[index]; }
+    char CharAt(size_t index) const { return m_data[m_positions[index]]; }
+
+    // Index of the matching bracket/brace or closing quote for an opening structural
+    uint32_t Match(size_t index) const { return m_matches[index]; }
+
+    bool UsedAvx2() const { return m_usedAvx2; }
+    RequestArena* Arena() const { return m_arena; }
+    static bool IsAvx2Supported();
+
+private:
+    bool BuildScalar(const char* data, size_t length, ArenaVector<uint32_t>& positions);
+    bool BuildAvx2(const char* data, size_t length, ArenaVector<uint32_t>& positions);
+    bool BuildMatches();
+
+    const char* m_data;
+    size_t m_length;
+    bool m_usedAvx2;
+    RequestArena* m_arena;
+    ArenaVector<uint32_t> m_positions;
+    ArenaVector<uint32_t> m_matches;
+};
+
+// A JSON value located through the structural index. Objects, arrays and strings
+// span [Begin, End] in structural index space; scalars are text between two structurals.
+struct JsonValue {
+    char Kind;              // '{', '[', '"', or 's' for a number/true/false/null scalar
+    uint32_t Begin;
+    uint32_t End;
+    const char* Text;       // Scalar text or string contents (still escaped)
+    size_t TextLength;
+
+    JsonValue() : Kind(0), Begin(0), End(0), Text(nullptr), TextLength(0) {}
+};
+
+// Stage 2: typed access that walks the structural index instead of the raw bytes.
+// Skipping a nested object or array is a single jump through the match table.
+class JsonIndexReader {
+public:
+    explicit JsonIndexReader(const JsonStructuralIndex& index);
+
+    bool Root(JsonValue& value) const;
+
+    // Checks the rest of the JSON grammar over the whole document: separators, literals and
+    // numbers, string escapes and control characters, and nothing but whitespace around the
+    // root. The walkers below skip what they are not asked for, so decoders that must reject
+    // malformed documents call this first. UTF-8 is not checked; the text conversion replaces
+    // malformed sequences.
+    bool IsWellFormed() const;
+
+    // Calls fn(key, keyLength, value) for each member; fn returns false to abort the walk
+    template <typename Fn>
+    bool ForEachMember(const JsonValue& object, Fn fn) const;
+
+    // Calls fn(value) for each element; fn returns false to abort the walk
+    template <typename Fn>
+    bool ForEachElement(const JsonValue& array, Fn fn) const;
+
+    bool GetString(const JsonValue& value, ArenaString& out) const;  // Unescapes into UTF-8
+    bool GetDouble(const JsonValue& value, double& out) const;         // JSON numbers, bare or quoted
+
+private:
+    bool ValueAfter(uint32_t separator, JsonValue& value) const;
+    uint32_t NextAfter(const JsonValue& value) const;
+
+    const JsonStructuralIndex& m_index;
+};
+
+template <typename Fn>
+bool JsonIndexReader::ForEachMember(const JsonValue& object, Fn fn) const
+{
+    if (object.Kind != '{') {
+        return false;
+    }
+
+    uint32_t i = object.Begin + 1;
+    if (i == object.End) {
+        return true; // Empty object
+    }
+
+    while (i < object.End) {
+        // Expect: "key" :
+        if (m_index.CharAt(i) != '"' || i + 2 > object.End || m_index.CharAt(i + 2) != ':') {
+            return false;
+        }
+
+        const char* key = m_index.Data() + m_index.Position(i) + 1;
+        size_t keyLength = m_index.Position(i + 1) - m_index.Position(i) - 1;
+
+        JsonValue value;
+        if (!ValueAfter(i + 2, value)) {
+            return false;
+        }
+        if (!fn(key, keyLength, value)) {
+            return false;
+        }
+
+        uint32_t next = NextAfter(value);
+        if (next == object.End) {
+            return true;
+        }
+        if (next > object.End || m_index.CharAt(next) != ',') {
+            return false;
+        }
+        i = next + 1;
+    }
+
+    return false;
+}
+
+template <typename Fn>
+bool JsonIndexReader::ForEachElement(const JsonValue& array, Fn fn) const
+{
+    if (array.Kind != '[') {
+        return false;
+    }
+
+    uint32_t separator = array.Begin;
+    while (separator < array.End) {
+        JsonValue value;
+        if (!ValueAfter(separator, value)) {
+            return false;
+        }
+
+        // "[]" shows up as an empty scalar directly before the closing bracket
+        if (separator == array.Begin && value.Kind == 's' && value.TextLength == 0 && value.Begin + 1 == array.End) {
+            return true;
+        }
+
+        if (!fn(value)) {
+            return false;
+        }
+
+        uint32_t next = NextAfter(value);
+        if (next == array.End) {
+            return true;
+        }
+        if (next > array.End || m_index.CharAt(next) != ',') {
+            return false;
+        }
+        separator = next;
+    }
+
+    return false;
+}
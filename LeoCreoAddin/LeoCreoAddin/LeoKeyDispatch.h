@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Compile-time perfect-hash dispatch for the fixed key sets of the Leo payload structs.
+// Keys match case-insensitively (ASCII), so "DownloadPath", "downloadPath" and
+// "DOWNLOADPATH" all select the same member: one hash plus one compare per key.
+
+struct KeyName {
+    const char* Text;
+    size_t Length;
+};
+
+// Build a KeyName from a string literal, with the length taken from the array type
+template <size_t L>
+constexpr KeyName Key(const char (&text)[L])
+{
+    return KeyName{ text, L - 1 };
+}
+
+constexpr char AsciiLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// FNV-1a over the lower-cased bytes, seeded so each table can pick a collision-free variant.
+// The final mix folds the high bits down, since tables only use the low bits.
+constexpr uint32_t KeyHash(const char* text, size_t length, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint8_t>(AsciiLower(text[i]));
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+constexpr bool KeyEqualsNoCase(const char* a, const char* b, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        if (AsciiLower(a[i]) != AsciiLower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Smallest power of two holding N keys at a load factor of at most 1/2
+constexpr size_t KeySlotCount(size_t keyCount)
+{
+    size_t slots = 2;
+    while (slots < keyCount * 2) {
+        slots *= 2;
+    }
+    return slots;
+}
+
+// Open-address table with no collisions for its key set. The constructor searches
+// for a seed under which every key lands in its own slot; declare tables constexpr
+// so that search runs in the compiler.
+template <size_t N, size_t Slots>
+class KeyDispatchTable {
+public:
+    constexpr explicit KeyDispatchTable(const KeyName (&keys)[N])
+        : m_keys{}
+        , m_slots{}
+        , m_seed(0)
+        , m_perfect(false)
+    {
+        for (size_t i = 0; i < N; ++i) {
+            m_keys[i] = keys[i];
+        }
+
+        for (uint32_t seed = 0; seed < 4096 && !m_perfect; ++seed) {
+            for (size_t s = 0; s < Slots; ++s) {
+                m_slots[s] = 0;
+            }
+            bool collision = false;
+            for (size_t i = 0; i < N && !collision; ++i) {
+                size_t slot = KeyHash(keys[i].Text, keys[i].Length, seed) & (Slots - 1);
+                if (m_slots[slot] != 0) {
+                    collision = true;
+                } else {
+                    m_slots[slot] = static_cast<uint8_t>(i + 1);
+                }
+            }
+            if (!collision) {
+                m_seed = seed;
+                m_perfect = true;
+            }
+        }
+    }
+
+    // Index of the key in the table's key list, or -1 for unknown keys
+    constexpr int Find(const char* key, size_t length) const
+    {
+        uint8_t entry = m_slots[KeyHash(key, length, m_seed) & (Slots - 1)];
+        if (entry == 0) {
+            return -1;
+        }
+        const KeyName& candidate = m_keys[entry - 1];
+        return (candidate.Length == length && KeyEqualsNoCase(candidate.Text, key, length))
+            ? static_cast<int>(entry - 1)
+            : -1;
+    }
+
+    constexpr bool IsPerfect() const { return m_perfect; }
+
+private:
+    KeyName m_keys[N];
+    uint8_t m_slots[Slots];
+    uint32_t m_seed;
+    bool m_perfect;
+};
+
+template <size_t N>
+constexpr KeyDispatchTable<N, KeySlotCount(N)> MakeKeyTable(const KeyName (&keys)[N])
+{
+    return KeyDispatchTable<N, KeySlotCount(N)>(keys);
+}
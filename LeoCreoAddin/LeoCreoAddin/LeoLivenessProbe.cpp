@@ -0,0 +1,334 @@
+#include "stdafx.h"
+#include "LeoLivenessProbe.h"
+#include "LeoConfig.h"
+#include "LogFileWriter.h"
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <algorithm>
+#include <vector>
+
+#pragma comment(lib, "ws2_32.lib")
+
+LeoLivenessProbe::LeoLivenessProbe()
+    : m_shouldStop(false)
+    , m_winsockReady(false)
+    , m_host(L"localhost")
+    , m_port(0)
+    , m_known(false)
+    , m_isUp(false)
+    , m_intervalMs(LEO_PROBE_MIN_INTERVAL_MS)
+    , m_waiters(0)
+    , m_launchPending(false)
+    , m_lastTimeToReadyMs(-1)
+    , m_readyCount(0)
+    , m_readyTotalMs(0)
+    , m_nextSubscription(1)
+{
+}
+
+LeoLivenessProbe::~LeoLivenessProbe()
+{
+    Stop();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_winsockReady) {
+        WSACleanup();
+        m_winsockReady = false;
+    }
+}
+
+void LeoLivenessProbe::SetTarget(const CString& host, int port)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_host == host && m_port == port) {
+        return;
+    }
+    // Whatever we knew was about the old endpoint
+    m_host = host;
+    m_port = port;
+    m_known = false;
+    m_intervalMs = LEO_PROBE_MIN_INTERVAL_MS;
+    m_wakeUp.notify_all();
+}
+
+void LeoLivenessProbe::Start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_shouldStop = false;
+    m_thread = std::thread(&LeoLivenessProbe::ProbeThread, this);
+    LogMessage(_T("Background probe started"));
+}
+
+void LeoLivenessProbe::Stop()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shouldStop = true;
+        thread.swap(m_thread);
+    }
+    m_wakeUp.notify_all();
+    m_stateChanged.notify_all();
+
+    if (thread.joinable()) {
+        thread.join();
+        LogMessage(_T("Background probe stopped"));
+    }
+}
+
+bool LeoLivenessProbe::IsUp()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto age = std::chrono::steady_clock::now() - m_checkedAt;
+        if (m_known && age < std::chrono::milliseconds(LEO_PROBE_TTL_MS)) {
+            return m_isUp;
+        }
+    }
+    return ProbeNow();
+}
+
+bool LeoLivenessProbe::ProbeNow()
+{
+    CString host;
+    int port = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        host = m_host;
+        port = m_port;
+    }
+
+    bool isUp = Connect(host, port);
+    UpdateState(isUp);
+    return isUp;
+}
+
+void LeoLivenessProbe::Report(bool isUp)
+{
+    UpdateState(isUp);
+}
+
+void LeoLivenessProbe::NotifyLaunched()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_launchPending = true;
+    m_launchedAt = std::chrono::steady_clock::now();
+    m_intervalMs = LEO_PROBE_MIN_INTERVAL_MS;
+    m_wakeUp.notify_all();
+}
+
+bool LeoLivenessProbe::WaitUntilUp(int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    int inlineIntervalMs = LEO_PROBE_MIN_INTERVAL_MS;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_waiters++;
+    m_intervalMs = LEO_PROBE_MIN_INTERVAL_MS;
+    m_wakeUp.notify_all();
+
+    while (!(m_known && m_isUp) && std::chrono::steady_clock::now() < deadline) {
+        if (m_thread.joinable()) {
+            m_stateChanged.wait_until(lock, deadline);
+            continue;
+        }
+
+        // No background thread: probe from here with the same growing spacing
+        lock.unlock();
+        ProbeNow();
+        lock.lock();
+        if (m_known && m_isUp) {
+            break;
+        }
+        auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(inlineIntervalMs);
+        m_stateChanged.wait_until(lock, (std::min)(next, deadline));
+        inlineIntervalMs = (std::min)(inlineIntervalMs * 2, LEO_PROBE_FAST_INTERVAL_MS);
+    }
+
+    m_waiters--;
+    return m_known && m_isUp;
+}
+
+LeoLivenessProbe::SubscriptionId LeoLivenessProbe::Subscribe(StateCallback callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SubscriptionId id = m_nextSubscription++;
+    m_subscribers[id] = callback;
+    return id;
+}
+
+void LeoLivenessProbe::Unsubscribe(SubscriptionId id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_subscribers.erase(id);
+}
+
+int LeoLivenessProbe::GetLastTimeToReadyMs() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastTimeToReadyMs;
+}
+
+CString LeoLivenessProbe::Describe() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    long long checkedAgoMs = m_known
+        ? std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_checkedAt).count()
+        : -1;
+    int averageMs = m_readyCount > 0 ? static_cast<int>(m_readyTotalMs / m_readyCount) : -1;
+
+    CString text;
+    text.Format(_T("leoState=%s checkedAgoMs=%lld probeIntervalMs=%d timeToReadyMs=%d avgTimeToReadyMs=%d launchesSeen=%d"),
+                !m_known ? _T("unknown") : (m_isUp ? _T("up") : _T("down")),
+                checkedAgoMs, m_intervalMs, m_lastTimeToReadyMs, averageMs, m_readyCount);
+    return text;
+}
+
+void LeoLivenessProbe::ProbeThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_shouldStop) {
+        // A request or inline probe may have refreshed the state; only probe once it is due
+        auto due = m_checkedAt + std::chrono::milliseconds(m_intervalMs);
+        if (m_known && std::chrono::steady_clock::now() < due) {
+            m_wakeUp.wait_until(lock, due);
+            continue;
+        }
+
+        CString host = m_host;
+        int port = m_port;
+        lock.unlock();
+
+        UpdateState(Connect(host, port));
+
+        lock.lock();
+    }
+}
+
+void LeoLivenessProbe::UpdateState(bool isUp)
+{
+    std::vector<StateCallback> callbacks;
+    bool changed = false;
+    int timeToReadyMs = -1;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+        changed = !m_known || m_isUp != isUp;
+        m_known = true;
+        m_isUp = isUp;
+        m_checkedAt = now;
+
+        // Exponential spacing while nothing changes; stay quick while someone is waiting on a launch
+        if (changed) {
+            m_intervalMs = LEO_PROBE_MIN_INTERVAL_MS;
+        } else {
+            int cap = (m_launchPending || m_waiters > 0) ? LEO_PROBE_FAST_INTERVAL_MS : LEO_PROBE_MAX_INTERVAL_MS;
+            m_intervalMs = (std::min)(m_intervalMs * 2, cap);
+        }
+
+        if (isUp && m_launchPending) {
+            m_launchPending = false;
+            // Leo that was already running when the launch was announced says nothing about start-up time
+            if (changed) {
+                timeToReadyMs = static_cast<int>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(now - m_launchedAt).count());
+                m_lastTimeToReadyMs = timeToReadyMs;
+                m_readyCount++;
+                m_readyTotalMs += timeToReadyMs;
+            }
+        }
+
+        if (changed) {
+            for (const auto& subscriber : m_subscribers) {
+                callbacks.push_back(subscriber.second);
+            }
+        }
+    }
+
+    if (!changed) {
+        return;
+    }
+    m_stateChanged.notify_all();
+
+    CString msg;
+    msg.Format(_T("Leo is %s"), isUp ? _T("up") : _T("down"));
+    LogMessage(msg);
+    if (timeToReadyMs >= 0) {
+        msg.Format(_T("Leo ready %d ms after launch"), timeToReadyMs);
+        LogMessage(msg);
+    }
+
+    for (auto& callback : callbacks) {
+        try {
+            callback(isUp);
+        } catch (const std::exception& e) {
+            LogMessage(_T("Exception in state subscriber: ") + CString(e.what()));
+        }
+    }
+}
+
+bool LeoLivenessProbe::Connect(const CString& host, int port)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_winsockReady) {
+            WSADATA wsaData;
+            m_winsockReady = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+        }
+    }
+
+    ADDRINFOW hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    CString portStr;
+    portStr.Format(_T("%d"), port);
+
+    ADDRINFOW* addresses = NULL;
+    if (GetAddrInfoW(host, portStr, &hints, &addresses) != 0) {
+        return false;
+    }
+
+    // "localhost" may resolve to ::1 and 127.0.0.1; Leo only has to listen on one of them
+    bool connected = false;
+    for (ADDRINFOW* address = addresses; address && !connected; address = address->ai_next) {
+        SOCKET probeSocket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (probeSocket == INVALID_SOCKET) {
+            continue;
+        }
+
+        u_long nonBlocking = 1;
+        ioctlsocket(probeSocket, FIONBIO, &nonBlocking);
+
+        if (connect(probeSocket, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0) {
+            connected = true;
+        } else if (WSAGetLastError() == WSAEWOULDBLOCK) {
+            fd_set writeSet;
+            fd_set errorSet;
+            FD_ZERO(&writeSet);
+            FD_ZERO(&errorSet);
+            FD_SET(probeSocket, &writeSet);
+            FD_SET(probeSocket, &errorSet);
+
+            // A refused connect shows up in the error set; Windows retries it until the timeout
+            timeval timeout;
+            timeout.tv_sec = LEO_PROBE_CONNECT_TIMEOUT_MS / 1000;
+            timeout.tv_usec = (LEO_PROBE_CONNECT_TIMEOUT_MS % 1000) * 1000;
+            connected = select(0, NULL, &writeSet, &errorSet, &timeout) > 0 && FD_ISSET(probeSocket, &writeSet);
+        }
+
+        closesocket(probeSocket);
+    }
+
+    FreeAddrInfoW(addresses);
+    return connected;
+}
+
+void LeoLivenessProbe::LogMessage(const CString& message)
+{
+    LEO_INFO(Http, _T("LeoLivenessProbe: %s"), (LPCTSTR)message);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Cached up/down state of the Leo desktop app.
+// A background thread checks Leo with a bare TCP connect (no HTTP request) and spaces the
+// checks exponentially while the state is stable, dropping back to fast probing whenever the
+// state changes, a launch is announced or someone waits for readiness. Real requests report
+// what they saw through Report(), so a busy client rarely needs a probe at all.
+// Subscribers are called on whichever thread observed the change.
+class LeoLivenessProbe {
+public:
+    using StateCallback = std::function<void(bool isUp)>;
+    typedef int SubscriptionId;
+
+    LeoLivenessProbe();
+    ~LeoLivenessProbe();
+
+    void SetTarget(const CString& host, int port);
+    void Start();
+    void Stop();
+
+    bool IsUp();                        // Cached state; probes inline only once it is older than the TTL
+    bool ProbeNow();                    // Fresh probe, updates the cache
+    void Report(bool isUp);             // Passive observation from a real request
+
+    // Starts the time-to-ready clock; the next transition to up records the metric
+    void NotifyLaunched();
+    bool WaitUntilUp(int timeoutMs);
+
+    SubscriptionId Subscribe(StateCallback callback);
+    void Unsubscribe(SubscriptionId id);
+
+    int GetLastTimeToReadyMs() const;   // -1 until a launch has been seen through to ready
+    CString Describe() const;           // One-line state summary for diagnostics
+
+private:
+    LeoLivenessProbe(const LeoLivenessProbe&) = delete;
+    LeoLivenessProbe& operator=(const LeoLivenessProbe&) = delete;
+
+    void ProbeThread();
+    void UpdateState(bool isUp);
+    bool Connect(const CString& host, int port);
+    void LogMessage(const CString& message);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeUp;           // Probe thread: stop, launch or waiter arrived
+    std::condition_variable m_stateChanged;     // WaitUntilUp
+    std::thread m_thread;
+    bool m_shouldStop;
+    bool m_winsockReady;
+
+    CString m_host;
+    int m_port;
+
+    bool m_known;
+    bool m_isUp;
+    std::chrono::steady_clock::time_point m_checkedAt;
+    int m_intervalMs;
+    int m_waiters;
+
+    bool m_launchPending;
+    std::chrono::steady_clock::time_point m_launchedAt;
+    int m_lastTimeToReadyMs;
+    int m_readyCount;
+    long long m_readyTotalMs;
+
+    std::map<SubscriptionId, StateCallback> m_subscribers;
+    SubscriptionId m_nextSubscription;
+};
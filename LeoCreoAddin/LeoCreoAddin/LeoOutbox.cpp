@@ -0,0 +1,761 @@
+#include "stdafx.h"
+#include "LeoOutbox.h"
+#include "LeoConfig.h"
+#include "LogFileWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+static const uint64_t DATA_START = 32;     // sizeof(JournalHeader), records start here
+
+struct Crc32Table {
+    uint32_t Entries[256];
+
+    Crc32Table()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            Entries[i] = c;
+        }
+    }
+};
+
+static uint32_t Crc32(const char* data, size_t length)
+{
+    static const Crc32Table table;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table.Entries[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+LeoOutbox::LeoOutbox(LeoAsyncClient& asyncClient, LeoLivenessProbe& liveness)
+    : m_asyncClient(asyncClient)
+    , m_liveness(liveness)
+    , m_subscription(0)
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(NULL)
+    , m_view(NULL)
+    , m_size(0)
+    , m_tail(DATA_START)
+    , m_pendingCount(0)
+    , m_replaying(false)
+    , m_attempt(0)
+    , m_lastAttempt(0)
+    , m_inFlightSequence(0)
+    , m_inFlightRequest(LeoAsyncClient::INVALID_REQUEST)
+    , m_failures(0)
+    , m_deliveredCount(0)
+    , m_droppedCount(0)
+    , m_compactionCount(0)
+{
+    static_assert(sizeof(JournalHeader) == DATA_START, "Journal header layout changed");
+    static_assert(sizeof(RecordHeader) % 8 == 0, "Records must stay 8-byte aligned");
+}
+
+LeoOutbox::~LeoOutbox()
+{
+    Close();
+}
+
+bool LeoOutbox::Open(const CString& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_view) {
+            return true;
+        }
+
+        m_path = path;
+        if (!OpenJournalFile()) {
+            CString msg;
+            msg.Format(_T("Cannot open journal %s (error %lu), messages will not survive Leo being down"),
+                       (LPCTSTR)path, ::GetLastError());
+            LogMessage(msg);
+            return false;
+        }
+
+        JournalHeader* header = Header();
+        if (header->Magic != JOURNAL_MAGIC || header->Version != JOURNAL_VERSION) {
+            if (header->Magic != 0) {
+                LogMessage(_T("Journal has an unknown format, starting empty"));
+            }
+            memset(m_view, 0, static_cast<size_t>(m_size));
+            header->Magic = JOURNAL_MAGIC;
+            header->Version = JOURNAL_VERSION;
+            header->Head = DATA_START;
+            header->NextSequence = 1;
+            FlushRange(0, m_size, true);
+        }
+
+        if (!Recover()) {
+            LogMessage(_T("Journal could not be recovered"));
+            return false;
+        }
+
+        CString msg;
+        msg.Format(_T("Journal %s open, %d pending message(s)"), (LPCTSTR)path, static_cast<int>(m_pendingCount));
+        LogMessage(msg);
+    }
+
+    // An up transition replays, or ends a retry's backoff; Leo may also already be up, so try
+    // once right away
+    m_subscription = m_liveness.Subscribe([this](bool isUp) {
+        if (isUp) {
+            StartReplay(true);
+        }
+    });
+    Replay();
+    return true;
+}
+
+void LeoOutbox::Close()
+{
+    if (m_subscription) {
+        m_liveness.Unsubscribe(m_subscription);
+        m_subscription = 0;
+    }
+
+    LeoAsyncClient::RequestId cancelled = LeoAsyncClient::INVALID_REQUEST;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cancelled = m_inFlightRequest;
+        m_replaying = false;
+        m_attempt = 0;
+        m_inFlightSequence = 0;
+        m_inFlightRequest = LeoAsyncClient::INVALID_REQUEST;
+        m_failures = 0;
+
+        if (m_view) {
+            FlushRange(0, m_size, true);
+            UnmapJournal();
+        }
+        if (m_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    // Whatever was in flight stays pending in the journal for the next session
+    if (cancelled != LeoAsyncClient::INVALID_REQUEST) {
+        m_asyncClient.Cancel(cancelled);
+    }
+}
+
+bool LeoOutbox::IsOpen() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_view != NULL;
+}
+
+bool LeoOutbox::Post(const CString& endpoint, const std::string& jsonBody)
+{
+    size_t pending = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_view) {
+            LogMessage(_T("Journal is not open, message to ") + endpoint + _T(" not queued"));
+            return false;
+        }
+
+        CT2CA endpointUtf8(endpoint, CP_UTF8);
+        if (!Append(std::string((const char*)endpointUtf8), jsonBody)) {
+            return false;
+        }
+        pending = m_pendingCount;
+    }
+
+    CString msg;
+    msg.Format(_T("Queued %s (%u bytes), %d pending"), (LPCTSTR)endpoint,
+               static_cast<unsigned>(jsonBody.size()), static_cast<int>(pending));
+    LogMessage(msg);
+
+    Replay();
+    return true;
+}
+
+bool LeoOutbox::PostAssemblyData(const AssemblyData& data)
+{
+    return Post(L"/v2/receive-data", LeoWebClient::EncodeAssemblyDataJson(data));
+}
+
+void LeoOutbox::Replay()
+{
+    StartReplay(false);
+}
+
+size_t LeoOutbox::GetPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pendingCount;
+}
+
+CString LeoOutbox::Describe() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CString text;
+    text.Format(_T("outbox=%s pending=%d inFlight=%d failures=%d journalBytes=%llu delivered=%d dropped=%d compactions=%d"),
+                !m_view ? _T("closed") : (m_replaying ? _T("replaying") : _T("idle")),
+                static_cast<int>(m_pendingCount), m_attempt != 0 ? 1 : 0, m_failures,
+                static_cast<unsigned long long>(m_size), m_deliveredCount, m_droppedCount, m_compactionCount);
+    return text;
+}
+
+CString LeoOutbox::DefaultPath()
+{
+    wchar_t base[MAX_PATH] = { 0 };
+    DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", base, MAX_PATH);
+    if (length == 0 || length >= MAX_PATH) {
+        length = GetTempPathW(MAX_PATH, base);
+    }
+
+    CString directory(base);
+    directory.TrimRight(L'\\');
+    directory += L"\\Leo";
+    CreateDirectoryW(directory, NULL);
+    return directory + L"\\" + LEO_OUTBOX_FILE;
+}
+
+bool LeoOutbox::OpenJournalFile()
+{
+    m_file = CreateFileW(m_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                         OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize)) {
+        fileSize.QuadPart = 0;
+    }
+    uint64_t size = (std::max)(static_cast<uint64_t>(fileSize.QuadPart), static_cast<uint64_t>(LEO_OUTBOX_INITIAL_BYTES));
+
+    if (!MapJournal(size)) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    return true;
+}
+
+bool LeoOutbox::MapJournal(uint64_t size)
+{
+    // Mapping past the end of the file extends it with zeros
+    LARGE_INTEGER mappingSize;
+    mappingSize.QuadPart = static_cast<LONGLONG>(size);
+    m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READWRITE, mappingSize.HighPart, mappingSize.LowPart, NULL);
+    if (!m_mapping) {
+        return false;
+    }
+
+    m_view = static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    if (!m_view) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+        return false;
+    }
+    m_size = size;
+    return true;
+}
+
+void LeoOutbox::UnmapJournal()
+{
+    if (m_view) {
+        FlushViewOfFile(m_view, 0);
+        UnmapViewOfFile(m_view);
+        m_view = NULL;
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+}
+
+bool LeoOutbox::Recover()
+{
+    JournalHeader* header = Header();
+    if (header->Head < DATA_START || header->Head > m_size) {
+        header->Head = DATA_START;
+    }
+
+    // Walk the chain from Head; the first record that fails a check is the end of the journal
+    uint64_t offset = header->Head;
+    uint64_t lastSequence = 0;
+    size_t pending = 0;
+    while (const RecordHeader* record = ValidRecordAt(offset, lastSequence)) {
+        if (record->State == RECORD_PENDING) {
+            pending++;
+        }
+        lastSequence = record->Sequence;
+        offset += RecordSize(record->Length);
+    }
+
+    if (offset + sizeof(RecordHeader) <= m_size) {
+        const RecordHeader* next = RecordAt(offset);
+        if (next->Magic == RECORD_MAGIC && next->Sequence > lastSequence) {
+            CString msg;
+            msg.Format(_T("Dropped a torn record at offset %llu"), static_cast<unsigned long long>(offset));
+            LogMessage(msg);
+        }
+    }
+
+    m_tail = offset;
+    m_pendingCount = pending;
+    if (header->NextSequence <= lastSequence) {
+        header->NextSequence = lastSequence + 1;
+    }
+
+    AdvanceHead();
+    if (m_view && Header()->Head > DATA_START) {
+        Compact();
+    }
+    return m_view != NULL;
+}
+
+bool LeoOutbox::Append(const std::string& endpoint, const std::string& body)
+{
+    uint64_t payloadLength = sizeof(uint32_t) + endpoint.size() + body.size();
+    if (payloadLength > LEO_OUTBOX_MAX_BYTES) {
+        LogMessage(_T("Message is larger than the journal limit, not queued"));
+        return false;
+    }
+
+    uint64_t recordSize = RecordSize(static_cast<uint32_t>(payloadLength));
+    if (!EnsureSpace(recordSize)) {
+        return false;
+    }
+
+    char* at = m_view + m_tail;
+    char* payload = at + sizeof(RecordHeader);
+    uint32_t endpointLength = static_cast<uint32_t>(endpoint.size());
+    memcpy(payload, &endpointLength, sizeof(endpointLength));
+    memcpy(payload + sizeof(endpointLength), endpoint.data(), endpoint.size());
+    memcpy(payload + sizeof(endpointLength) + endpoint.size(), body.data(), body.size());
+
+    RecordHeader* record = reinterpret_cast<RecordHeader*>(at);
+    record->Length = static_cast<uint32_t>(payloadLength);
+    record->Sequence = Header()->NextSequence++;
+    record->Checksum = Crc32(payload, static_cast<size_t>(payloadLength));
+    record->State = RECORD_PENDING;
+
+    // The magic makes the record visible to recovery, so it goes in after everything else
+    MemoryBarrier();
+    record->Magic = RECORD_MAGIC;
+
+    FlushRange(m_tail, recordSize, false);
+    FlushRange(0, sizeof(JournalHeader), true);
+
+    m_tail += recordSize;
+    m_pendingCount++;
+    return true;
+}
+
+bool LeoOutbox::MarkDone(uint64_t sequence)
+{
+    for (uint64_t offset = Header()->Head; offset < m_tail; ) {
+        RecordHeader* record = RecordAt(offset);
+        if (record->Sequence == sequence) {
+            if (record->State == RECORD_PENDING) {
+                record->State = RECORD_DONE;
+                m_pendingCount--;
+                FlushRange(offset, sizeof(RecordHeader), false);
+            }
+            AdvanceHead();
+            return true;
+        }
+        offset += RecordSize(record->Length);
+    }
+    return false;
+}
+
+bool LeoOutbox::FindPending(uint64_t minSequence, PendingMessage& message) const
+{
+    for (uint64_t offset = Header()->Head; offset < m_tail; ) {
+        const RecordHeader* record = RecordAt(offset);
+        if (record->State == RECORD_PENDING && record->Sequence >= minSequence) {
+            const char* payload = reinterpret_cast<const char*>(record) + sizeof(RecordHeader);
+            uint32_t endpointLength = 0;
+            memcpy(&endpointLength, payload, sizeof(endpointLength));
+
+            std::string endpoint(payload + sizeof(endpointLength), endpointLength);
+            message.Sequence = record->Sequence;
+            message.Endpoint = CString(CA2W(endpoint.c_str(), CP_UTF8));
+            message.Body.assign(payload + sizeof(endpointLength) + endpointLength,
+                                record->Length - sizeof(endpointLength) - endpointLength);
+            return true;
+        }
+        offset += RecordSize(record->Length);
+    }
+    return false;
+}
+
+bool LeoOutbox::EnsureSpace(uint64_t bytes)
+{
+    if (m_tail + bytes <= m_size) {
+        return true;
+    }
+
+    // Reclaim the delivered prefix first, then grow the file
+    if (Header()->Head > DATA_START && Compact() && m_tail + bytes <= m_size) {
+        return true;
+    }
+
+    uint64_t size = m_size;
+    while (size < m_tail + bytes) {
+        size *= 2;
+    }
+    if (size > LEO_OUTBOX_MAX_BYTES) {
+        CString msg;
+        msg.Format(_T("Journal full (%d pending, limit %d bytes), message not queued"),
+                   static_cast<int>(m_pendingCount), LEO_OUTBOX_MAX_BYTES);
+        LogMessage(msg);
+        return false;
+    }
+
+    uint64_t oldSize = m_size;
+    UnmapJournal();
+    if (MapJournal(size)) {
+        return true;
+    }
+
+    LogMessage(_T("Cannot grow the journal, message not queued"));
+    if (!MapJournal(oldSize)) {
+        LogMessage(_T("Cannot remap the journal, outbox closed"));
+    }
+    return false;
+}
+
+bool LeoOutbox::Compact()
+{
+    // Pending records are copied into a fresh file that then replaces the journal, so a crash
+    // at any point leaves either the old or the new journal intact
+    CString tempPath = m_path + _T(".tmp");
+    HANDLE temp = CreateFileW(tempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (temp == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    JournalHeader header = *Header();
+    header.Head = DATA_START;
+    DWORD written = 0;
+    bool ok = WriteFile(temp, &header, sizeof(header), &written, NULL) && written == sizeof(header);
+
+    uint64_t newTail = DATA_START;
+    for (uint64_t offset = Header()->Head; ok && offset < m_tail; ) {
+        const RecordHeader* record = RecordAt(offset);
+        uint64_t recordSize = RecordSize(record->Length);
+        if (record->State == RECORD_PENDING) {
+            ok = WriteFile(temp, record, static_cast<DWORD>(recordSize), &written, NULL) && written == recordSize;
+            newTail += recordSize;
+        }
+        offset += recordSize;
+    }
+
+    // Shrink back once a backlog has drained, but keep room for the records that are left
+    uint64_t newSize = LEO_OUTBOX_INITIAL_BYTES;
+    while (newSize < newTail * 2 && newSize < m_size) {
+        newSize *= 2;
+    }
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>((std::max)(newSize, newTail));
+    ok = ok && SetFilePointerEx(temp, end, NULL, FILE_BEGIN) && SetEndOfFile(temp) && FlushFileBuffers(temp);
+    CloseHandle(temp);
+
+    if (!ok) {
+        DeleteFileW(tempPath);
+        LogMessage(_T("Compaction failed, keeping the journal as it is"));
+        return false;
+    }
+
+    UnmapJournal();
+    CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+
+    bool replaced = MoveFileExW(tempPath, m_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+    if (!replaced) {
+        DeleteFileW(tempPath);
+    }
+
+    if (!OpenJournalFile()) {
+        LogMessage(_T("Cannot reopen the journal after compaction, outbox closed"));
+        return false;
+    }
+    if (!replaced) {
+        LogMessage(_T("Compaction could not replace the journal, keeping the old one"));
+        return false;
+    }
+
+    m_tail = newTail;
+    m_compactionCount++;
+
+    CString msg;
+    msg.Format(_T("Journal compacted to %llu bytes, %d pending"),
+               static_cast<unsigned long long>(newTail), static_cast<int>(m_pendingCount));
+    LogMessage(msg);
+    return true;
+}
+
+void LeoOutbox::AdvanceHead()
+{
+    JournalHeader* header = Header();
+    uint64_t offset = header->Head;
+    while (offset < m_tail && RecordAt(offset)->State == RECORD_DONE) {
+        offset += RecordSize(RecordAt(offset)->Length);
+    }
+
+    if (offset >= m_tail) {
+        // Everything delivered: start over at the front. Leftover records there carry older
+        // sequence numbers, so recovery stops at them.
+        reinterpret_cast<RecordHeader*>(m_view + DATA_START)->Magic = 0;
+        header->Head = DATA_START;
+        m_tail = DATA_START;
+        FlushRange(0, sizeof(JournalHeader), false);
+
+        // A drained backlog gives its disk space back
+        if (m_size > LEO_OUTBOX_INITIAL_BYTES) {
+            Compact();
+        }
+        return;
+    }
+
+    header->Head = offset;
+    FlushRange(0, sizeof(JournalHeader), false);
+
+    if (header->Head - DATA_START > m_size / 2) {
+        Compact();
+    }
+}
+
+void LeoOutbox::FlushRange(uint64_t offset, uint64_t length, bool toDisk)
+{
+    FlushViewOfFile(m_view + offset, static_cast<SIZE_T>(length));
+    if (toDisk) {
+        FlushFileBuffers(m_file);
+    }
+}
+
+LeoOutbox::RecordHeader* LeoOutbox::RecordAt(uint64_t offset) const
+{
+    return reinterpret_cast<RecordHeader*>(m_view + offset);
+}
+
+const LeoOutbox::RecordHeader* LeoOutbox::ValidRecordAt(uint64_t offset, uint64_t lastSequence) const
+{
+    if (offset + sizeof(RecordHeader) > m_size) {
+        return NULL;
+    }
+
+    const RecordHeader* record = RecordAt(offset);
+    if (record->Magic != RECORD_MAGIC || record->Sequence <= lastSequence ||
+        record->Length < sizeof(uint32_t) || record->Length > m_size - offset - sizeof(RecordHeader) ||
+        (record->State != RECORD_PENDING && record->State != RECORD_DONE)) {
+        return NULL;
+    }
+
+    const char* payload = reinterpret_cast<const char*>(record) + sizeof(RecordHeader);
+    uint32_t endpointLength = 0;
+    memcpy(&endpointLength, payload, sizeof(endpointLength));
+    if (endpointLength > record->Length - sizeof(uint32_t) || Crc32(payload, record->Length) != record->Checksum) {
+        return NULL;
+    }
+    return record;
+}
+
+uint64_t LeoOutbox::RecordSize(uint32_t payloadLength)
+{
+    return (sizeof(RecordHeader) + static_cast<uint64_t>(payloadLength) + 7) & ~static_cast<uint64_t>(7);
+}
+
+void LeoOutbox::StartReplay(bool skipBackoff)
+{
+    PendingMessage message;
+    uint64_t attempt = 0;
+    LeoAsyncClient::RequestId waiting = LeoAsyncClient::INVALID_REQUEST;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_view || m_pendingCount == 0) {
+            return;
+        }
+
+        if (m_replaying) {
+            // Only a retry still waiting out its backoff is sent again, now that Leo is back
+            if (!skipBackoff || m_failures == 0) {
+                return;
+            }
+            waiting = m_inFlightRequest;
+            LogMessage(_T("Leo is up, retrying without waiting out the backoff"));
+        } else {
+            CString msg;
+            msg.Format(_T("Replaying %d pending message(s)"), static_cast<int>(m_pendingCount));
+            LogMessage(msg);
+            m_replaying = true;
+        }
+
+        if (!NextMessage(message)) {
+            return;
+        }
+        attempt = m_attempt;
+    }
+
+    if (waiting != LeoAsyncClient::INVALID_REQUEST) {
+        m_asyncClient.Cancel(waiting);
+    }
+    Submit(std::move(message), attempt, 0);
+}
+
+bool LeoOutbox::NextMessage(PendingMessage& message)
+{
+    // Records go out one at a time and stay pending until delivered or dropped, so the first
+    // pending record is always the next one, or the one to retry
+    if (!m_view || !FindPending(0, message)) {
+        if (m_replaying) {
+            LogMessage(m_pendingCount == 0 ? _T("Replay complete, outbox empty") : _T("Replay finished"));
+        }
+        m_replaying = false;
+        m_attempt = 0;
+        m_inFlightSequence = 0;
+        m_inFlightRequest = LeoAsyncClient::INVALID_REQUEST;
+        return false;
+    }
+
+    m_attempt = ++m_lastAttempt;
+    m_inFlightSequence = message.Sequence;
+    m_inFlightRequest = LeoAsyncClient::INVALID_REQUEST;
+    return true;
+}
+
+int LeoOutbox::RetryDelayMs() const
+{
+    int delayMs = LEO_OUTBOX_RETRY_MS;
+    for (int n = 1; n < m_failures && delayMs < LEO_OUTBOX_RETRY_MAX_MS; ++n) {
+        delayMs *= 2;
+    }
+    return (std::min)(delayMs, LEO_OUTBOX_RETRY_MAX_MS);
+}
+
+void LeoOutbox::Submit(PendingMessage message, uint64_t attempt, int delayMs)
+{
+    CString endpoint = message.Endpoint;
+    auto body = std::make_shared<const std::string>(std::move(message.Body));
+
+    LeoAsyncClient::RequestId id = m_asyncClient.Submit(
+        [this, attempt, endpoint, body](LeoWebClient& client, SuccessCallback onSuccess, ErrorCallback onError) {
+            int statusCode = 0;
+            CString failure;
+            bool sent = client.SendEncodedJson(endpoint, *body, onSuccess,
+                [&client, &statusCode, &failure, onError](const CString& error) {
+                    statusCode = client.GetLastStatusCode();
+                    failure = error;
+                    onError(error);
+                });
+
+            // Settled here on the I/O thread: the journal is updated off the UI thread, and the
+            // next record is queued only once this one's outcome is known
+            if (sent) {
+                OnDelivered(attempt);
+            } else {
+                OnFailed(attempt, statusCode, failure);
+            }
+            return sent;
+        },
+        nullptr,
+        // Only matters when the work never ran (its deadline passed in the queue); an attempt
+        // the work already settled is ignored
+        [this, attempt](const CString& error) { OnFailed(attempt, 0, error); },
+        nullptr,
+        LEO_OUTBOX_DEADLINE_MS,
+        delayMs);
+
+    // The replay may have been stopped, or the attempt settled, while this one was being submitted
+    bool stillWanted = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_attempt == attempt) {
+            stillWanted = true;
+            m_inFlightRequest = id;
+            if (id == LeoAsyncClient::INVALID_REQUEST) {
+                LogMessage(_T("Async client is not running, replay stopped"));
+                m_replaying = false;
+                m_attempt = 0;
+                m_inFlightSequence = 0;
+            }
+        }
+    }
+    if (!stillWanted && id != LeoAsyncClient::INVALID_REQUEST) {
+        m_asyncClient.Cancel(id);
+    }
+}
+
+void LeoOutbox::OnDelivered(uint64_t attempt)
+{
+    PendingMessage next;
+    uint64_t nextAttempt = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_view || attempt != m_attempt) {
+            return;
+        }
+
+        m_rejections.erase(m_inFlightSequence);
+        MarkDone(m_inFlightSequence);
+        m_deliveredCount++;
+        m_failures = 0;
+        if (!NextMessage(next)) {
+            return;
+        }
+        nextAttempt = m_attempt;
+    }
+    Submit(std::move(next), nextAttempt, 0);
+}
+
+void LeoOutbox::OnFailed(uint64_t attempt, int statusCode, const CString& error)
+{
+    PendingMessage next;
+    uint64_t nextAttempt = 0;
+    int delayMs = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_view || attempt != m_attempt) {
+            return;
+        }
+
+        // Leo answered and refused the message: retrying it forever would block the queue
+        uint64_t sequence = m_inFlightSequence;
+        bool rejected = statusCode >= 400 && statusCode < 500 && statusCode != 408 && statusCode != 429;
+        if (rejected && ++m_rejections[sequence] >= LEO_OUTBOX_MAX_REJECTS) {
+            CString msg;
+            msg.Format(_T("Dropping message %llu, Leo rejected it %d times (status %d)"),
+                       static_cast<unsigned long long>(sequence), LEO_OUTBOX_MAX_REJECTS, statusCode);
+            LogMessage(msg);
+
+            m_rejections.erase(sequence);
+            MarkDone(sequence);
+            m_droppedCount++;
+            m_failures = 0;
+        } else {
+            // Later messages must not overtake this one, so the replay waits on it
+            m_failures++;
+            delayMs = RetryDelayMs();
+            CString msg;
+            msg.Format(_T("Message %llu failed (status %d), retrying in %d ms: "),
+                       static_cast<unsigned long long>(sequence), statusCode, delayMs);
+            LogMessage(msg + error);
+        }
+
+        if (!NextMessage(next)) {
+            return;
+        }
+        nextAttempt = m_attempt;
+    }
+    Submit(std::move(next), nextAttempt, delayMs);
+}
+
+void LeoOutbox::LogMessage(const CString& message)
+{
+    LEO_INFO(Http, _T("LeoOutbox: %s"), (LPCTSTR)message);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include "LeoAsyncClient.h"
+
+// Durable outbox for non-interactive Leo messages (assembly uploads and the like).
+// Every message is first appended to a memory-mapped, append-only journal on disk and only
+// then sent, so nothing is lost while Leo is down, restarting or when Creo exits early.
+// Records carry a sequence number and a CRC; a torn tail left by a crash is dropped on the
+// next Open(). Delivered records are flagged done in place and the journal is compacted once
+// the done prefix dominates it.
+// Replay runs whenever Leo comes up (liveness probe) or a message is posted: pending records
+// go out in journal order through LeoAsyncClient, one at a time. Each record's outcome is
+// settled on the I/O thread before the next one is queued, so a later record never overtakes
+// an earlier one, and marking it done and compacting the journal stay off Creo's UI thread.
+// A failed record is retried after a doubling backoff (an up transition cuts the wait short);
+// one Leo rejects LEO_OUTBOX_MAX_REJECTS times is dropped. Delivery is at-least-once.
+// The async client must be stopped before the outbox is destroyed.
+class LeoOutbox {
+public:
+    LeoOutbox(LeoAsyncClient& asyncClient, LeoLivenessProbe& liveness);
+    ~LeoOutbox();
+
+    bool Open(const CString& path);     // Creates the journal if needed and recovers pending records
+    void Close();
+    bool IsOpen() const;
+
+    // Journals the message and starts a replay; false only if it could not be made durable
+    bool Post(const CString& endpoint, const std::string& jsonBody);
+    bool PostAssemblyData(const AssemblyData& data);
+
+    void Replay();                      // Sends pending records in order; no-op while a replay runs
+
+    size_t GetPendingCount() const;
+    CString Describe() const;           // One-line state summary for diagnostics
+
+    static CString DefaultPath();       // %LOCALAPPDATA%\Leo\LEO_OUTBOX_FILE
+
+private:
+    LeoOutbox(const LeoOutbox&) = delete;
+    LeoOutbox& operator=(const LeoOutbox&) = delete;
+
+    // On-disk layout: JournalHeader, then 8-byte aligned records (RecordHeader + payload).
+    // The payload is a uint32 endpoint length, the UTF-8 endpoint and the JSON body.
+    struct JournalHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        uint64_t Head;              // Offset of the first record that may still be pending
+        uint64_t NextSequence;
+        uint64_t Reserved;
+    };
+
+    struct RecordHeader {
+        uint32_t Magic;             // Written last, after the rest of the record is in place
+        uint32_t Length;            // Payload bytes
+        uint64_t Sequence;          // Strictly increasing; a smaller one marks stale data
+        uint32_t Checksum;          // CRC-32 of the payload
+        uint32_t State;             // RECORD_PENDING or RECORD_DONE
+    };
+
+    struct PendingMessage {
+        uint64_t Sequence;
+        CString Endpoint;
+        std::string Body;
+    };
+
+    // Journal primitives; callers hold m_mutex
+    bool OpenJournalFile();
+    bool MapJournal(uint64_t size);
+    void UnmapJournal();
+    bool Recover();
+    bool Append(const std::string& endpoint, const std::string& body);
+    bool MarkDone(uint64_t sequence);
+    bool FindPending(uint64_t minSequence, PendingMessage& message) const;
+    bool EnsureSpace(uint64_t bytes);
+    bool Compact();
+    void AdvanceHead();
+    void FlushRange(uint64_t offset, uint64_t length, bool toDisk);
+    RecordHeader* RecordAt(uint64_t offset) const;                             // Inside [Head, m_tail)
+    const RecordHeader* ValidRecordAt(uint64_t offset, uint64_t lastSequence) const;  // Recovery: checks everything
+    static uint64_t RecordSize(uint32_t payloadLength);
+    JournalHeader* Header() const { return reinterpret_cast<JournalHeader*>(m_view); }
+
+    // Replay; NextMessage() and RetryDelayMs() are called with m_mutex held. An attempt is one
+    // submission of one record; outcomes of any attempt but the current one are ignored.
+    void StartReplay(bool skipBackoff);     // skipBackoff: a retry waiting out its backoff goes at once
+    bool NextMessage(PendingMessage& message);
+    int RetryDelayMs() const;
+    void Submit(PendingMessage message, uint64_t attempt, int delayMs);
+    void OnDelivered(uint64_t attempt);
+    void OnFailed(uint64_t attempt, int statusCode, const CString& error);
+
+    void LogMessage(const CString& message);
+
+    LeoAsyncClient& m_asyncClient;
+    LeoLivenessProbe& m_liveness;
+    LeoLivenessProbe::SubscriptionId m_subscription;
+
+    mutable std::mutex m_mutex;
+    CString m_path;
+    HANDLE m_file;
+    HANDLE m_mapping;
+    char* m_view;
+    uint64_t m_size;
+    uint64_t m_tail;                    // End of the last valid record
+    size_t m_pendingCount;
+
+    bool m_replaying;
+    uint64_t m_attempt;                 // Current attempt; 0 while none is in flight
+    uint64_t m_lastAttempt;
+    uint64_t m_inFlightSequence;        // Record of the current attempt
+    LeoAsyncClient::RequestId m_inFlightRequest;
+    int m_failures;                     // Consecutive failed attempts, for the backoff
+    std::map<uint64_t, int> m_rejections;
+    int m_deliveredCount;
+    int m_droppedCount;
+    int m_compactionCount;
+
+    static const uint32_t JOURNAL_MAGIC = 0x58424F4C;      // "LOBX"
+    static const uint32_t JOURNAL_VERSION = 1;
+    static const uint32_t RECORD_MAGIC = 0x4345524C;       // "LREC"
+    static const uint32_t RECORD_PENDING = 0;
+    static const uint32_t RECORD_DONE = 1;
+};
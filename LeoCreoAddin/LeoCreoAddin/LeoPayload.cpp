@@ -0,0 +1,434 @@
+#include "stdafx.h"
+#include "LeoPayload.h"
+#include "LeoBodyStream.h"
+#include "LeoJsonIndex.h"
+#include "LeoPayloadKeys.h"
+#include "LeoWireFormat.h"
+#include "LogFileWriter.h"
+#include <cstring>
+#include <string>
+
+static CString Utf8ToCString(const char* data, size_t length)
+{
+    CString result;
+    if (length == 0) {
+        return result;
+    }
+
+    int wideLen = MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(length), NULL, 0);
+    if (wideLen > 0) {
+        MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(length), result.GetBuffer(wideLen), wideLen);
+        result.ReleaseBuffer(wideLen);
+    }
+    return result;
+}
+
+// Converts into scratch, which the encoders reuse for every string of a payload
+static const std::string& CStringToUtf8(const CString& value, std::string& scratch)
+{
+    scratch.clear();
+    int length = value.GetLength();
+    if (length == 0) {
+        return scratch;
+    }
+
+    int utf8Len = WideCharToMultiByte(CP_UTF8, 0, value.GetString(), length, NULL, 0, NULL, NULL);
+    if (utf8Len > 0) {
+        scratch.resize(utf8Len);
+        WideCharToMultiByte(CP_UTF8, 0, value.GetString(), length, &scratch[0], utf8Len, NULL, NULL);
+    }
+    return scratch;
+}
+
+// Member names are looked up unescaped, so "loc" selects "loc" as any JSON parser would.
+// Names hardly ever contain escapes; the plain case costs one memchr.
+template <typename Table>
+static int FindMember(const Table& table, const JsonIndexReader& reader, const char* key, size_t keyLength,
+                      RequestArena* arena)
+{
+    if (!memchr(key, '\\', keyLength)) {
+        return table.Find(key, keyLength);
+    }
+
+    JsonValue name;
+    name.Kind = '"';
+    name.Text = key;
+    name.TextLength = keyLength;
+    ArenaString unescaped((ArenaAllocator<char>(arena)));
+    return reader.GetString(name, unescaped) ? table.Find(unescaped.data(), unescaped.size()) : -1;
+}
+
+// JSON decoding: walks the structural index built by JsonStructuralIndex
+
+static bool ParseLocation(const JsonIndexReader& reader, const JsonValue& value, Location& location, RequestArena* arena)
+{
+    // Extract X, Y, Z coordinates; all three must be present
+    double coords[3] = { 0.0, 0.0, 0.0 };
+    bool found[3] = { false, false, false };
+
+    bool walked = reader.ForEachMember(value, [&](const char* key, size_t keyLength, const JsonValue& member) {
+        int axis = FindMember(kLocationTable, reader, key, keyLength, arena);
+        if (axis >= 0) {
+            found[axis] = reader.GetDouble(member, coords[axis]);
+        }
+        return true;
+    });
+
+    if (walked && found[0] && found[1] && found[2]) {
+        location.X = coords[0];
+        location.Y = coords[1];
+        location.Z = coords[2];
+        return true;
+    }
+
+    return false;
+}
+
+static void ParseOrientationMatrix(const JsonIndexReader& reader, const JsonValue& value, std::vector<std::vector<double>>& matrix)
+{
+    // Expect a 3x3 array of numbers; anything else falls back to the identity matrix
+    double values[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+    int row = 0;
+
+    bool walked = reader.ForEachElement(value, [&](const JsonValue& rowValue) {
+        if (row >= 3) {
+            return false;
+        }
+        int column = 0;
+        bool rowOk = reader.ForEachElement(rowValue, [&](const JsonValue& cell) {
+            return column < 3 && reader.GetDouble(cell, values[row][column++]);
+        });
+        if (!rowOk || column != 3) {
+            return false;
+        }
+        row++;
+        return true;
+    });
+
+    if (!walked || row != 3) {
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                values[i][j] = (i == j) ? 1.0 : 0.0;
+            }
+        }
+        LEO_INFO(Server, _T("LeoPayload: Orientation is not a 3x3 numeric matrix, using identity"));
+    }
+
+    // Rows are overwritten in place, reusing the storage of the default identity matrix
+    matrix.resize(3);
+    for (int i = 0; i < 3; i++) {
+        matrix[i].assign(values[i], values[i] + 3);
+    }
+}
+
+static bool ParseLocationInfo(const JsonIndexReader& reader, const JsonValue& value, LocationInfo& locationInfo, RequestArena* arena)
+{
+    // Decode straight into the caller's struct; no temporaries are copied around
+    return reader.ForEachMember(value, [&](const char* key, size_t keyLength, const JsonValue& member) {
+        switch (FindMember(kLocationInfoTable, reader, key, keyLength, arena)) {
+            case kLoc:
+                ParseLocation(reader, member, locationInfo.Loc, arena);
+                break;
+            case kOrientation:
+                ParseOrientationMatrix(reader, member, locationInfo.Orientation);
+                break;
+            default:
+                break;
+        }
+        return true;
+    });
+}
+
+bool ParseFileDownloadInfo(const char* json, size_t length, FileDownloadInfo& fileInfo, RequestArena* arena)
+{
+    // Stage 1: index every structural character once (AVX2 when available)
+    JsonStructuralIndex index(arena);
+    if (!index.Build(json, length)) {
+        return false;
+    }
+
+    // Stage 2: check the grammar, then walk the index and decode only the members we know
+    JsonIndexReader reader(index);
+    JsonValue root;
+    if (!reader.IsWellFormed() || !reader.Root(root) || root.Kind != '{') {
+        return false;
+    }
+
+    return reader.ForEachMember(root, [&](const char* key, size_t keyLength, const JsonValue& value) {
+        switch (FindMember(kFileDownloadInfoTable, reader, key, keyLength, arena)) {
+            case kDownloadPath: {
+                ArenaString downloadPath((ArenaAllocator<char>(arena)));
+                if (reader.GetString(value, downloadPath) && !downloadPath.empty()) {
+                    fileInfo.DownloadPath = Utf8ToCString(downloadPath.data(), downloadPath.size());
+                }
+                break;
+            }
+            case kLocationInfo:
+                ParseLocationInfo(reader, value, fileInfo.LocationInfo, arena);
+                break;
+            default:
+                break;
+        }
+        return true;
+    });
+}
+
+// MessagePack decoding (Content-Type: application/msgpack)
+
+static bool ParseLocationMsgPack(MsgPackReader& reader, Location& location)
+{
+    uint32_t count = 0;
+    if (!reader.ReadMapHeader(count)) {
+        return false;
+    }
+
+    // All three axes must be present, as in ParseLocation; location is only written on success
+    double coords[3] = { 0.0, 0.0, 0.0 };
+    bool found[3] = { false, false, false };
+
+    for (uint32_t i = 0; i < count; i++) {
+        const char* key = nullptr;
+        uint32_t keyLength = 0;
+        if (!reader.ReadString(key, keyLength)) {
+            return false;
+        }
+
+        int axis = kLocationTable.Find(key, keyLength);
+        if (axis >= 0) {
+            found[axis] = reader.ReadDouble(coords[axis]);
+            if (!found[axis]) {
+                return false;
+            }
+        } else if (!reader.Skip()) {
+            return false;
+        }
+    }
+
+    if (!found[0] || !found[1] || !found[2]) {
+        return false;
+    }
+
+    location.X = coords[0];
+    location.Y = coords[1];
+    location.Z = coords[2];
+    return true;
+}
+
+static bool ParseOrientationMatrixMsgPack(MsgPackReader& reader, std::vector<std::vector<double>>& matrix)
+{
+    uint32_t rows = 0;
+    if (!reader.ReadArrayHeader(rows) || rows != 3) {
+        return false;
+    }
+
+    matrix.assign(3, std::vector<double>(3, 0.0));
+    for (uint32_t i = 0; i < rows; i++) {
+        uint32_t columns = 0;
+        if (!reader.ReadArrayHeader(columns) || columns != 3) {
+            return false;
+        }
+        for (uint32_t j = 0; j < columns; j++) {
+            if (!reader.ReadDouble(matrix[i][j])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool ParseLocationInfoMsgPack(MsgPackReader& reader, LocationInfo& locationInfo)
+{
+    uint32_t count = 0;
+    if (!reader.ReadMapHeader(count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const char* key = nullptr;
+        uint32_t keyLength = 0;
+        if (!reader.ReadString(key, keyLength)) {
+            return false;
+        }
+
+        switch (kLocationInfoTable.Find(key, keyLength)) {
+            case kLoc:
+                if (!ParseLocationMsgPack(reader, locationInfo.Loc)) {
+                    return false;
+                }
+                break;
+            case kOrientation:
+                if (!ParseOrientationMatrixMsgPack(reader, locationInfo.Orientation)) {
+                    return false;
+                }
+                break;
+            default:
+                if (!reader.Skip()) {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool ParseFileDownloadInfoMsgPack(const char* body, size_t length, FileDownloadInfo& fileInfo)
+{
+    MsgPackReader reader(body, length);
+    uint32_t count = 0;
+    if (!reader.ReadMapHeader(count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const char* key = nullptr;
+        uint32_t keyLength = 0;
+        if (!reader.ReadString(key, keyLength)) {
+            return false;
+        }
+
+        switch (kFileDownloadInfoTable.Find(key, keyLength)) {
+            case kDownloadPath: {
+                const char* path = nullptr;
+                uint32_t pathLength = 0;
+                if (!reader.ReadString(path, pathLength)) {
+                    return false;
+                }
+                fileInfo.DownloadPath = Utf8ToCString(path, pathLength);
+                break;
+            }
+            case kLocationInfo:
+                if (!ParseLocationInfoMsgPack(reader, fileInfo.LocationInfo)) {
+                    return false;
+                }
+                break;
+            default:
+                if (!reader.Skip()) {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    return true;
+}
+
+// Assembly encoding: streamed into the upload one child at a time
+
+static void WriteJsonCString(ChunkedBodyWriter& out, const CString& value, std::string& scratch)
+{
+    const std::string& utf8 = CStringToUtf8(value, scratch);
+    WriteJsonString(out, utf8.data(), utf8.size());
+}
+
+void WriteAssemblyDataJson(ChunkedBodyWriter& out, const AssemblyData& data)
+{
+    std::string scratch;
+
+    out.Write("{\"AssemblyRoot\":");
+    WriteJsonCString(out, data.AssemblyRoot, scratch);
+    out.Write(",\"UserInstruction\":");
+    WriteJsonCString(out, data.UserInstruction, scratch);
+    out.Write(",\"ChildrenList\":[");
+
+    for (size_t i = 0; i < data.ChildrenList.size(); ++i) {
+        const auto& child = data.ChildrenList[i];
+        if (i > 0) out.Put(',');
+
+        out.Write("{\"Name\":");
+        WriteJsonCString(out, child.Name, scratch);
+        out.Write(",\"LocalPath\":");
+        WriteJsonCString(out, child.LocalPath, scratch);
+        out.Write(",\"Locations\":[");
+
+        for (size_t j = 0; j < child.Locations.size(); ++j) {
+            const auto& location = child.Locations[j];
+            if (j > 0) out.Put(',');
+
+            out.Write("{\"Loc\":{\"x\":");
+            WriteJsonNumber(out, location.Loc.X);
+            out.Write(",\"y\":");
+            WriteJsonNumber(out, location.Loc.Y);
+            out.Write(",\"z\":");
+            WriteJsonNumber(out, location.Loc.Z);
+            out.Write("},\"Orientation\":[");
+            for (size_t r = 0; r < location.Orientation.size(); ++r) {
+                if (r > 0) out.Put(',');
+                out.Put('[');
+                for (size_t c = 0; c < location.Orientation[r].size(); ++c) {
+                    if (c > 0) out.Put(',');
+                    WriteJsonNumber(out, location.Orientation[r][c]);
+                }
+                out.Put(']');
+            }
+            out.Write("]}");
+        }
+
+        out.Write("]}");
+    }
+
+    out.Write("]}");
+}
+
+static void WriteMsgPackCString(MsgPackWriter& writer, const CString& value, std::string& scratch)
+{
+    const std::string& utf8 = CStringToUtf8(value, scratch);
+    writer.WriteString(utf8.data(), utf8.size());
+}
+
+static void WriteMsgPackOrientation(MsgPackWriter& writer, const std::vector<std::vector<double>>& matrix)
+{
+    writer.WriteArrayHeader(static_cast<uint32_t>(matrix.size()));
+    for (const auto& row : matrix) {
+        writer.WriteArrayHeader(static_cast<uint32_t>(row.size()));
+        for (double value : row) {
+            writer.WriteDouble(value);
+        }
+    }
+}
+
+void WriteAssemblyDataMsgPack(ChunkedBodyWriter& out, const AssemblyData& data)
+{
+    // The encoder buffers one child at a time and hands it to the upload
+    MsgPackWriter writer;
+    writer.Reserve(4096);
+    std::string scratch;
+
+    writer.WriteMapHeader(3);
+    writer.WriteString("AssemblyRoot", 12);
+    WriteMsgPackCString(writer, data.AssemblyRoot, scratch);
+    writer.WriteString("UserInstruction", 15);
+    WriteMsgPackCString(writer, data.UserInstruction, scratch);
+
+    writer.WriteString("ChildrenList", 12);
+    writer.WriteArrayHeader(static_cast<uint32_t>(data.ChildrenList.size()));
+    for (const auto& child : data.ChildrenList) {
+        writer.WriteMapHeader(3);
+        writer.WriteString("Name", 4);
+        WriteMsgPackCString(writer, child.Name, scratch);
+        writer.WriteString("LocalPath", 9);
+        WriteMsgPackCString(writer, child.LocalPath, scratch);
+
+        writer.WriteString("Locations", 9);
+        writer.WriteArrayHeader(static_cast<uint32_t>(child.Locations.size()));
+        for (const auto& location : child.Locations) {
+            writer.WriteMapHeader(2);
+            writer.WriteString("Loc", 3);
+            writer.WriteMapHeader(3);
+            writer.WriteString("x", 1);
+            writer.WriteDouble(location.Loc.X);
+            writer.WriteString("y", 1);
+            writer.WriteDouble(location.Loc.Y);
+            writer.WriteString("z", 1);
+            writer.WriteDouble(location.Loc.Z);
+            writer.WriteString("Orientation", 11);
+            WriteMsgPackOrientation(writer, location.Orientation);
+        }
+
+        out.Write(writer.Buffer());
+        writer.Clear();
+    }
+
+    out.Write(writer.Buffer());
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "LeoArena.h"
+
+// Payloads exchanged with Leo and their codecs: the assembly the add-in uploads (AssemblyData)
+// and the part opening request Leo posts to the add-in's web server (FileDownloadInfo).
+// Nothing here needs Windows beyond CString, so LeoTests runs the codecs on every platform.
+
+class ChunkedBodyWriter;
+
+// 3D Location structure for component positioning
+struct Location {
+    double X;
+    double Y;
+    double Z;
+
+    Location() : X(0.0), Y(0.0), Z(0.0) {}
+    Location(double x, double y, double z) : X(x), Y(y), Z(z) {}
+};
+
+// Location information for file placement
+struct LocationInfo {
+    Location Loc;
+    std::vector<std::vector<double>> Orientation;
+
+    LocationInfo() {
+        // Initialize 3x3 identity matrix
+        Orientation = { {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0} };
+    }
+};
+
+// Location wrapper with orientation matrix
+struct LocationWrapper {
+    Location Loc;
+    std::vector<std::vector<double>> Orientation;
+
+    LocationWrapper() {
+        // Initialize 3x3 identity matrix
+        Orientation = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+    }
+};
+
+// Child component structure
+struct Child {
+    CString Name;
+    CString LocalPath;
+    std::vector<LocationWrapper> Locations;
+
+    Child() = default;
+};
+
+// Assembly data structure
+struct AssemblyData {
+    CString AssemblyRoot;
+    CString UserInstruction;
+    std::vector<Child> ChildrenList;
+
+    AssemblyData() = default;
+};
+
+// File download information
+struct FileDownloadInfo {
+    CString DownloadPath;
+    ::LocationInfo LocationInfo;        // Qualified: the member reuses the type's name
+
+    FileDownloadInfo() = default;
+};
+
+// Decode a part opening request body into fileInfo. Member names match case-insensitively and
+// unknown members are skipped.
+// JSON: any malformed document is rejected. Within a well-formed one, a "loc" lacking one of
+// the three numeric axes is ignored and an orientation that is not a 3x3 numeric matrix becomes
+// the identity. The structural index and unescaped strings live in arena.
+bool ParseFileDownloadInfo(const char* json, size_t length, FileDownloadInfo& fileInfo, RequestArena* arena);
+
+// MessagePack bodies come from typed encoders, so any member of the wrong shape rejects the body
+bool ParseFileDownloadInfoMsgPack(const char* body, size_t length, FileDownloadInfo& fileInfo);
+
+// Streaming assembly encoders: one child at a time, so memory stays bounded for any assembly size
+void WriteAssemblyDataJson(ChunkedBodyWriter& out, const AssemblyData& data);
+void WriteAssemblyDataMsgPack(ChunkedBodyWriter& out, const AssemblyData& data);
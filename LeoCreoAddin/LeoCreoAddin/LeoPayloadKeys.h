@@ -0,0 +1,34 @@
+#pragma once
+
+#include "LeoKeyDispatch.h"
+
+// Member names of the payloads the add-in decodes, one table per struct. Each enum lists the
+// keys in table order, so Find() returns the enumerator. The decoders and LeoTests share
+// these definitions.
+
+// Leo response body and each of its candidates (LeoResponseParser)
+enum ResponseKey { kStatus, kMessage, kCandidates };
+static constexpr KeyName kResponseKeys[] = { Key("status"), Key("message"), Key("candidates") };
+static constexpr auto kResponseTable = MakeKeyTable(kResponseKeys);
+
+enum CandidateKey { kName, kPath, kLocalPath, kScore };
+static constexpr KeyName kCandidateKeys[] = { Key("name"), Key("path"), Key("localPath"), Key("score") };
+static constexpr auto kCandidateTable = MakeKeyTable(kCandidateKeys);
+
+// Part opening request (LeoPayload). Lookup is case-insensitive, so both the documented
+// spelling (DownloadPath, LocationInfo, Loc) and the camelCase one are accepted.
+enum FileDownloadInfoKey { kDownloadPath, kLocationInfo };
+static constexpr KeyName kFileDownloadInfoKeys[] = { Key("downloadPath"), Key("locationInfo") };
+static constexpr auto kFileDownloadInfoTable = MakeKeyTable(kFileDownloadInfoKeys);
+
+enum LocationInfoKey { kLoc, kOrientation };
+static constexpr KeyName kLocationInfoKeys[] = { Key("loc"), Key("orientation") };
+static constexpr auto kLocationInfoTable = MakeKeyTable(kLocationInfoKeys);
+
+enum LocationKey { kX, kY, kZ };
+static constexpr KeyName kLocationKeys[] = { Key("x"), Key("y"), Key("z") };
+static constexpr auto kLocationTable = MakeKeyTable(kLocationKeys);
+
+static_assert(kResponseTable.IsPerfect() && kCandidateTable.IsPerfect() && kFileDownloadInfoTable.IsPerfect() &&
+              kLocationInfoTable.IsPerfect() && kLocationTable.IsPerfect(),
+              "Payload key tables must be collision-free");
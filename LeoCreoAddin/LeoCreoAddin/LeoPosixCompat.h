@@ -0,0 +1,247 @@
+#pragma once
+
+#ifndef _WIN32
+
+// The few Windows and MFC names the portable modules use (LeoWireFormat, LeoJsonIndex,
+// LeoArena, LeoBodyStream, LeoResponseParser, LeoPayload, LeoHttpRequest, LeoPosixTransport),
+// so they build on Linux and macOS for LeoTests. Not meant to cover the rest of the add-in.
+
+#include <algorithm>
+#include <cassert>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <string>
+#include <utility>
+
+// There is no LogFileWriter outside Windows; INFO and below compile away, and the
+// modules above log nothing at WARN or ERROR
+#define LEO_LOG_COMPILED_LEVEL 5    // LEO_LOG_LEVEL_OFF
+
+#ifndef ASSERT
+#define ASSERT(expr) assert(expr)
+#endif
+
+#ifndef _T
+#define LEO_WIDEN(text) L##text
+#define _T(text) LEO_WIDEN(text)     // Two steps, as in tchar.h, so macro arguments expand first
+#endif
+
+#define CP_UTF8 65001
+
+typedef const wchar_t* LPCTSTR;
+typedef const wchar_t* LPCWSTR;
+
+// Narrow text in the ANSI code page; only converted to CString
+class CStringA {
+public:
+    CStringA(const char* text, int length) : m_text(text, static_cast<size_t>(length)) {}
+    operator const char*() const { return m_text.c_str(); }
+
+private:
+    std::string m_text;
+};
+
+// Minimal CString: wide text with the GetBuffer/ReleaseBuffer protocol and the searching and
+// trimming LeoHttpRequest does on a request head
+class CString {
+public:
+    CString() {}
+    CString(const wchar_t* text) : m_text(text ? text : L"") {}
+    CString(const wchar_t* text, int length) : m_text(text, static_cast<size_t>(length)) {}
+    explicit CString(const char* text)     // ANSI taken as Latin-1
+    {
+        for (const char* c = text ? text : ""; *c; ++c) {
+            m_text.push_back(static_cast<wchar_t>(static_cast<unsigned char>(*c)));
+        }
+    }
+
+    CString& operator=(const wchar_t* text) { m_text = text ? text : L""; return *this; }
+
+    wchar_t* GetBuffer(int minLength)
+    {
+        if (m_text.size() < static_cast<size_t>(minLength)) {
+            m_text.resize(static_cast<size_t>(minLength));
+        }
+        return &m_text[0];
+    }
+
+    void ReleaseBuffer(int newLength = -1)
+    {
+        m_text.resize(newLength < 0 ? wcslen(m_text.c_str()) : static_cast<size_t>(newLength));
+    }
+
+    int GetLength() const { return static_cast<int>(m_text.size()); }
+    bool IsEmpty() const { return m_text.empty(); }
+    const wchar_t* GetString() const { return m_text.c_str(); }
+    operator const wchar_t*() const { return m_text.c_str(); }
+
+    bool operator==(const CString& other) const { return m_text == other.m_text; }
+    bool operator!=(const CString& other) const { return m_text != other.m_text; }
+    bool operator==(const wchar_t* other) const { return m_text == (other ? other : L""); }
+    bool operator!=(const wchar_t* other) const { return !(*this == other); }
+    bool operator<(const CString& other) const { return m_text < other.m_text; }
+    wchar_t operator[](int index) const { return m_text[static_cast<size_t>(index)]; }
+
+    int Find(const wchar_t* text, int start = 0) const { return ToIndex(m_text.find(text, static_cast<size_t>(start))); }
+    int Find(wchar_t c, int start = 0) const { return ToIndex(m_text.find(c, static_cast<size_t>(start))); }
+
+    CString Left(int count) const { return CString(m_text.substr(0, Clamp(count))); }
+    CString Mid(int first) const { return CString(m_text.substr(Clamp(first))); }
+    CString Mid(int first, int count) const { return CString(m_text.substr(Clamp(first), static_cast<size_t>(count < 0 ? 0 : count))); }
+
+    CString& Trim()
+    {
+        static const wchar_t kSpace[] = L" \t\r\n";
+        size_t begin = m_text.find_first_not_of(kSpace);
+        if (begin == std::wstring::npos) {
+            m_text.clear();
+        } else {
+            m_text.erase(m_text.find_last_not_of(kSpace) + 1);
+            m_text.erase(0, begin);
+        }
+        return *this;
+    }
+
+    CString& MakeLower()
+    {
+        for (wchar_t& c : m_text) {
+            c = static_cast<wchar_t>(towlower(c));
+        }
+        return *this;
+    }
+
+private:
+    explicit CString(std::wstring&& text) : m_text(std::move(text)) {}
+
+    static int ToIndex(size_t position) { return position == std::wstring::npos ? -1 : static_cast<int>(position); }
+    size_t Clamp(int index) const { return index < 0 ? 0 : (std::min)(static_cast<size_t>(index), m_text.size()); }
+
+    std::wstring m_text;
+};
+
+inline long long _ttoi64(const wchar_t* text)
+{
+    return wcstoll(text, nullptr, 10);
+}
+
+template <size_t N>
+int sprintf_s(char (&buffer)[N], const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer, N, format, args);
+    va_end(args);
+    return written;
+}
+
+// UTF-8 to wchar_t (UTF-32 here), with the Windows behaviour for flags 0: each malformed
+// sequence becomes U+FFFD. Returns the characters written, or the count needed when output
+// is null.
+inline int MultiByteToWideChar(unsigned codePage, unsigned long flags, const char* input, int inputLength,
+                               wchar_t* output, int outputLength)
+{
+    (void)codePage;
+    (void)flags;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(input);
+    size_t length = inputLength < 0 ? strlen(input) + 1 : static_cast<size_t>(inputLength);
+    int count = 0;
+
+    for (size_t i = 0; i < length;) {
+        unsigned char lead = data[i];
+        unsigned long codePoint = 0xFFFD;
+        size_t extra = lead < 0x80 ? 0 : lead >= 0xC2 && lead < 0xE0 ? 1 : lead >= 0xE0 && lead < 0xF0 ? 2
+                     : lead >= 0xF0 && lead < 0xF5 ? 3 : static_cast<size_t>(-1);
+        size_t used = 1;
+
+        if (extra == 0) {
+            codePoint = lead;
+        } else if (extra != static_cast<size_t>(-1)) {
+            unsigned long value = lead & (0x3F >> extra);
+            size_t j = 1;
+            for (; j <= extra && i + j < length; ++j) {
+                unsigned char next = data[i + j];
+                // Second byte ranges rule out overlong forms, surrogates and values past U+10FFFF
+                unsigned char low = 0x80, high = 0xBF;
+                if (j == 1 && lead == 0xE0) low = 0xA0;
+                if (j == 1 && lead == 0xED) high = 0x9F;
+                if (j == 1 && lead == 0xF0) low = 0x90;
+                if (j == 1 && lead == 0xF4) high = 0x8F;
+                if (next < low || next > high) {
+                    break;
+                }
+                value = (value << 6) | (next & 0x3F);
+            }
+            if (j > extra) {
+                codePoint = value;
+                used = extra + 1;
+            } else {
+                used = j;       // The valid prefix of a truncated sequence is one replacement
+            }
+        }
+
+        if (output) {
+            if (count >= outputLength) {
+                return 0;
+            }
+            output[count] = static_cast<wchar_t>(codePoint);
+        }
+        ++count;
+        i += used;
+    }
+    return count;
+}
+
+// wchar_t (UTF-32 here) to UTF-8, as Windows does for CP_UTF8: surrogates and values past
+// U+10FFFF become U+FFFD. Returns the bytes written, or the count needed when output is null.
+inline int WideCharToMultiByte(unsigned codePage, unsigned long flags, const wchar_t* input, int inputLength,
+                               char* output, int outputLength, const char* defaultChar, int* usedDefault)
+{
+    (void)codePage;
+    (void)flags;
+    (void)defaultChar;
+    if (usedDefault) {
+        *usedDefault = 0;
+    }
+    size_t length = inputLength < 0 ? wcslen(input) + 1 : static_cast<size_t>(inputLength);
+    int count = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        unsigned long codePoint = static_cast<unsigned long>(input[i]);
+        if ((codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF) {
+            codePoint = 0xFFFD;
+        }
+
+        char bytes[4];
+        int used = 0;
+        if (codePoint < 0x80) {
+            bytes[used++] = static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            bytes[used++] = static_cast<char>(0xC0 | (codePoint >> 6));
+            bytes[used++] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            bytes[used++] = static_cast<char>(0xE0 | (codePoint >> 12));
+            bytes[used++] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            bytes[used++] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else {
+            bytes[used++] = static_cast<char>(0xF0 | (codePoint >> 18));
+            bytes[used++] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            bytes[used++] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            bytes[used++] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+
+        if (output) {
+            if (count + used > outputLength) {
+                return 0;
+            }
+            memcpy(output + count, bytes, used);
+        }
+        count += used;
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,481 @@
+#include "stdafx.h"
+#include "LeoPosixTransport.h"
+
+#ifndef _WIN32
+
+#include "LeoConfig.h"
+#include "LogFileWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // macOS: SO_NOSIGPIPE is set on the socket instead
+#endif
+
+static const size_t READ_CHUNK_SIZE = 64 * 1024;
+static const size_t MAX_HEADER_LINE = 16 * 1024;
+
+static std::string ToLower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    return text;
+}
+
+static std::string Trim(const std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t");
+    size_t end = text.find_last_not_of(" \t");
+    return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+}
+
+LeoPosixTransport::LeoPosixTransport()
+    : m_socket(-1)
+    , m_cancelToken(nullptr)
+    , m_timedOut(false)
+    , m_host("localhost")
+    , m_port(0)
+    , m_timeoutMs(HTTP_TIMEOUT_MS)
+    , m_readPos(0)
+{
+}
+
+LeoPosixTransport::~LeoPosixTransport()
+{
+    CloseSocket();
+}
+
+void LeoPosixTransport::SetTarget(const std::string& host, int port)
+{
+    CloseSocket();
+    m_host = host;
+    m_port = port;
+}
+
+void LeoPosixTransport::SetTimeout(int timeoutMs)
+{
+    m_timeoutMs = timeoutMs;
+}
+
+HttpTransportResult LeoPosixTransport::Execute(const HttpTransportRequest& request, HttpResponseSink& sink)
+{
+    HttpTransportResult result;
+
+    // A cancel that came before this point is seen here; a later one shuts the socket down
+    m_cancelToken = request.CancelToken;
+    if (m_cancelToken && !m_cancelToken->Arm([this]() { AbortSocket(); })) {
+        m_cancelToken = nullptr;
+        result.Cancelled = true;
+        result.Error = "Request cancelled";
+        return result;
+    }
+
+    for (int attempt = 1; attempt <= 2; ++attempt) {
+        bool reused = m_socket >= 0;
+        bool responseStarted = false;
+        bool keepAlive = false;
+        m_timedOut = false;
+
+        if (Exchange(request, sink, responseStarted, keepAlive, result.Error)) {
+            if (!keepAlive) {
+                CloseSocket();
+            }
+            result.Completed = true;
+            result.Error.clear();
+            break;
+        }
+
+        CloseSocket();
+        result.Cancelled = IsCancelled();
+        if (result.Cancelled) {
+            result.Error = "Request cancelled";
+            break;
+        }
+
+        // Leo may have closed an idle keep-alive connection; that shows up before any response
+        // byte, and one fresh connection settles it
+        if (!(reused && !responseStarted && !m_timedOut)) {
+            break;
+        }
+        LogMessage("Kept-alive connection was closed by the server, reconnecting");
+    }
+
+    if (m_cancelToken) {
+        m_cancelToken->Disarm();
+        m_cancelToken = nullptr;
+    }
+    return result;
+}
+
+void LeoPosixTransport::Reset()
+{
+    CloseSocket();
+}
+
+bool LeoPosixTransport::Exchange(const HttpTransportRequest& request, HttpResponseSink& sink,
+                                 bool& responseStarted, bool& keepAlive, std::string& error)
+{
+    m_readBuffer.clear();
+    m_readPos = 0;
+
+    if (m_socket < 0 && !Connect(error)) {
+        return false;
+    }
+
+    // Counting pass: the length goes into Content-Length without keeping the body around
+    uint64_t bodyLength = 0;
+    if (request.Body) {
+        ChunkedBodyWriter counter(nullptr);
+        (*request.Body)(counter);
+        bodyLength = counter.BytesWritten();
+    }
+
+    char lengthLine[64];
+    snprintf(lengthLine, sizeof(lengthLine), "Content-Length: %llu\r\n", static_cast<unsigned long long>(bodyLength));
+    std::string head = "POST " + request.Path + " HTTP/1.1\r\n"
+                       "Host: " + m_host + ":" + std::to_string(m_port) + "\r\n"
+                       "User-Agent: LeoCreoAddin/1.0\r\n" +
+                       lengthLine + request.Headers + "\r\n";
+    if (!SendAll(head.data(), head.size())) {
+        error = "Failed to send HTTP request";
+        return false;
+    }
+
+    // Send pass: each chunk goes out as soon as the serializer fills it
+    if (request.Body) {
+        ChunkedBodyWriter writer([this](const char* data, size_t length) { return SendAll(data, length); },
+                                 HTTP_BODY_CHUNK_SIZE);
+        (*request.Body)(writer);
+        if (!writer.Flush() || writer.BytesWritten() != bodyLength) {
+            error = "Failed to write HTTP request body";
+            return false;
+        }
+    }
+
+    // Status line; interim 1xx answers are skipped along with their headers
+    int statusCode = 0;
+    bool http10 = false;
+    std::string line;
+    std::string contentType;
+    bool chunked = false;
+    bool hasLength = false;
+    uint64_t contentLength = 0;
+    keepAlive = true;
+
+    do {
+        if (!ReadLine(line)) {
+            error = m_timedOut ? "Timed out waiting for the HTTP response" : "Failed to receive HTTP response";
+            return false;
+        }
+        int major = 0;
+        int minor = 0;
+        if (sscanf(line.c_str(), "HTTP/%d.%d %d", &major, &minor, &statusCode) != 3) {
+            error = "Malformed HTTP status line";
+            return false;
+        }
+        responseStarted = true;
+        http10 = major == 1 && minor == 0;
+
+        for (;;) {
+            if (!ReadLine(line)) {
+                error = "Failed to read HTTP response headers";
+                return false;
+            }
+            if (line.empty()) {
+                break;
+            }
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = ToLower(Trim(line.substr(0, colon)));
+            std::string value = Trim(line.substr(colon + 1));
+            if (name == "content-length") {
+                hasLength = true;
+                contentLength = strtoull(value.c_str(), nullptr, 10);
+            } else if (name == "transfer-encoding") {
+                chunked = ToLower(value).find("chunked") != std::string::npos;
+            } else if (name == "content-type") {
+                contentType = value;
+            } else if (name == "connection") {
+                std::string token = ToLower(value);
+                keepAlive = token.find("close") == std::string::npos &&
+                            (!http10 || token.find("keep-alive") != std::string::npos);
+            }
+        }
+    } while (statusCode >= 100 && statusCode < 200);
+
+    if (http10 && keepAlive) {
+        keepAlive = false;      // HTTP/1.0 keeps the connection only when it says so
+    }
+
+    sink.OnStatus(statusCode, contentType);
+
+    bool bodyRead = true;
+    if (statusCode == 204 || statusCode == 304) {
+        // No body by definition
+    } else if (chunked) {
+        bodyRead = ReadChunkedBody(sink);
+    } else if (hasLength) {
+        bodyRead = ReadBody(contentLength, false, sink);
+    } else {
+        bodyRead = ReadBody(0, true, sink);
+        keepAlive = false;
+    }
+
+    if (!bodyRead) {
+        error = m_timedOut ? "Timed out reading the HTTP response body" : "Failed to read HTTP response body";
+        return false;
+    }
+    return true;
+}
+
+bool LeoPosixTransport::Connect(std::string& error)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    addrinfo* addresses = nullptr;
+    std::string port = std::to_string(m_port);
+    int lookup = getaddrinfo(m_host.c_str(), port.c_str(), &hints, &addresses);
+    if (lookup != 0) {
+        error = "Cannot resolve " + m_host + ": " + gai_strerror(lookup);
+        return false;
+    }
+
+    // "localhost" may resolve to ::1 and 127.0.0.1; Leo only has to listen on one of them
+    int lastError = 0;
+    for (addrinfo* address = addresses; address; address = address->ai_next) {
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            lastError = errno;
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int noSigPipe = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+        {
+            // Visible to AbortSocket() from here on
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_socket = fd;
+        }
+        if (IsCancelled()) {
+            // The cancel came before the socket was published and had nothing to shut down
+            CloseSocket();
+            break;
+        }
+
+        bool connected = connect(fd, address->ai_addr, address->ai_addrlen) == 0;
+        if (!connected && errno == EINPROGRESS && WaitFor(POLLOUT)) {
+            int socketError = 0;
+            socklen_t errorLength = sizeof(socketError);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &socketError, &errorLength);
+            connected = socketError == 0;
+            lastError = socketError;
+        } else if (!connected) {
+            lastError = m_timedOut ? ETIMEDOUT : errno;
+        }
+
+        if (connected && !IsCancelled()) {
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            freeaddrinfo(addresses);
+
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Connection opened to %s:%d", m_host.c_str(), m_port);
+            LogMessage(msg);
+            return true;
+        }
+        CloseSocket();
+        if (IsCancelled()) {
+            break;
+        }
+    }
+
+    freeaddrinfo(addresses);
+    error = "Failed to connect to " + m_host + ":" + port + ": " + strerror(lastError ? lastError : ECONNREFUSED);
+    return false;
+}
+
+bool LeoPosixTransport::SendAll(const char* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(m_socket, data, length, MSG_NOSIGNAL);
+        if (sent > 0) {
+            data += sent;
+            length -= static_cast<size_t>(sent);
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!WaitFor(POLLOUT)) {
+                return false;
+            }
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return false;
+        }
+    }
+    return !IsCancelled();
+}
+
+bool LeoPosixTransport::WaitFor(short events)
+{
+    pollfd entry;
+    entry.fd = m_socket;
+    entry.events = events;
+    entry.revents = 0;
+
+    int ready = 0;
+    do {
+        ready = poll(&entry, 1, m_timeoutMs);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready == 0) {
+        m_timedOut = true;
+        return false;
+    }
+    // Errors and hang-ups are left to the following recv()/send() to report
+    return ready > 0 && !IsCancelled();
+}
+
+bool LeoPosixTransport::Fill()
+{
+    if (m_readPos > 0) {
+        m_readBuffer.erase(0, m_readPos);
+        m_readPos = 0;
+    }
+
+    char chunk[16 * 1024];
+    for (;;) {
+        ssize_t received = recv(m_socket, chunk, sizeof(chunk), 0);
+        if (received > 0) {
+            m_readBuffer.append(chunk, static_cast<size_t>(received));
+            return true;
+        }
+        if (received == 0) {
+            return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || !WaitFor(POLLIN)) {
+            return false;
+        }
+    }
+}
+
+bool LeoPosixTransport::ReadLine(std::string& line)
+{
+    for (;;) {
+        size_t end = m_readBuffer.find("\r\n", m_readPos);
+        if (end != std::string::npos) {
+            line.assign(m_readBuffer, m_readPos, end - m_readPos);
+            m_readPos = end + 2;
+            return true;
+        }
+        if (m_readBuffer.size() - m_readPos > MAX_HEADER_LINE || !Fill()) {
+            return false;
+        }
+    }
+}
+
+bool LeoPosixTransport::ReadBody(uint64_t length, bool untilClose, HttpResponseSink& sink)
+{
+    uint64_t remaining = length;
+    while (untilClose || remaining > 0) {
+        // Bytes that arrived together with the headers go first
+        size_t buffered = m_readBuffer.size() - m_readPos;
+        if (buffered > 0) {
+            size_t take = untilClose ? buffered : static_cast<size_t>((std::min)(static_cast<uint64_t>(buffered), remaining));
+            memcpy(sink.PrepareBody(take), m_readBuffer.data() + m_readPos, take);
+            sink.CommitBody(take);
+            m_readPos += take;
+            remaining -= untilClose ? 0 : take;
+            continue;
+        }
+
+        // Then receive straight into the sink's buffer
+        size_t want = untilClose ? READ_CHUNK_SIZE
+                                 : static_cast<size_t>((std::min)(static_cast<uint64_t>(READ_CHUNK_SIZE), remaining));
+        char* dest = sink.PrepareBody(want);
+        ssize_t received = recv(m_socket, dest, want, 0);
+        if (received > 0) {
+            sink.CommitBody(static_cast<size_t>(received));
+            remaining -= untilClose ? 0 : static_cast<uint64_t>(received);
+        } else if (received == 0) {
+            return untilClose && !IsCancelled();
+        } else if (errno == EINTR) {
+            continue;
+        } else if ((errno != EAGAIN && errno != EWOULDBLOCK) || !WaitFor(POLLIN)) {
+            return false;
+        }
+    }
+    return !IsCancelled();
+}
+
+bool LeoPosixTransport::ReadChunkedBody(HttpResponseSink& sink)
+{
+    std::string line;
+    for (;;) {
+        if (!ReadLine(line) || line.empty() || !isxdigit(static_cast<unsigned char>(line[0]))) {
+            return false;
+        }
+        uint64_t size = strtoull(line.c_str(), nullptr, 16);     // Stops at any chunk extension
+        if (size == 0) {
+            // Trailer section ends with an empty line
+            do {
+                if (!ReadLine(line)) {
+                    return false;
+                }
+            } while (!line.empty());
+            return true;
+        }
+        if (!ReadBody(size, false, sink) || !ReadLine(line) || !line.empty()) {
+            return false;
+        }
+    }
+}
+
+void LeoPosixTransport::CloseSocket()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_socket >= 0) {
+        close(m_socket);
+        m_socket = -1;
+    }
+}
+
+void LeoPosixTransport::AbortSocket()
+{
+    // Wakes the poll() the I/O thread is blocked in; that thread closes the descriptor
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_socket >= 0) {
+        shutdown(m_socket, SHUT_RDWR);
+    }
+    LogMessage("In-flight request cancelled");
+}
+
+bool LeoPosixTransport::IsCancelled() const
+{
+    return m_cancelToken && m_cancelToken->IsCancelled();
+}
+
+void LeoPosixTransport::LogMessage(const char* message)
+{
+    LEO_INFO(Http, "LeoPosixTransport: %s", message);
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <mutex>
+#include <string>
+#include "LeoHttpTransport.h"
+
+// HTTP/1.1 transport over BSD sockets, for running LeoWebClient's shared code on Linux and
+// macOS. Keeps one connection alive across requests and reconnects once if a reused
+// connection turns out to be closed. Handles Content-Length, chunked and close-delimited
+// bodies. Every connect, send and receive step waits at most the timeout; cancelling the
+// request's token shuts the socket down, which wakes the blocked poll() at once.
+class LeoPosixTransport : public LeoHttpTransport {
+public:
+    LeoPosixTransport();
+    ~LeoPosixTransport();
+
+    void SetTarget(const std::string& host, int port) override;
+    void SetTimeout(int timeoutMs) override;
+    HttpTransportResult Execute(const HttpTransportRequest& request, HttpResponseSink& sink) override;
+    void Reset() override;
+    const char* Name() const override { return "posix"; }
+
+private:
+    LeoPosixTransport(const LeoPosixTransport&) = delete;
+    LeoPosixTransport& operator=(const LeoPosixTransport&) = delete;
+
+    // One attempt on the current (or a fresh) connection; responseStarted tells a stale
+    // keep-alive socket apart from a real failure
+    bool Exchange(const HttpTransportRequest& request, HttpResponseSink& sink,
+                  bool& responseStarted, bool& keepAlive, std::string& error);
+    bool Connect(std::string& error);
+    bool SendAll(const char* data, size_t length);
+    bool WaitFor(short events);
+    bool Fill();                                        // Reads more into m_readBuffer; false on EOF or error
+    bool ReadLine(std::string& line);
+    bool ReadBody(uint64_t length, bool untilClose, HttpResponseSink& sink);
+    bool ReadChunkedBody(HttpResponseSink& sink);
+    void CloseSocket();
+    void AbortSocket();                                 // Runs on the cancelling thread
+    bool IsCancelled() const;
+    void LogMessage(const char* message);
+
+    std::mutex m_mutex;                 // Guards m_socket against AbortSocket()
+    int m_socket;
+    HttpCancelToken* m_cancelToken;     // The running request's; armed only inside Execute(), so an idle connection is left alone
+    bool m_timedOut;
+
+    std::string m_host;
+    int m_port;
+    int m_timeoutMs;
+
+    std::string m_readBuffer;           // Received but not yet consumed bytes
+    size_t m_readPos;
+};
+
+#endif
@@ -0,0 +1,384 @@
+#include "stdafx.h"
+#include "LeoResponseParser.h"
+#include "LeoJsonIndex.h"
+#include "LeoPayloadKeys.h"
+#include <cstring>
+
+static CString Utf8ToCString(const char* data, size_t length)
+{
+    CString result;
+    if (length == 0) {
+        return result;
+    }
+
+    int wideLen = MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(length), NULL, 0);
+    if (wideLen > 0) {
+        MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(length), result.GetBuffer(wideLen), wideLen);
+        result.ReleaseBuffer(wideLen);
+    }
+    return result;
+}
+
+static bool ReadJsonString(const JsonIndexReader& reader, const JsonValue& value, CString& out)
+{
+    ArenaString text;
+    if (!reader.GetString(value, text)) {
+        return false;
+    }
+    out = Utf8ToCString(text.data(), text.size());
+    return true;
+}
+
+ResponseBuffer::ResponseBuffer()
+    : m_size(0)
+    , m_capacity(0)
+    , m_growCount(0)
+{
+}
+
+char* ResponseBuffer::PrepareAppend(size_t bytes)
+{
+    if (m_capacity - m_size < bytes) {
+        Grow(m_size + bytes);
+    }
+    return m_data.get() + m_size;
+}
+
+void ResponseBuffer::CommitAppend(size_t bytes)
+{
+    m_size += bytes;
+}
+
+void ResponseBuffer::Append(const char* data, size_t length)
+{
+    memcpy(PrepareAppend(length), data, length);
+    m_size += length;
+}
+
+void ResponseBuffer::Reset(size_t retainBytes)
+{
+    m_size = 0;
+    if (m_capacity > retainBytes) {
+        m_data.reset();
+        m_capacity = 0;
+    }
+}
+
+void ResponseBuffer::Grow(size_t minCapacity)
+{
+    // Doubling keeps a body of n bytes at O(log n) reallocations
+    size_t capacity = m_capacity > 0 ? m_capacity : 8 * 1024;
+    while (capacity < minCapacity) {
+        capacity *= 2;
+    }
+
+    std::unique_ptr<char[]> data(new char[capacity]);
+    if (m_size > 0) {
+        memcpy(data.get(), m_data.get(), m_size);
+    }
+    m_data.swap(data);
+    m_capacity = capacity;
+    m_growCount++;
+}
+
+CString ResponseBuffer::ToText() const
+{
+    return Utf8ToCString(m_data.get(), m_size);
+}
+
+LeoResponseParser::LeoResponseParser(WireFormat format, ResponseBuffer* buffer)
+    : m_format(format)
+    , m_buffer(buffer ? buffer : &m_ownBuffer)
+    , m_scanPos(0)
+    , m_depth(0)
+    , m_inString(false)
+    , m_escape(false)
+    , m_expectKey(false)
+    , m_keyBegin(0)
+    , m_keyEnd(0)
+    , m_candidatesNext(false)
+    , m_candidatesDepth(0)
+    , m_elementBegin(std::string::npos)
+    , m_malformed(false)
+{
+}
+
+bool LeoResponseParser::Feed(const char* data, size_t length)
+{
+    m_buffer->Append(data, length);
+
+    if (m_format == WireFormat::Json && !m_malformed) {
+        Scan();
+    }
+    return !m_malformed;
+}
+
+bool LeoResponseParser::CommitFeed(size_t bytes)
+{
+    m_buffer->CommitAppend(bytes);
+
+    if (m_format == WireFormat::Json && !m_malformed) {
+        Scan();
+    }
+    return !m_malformed;
+}
+
+void LeoResponseParser::Scan()
+{
+    // Resume where the previous chunk stopped; all state survives chunk boundaries
+    const char* data = m_buffer->Data();
+    size_t length = m_buffer->Size();
+
+    for (size_t i = m_scanPos; i < length && !m_malformed; ++i) {
+        char c = data[i];
+
+        if (m_inString) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '"') {
+                m_inString = false;
+                if (m_depth == 1 && m_expectKey) {
+                    m_keyEnd = i;
+                }
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '"':
+                m_inString = true;
+                if (m_depth == 1 && m_expectKey) {
+                    m_keyBegin = i + 1;
+                }
+                break;
+            case ':':
+                if (m_depth == 1 && m_expectKey) {
+                    m_expectKey = false;
+                    m_candidatesNext = kResponseTable.Find(data + m_keyBegin, m_keyEnd - m_keyBegin) == kCandidates;
+                }
+                break;
+            case ',':
+                if (m_depth == 1) {
+                    m_expectKey = true;
+                    m_candidatesNext = false;
+                }
+                break;
+            case '{':
+            case '[':
+                ++m_depth;
+                if (m_depth == 1) {
+                    // A bare array at the root is taken as the candidate list itself
+                    m_expectKey = (c == '{');
+                    m_candidatesDepth = (c == '[') ? 1 : 0;
+                } else if (m_depth == 2 && c == '[' && m_candidatesNext) {
+                    m_candidatesDepth = 2;
+                } else if (m_candidatesDepth > 0 && m_depth == m_candidatesDepth + 1 && c == '{') {
+                    m_elementBegin = i;
+                }
+                break;
+            case '}':
+            case ']':
+                if (m_depth == 0) {
+                    m_malformed = true;
+                    break;
+                }
+                if (c == '}' && m_candidatesDepth > 0 && m_depth == m_candidatesDepth + 1 &&
+                    m_elementBegin != std::string::npos) {
+                    EmitCandidate(m_elementBegin, i + 1);
+                    m_elementBegin = std::string::npos;
+                } else if (c == ']' && m_depth == m_candidatesDepth) {
+                    m_candidatesDepth = 0;
+                }
+                --m_depth;
+                break;
+            default:
+                break;
+        }
+    }
+
+    m_scanPos = length;
+}
+
+void LeoResponseParser::EmitCandidate(size_t begin, size_t end)
+{
+    JsonStructuralIndex index;
+    if (!index.Build(m_buffer->Data() + begin, end - begin)) {
+        return;
+    }
+
+    JsonIndexReader reader(index);
+    JsonValue root;
+    if (!reader.Root(root) || root.Kind != '{') {
+        return;
+    }
+
+    CandidatePart candidate;
+    reader.ForEachMember(root, [&](const char* key, size_t keyLength, const JsonValue& value) {
+        switch (kCandidateTable.Find(key, keyLength)) {
+            case kName:
+                ReadJsonString(reader, value, candidate.Name);
+                break;
+            case kPath:
+            case kLocalPath:
+                ReadJsonString(reader, value, candidate.Path);
+                break;
+            case kScore:
+                reader.GetDouble(value, candidate.Score);
+                break;
+            default:
+                break;
+        }
+        return true;
+    });
+
+    m_data.Candidates.push_back(candidate);
+    if (m_candidateCallback) {
+        m_candidateCallback(m_data.Candidates.back());
+    }
+}
+
+bool LeoResponseParser::Finish(LeoResponseData& result)
+{
+    bool ok = (m_format == WireFormat::MessagePack) ? FinishMsgPack() : FinishJson();
+    m_data.IsValid = ok;
+    result = m_data;
+    return ok;
+}
+
+bool LeoResponseParser::FinishJson()
+{
+    if (m_malformed || m_inString || m_depth != 0) {
+        return false;
+    }
+
+    // Candidates were already decoded while streaming; pick up the remaining top-level fields
+    JsonStructuralIndex index;
+    if (!index.Build(m_buffer->Data(), m_buffer->Size())) {
+        return false;
+    }
+
+    JsonIndexReader reader(index);
+    JsonValue root;
+    if (!reader.Root(root)) {
+        return false;
+    }
+    if (root.Kind == '[') {
+        return true;
+    }
+
+    return reader.ForEachMember(root, [&](const char* key, size_t keyLength, const JsonValue& value) {
+        switch (kResponseTable.Find(key, keyLength)) {
+            case kStatus:
+                if (!ReadJsonString(reader, value, m_data.Status) && value.Kind == 's') {
+                    // Accept "status": true/false as well
+                    m_data.Status = Utf8ToCString(value.Text, value.TextLength);
+                }
+                break;
+            case kMessage:
+                ReadJsonString(reader, value, m_data.Message);
+                break;
+            default:
+                break;
+        }
+        return true;
+    });
+}
+
+bool LeoResponseParser::FinishMsgPack()
+{
+    MsgPackReader reader(m_buffer->Data(), m_buffer->Size());
+    uint32_t count = 0;
+    if (!reader.ReadMapHeader(count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const char* key = nullptr;
+        uint32_t keyLength = 0;
+        if (!reader.ReadString(key, keyLength)) {
+            return false;
+        }
+
+        const char* text = nullptr;
+        uint32_t textLength = 0;
+        int member = kResponseTable.Find(key, keyLength);
+        switch (member) {
+            case kStatus:
+            case kMessage:
+                if (!reader.ReadString(text, textLength)) {
+                    return false;
+                }
+                (member == kStatus ? m_data.Status : m_data.Message) = Utf8ToCString(text, textLength);
+                break;
+            case kCandidates: {
+                uint32_t candidateCount = 0;
+                if (!reader.ReadArrayHeader(candidateCount)) {
+                    return false;
+                }
+                m_data.Candidates.reserve(candidateCount);
+                for (uint32_t n = 0; n < candidateCount; n++) {
+                    CandidatePart candidate;
+                    if (!ReadCandidateMsgPack(reader, candidate)) {
+                        return false;
+                    }
+                    m_data.Candidates.push_back(candidate);
+                    if (m_candidateCallback) {
+                        m_candidateCallback(m_data.Candidates.back());
+                    }
+                }
+                break;
+            }
+            default:
+                if (!reader.Skip()) {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool LeoResponseParser::ReadCandidateMsgPack(MsgPackReader& reader, CandidatePart& candidate)
+{
+    uint32_t count = 0;
+    if (!reader.ReadMapHeader(count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const char* key = nullptr;
+        uint32_t keyLength = 0;
+        if (!reader.ReadString(key, keyLength)) {
+            return false;
+        }
+
+        const char* text = nullptr;
+        uint32_t textLength = 0;
+        bool ok = true;
+        switch (kCandidateTable.Find(key, keyLength)) {
+            case kName:
+                ok = reader.ReadString(text, textLength);
+                candidate.Name = Utf8ToCString(text, textLength);
+                break;
+            case kPath:
+            case kLocalPath:
+                ok = reader.ReadString(text, textLength);
+                candidate.Path = Utf8ToCString(text, textLength);
+                break;
+            case kScore:
+                ok = reader.ReadDouble(candidate.Score);
+                break;
+            default:
+                ok = reader.Skip();
+                break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include "LeoWireFormat.h"
+
+// A part Leo proposes for the selected face, best match first
+struct CandidatePart {
+    CString Name;
+    CString Path;
+    double Score;
+
+    CandidatePart() : Score(0.0) {}
+};
+
+// Typed view of a Leo response body
+struct LeoResponseData {
+    bool IsValid;                           // Body was a well-formed JSON/MessagePack document
+    CString Status;
+    CString Message;
+    std::vector<CandidatePart> Candidates;
+
+    LeoResponseData() : IsValid(false) {}
+};
+
+using CandidateCallback = std::function<void(const CandidatePart&)>;
+
+// Growable byte buffer for response bodies.
+// WinHttpReadData writes straight into the spare capacity (no per-chunk buffer, no copy),
+// growth is geometric, and Reset keeps the capacity, so a client that reuses one buffer
+// stops allocating once it has seen its typical response size. The bytes are decoded to
+// text at most once, after the last chunk, so multi-byte characters split across chunks
+// come out intact.
+class ResponseBuffer {
+public:
+    ResponseBuffer();
+
+    char* PrepareAppend(size_t bytes);      // Room for at least bytes; valid until the next call
+    void CommitAppend(size_t bytes);
+    void Append(const char* data, size_t length);
+
+    // Empties the buffer; capacity above retainBytes is given back to the heap
+    void Reset(size_t retainBytes = DEFAULT_RETAIN_BYTES);
+
+    const char* Data() const { return m_data.get(); }
+    size_t Size() const { return m_size; }
+    bool Empty() const { return m_size == 0; }
+    size_t Capacity() const { return m_capacity; }
+    size_t GrowCount() const { return m_growCount; }   // Reallocations since construction
+
+    CString ToText() const;                 // UTF-8 decode of the whole body
+
+    static const size_t DEFAULT_RETAIN_BYTES = 1024 * 1024;
+
+private:
+    ResponseBuffer(const ResponseBuffer&) = delete;
+    ResponseBuffer& operator=(const ResponseBuffer&) = delete;
+
+    void Grow(size_t minCapacity);
+
+    std::unique_ptr<char[]> m_data;
+    size_t m_size;
+    size_t m_capacity;
+    size_t m_growCount;
+};
+
+// Incremental decoder for Leo response bodies, fed chunk by chunk as WinHttpReadData
+// delivers them. For JSON, each element of the "candidates" array (or of a root array)
+// is decoded and reported as soon as its closing brace arrives, so callers can act on
+// the first results while the rest of the body is still on the wire. MessagePack bodies
+// are decoded when the last chunk is in.
+class LeoResponseParser {
+public:
+    // The body accumulates in buffer when given (reset by the caller), otherwise in a private one
+    explicit LeoResponseParser(WireFormat format = WireFormat::Json, ResponseBuffer* buffer = nullptr);
+
+    void SetCandidateCallback(CandidateCallback callback) { m_candidateCallback = callback; }
+
+    // Append the next chunk; returns false once the stream is known to be malformed
+    bool Feed(const char* data, size_t length);
+
+    // Zero-copy variant of Feed: read up to bytes into PrepareFeed's pointer, then commit what arrived
+    char* PrepareFeed(size_t bytes) { return m_buffer->PrepareAppend(bytes); }
+    bool CommitFeed(size_t bytes);
+
+    // Decode the remaining top-level fields; returns false if the body is not a valid document
+    bool Finish(LeoResponseData& result);
+
+    // Raw body bytes received so far
+    const ResponseBuffer& Bytes() const { return *m_buffer; }
+
+private:
+    void Scan();
+    void EmitCandidate(size_t begin, size_t end);
+    bool FinishJson();
+    bool FinishMsgPack();
+    bool ReadCandidateMsgPack(MsgPackReader& reader, CandidatePart& candidate);
+
+    WireFormat m_format;
+    ResponseBuffer m_ownBuffer;
+    ResponseBuffer* m_buffer;
+    CandidateCallback m_candidateCallback;
+    LeoResponseData m_data;
+
+    // Streaming scanner state (JSON only)
+    size_t m_scanPos;
+    int m_depth;
+    bool m_inString;
+    bool m_escape;
+    bool m_expectKey;           // Next string at depth 1 is a member name
+    size_t m_keyBegin;
+    size_t m_keyEnd;
+    bool m_candidatesNext;      // Last member name was "candidates"
+    int m_candidatesDepth;      // Depth of the open candidates array, 0 when outside it
+    size_t m_elementBegin;
+    bool m_malformed;
+};
@@ -0,0 +1,395 @@
+#include "stdafx.h"
+#include "LeoTrace.h"
+#include "LeoBinaryLog.h"
+#include "LeoConfig.h"
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> LeoTrace::s_enabled(false);
+
+namespace {
+
+enum TracePhase : uint8_t {
+    PHASE_SPAN,
+    PHASE_FLOW_BEGIN,
+    PHASE_FLOW_STEP,
+    PHASE_FLOW_END
+};
+
+// A span or one step of a flow. Fixed size, so recording is a copy into the thread's buffer.
+struct TraceEvent {
+    const char* Name;
+    int64_t Begin;              // Performance counter
+    int64_t End;                // Spans; the flow id for flow steps
+    uint8_t Phase;              // TracePhase
+    uint8_t Category;           // LogCategory
+};
+
+// One thread's events in one trace. Only the owning thread appends; Stop reads the first Count
+// events. A buffer is handed to a new thread only once its events belong to an earlier trace,
+// so within a trace every buffer is one thread's track.
+struct TraceBuffer {
+    std::unique_ptr<TraceEvent[]> Events;
+    std::atomic<size_t> Count;
+    std::atomic<unsigned> Session;      // Trace the events belong to
+    std::atomic<bool> InUse;            // The owning thread has not ended yet
+
+    // Set under TraceState::BuffersMutex
+    uint32_t Thread;
+    const char* ThreadName;
+
+    TraceBuffer()
+        : Events(new TraceEvent[LEO_TRACE_EVENTS_PER_THREAD])
+        , Count(0)
+        , Session(0)
+        , InUse(true)
+        , Thread(0)
+        , ThreadName(NULL)
+    {
+    }
+};
+
+// Releases the thread's buffer when the thread ends
+struct TraceBufferOwner {
+    TraceBuffer* Buffer;
+    const char* Name;
+
+    TraceBufferOwner() : Buffer(NULL), Name(NULL) {}
+    ~TraceBufferOwner()
+    {
+        if (Buffer) {
+            Buffer->InUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local TraceBufferOwner t_traceBuffer;
+
+struct TraceState {
+    std::atomic<unsigned> Session;      // Bumped by every Start
+    std::atomic<int64_t> StartTicks;    // Counter value when the current trace started
+    std::atomic<long long> Dropped;
+
+    std::mutex ControlMutex;            // Serializes Start and Stop
+    FILETIME StartTime;                 // Wall clock at StartTicks; ControlMutex
+
+    std::mutex BuffersMutex;            // Guards Buffers and their Thread and ThreadName
+    std::vector<TraceBuffer*> Buffers;  // Never freed, like the log rings
+
+    TraceState() : Session(0), StartTicks(0), Dropped(0)
+    {
+        StartTime.dwLowDateTime = 0;
+        StartTime.dwHighDateTime = 0;
+    }
+};
+
+// Never destroyed: spans may still close in global destructors while the DLL unloads
+TraceState& State()
+{
+    static TraceState* state = new TraceState();
+    return *state;
+}
+
+int64_t Frequency()
+{
+    static const int64_t frequency = []() {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        return static_cast<int64_t>(value.QuadPart);
+    }();
+    return frequency;
+}
+
+TraceBuffer* CurrentBuffer(TraceState& state)
+{
+    if (t_traceBuffer.Buffer) {
+        return t_traceBuffer.Buffer;
+    }
+
+    std::lock_guard<std::mutex> lock(state.BuffersMutex);
+    unsigned session = state.Session.load(std::memory_order_acquire);
+    TraceBuffer* buffer = NULL;
+    for (size_t i = 0; i < state.Buffers.size() && !buffer; ++i) {
+        TraceBuffer* candidate = state.Buffers[i];
+        if (!candidate->InUse.load(std::memory_order_acquire) && candidate->Session.load(std::memory_order_relaxed) != session) {
+            buffer = candidate;
+        }
+    }
+    if (!buffer) {
+        buffer = new TraceBuffer();
+        state.Buffers.push_back(buffer);
+    }
+    buffer->InUse.store(true, std::memory_order_relaxed);
+    buffer->Thread = GetCurrentThreadId();
+    buffer->ThreadName = t_traceBuffer.Name;
+    t_traceBuffer.Buffer = buffer;
+    return buffer;
+}
+
+void Record(const TraceEvent& event)
+{
+    TraceState& state = State();
+    TraceBuffer* buffer = CurrentBuffer(state);
+
+    unsigned session = state.Session.load(std::memory_order_acquire);
+    if (buffer->Session.load(std::memory_order_relaxed) != session) {
+        buffer->Count.store(0, std::memory_order_relaxed);
+        buffer->Session.store(session, std::memory_order_release);
+    }
+    if (event.Begin < state.StartTicks.load(std::memory_order_relaxed)) {
+        return;                         // Opened before this trace started
+    }
+
+    size_t count = buffer->Count.load(std::memory_order_relaxed);
+    if (count >= LEO_TRACE_EVENTS_PER_THREAD) {
+        state.Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->Events[count] = event;
+    buffer->Count.store(count + 1, std::memory_order_release);
+}
+
+void RecordFlow(TracePhase phase, const char* name, uint64_t id)
+{
+    if (!LeoTrace::IsEnabled()) {
+        return;
+    }
+    TraceEvent event;
+    event.Name = name;
+    event.Begin = LeoTrace::Now();
+    event.End = static_cast<int64_t>(id);
+    event.Phase = phase;
+    event.Category = static_cast<uint8_t>(LogCategory::General);
+    Record(event);
+}
+
+void AppendJsonString(std::string& out, const char* text)
+{
+    out += '"';
+    for (const char* p = text ? text : ""; *p; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    out += '"';
+}
+
+// Microseconds since the trace started, as trace-event "ts" and "dur" expect
+double ToMicros(int64_t ticks)
+{
+    int64_t frequency = Frequency();
+    return static_cast<double>(ticks / frequency) * 1e6 + static_cast<double>(ticks % frequency) * 1e6 / frequency;
+}
+
+// "Sun Oct 18 09:30:00.123456 2026", the same stamp as the log lines, so a trace can be lined up with them
+std::string FormatWallTime(const FILETIME& time)
+{
+    unsigned long long hundreds = (static_cast<unsigned long long>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    long long micros = static_cast<long long>(hundreds / 10) - 11644473600000000LL;
+    time_t seconds = static_cast<time_t>(micros / 1000000);
+    char text[26] = { 0 };
+    if (ctime_s(text, sizeof(text), &seconds) != 0) {
+        return std::string();
+    }
+    char stamp[40];
+    snprintf(stamp, sizeof(stamp), "%.19s.%06d%.5s", text, static_cast<int>(micros % 1000000), text + 19);
+    return stamp;
+}
+
+bool WriteChunk(FILE* file, std::string& json)
+{
+    bool written = json.empty() || fwrite(json.data(), 1, json.size(), file) == json.size();
+    json.clear();
+    return written;
+}
+
+} // namespace
+
+void LeoTrace::Start()
+{
+    TraceState& state = State();
+    std::lock_guard<std::mutex> lock(state.ControlMutex);
+    GetSystemTimePreciseAsFileTime(&state.StartTime);
+    state.StartTicks.store(Now(), std::memory_order_relaxed);
+    state.Dropped.store(0, std::memory_order_relaxed);
+    state.Session.fetch_add(1, std::memory_order_acq_rel);
+    s_enabled.store(true, std::memory_order_release);
+    LEO_INFO(General, "LeoTrace: tracing started");
+}
+
+bool LeoTrace::Stop(const std::wstring& path)
+{
+    TraceState& state = State();
+    std::lock_guard<std::mutex> lock(state.ControlMutex);
+    if (!s_enabled.exchange(false, std::memory_order_acq_rel)) {
+        return false;
+    }
+
+    struct Track {
+        TraceBuffer* Buffer;
+        uint32_t Thread;
+        const char* Name;
+    };
+    std::vector<Track> tracks;
+    unsigned session = state.Session.load(std::memory_order_acquire);
+    {
+        std::lock_guard<std::mutex> buffersLock(state.BuffersMutex);
+        for (size_t i = 0; i < state.Buffers.size(); ++i) {
+            TraceBuffer* buffer = state.Buffers[i];
+            if (buffer->Session.load(std::memory_order_acquire) == session) {
+                Track track = { buffer, buffer->Thread, buffer->ThreadName };
+                tracks.push_back(track);
+            }
+        }
+    }
+
+    FILE* file = NULL;
+    if (_wfopen_s(&file, path.c_str(), L"wb") != 0 || !file) {
+        LEO_WARN(General, L"LeoTrace: cannot write %s", path.c_str());
+        return false;
+    }
+
+    // JSON object format: the events, and the wall-clock start for lining the trace up with the log
+    int64_t startTicks = state.StartTicks.load(std::memory_order_relaxed);
+    unsigned long pid = GetCurrentProcessId();
+    std::string json;
+    char number[160];
+    bool ok = true;
+    size_t written = 0;
+
+    json += "{\"traceEvents\":[\n";
+    snprintf(number, sizeof(number), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":0,\"args\":{\"name\":\"Creo (LeoCreoAddin)\"}}", pid);
+    json += number;
+    for (size_t t = 0; t < tracks.size(); ++t) {
+        const Track& track = tracks[t];
+        if (track.Name) {
+            snprintf(number, sizeof(number), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%u,\"args\":{\"name\":", pid, track.Thread);
+            json += number;
+            AppendJsonString(json, track.Name);
+            json += "}}";
+        }
+
+        size_t count = track.Buffer->Count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            const TraceEvent& event = track.Buffer->Events[i];
+            json += ",\n{\"name\":";
+            AppendJsonString(json, event.Name);
+            double ts = ToMicros(event.Begin - startTicks);
+            if (event.Phase == PHASE_SPAN) {
+                int category = event.Category < LeoBinaryLog::CATEGORY_COUNT ? event.Category : 0;
+                snprintf(number, sizeof(number), ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%u}",
+                         LeoBinaryLog::CATEGORY_NAMES[category], ts, ToMicros(event.End - event.Begin), pid, track.Thread);
+            } else {
+                const char phase = event.Phase == PHASE_FLOW_BEGIN ? 's' : event.Phase == PHASE_FLOW_STEP ? 't' : 'f';
+                snprintf(number, sizeof(number), ",\"cat\":\"flow\",\"ph\":\"%c\",\"bp\":\"e\",\"id\":%llu,\"ts\":%.3f,\"pid\":%lu,\"tid\":%u}",
+                         phase, static_cast<unsigned long long>(event.End), ts, pid, track.Thread);
+            }
+            json += number;
+            ++written;
+            if (json.size() >= 64 * 1024) {
+                ok = WriteChunk(file, json) && ok;
+            }
+        }
+    }
+    long long dropped = state.Dropped.load(std::memory_order_relaxed);
+    json += "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"startedAt\":";
+    AppendJsonString(json, FormatWallTime(state.StartTime).c_str());
+    snprintf(number, sizeof(number), ",\"droppedEvents\":%lld}}\n", dropped);
+    json += number;
+    ok = WriteChunk(file, json) && ok;
+    ok = fclose(file) == 0 && ok;
+
+    if (ok) {
+        LEO_INFO(General, L"LeoTrace: %u event(s) from %u thread(s) written to %s (%lld dropped)",
+                 static_cast<unsigned>(written), static_cast<unsigned>(tracks.size()), path.c_str(), dropped);
+    } else {
+        LEO_WARN(General, L"LeoTrace: writing %s failed", path.c_str());
+    }
+    return ok;
+}
+
+std::wstring LeoTrace::DefaultPath()
+{
+    std::wstring directory = LogFileWriter::GetDirectory();
+    if (directory.empty()) {
+        wchar_t temp[MAX_PATH] = { 0 };
+        DWORD length = GetTempPathW(MAX_PATH, temp);
+        directory = length > 0 && length < MAX_PATH ? std::wstring(temp, length - 1) : std::wstring(L".");
+    }
+
+    time_t now = time(NULL);
+    struct tm local;
+    wchar_t stamp[32] = { 0 };
+    if (localtime_s(&local, &now) == 0) {
+        wcsftime(stamp, sizeof(stamp) / sizeof(stamp[0]), L"%Y%m%d-%H%M%S", &local);
+    }
+    return directory + L"\\" + LEO_TRACE_FILE_PREFIX + stamp + L".json";
+}
+
+void LeoTrace::NameThread(const char* name)
+{
+    t_traceBuffer.Name = name;
+    if (t_traceBuffer.Buffer) {
+        std::lock_guard<std::mutex> lock(State().BuffersMutex);
+        t_traceBuffer.Buffer->ThreadName = name;
+    }
+}
+
+void LeoTrace::FlowBegin(const char* name, uint64_t id)
+{
+    RecordFlow(PHASE_FLOW_BEGIN, name, id);
+}
+
+void LeoTrace::FlowStep(const char* name, uint64_t id)
+{
+    RecordFlow(PHASE_FLOW_STEP, name, id);
+}
+
+void LeoTrace::FlowEnd(const char* name, uint64_t id)
+{
+    RecordFlow(PHASE_FLOW_END, name, id);
+}
+
+int64_t LeoTrace::Now()
+{
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return ticks.QuadPart;
+}
+
+void LeoTrace::OpenSpan(const char* name, LogCategory category, int64_t begin)
+{
+    LeoFlightRecorder::SpanBegin(name, static_cast<uint8_t>(category), begin);
+}
+
+void LeoTrace::RecordSpan(const char* name, LogCategory category, int64_t begin, int64_t end)
+{
+    LeoFlightRecorder::SpanEnd(name, static_cast<uint8_t>(category), begin, end);
+    if (!IsEnabled()) {
+        return;
+    }
+
+    TraceEvent event;
+    event.Name = name;
+    event.Begin = begin;
+    event.End = end;
+    event.Phase = PHASE_SPAN;
+    event.Category = static_cast<uint8_t>(category);
+    Record(event);
+}
+
+long long LeoTrace::GetDroppedCount()
+{
+    return State().Dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "LogFileWriter.h"
+#include "LeoFlightRecorder.h"
+
+// Span collector for Chrome/Perfetto trace-event JSON (open the file in chrome://tracing or
+// ui.perfetto.dev).
+// While tracing and the flight recorder are off a span costs two relaxed atomic loads. While
+// tracing is on, a span reads the performance counter when it opens and again when it closes,
+// and then appends one fixed-size event to a buffer owned by the calling thread, so threads
+// never wait on each other. Nesting
+// comes from the timestamps: a span that opens and closes inside another one on the same thread
+// is drawn under it. Flow events tie work that hops threads (a face query handed to the I/O
+// thread, its result posted back to the UI thread) into one arrow.
+// Names and flow names must be string literals or otherwise outlive the trace: only the pointer
+// is recorded.
+// Spans also go to the flight recorder when it is on, as a begin and an end record, so a crash
+// shows which spans were still open.
+class LeoTrace {
+public:
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Starts a new trace, discarding anything collected before
+    static void Start();
+
+    // Stops collecting and writes what was collected to path; false if the file could not be
+    // written. Spans still open are left out.
+    static bool Stop(const std::wstring& path);
+
+    // <log folder>\LeoCreoAddin.trace.<yyyyMMdd-HHmmss>.json for a trace stopped now
+    static std::wstring DefaultPath();
+
+    // Shown for the calling thread's track instead of its id; call once when a thread starts
+    static void NameThread(const char* name);
+
+    // Flow arrows between spans; id ties the steps together and must be unique per flow.
+    // Each call binds to the span that is open on the calling thread.
+    static void FlowBegin(const char* name, uint64_t id);
+    static void FlowStep(const char* name, uint64_t id);
+    static void FlowEnd(const char* name, uint64_t id);
+
+    // Span plumbing; use through LEO_SPAN
+    static bool IsRecording() { return IsEnabled() || LeoFlightRecorder::IsEnabled(); }
+    static int64_t Now();
+    static void OpenSpan(const char* name, LogCategory category, int64_t begin);
+    static void RecordSpan(const char* name, LogCategory category, int64_t begin, int64_t end);
+
+    static long long GetDroppedCount();     // Events lost to full buffers in the current trace
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// Records the time from construction to the end of the enclosing scope
+class LeoTraceSpan {
+public:
+    LeoTraceSpan(const char* name, LogCategory category)
+        : m_name(name)
+        , m_category(category)
+        , m_begin(0)
+    {
+        if (LeoTrace::IsRecording()) {
+            m_begin = LeoTrace::Now();
+            LeoTrace::OpenSpan(name, category, m_begin);
+        }
+    }
+
+    ~LeoTraceSpan()
+    {
+        if (m_begin != 0) {
+            LeoTrace::RecordSpan(m_name, m_category, m_begin, LeoTrace::Now());
+        }
+    }
+
+private:
+    LeoTraceSpan(const LeoTraceSpan&) = delete;
+    LeoTraceSpan& operator=(const LeoTraceSpan&) = delete;
+
+    const char* m_name;
+    LogCategory m_category;
+    int64_t m_begin;            // 0 when tracing and the flight recorder were off as the span opened
+};
+
+#define LEO_SPAN_JOIN2(a, b) a##b
+#define LEO_SPAN_JOIN(a, b) LEO_SPAN_JOIN2(a, b)
+
+// LEO_SPAN(Geometry, "IsFaceSelected"); times the rest of the scope
+#define LEO_SPAN(category, name) LeoTraceSpan LEO_SPAN_JOIN(leoTraceSpan, __LINE__)((name), LogCategory::category)
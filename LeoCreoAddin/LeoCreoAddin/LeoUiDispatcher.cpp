@@ -0,0 +1,126 @@
+#include "stdafx.h"
+#include "LeoUiDispatcher.h"
+#include "LogFileWriter.h"
+
+static const wchar_t* DISPATCHER_WINDOW_CLASS = L"LeoCreoAddinDispatcher";
+
+LeoUiDispatcher::LeoUiDispatcher()
+    : m_hwnd(NULL)
+    , m_uiThreadId(0)
+{
+}
+
+LeoUiDispatcher::~LeoUiDispatcher()
+{
+    // The window belongs to the UI thread; Shutdown() must have run there already
+    m_hwnd = NULL;
+}
+
+bool LeoUiDispatcher::Initialize()
+{
+    if (m_hwnd) {
+        return true;
+    }
+
+    // Register the window class against this DLL, not Creo's executable
+    HMODULE module = NULL;
+    GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                      reinterpret_cast<LPCWSTR>(&LeoUiDispatcher::WindowProc), &module);
+
+    WNDCLASSEX wc = { 0 };
+    wc.cbSize = sizeof(wc);
+    wc.lpfnWndProc = &LeoUiDispatcher::WindowProc;
+    wc.hInstance = module;
+    wc.lpszClassName = DISPATCHER_WINDOW_CLASS;
+    if (!RegisterClassEx(&wc) && ::GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+        LogFileWriter::WriteLog("LeoUiDispatcher: Failed to register window class");
+        return false;
+    }
+
+    m_hwnd = CreateWindowEx(0, DISPATCHER_WINDOW_CLASS, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, module, NULL);
+    if (!m_hwnd) {
+        LogFileWriter::WriteLog("LeoUiDispatcher: Failed to create message window");
+        return false;
+    }
+
+    SetWindowLongPtr(m_hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+    m_uiThreadId = GetCurrentThreadId();
+    LogFileWriter::WriteLog("LeoUiDispatcher: Initialized on the UI thread");
+    return true;
+}
+
+void LeoUiDispatcher::Shutdown()
+{
+    HWND hwnd = NULL;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        hwnd = m_hwnd;
+        m_hwnd = NULL;
+        m_queue.clear();
+    }
+
+    if (hwnd) {
+        DestroyWindow(hwnd);
+        LogFileWriter::WriteLog("LeoUiDispatcher: Shut down");
+    }
+}
+
+void LeoUiDispatcher::Post(std::function<void()> fn)
+{
+    HWND hwnd = NULL;
+    bool wasEmpty = false;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        hwnd = m_hwnd;
+        if (hwnd) {
+            wasEmpty = m_queue.empty();
+            m_queue.push_back(std::move(fn));
+        }
+    }
+
+    if (!hwnd) {
+        fn();
+        return;
+    }
+
+    // One message drains everything queued so far, so only the first item posts
+    if (wasEmpty) {
+        PostMessage(hwnd, WM_LEO_DISPATCH, 0, 0);
+    }
+}
+
+bool LeoUiDispatcher::IsUiThread() const
+{
+    return m_uiThreadId != 0 && GetCurrentThreadId() == m_uiThreadId;
+}
+
+void LeoUiDispatcher::Drain()
+{
+    std::deque<std::function<void()>> items;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        items.swap(m_queue);
+    }
+
+    for (auto& item : items) {
+        try {
+            item();
+        } catch (const std::exception& e) {
+            LogFileWriter::WriteLog((std::string("LeoUiDispatcher: Exception in dispatched item: ") + e.what()).c_str());
+        } catch (...) {
+            LogFileWriter::WriteLog("LeoUiDispatcher: Unknown exception in dispatched item");
+        }
+    }
+}
+
+LRESULT CALLBACK LeoUiDispatcher::WindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    if (message == WM_LEO_DISPATCH) {
+        LeoUiDispatcher* dispatcher = reinterpret_cast<LeoUiDispatcher*>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+        if (dispatcher) {
+            dispatcher->Drain();
+        }
+        return 0;
+    }
+    return DefWindowProc(hwnd, message, wParam, lParam);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <functional>
+#include <deque>
+#include <mutex>
+
+// Runs work items on Creo's UI thread.
+// Initialize() creates a message-only window on the calling (UI) thread; Post() may be
+// called from any thread and the item runs when Creo's message loop dispatches it.
+// Pro/TOOLKIT calls and dialogs are only safe from items posted this way.
+class LeoUiDispatcher {
+public:
+    LeoUiDispatcher();
+    ~LeoUiDispatcher();
+
+    bool Initialize();      // Call on the UI thread (user_initialize)
+    void Shutdown();        // Call on the UI thread (user_terminate); pending items are dropped
+
+    // Queue fn for the UI thread. Without a dispatcher window it runs inline on the caller.
+    void Post(std::function<void()> fn);
+
+    bool IsUiThread() const;
+
+private:
+    LeoUiDispatcher(const LeoUiDispatcher&) = delete;
+    LeoUiDispatcher& operator=(const LeoUiDispatcher&) = delete;
+
+    static LRESULT CALLBACK WindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
+    void Drain();
+
+    HWND m_hwnd;
+    DWORD m_uiThreadId;
+    std::mutex m_queueMutex;
+    std::deque<std::function<void()>> m_queue;
+
+    static const UINT WM_LEO_DISPATCH = WM_APP + 0x4C45;
+};
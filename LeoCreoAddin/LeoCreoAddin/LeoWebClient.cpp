@@ -1,16 +1,58 @@
 ﻿#include "stdafx.h"
 #include "LeoWebClient.h"
-#include <winhttp.h>
+#include "LeoTrace.h"
+#include "LeoWorkerPool.h"
+#ifdef _WIN32
+#include "LeoWinHttpTransport.h"
+#else
+#include "LeoPosixTransport.h"
+#endif
 #include <shellapi.h>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <regex>
-
-#pragma comment(lib, "winhttp.lib")
+#include <random>
+#include <thread>
 
 // Initialize static constants
-const CString LeoWebClient::DEFAULT_HOST = L"localhost";
+const CString LeoWebClient::DEFAULT_HOST = LEO_DESKTOP_HOST;
+
+// Feeds the transport's response straight into a LeoResponseParser; the decoder is picked
+// from the Content-Type Leo answered with
+class ResponseParserSink : public HttpResponseSink {
+public:
+    ResponseParserSink(ResponseBuffer& buffer, const CandidateCallback& candidateCallback)
+        : m_buffer(buffer)
+        , m_candidateCallback(candidateCallback)
+        , m_statusCode(0)
+        , m_isMsgPack(false)
+    {
+    }
+    
+    void OnStatus(int statusCode, const std::string& contentType) override
+    {
+        m_statusCode = statusCode;
+        m_isMsgPack = contentType.find("msgpack") != std::string::npos;
+        m_buffer.Reset();
+        m_parser.reset(new LeoResponseParser(m_isMsgPack ? WireFormat::MessagePack : WireFormat::Json, &m_buffer));
+        m_parser->SetCandidateCallback(m_candidateCallback);
+    }
+    
+    char* PrepareBody(size_t bytes) override { return m_parser->PrepareFeed(bytes); }
+    void CommitBody(size_t bytes) override { m_parser->CommitFeed(bytes); }
+    
+    int StatusCode() const { return m_statusCode; }
+    bool IsMsgPack() const { return m_isMsgPack; }
+    LeoResponseParser& Parser() { return *m_parser; }
+    
+private:
+    ResponseBuffer& m_buffer;
+    const CandidateCallback& m_candidateCallback;
+    std::unique_ptr<LeoResponseParser> m_parser;
+    int m_statusCode;
+    bool m_isMsgPack;
+};
 
 
 LeoWebClient::LeoWebClient()
@@ -19,19 +61,102 @@ LeoWebClient::LeoWebClient()
     , m_timeoutMs(DEFAULT_TIMEOUT_MS)
     , m_isConnected(false)
     , m_loggingEnabled(true)
-    , m_defaultPort(DEFAULT_PORT)
-    , m_defaultTimeout(DEFAULT_TIMEOUT_MS)
+    , m_wireFormat(WireFormat::Json)
+    , m_lastStatusCode(0)
+    , m_responseTextEnabled(true)
+    , m_circuitBreaker(LEO_CIRCUIT_FAILURE_THRESHOLD, LEO_CIRCUIT_OPEN_MS, LEO_CIRCUIT_MAX_OPEN_MS)
+    , m_retryTotal(0)
+    , m_fastFailTotal(0)
+    , m_config(nullptr)
+    , m_settingsGeneration(0)
+    , m_configSubscription(0)
+    , m_appliedTimeoutMs(DEFAULT_TIMEOUT_MS)
+    , m_workerPool(nullptr)
 {
+#ifdef _WIN32
+    SetTransport(std::unique_ptr<LeoHttpTransport>(new LeoWinHttpTransport()));
+#else
+    SetTransport(std::unique_ptr<LeoHttpTransport>(new LeoPosixTransport()));
+#endif
+    
+    m_circuitBreaker.SetProbe([this]() { return ProbeLeo(); });
+    m_liveness.SetTarget(m_host, m_port);
+    
+    // Leo coming back closes the circuit without waiting for the breaker's own probe
+    m_liveness.Subscribe([this](bool isUp) {
+        if (isUp) {
+            m_circuitBreaker.RecordSuccess();
+        }
+    });
 }
 
 LeoWebClient::~LeoWebClient()
 {
-    // Cleanup if needed
+    Shutdown();
+}
+
+void LeoWebClient::Shutdown()
+{
+    // Both probes are short TCP connects, so joining their threads is quick
+    m_circuitBreaker.Shutdown();
+    m_liveness.Stop();
+    SetConfigService(nullptr);
+    
+    m_transport->Reset();
+}
+
+void LeoWebClient::SetTransport(std::unique_ptr<LeoHttpTransport> transport)
+{
+    m_transport = std::move(transport);
+    m_transport->SetTarget(std::string(CT2CA(m_host, CP_UTF8)), m_port);
+    m_transport->SetTimeout(m_timeoutMs);
+    m_appliedTimeoutMs = m_timeoutMs;
+    LogMessage(L"Transport: " + CString(m_transport->Name()));
+}
+
+void LeoWebClient::SetWorkerPool(LeoWorkerPool* pool)
+{
+    m_workerPool = pool;
+}
+
+void LeoWebClient::ParallelFor(size_t count, const std::function<void(size_t)>& work)
+{
+    if (m_workerPool) {
+        m_workerPool->ParallelFor(count, work);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        work(i);
+    }
+}
+
+void LeoWebClient::SetConfigService(LeoConfigService* config)
+{
+    if (m_config) {
+        m_config->Unsubscribe(m_configSubscription);
+    }
+    m_config = config;
+    m_settings.reset();
+    m_settingsGeneration = 0;
+    
+    if (m_config) {
+        // The liveness probe runs on its own, so it follows a port change at once;
+        // the transport picks it up before the next request
+        m_configSubscription = m_config->Subscribe([this](const LeoConfigService::Snapshot& settings) {
+            m_liveness.SetTarget(settings->Host, settings->Port);
+        });
+        RefreshSettings();
+    }
 }
 
 void LeoWebClient::SetPort(int port)
 {
-    m_port = port;
+    {
+        std::lock_guard<std::mutex> lock(m_targetMutex);
+        m_port = port;
+    }
+    m_transport->SetTarget(std::string(CT2CA(m_host, CP_UTF8)), m_port);
+    m_liveness.SetTarget(m_host, m_port);
     CString str;
     str.Format(_T("%d"), port);
     LogMessage(_T("Port set to: ") + str);
@@ -39,35 +164,63 @@ void LeoWebClient::SetPort(int port)
 
 void LeoWebClient::SetHost(const CString& host)
 {
-    m_host = host;
+    {
+        std::lock_guard<std::mutex> lock(m_targetMutex);
+        m_host = host;
+    }
+    m_transport->SetTarget(std::string(CT2CA(m_host, CP_UTF8)), m_port);
+    m_liveness.SetTarget(m_host, m_port);
     LogMessage(L"Host set to: " + host);
 }
 
 void LeoWebClient::SetTimeout(int timeoutMs)
 {
     m_timeoutMs = timeoutMs;
+    m_transport->SetTimeout(timeoutMs);
+    m_appliedTimeoutMs = timeoutMs;
     CString str;
     str.Format(_T("%d"), timeoutMs);
     LogMessage(_T("Timeout set to: ") + str + _T("ms"));
 }
 
-bool LeoWebClient::IsLeoAppRunning()
+void LeoWebClient::SetWireFormat(WireFormat format)
 {
-    // Try to connect to the Leo app to check if it's running
-    try {
-        HttpResponse response;
-        bool success = SendHttpRequest(L"/", L"{}", 
-            [&response](const HttpResponse& resp) { response = resp; },
-            [](const CString& error) { /* ignore errors */ });
-        
-        m_isConnected = success && response.StatusCode == 200;
-    } catch (...) {
-        m_isConnected = false;
-    }
+    m_wireFormat = format;
+    LogMessage(format == WireFormat::MessagePack ? _T("Wire format set to: MessagePack") : _T("Wire format set to: JSON"));
+}
+
+WireFormat LeoWebClient::GetWireFormat() const
+{
+    return m_wireFormat;
+}
+
+void LeoWebClient::SetCandidateCallback(CandidateCallback callback)
+{
+    m_candidateCallback = callback;
+}
+
+void LeoWebClient::SetCancelToken(std::shared_ptr<HttpCancelToken> token)
+{
+    m_cancelToken = token;
+}
+
+void LeoWebClient::SetResponseTextEnabled(bool enabled)
+{
+    m_responseTextEnabled = enabled;
+}
 
+bool LeoWebClient::IsLeoAppRunning()
+{
+    // Answered from the liveness cache; only a stale entry costs a (short) TCP connect
+    m_isConnected = m_liveness.IsUp();
     return m_isConnected;
 }
 
+LeoLivenessProbe& LeoWebClient::GetLivenessProbe()
+{
+    return m_liveness;
+}
+
 int LeoWebClient::LaunchLeoDesktopApp(const CString& message)
 {
     try {
@@ -87,11 +240,17 @@ int LeoWebClient::LaunchLeoDesktopApp(const CString& message)
         if (ShellExecuteEx(&sei)) {
             LogMessage(L"Leo desktop app launched successfully");
             
-            // Wait a bit for the app to start
-            Sleep(2000);
+            // Wait until Leo accepts connections instead of guessing how long start-up takes
+            m_liveness.NotifyLaunched();
+            m_isConnected = m_liveness.WaitUntilUp(LEO_LAUNCH_READY_TIMEOUT_MS);
             
-            // Check if it's now running
-            //m_isConnected = IsLeoAppRunning();
+            CString readyMsg;
+            if (m_isConnected) {
+                readyMsg.Format(L"Leo desktop app ready after %d ms", m_liveness.GetLastTimeToReadyMs());
+            } else {
+                readyMsg.Format(L"Leo desktop app not ready after %d ms", LEO_LAUNCH_READY_TIMEOUT_MS);
+            }
+            LogMessage(readyMsg);
             return 1;
         } else {
             m_lastError = L"Failed to launch Leo app.";
@@ -110,10 +269,26 @@ bool LeoWebClient::SendFaceMeasurementData(const MeasurementData& data,
                                           ErrorCallback errorCallback)
 {
     try {
-        CString jsonData = SerializeMeasurementData(data);
-        LogMessage(L"Sending face measurement data: " + jsonData);
-        
-        return SendHttpRequest(L"/receive-data", jsonData, successCallback, errorCallback);
+        // Small payload: encode once on first use, then replay the bytes for the length pass,
+        // the send pass and any retries
+        std::string json;
+        std::string msgPack;
+        return SendPayload(L"/receive-data",
+            [&](ChunkedBodyWriter& out) {
+                if (json.empty()) {
+                    CString jsonData = SerializeMeasurementData(data);
+                    LEO_TRACE(Http, L"LeoWebClient: Sending face measurement data: %s", (LPCTSTR)jsonData);
+                    json = (const char*)CT2CA(jsonData, CP_UTF8);
+                }
+                out.Write(json);
+            },
+            [&](ChunkedBodyWriter& out) {
+                if (msgPack.empty()) {
+                    msgPack = SerializeMeasurementDataMsgPack(data);
+                }
+                out.Write(msgPack);
+            },
+            successCallback, errorCallback);
     } catch (const std::exception& e) {
         CString error = L"Exception sending face measurement data: " + CString(e.what());
         m_lastError = error;
@@ -123,15 +298,90 @@ bool LeoWebClient::SendFaceMeasurementData(const MeasurementData& data,
     }
 }
 
+bool LeoWebClient::SendFaceMeasurementBatch(const std::vector<MeasurementData>& faces,
+                                           SuccessCallback successCallback,
+                                           ErrorCallback errorCallback)
+{
+    try {
+        LEO_DEBUG(Http, L"LeoWebClient: Sending %d faces in one query", static_cast<int>(faces.size()));
+
+        // Every face is encoded on its own, spread over the worker pool, the first time a format
+        // is asked for; the length pass, the send pass and any retries replay the bytes
+        std::string json;
+        std::string msgPack;
+        // Hold back the error callback until we know Leo did not simply refuse the batch
+        bool success = SendPayload(LEO_FACE_SEARCH_ENDPOINT,
+            [&](ChunkedBodyWriter& out) {
+                if (json.empty()) {
+                    std::vector<std::string> encoded(faces.size());
+                    ParallelFor(faces.size(), [&](size_t i) {
+                        encoded[i] = (const char*)CT2CA(SerializeMeasurementData(faces[i]), CP_UTF8);
+                    });
+                    json = "{\"Faces\":[";
+                    for (size_t i = 0; i < encoded.size(); ++i) {
+                        if (i > 0) json += ',';
+                        json += encoded[i];
+                    }
+                    json += "]}";
+                }
+                out.Write(json);
+            },
+            [&](ChunkedBodyWriter& out) {
+                if (msgPack.empty()) {
+                    std::vector<std::string> encoded(faces.size());
+                    ParallelFor(faces.size(), [&](size_t i) {
+                        encoded[i] = SerializeMeasurementDataMsgPack(faces[i]);
+                    });
+                    MsgPackWriter writer;
+                    writer.WriteMapHeader(1);
+                    writer.WriteString("Faces", 5);
+                    writer.WriteArrayHeader(static_cast<uint32_t>(faces.size()));
+                    msgPack = writer.Buffer();
+                    for (const auto& face : encoded) {
+                        msgPack += face;
+                    }
+                }
+                out.Write(msgPack);
+            },
+            successCallback,
+            [this, &faces, &errorCallback](const CString& error) {
+                if ((faces.empty() || !IsBatchRefused(m_lastStatusCode)) && errorCallback) {
+                    errorCallback(error);
+                }
+            });
+
+        if (success || faces.empty() || !IsBatchRefused(m_lastStatusCode)) {
+            return success;
+        }
+
+        // A Leo without the batch endpoint still answers the first face the way it always has
+        CString msg;
+        msg.Format(L"Leo refused the %d-face query (%d), sending the first face to %s", static_cast<int>(faces.size()),
+                   m_lastStatusCode.load(), LEO_SEARCH_ENDPOINT);
+        LogMessage(msg);
+        return SendFaceMeasurementData(faces[0], successCallback, errorCallback);
+    } catch (const std::exception& e) {
+        CString error = L"Exception sending face batch: " + CString(e.what());
+        m_lastError = error;
+        LogMessage(error);
+        if (errorCallback) errorCallback(error);
+        return false;
+    }
+}
+
 bool LeoWebClient::SendAssemblyData(const AssemblyData& data,
                                    SuccessCallback successCallback,
                                    ErrorCallback errorCallback)
 {
     try {
-        CString jsonData = SerializeAssemblyData(data);
-        LogMessage(L"Sending assembly data: " + jsonData);
+        LEO_DEBUG(Http, L"LeoWebClient: Sending assembly data for %s (%d children)",
+            (LPCTSTR)data.AssemblyRoot, static_cast<int>(data.ChildrenList.size()));
         
-        return SendHttpRequest(L"/v2/receive-data", jsonData, successCallback, errorCallback);
+        // Large payload: serialized straight into the upload, never materialized as a whole
+        return SendPayload(L"/v2/receive-data",
+            [&data](ChunkedBodyWriter& out) { WriteAssemblyDataJson(out, data); },
+            [&data](ChunkedBodyWriter& out) { WriteAssemblyDataMsgPack(out, data); },
+            successCallback, errorCallback);
     } catch (const std::exception& e) {
         CString error = L"Exception sending assembly data: " + CString(e.what());
         m_lastError = error;
@@ -156,11 +406,44 @@ bool LeoWebClient::BringLeoAppToForeground(SuccessCallback successCallback,
     }
 }
 
+bool LeoWebClient::SendEncodedJson(const CString& endpoint,
+                                  const std::string& jsonBody,
+                                  SuccessCallback successCallback,
+                                  ErrorCallback errorCallback)
+{
+    try {
+        return SendHttpRequest(endpoint, jsonBody, HTTP_CONTENT_TYPE, successCallback, errorCallback);
+    } catch (const std::exception& e) {
+        CString error = L"Exception sending encoded payload: " + CString(e.what());
+        m_lastError = error;
+        LogMessage(error);
+        if (errorCallback) errorCallback(error);
+        return false;
+    }
+}
+
+std::string LeoWebClient::EncodeAssemblyDataJson(const AssemblyData& data)
+{
+    std::string body;
+    ChunkedBodyWriter writer([&body](const char* chunk, size_t length) {
+        body.append(chunk, length);
+        return true;
+    }, HTTP_BODY_CHUNK_SIZE);
+    WriteAssemblyDataJson(writer, data);
+    writer.Flush();
+    return body;
+}
+
 CString LeoWebClient::GetLastError() const
 {
     return m_lastError;
 }
 
+int LeoWebClient::GetLastStatusCode() const
+{
+    return m_lastStatusCode;
+}
+
 bool LeoWebClient::IsConnected() const
 {
     return m_isConnected;
@@ -169,6 +452,35 @@ bool LeoWebClient::IsConnected() const
 void LeoWebClient::SetLoggingEnabled(bool enabled)
 {
     m_loggingEnabled = enabled;
+    LogFileWriter::SetLevel(LogCategory::Http, enabled ? LEO_LOG_LEVEL_INFO : LEO_LOG_LEVEL_OFF);
+}
+
+bool LeoWebClient::SendPayload(const CString& endpoint,
+                              const BodyProducer& jsonBody,
+                              const BodyProducer& msgPackBody,
+                              SuccessCallback successCallback,
+                              ErrorCallback errorCallback)
+{
+    if (m_wireFormat == WireFormat::MessagePack) {
+        LEO_DEBUG(Http, L"LeoWebClient: Sending MessagePack payload to %s", (LPCTSTR)endpoint);
+        
+        // Hold back the error callback until we know Leo did not simply reject the encoding
+        bool success = SendHttpRequest(endpoint, msgPackBody, HTTP_CONTENT_TYPE_MSGPACK, successCallback,
+            [this, &errorCallback](const CString& error) {
+                if (m_lastStatusCode != 415 && errorCallback) {
+                    errorCallback(error);
+                }
+            });
+        
+        if (success || m_lastStatusCode != 415) {
+            return success;
+        }
+        
+        LogMessage(L"Leo does not accept MessagePack (415), falling back to JSON");
+        m_wireFormat = WireFormat::Json;
+    }
+    
+    return SendHttpRequest(endpoint, jsonBody, HTTP_CONTENT_TYPE, successCallback, errorCallback);
 }
 
 bool LeoWebClient::SendHttpRequest(const CString& endpoint, 
@@ -176,145 +488,153 @@ bool LeoWebClient::SendHttpRequest(const CString& endpoint,
                                   SuccessCallback successCallback,
                                   ErrorCallback errorCallback)
 {
-    HINTERNET hSession = NULL;
-    HINTERNET hConnect = NULL;
-    HINTERNET hRequest = NULL;
+    // Convert JSON data to UTF-8
+    CT2CA utf8Json(jsonData, CP_UTF8);
+    std::string body((const char*)utf8Json);
     
-    try {
-        // Initialize WinHTTP session
-        hSession = WinHttpOpen(L"LeoCreoAddin/1.0",
-                              WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
-                              WINHTTP_NO_PROXY_NAME,
-                              WINHTTP_NO_PROXY_BYPASS, 0);
-        
-        if (!hSession) {
-            CString error = GetLastError();
-            CString errorMsg;
-            errorMsg.Format(L"Failed to initialize WinHTTP session. Error: %s", (LPCTSTR)error);
-            throw std::runtime_error(CT2A(errorMsg));
+    return SendHttpRequest(endpoint, body, HTTP_CONTENT_TYPE, successCallback, errorCallback);
+}
+
+bool LeoWebClient::SendHttpRequest(const CString& endpoint,
+                                  const std::string& body,
+                                  LPCWSTR contentTypeHeader,
+                                  SuccessCallback successCallback,
+                                  ErrorCallback errorCallback)
+{
+    return SendHttpRequest(endpoint, [&body](ChunkedBodyWriter& out) { out.Write(body); },
+                           contentTypeHeader, successCallback, errorCallback);
+}
+
+bool LeoWebClient::SendHttpRequest(const CString& endpoint,
+                                  const BodyProducer& body,
+                                  LPCWSTR contentTypeHeader,
+                                  SuccessCallback successCallback,
+                                  ErrorCallback errorCallback)
+{
+    // Never reset here: a cancel that arrived before this request got going must still stop it
+    std::shared_ptr<HttpCancelToken> cancelToken = m_cancelToken;
+    
+    RefreshSettings();
+    ApplyTimeout(endpoint);
+    
+    // Fail fast while Leo is known to be down; the breaker's background probe closes the circuit again
+    if (!m_circuitBreaker.AllowRequest()) {
+        m_fastFailTotal++;
+        m_lastStatusCode = 0;
+        CString error;
+        error.Format(L"Leo is not responding (circuit open, next probe in %d ms). Endpoint: %s",
+                     m_circuitBreaker.GetRetryAfterMs(), (LPCTSTR)endpoint);
+        m_lastError = error;
+        LogMessage(error);
+        if (errorCallback) {
+            errorCallback(error);
         }
+        return false;
+    }
+    
+    // Only calls that are safe to repeat are retried; the rest get a single attempt
+    const int maxAttempts = IsIdempotentEndpoint(endpoint) ? MAX_RETRY_COUNT : 1;
+    CString lastError;
+    
+    for (int attempt = 1; ; ++attempt) {
+        lastError.Empty();
+        bool success = SendHttpRequestOnce(endpoint, body, contentTypeHeader, successCallback,
+            [&lastError](const CString& error) { lastError = error; });
         
-        // Set timeouts
-        DWORD timeout = static_cast<DWORD>(m_timeoutMs);
-        WinHttpSetOption(hSession, WINHTTP_OPTION_CONNECT_TIMEOUT, &timeout, sizeof(timeout));
-        WinHttpSetOption(hSession, WINHTTP_OPTION_RECEIVE_TIMEOUT, &timeout, sizeof(timeout));
-        WinHttpSetOption(hSession, WINHTTP_OPTION_SEND_TIMEOUT, &timeout, sizeof(timeout));
+        bool cancelled = cancelToken && cancelToken->IsCancelled();
+        ReportLiveness(cancelled);
         
-        // Connect to the server using member variables
-        hConnect = WinHttpConnect(hSession, m_host, static_cast<INTERNET_PORT>(m_port), 0);
+        if (success) {
+            m_circuitBreaker.RecordSuccess();
+            return true;
+        }
         
-        if (!hConnect) {
-            CString error = GetLastError();
-            CString errorMsg;
-            errorMsg.Format(L"Failed to connect to %s:%d. Error: %s", (LPCTSTR)m_host, m_port, (LPCTSTR)error);
-            throw std::runtime_error(CT2A(errorMsg));
+        if (cancelled) {
+            break;      // Deliberate cancel says nothing about Leo's health
         }
         
-        // Create HTTP request (use 0 for HTTP, not WINHTTP_FLAG_SECURE)
-        hRequest = WinHttpOpenRequest(hConnect, L"POST", endpoint,
-                                    NULL, WINHTTP_NO_REFERER,
-                                    WINHTTP_DEFAULT_ACCEPT_TYPES,
-                                    0); // 0 for HTTP, WINHTTP_FLAG_SECURE for HTTPS
+        if (!IsTransientFailure(m_lastStatusCode)) {
+            // Leo answered, just not with success; it is up, and repeating will not help
+            m_circuitBreaker.RecordSuccess();
+            break;
+        }
         
-        if (!hRequest) {
-            CString error = GetLastError();
-            CString errorMsg;
-            errorMsg.Format(L"Failed to create HTTP request. Error: %s", (LPCTSTR)error);
-            throw std::runtime_error(CT2A(errorMsg));
+        if (attempt >= maxAttempts) {
+            m_circuitBreaker.RecordFailure();
+            break;
         }
         
-        // Set Content-Type header
-        if (!WinHttpAddRequestHeaders(hRequest,
-                                    L"Content-Type: application/json",
-                                    -1,
-                                    WINHTTP_ADDREQ_FLAG_ADD | WINHTTP_ADDREQ_FLAG_REPLACE)) {
-            CString error = GetLastError();
-            CString errorMsg;
-            errorMsg.Format(L"Failed to add request headers. Error: %s", (LPCTSTR)error);
-            throw std::runtime_error(CT2A(errorMsg));
+        int delayMs = NextRetryDelayMs(attempt);
+        CString retryStr;
+        retryStr.Format(L"Retrying %s in %d ms (attempt %d of %d)", (LPCTSTR)endpoint, delayMs, attempt + 1, maxAttempts);
+        LogMessage(retryStr);
+        m_retryTotal++;
+        
+        if (!WaitBeforeRetry(cancelToken.get(), delayMs)) {
+            break;
         }
+    }
+    
+    if (errorCallback) {
+        errorCallback(lastError);
+    }
+    return false;
+}
 
-        // Convert JSON data to UTF-8
-        CT2CA utf8Json(jsonData, CP_UTF8);
-        DWORD jsonLength = static_cast<DWORD>(strlen(utf8Json));
-
-        // Send the request
-        BOOL sendResult = WinHttpSendRequest(hRequest,
-                                           WINHTTP_NO_ADDITIONAL_HEADERS,
-                                           0,
-                                           (LPVOID)(const char*)utf8Json,
-                                           jsonLength,
-                                           jsonLength,
-                                           0);
-
-        if (!sendResult) {
-            CString error = GetLastError();
-            CString errorMsg;
-            errorMsg.Format(L"Failed to send HTTP request. Error: %s", (LPCTSTR)error);
-            throw std::runtime_error(CT2A(errorMsg));
-        }
+bool LeoWebClient::SendHttpRequestOnce(const CString& endpoint,
+                                      const BodyProducer& body,
+                                      LPCWSTR contentTypeHeader,
+                                      SuccessCallback successCallback,
+                                      ErrorCallback errorCallback)
+{
+    LEO_SPAN(Http, "HTTP exchange");
+    try {
+        HttpTransportRequest request;
+        request.Path = std::string(CT2CA(endpoint, CP_UTF8));
+        request.Headers = std::string(CT2CA(contentTypeHeader)) + "\r\n";
+        request.Body = &body;
+        request.CancelToken = m_cancelToken.get();
         
-        // Receive the response
-        if (!WinHttpReceiveResponse(hRequest, NULL)) {
-            CString error = GetLastError();
-            CString errorMsg;
-            errorMsg.Format(L"Failed to receive HTTP response. Error: %s", (LPCTSTR)error);
-            throw std::runtime_error(CT2A(errorMsg));
+        // Advertise MessagePack support so Leo may answer in kind
+        if (m_wireFormat == WireFormat::MessagePack) {
+            request.Headers += std::string(CT2CA(HTTP_ACCEPT_MSGPACK)) + "\r\n";
         }
         
-        // Get response status code
-        DWORD statusCode = 0;
-        DWORD statusCodeSize = sizeof(statusCode);
-        if (!WinHttpQueryHeaders(hRequest, 
-                               WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
-                               WINHTTP_HEADER_NAME_BY_INDEX, 
-                               &statusCode, 
-                               &statusCodeSize, 
-                               WINHTTP_NO_HEADER_INDEX)) {
-            statusCode = 0; // Default if we can't get status code
+        // The response is read straight into the reusable buffer, decoding candidates while later chunks are still arriving
+        ResponseParserSink sink(m_responseBuffer, m_candidateCallback);
+        HttpTransportResult result = m_transport->Execute(request, sink);
+        
+        if (!result.Completed) {
+            throw std::runtime_error(result.Error);
         }
         
-        // Read response body
+        // Convert the complete body from UTF-8 once, so multi-byte characters split across chunks survive
+        LeoResponseParser& parser = sink.Parser();
         CString responseBody;
-        DWORD bytesAvailable = 0;
-        
-        do {
-            bytesAvailable = 0;
-            if (WinHttpQueryDataAvailable(hRequest, &bytesAvailable) && bytesAvailable > 0) {
-                // Allocate buffer for this chunk
-                std::vector<char> buffer(bytesAvailable + 1, 0);
-                DWORD bytesRead = 0;
-                
-                if (WinHttpReadData(hRequest, buffer.data(), bytesAvailable, &bytesRead) && bytesRead > 0) {
-                    // Convert from UTF-8 to CString
-                    CA2T wideBuffer(buffer.data(), CP_UTF8);
-                    responseBody += CString(wideBuffer);
-                }
-            }
-        } while (bytesAvailable > 0);
-        
-        // Cleanup handles
-        WinHttpCloseHandle(hRequest);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        hRequest = hConnect = hSession = NULL;
+        if (m_responseTextEnabled && !sink.IsMsgPack() && !parser.Bytes().Empty()) {
+            responseBody = parser.Bytes().ToText();
+        }
         
         // Create response object
         HttpResponse response;
-        response.StatusCode = static_cast<int>(statusCode);
+        response.StatusCode = sink.StatusCode();
+        m_lastStatusCode = response.StatusCode;
         response.Body = responseBody;
-        response.Success = (statusCode >= 200 && statusCode < 300);
+        response.Success = (response.StatusCode >= 200 && response.StatusCode < 300);
+        {
+            LEO_SPAN(Http, "Finish response parse");
+            parser.Finish(response.Data);
+        }
         
         // Log and handle response
-        CString statusStr;
-        statusStr.Format(L"%d", statusCode);
-        
         if (response.Success) {
-            LogMessage(L"HTTP request successful. Status: " + statusStr + L", Endpoint: " + endpoint);
+            LEO_DEBUG(Http, L"LeoWebClient: HTTP request successful. Status: %d, Endpoint: %s", response.StatusCode, (LPCTSTR)endpoint);
             if (successCallback) {
                 successCallback(response);
             }
         } else {
+            CString statusStr;
+            statusStr.Format(L"%d", response.StatusCode);
             CString error = L"HTTP request failed. Status: " + statusStr + L", Endpoint: " + endpoint;
             if (!responseBody.IsEmpty()) {
                 error += L", Response: " + responseBody;
@@ -329,10 +649,7 @@ bool LeoWebClient::SendHttpRequest(const CString& endpoint,
         return response.Success;
         
     } catch (const std::exception& e) {
-        // Cleanup handles in case of exception
-        if (hRequest) WinHttpCloseHandle(hRequest);
-        if (hConnect) WinHttpCloseHandle(hConnect);
-        if (hSession) WinHttpCloseHandle(hSession);
+        m_lastStatusCode = 0;
         
         CString error = L"HTTP request exception: " + CString(e.what());
         m_lastError = error;
@@ -347,6 +664,7 @@ bool LeoWebClient::SendHttpRequest(const CString& endpoint,
 
 CString LeoWebClient::SerializeMeasurementData(const MeasurementData& data)
 {
+    LEO_SPAN(Http, "Serialize JSON");
     std::ostringstream json;
     json << "{";
     json << "\"Area\":\"" << (const char*)CT2A(data.Area) << "\", ";
@@ -375,45 +693,6 @@ CString LeoWebClient::SerializeMeasurementData(const MeasurementData& data)
     json << "\"ClickLocation\": { \"x\": \"" << (const char*)CT2A(data.ClickLocation.X) << "\", \"y\": \"" << (const char*)CT2A(data.ClickLocation.Y) << "\", \"z\": \"" << (const char*)CT2A(data.ClickLocation.Z) << "\" }";
     json << "}";
 
-    LogMessage(CString(json.str().c_str()));
-
-    return CString(json.str().c_str());
-}
-
-CString LeoWebClient::SerializeAssemblyData(const AssemblyData& data)
-{
-    std::ostringstream json;
-    json << "{";
-    json << "\"AssemblyRoot\":\"" << data.AssemblyRoot << "\",";
-    json << "\"UserInstruction\":\"" << data.UserInstruction << "\",";
-    json << "\"ChildrenList\":[";
-    
-    for (size_t i = 0; i < data.ChildrenList.size(); ++i) {
-        const auto& child = data.ChildrenList[i];
-        if (i > 0) json << ",";
-        
-        json << "{";
-        json << "\"Name\":\"" << child.Name << "\",";
-        json << "\"LocalPath\":\"" << child.LocalPath << "\",";
-        json << "\"Locations\":[";
-        
-        for (size_t j = 0; j < child.Locations.size(); ++j) {
-            const auto& location = child.Locations[j];
-            if (j > 0) json << ",";
-            
-            json << "{";
-            json << "\"Loc\":" << SerializeLocation(location.Loc) << ",";
-            json << "\"Orientation\":" << SerializeOrientationMatrix(location.Orientation);
-            json << "}";
-        }
-        
-        json << "]";
-        json << "}";
-    }
-    
-    json << "]";
-    json << "}";
-
     return CString(json.str().c_str());
 }
 
@@ -466,26 +745,197 @@ CString LeoWebClient::SerializeOrientationMatrix(const std::vector<std::vector<d
     return CString(json.str().c_str());
 }
 
-bool LeoWebClient::ParseHttpResponse(const CString& response, HttpResponse& httpResponse)
+void LeoWebClient::WriteMsgPackString(MsgPackWriter& writer, const CString& value)
 {
-    // Simple response parsing - in a real implementation, you might want to use a JSON parser
-    try {
-        // For now, just check if response contains success indicators
+    CT2CA utf8(value, CP_UTF8);
+    const char* str = utf8;
+    writer.WriteString(str, strlen(str));
+}
 
-        CString lowerResponse = response;
-        for (int i = 0; i < lowerResponse.GetLength(); ++i) {
-            lowerResponse.SetAt(i, tolower(lowerResponse[i]));
-        }
-        
-        httpResponse.Body = response;
-        httpResponse.Success = (lowerResponse.Find(_T("success")) != -1 ||
-                               lowerResponse.Find(_T("ok")) != -1 ||
-                               response.GetLength() > 0);
-        
+void LeoWebClient::WriteMsgPackPoint3D(MsgPackWriter& writer, const Point3D& point)
+{
+    writer.WriteMapHeader(3);
+    writer.WriteString("x", 1);
+    writer.WriteDouble(_tstof(point.X));
+    writer.WriteString("y", 1);
+    writer.WriteDouble(_tstof(point.Y));
+    writer.WriteString("z", 1);
+    writer.WriteDouble(_tstof(point.Z));
+}
+
+std::string LeoWebClient::SerializeMeasurementDataMsgPack(const MeasurementData& data)
+{
+    LEO_SPAN(Http, "Serialize MessagePack");
+    MsgPackWriter writer;
+    writer.Reserve(512);
+    
+    writer.WriteMapHeader(10);
+    writer.WriteString("Area", 4);
+    writer.WriteDouble(_tstof(data.Area));
+    writer.WriteString("Perimeter", 9);
+    writer.WriteDouble(_tstof(data.Perimeter));
+    writer.WriteString("Radius", 6);
+    writer.WriteDouble(_tstof(data.Radius));
+    writer.WriteString("Diameter", 8);
+    writer.WriteDouble(_tstof(data.Diameter));
+    writer.WriteString("CenterPoint", 11);
+    WriteMsgPackPoint3D(writer, data.CenterPoint);
+    
+    // Normal is kept as "x, y, z" text in MeasurementData; send it as three doubles
+    double normal[3] = { 0.0, 0.0, 0.0 };
+    _stscanf_s(data.Normal, _T("%lf, %lf, %lf"), &normal[0], &normal[1], &normal[2]);
+    writer.WriteString("Normal", 6);
+    writer.WriteArrayHeader(3);
+    writer.WriteDouble(normal[0]);
+    writer.WriteDouble(normal[1]);
+    writer.WriteDouble(normal[2]);
+    
+    writer.WriteString("IsHole", 6);
+    writer.WriteBool(data.IsHole);
+    writer.WriteString("SurfaceType", 11);
+    WriteMsgPackString(writer, data.SurfaceType);
+    
+    writer.WriteString("HoleInfo", 8);
+    if (data.IsHole) {
+        writer.WriteMapHeader(6);
+        writer.WriteString("ThreadSize", 10);
+        WriteMsgPackString(writer, data.HoleInfo.ThreadSize);
+        writer.WriteString("HoleDiameter", 12);
+        writer.WriteDouble(_tstof(data.HoleInfo.HoleDiameter));
+        writer.WriteString("HoleDepth", 9);
+        writer.WriteDouble(_tstof(data.HoleInfo.HoleDepth));
+        writer.WriteString("Standard", 8);
+        WriteMsgPackString(writer, data.HoleInfo.Standard);
+        writer.WriteString("ThreadClass", 11);
+        WriteMsgPackString(writer, data.HoleInfo.ThreadClass);
+        writer.WriteString("HoleType", 8);
+        WriteMsgPackString(writer, data.HoleInfo.HoleType);
+    } else {
+        writer.WriteNil();
+    }
+    
+    writer.WriteString("ClickLocation", 13);
+    WriteMsgPackPoint3D(writer, data.ClickLocation);
+    
+    return writer.Buffer();
+}
+
+bool LeoWebClient::IsIdempotentEndpoint(const CString& endpoint)
+{
+    // Liveness checks, un-minimising and a face search can be repeated safely;
+    // an assembly placement could be applied twice, so it is only sent once
+    return endpoint == L"/" || endpoint == L"/unminized" || endpoint == LEO_SEARCH_ENDPOINT
+        || endpoint == LEO_FACE_SEARCH_ENDPOINT;
+}
+
+bool LeoWebClient::IsTransientFailure(int statusCode)
+{
+    // 0 means no HTTP answer at all (refused, reset, timed out)
+    return statusCode == 0 || statusCode == 502 || statusCode == 503 || statusCode == 504;
+}
+
+bool LeoWebClient::IsBatchRefused(int statusCode)
+{
+    // No such endpoint, or a content type it does not take: an older Leo. A 400 means Leo has
+    // the endpoint and found the batch malformed; falling back would silently drop all but the
+    // first face, so it is reported like any other error.
+    return statusCode == 404 || statusCode == 415;
+}
+
+int LeoWebClient::NextRetryDelayMs(int attempt)
+{
+    // Exponential backoff with equal jitter: half the step is fixed, half random,
+    // so retries from several calls do not line up
+    int step = (std::min)(HTTP_RETRY_BASE_DELAY_MS << (attempt - 1), HTTP_RETRY_MAX_DELAY_MS);
+    static thread_local std::mt19937 generator(std::random_device{}());
+    std::uniform_int_distribution<int> jitter(0, step / 2);
+    return step / 2 + jitter(generator);
+}
+
+bool LeoWebClient::WaitBeforeRetry(HttpCancelToken* token, int delayMs)
+{
+    LEO_SPAN(Http, "Retry backoff");
+    if (!token) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
         return true;
-    } catch (...) {
-        return false;
     }
+    return !token->WaitFor(delayMs);
+}
+
+bool LeoWebClient::ProbeLeo()
+{
+    // A TCP connect is enough to tell whether Leo is back, and leaves the transport's pooled connection alone
+    return m_liveness.ProbeNow();
+}
+
+void LeoWebClient::ReportLiveness(bool cancelled)
+{
+    // Any HTTP answer means Leo is up; no answer means down, unless we hung up ourselves
+    if (m_lastStatusCode != 0) {
+        m_liveness.Report(true);
+    } else if (!cancelled) {
+        m_liveness.Report(false);
+    }
+}
+
+void LeoWebClient::RefreshSettings()
+{
+    // One atomic read per request; the snapshot is only fetched after the file changed
+    if (!m_config || m_config->GetGeneration() == m_settingsGeneration) {
+        return;
+    }
+    m_settings = m_config->Current();
+    m_settingsGeneration = m_settings->Generation;
+    m_configFilePath = m_settings->SourcePath;
+    
+    // The target is published to other threads (GetDiagnostics) only under m_targetMutex
+    bool targetChanged = false;
+    {
+        std::lock_guard<std::mutex> lock(m_targetMutex);
+        if (m_settings->Host != m_host || m_settings->Port != m_port) {
+            m_host = m_settings->Host;
+            m_port = m_settings->Port;
+            targetChanged = true;
+        }
+    }
+    if (targetChanged) {
+        m_transport->SetTarget(std::string(CT2CA(m_settings->Host, CP_UTF8)), m_settings->Port);
+        m_liveness.SetTarget(m_settings->Host, m_settings->Port);
+    }
+    m_timeoutMs = m_settings->TimeoutMs;
+    
+    CString msg;
+    msg.Format(L"Settings applied (gen %u, %s): leo=%s:%d timeout=%dms",
+               m_settingsGeneration, m_configFilePath.IsEmpty() ? L"defaults" : (LPCTSTR)m_configFilePath,
+               (LPCTSTR)m_settings->Host, m_settings->Port, m_timeoutMs);
+    LogMessage(msg);
+}
+
+void LeoWebClient::ApplyTimeout(const CString& endpoint)
+{
+    int timeoutMs = m_settings ? m_settings->TimeoutFor(endpoint, m_timeoutMs) : m_timeoutMs;
+    if (timeoutMs != m_appliedTimeoutMs) {
+        m_transport->SetTimeout(timeoutMs);
+        m_appliedTimeoutMs = timeoutMs;
+    }
+}
+
+CString LeoWebClient::GetDiagnostics() const
+{
+    // Runs on the web server thread while the I/O thread may be switching targets
+    CString host;
+    int port = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_targetMutex);
+        host = m_host;
+        port = m_port;
+    }
+    
+    CString text;
+    text.Format(L"leo=%s:%d %s %s retries=%d fastFails=%d lastStatus=%d",
+                (LPCTSTR)host, port, (LPCTSTR)m_liveness.Describe(), (LPCTSTR)m_circuitBreaker.Describe(),
+                m_retryTotal.load(), m_fastFailTotal.load(), m_lastStatusCode.load());
+    return text;
 }
 
 void LeoWebClient::LogMessage(const CString& message)
@@ -493,10 +943,7 @@ void LeoWebClient::LogMessage(const CString& message)
     if (!m_loggingEnabled) return;
 
     try {
-        // Convert CString (wide) to std::wstring, then to std::string (UTF-8 or ANSI as needed)
-        // But since WriteLog expects const char*, use CT2A for conversion
-        CT2A logMsgA(_T("LeoWebClient: ") + message);
-        LogFileWriter::WriteLog((const char*)logMsgA);
+        LEO_INFO(Http, L"LeoWebClient: %s", (LPCTSTR)message);
     }
     catch (...) {
         // Silently fail if logging fails
@@ -4,19 +4,26 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <string>
+#include <mutex>
+#include <atomic>
 #include "LeoConfig.h" // Leo AI configuration  
 #include "LogFileWriter.h"
+#include "LeoWireFormat.h"
+#include "LeoPayload.h"
+#include "LeoResponseParser.h"
+#include "LeoBodyStream.h"
+#include "LeoCircuitBreaker.h"
+#include "LeoLivenessProbe.h"
+#include "LeoHttpTransport.h"
+#include "LeoConfigService.h"
+
+class LeoWorkerPool;
 
 // Forward declarations
 struct Point3D;
 struct HoleInfo;
 struct MeasurementData;
-struct Location;
-struct LocationWrapper;
-struct Child;
-struct AssemblyData;
-struct FileDownloadInfo;
-struct LocationInfo;
 
 // 3D Point structure for coordinates
 struct Point3D {
@@ -57,64 +64,6 @@ struct MeasurementData {
     MeasurementData() : IsHole(false) {}
 };
 
-// 3D Location structure for component positioning
-struct Location {
-    double X;
-    double Y;
-    double Z;
-    
-    Location() : X(0.0), Y(0.0), Z(0.0) {}
-    Location(double x, double y, double z) : X(x), Y(y), Z(z) {}
-};
-
-// Location wrapper with orientation matrix
-struct LocationWrapper {
-    Location Loc;
-    std::vector<std::vector<double>> Orientation;
-    
-    LocationWrapper() {
-        // Initialize 3x3 identity matrix
-        Orientation = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
-    }
-};
-
-// Child component structure
-struct Child {
-    CString Name;
-    CString LocalPath;
-    std::vector<LocationWrapper> Locations;
-    
-    Child() = default;
-};
-
-// Assembly data structure
-struct AssemblyData {
-    CString AssemblyRoot;
-    CString UserInstruction;
-    std::vector<Child> ChildrenList;
-    
-    AssemblyData() = default;
-};
-
-// Location information for file placement
-struct LocationInfo {
-    Location Loc;
-    std::vector<std::vector<double>> Orientation;
-
-    LocationInfo() {
-        // Initialize 3x3 identity matrix
-        Orientation = { {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0} };
-    }
-};
-
-// File download information
-struct FileDownloadInfo {
-    CString DownloadPath;
-    LocationInfo LocationInfo;
-    
-    FileDownloadInfo() = default;
-};
-
 
 // HTTP response structure
 struct HttpResponse {
@@ -122,6 +71,7 @@ struct HttpResponse {
     CString Body;
     CString ErrorMessage;
     bool Success;
+    LeoResponseData Data;       // Typed decode of Body (status, message, candidate parts)
     
     HttpResponse() : StatusCode(0), Success(false) {}
 };
@@ -140,16 +90,33 @@ public:
     void SetPort(int port);
     void SetHost(const CString& host);
     void SetTimeout(int timeoutMs);
+    void SetWireFormat(WireFormat format);
+    WireFormat GetWireFormat() const;
+    
+    // Called for each candidate part as soon as it is decoded, before the response completes
+    void SetCandidateCallback(CandidateCallback callback);
+    
+    // Off: HttpResponse::Body stays empty and only the typed Data is decoded (saves the UTF-16 copy)
+    void SetResponseTextEnabled(bool enabled);
     
     // Core HTTP communication methods
-    bool IsLeoAppRunning();
-    int LaunchLeoDesktopApp(const CString& message = L"");
+    bool IsLeoAppRunning();                     // Cached liveness state, see LeoLivenessProbe
+    int LaunchLeoDesktopApp(const CString& message = L"");  // Waits until Leo accepts connections
+    
+    // Background liveness probe for Leo; Start() it once and Subscribe() to up/down changes
+    LeoLivenessProbe& GetLivenessProbe();
     
     // Data sending methods
     bool SendFaceMeasurementData(const MeasurementData& data, 
                                 SuccessCallback successCallback = nullptr,
                                 ErrorCallback errorCallback = nullptr);
     
+    // Several faces in one query to LEO_FACE_SEARCH_ENDPOINT, as {"Faces": [...]}. If Leo answers
+    // 404 or 415 there, the first face goes to LEO_SEARCH_ENDPOINT instead, as before batching.
+    bool SendFaceMeasurementBatch(const std::vector<MeasurementData>& faces,
+                                 SuccessCallback successCallback = nullptr,
+                                 ErrorCallback errorCallback = nullptr);
+    
     bool SendAssemblyData(const AssemblyData& data,
                          SuccessCallback successCallback = nullptr,
                          ErrorCallback errorCallback = nullptr);
@@ -157,11 +124,42 @@ public:
     bool BringLeoAppToForeground(SuccessCallback successCallback = nullptr,
                                 ErrorCallback errorCallback = nullptr);
     
+    // Sends a body that was serialized earlier (LeoOutbox replay); always JSON
+    bool SendEncodedJson(const CString& endpoint,
+                        const std::string& jsonBody,
+                        SuccessCallback successCallback = nullptr,
+                        ErrorCallback errorCallback = nullptr);
+    
+    // JSON body of SendAssemblyData, for callers that store it before sending
+    static std::string EncodeAssemblyDataJson(const AssemblyData& data);
+    
     // Utility methods
     CString GetLastError() const;
+    int GetLastStatusCode() const;              // HTTP status of the last call, 0 if Leo did not answer
     bool IsConnected() const;
     void SetLoggingEnabled(bool enabled);
     
+    // Close the pooled connection (called from user_terminate)
+    void Shutdown();
+    
+    // Takes host, port and timeouts from local.properties. The snapshot is re-read before a request
+    // only when the file changed; those values then replace any set through SetHost/SetPort/SetTimeout
+    void SetConfigService(LeoConfigService* config);
+    
+    // Face batches are encoded one face per task on this pool when one is set; call before the first request
+    void SetWorkerPool(LeoWorkerPool* pool);
+    
+    // Replaces the network layer (WinHTTP on Windows, BSD sockets elsewhere); call before the first request
+    void SetTransport(std::unique_ptr<LeoHttpTransport> transport);
+    
+    // Requests sent from now on are aborted, backoff between retries included, when token is cancelled
+    // from any thread; null for none. A cancelled token stays cancelled, so set a fresh one per request.
+    // Call from the sending thread; cancellers keep their own reference to the token
+    void SetCancelToken(std::shared_ptr<HttpCancelToken> token);
+    
+    // Circuit breaker state and retry settings for the add-in's diagnostics
+    CString GetDiagnostics() const;
+    
 private:
     // Private helper methods
     bool SendHttpRequest(const CString& endpoint, 
@@ -169,32 +167,95 @@ private:
                         SuccessCallback successCallback,
                         ErrorCallback errorCallback);
     
+    bool SendHttpRequest(const CString& endpoint,
+                        const std::string& body,
+                        LPCWSTR contentTypeHeader,
+                        SuccessCallback successCallback,
+                        ErrorCallback errorCallback);
+    
+    // Retry and circuit breaker layer over SendHttpRequestOnce
+    bool SendHttpRequest(const CString& endpoint,
+                        const BodyProducer& body,
+                        LPCWSTR contentTypeHeader,
+                        SuccessCallback successCallback,
+                        ErrorCallback errorCallback);
+    
+    // The body is measured in a counting pass, then serialized straight into WinHttpWriteData chunks
+    bool SendHttpRequestOnce(const CString& endpoint,
+                            const BodyProducer& body,
+                            LPCWSTR contentTypeHeader,
+                            SuccessCallback successCallback,
+                            ErrorCallback errorCallback);
+    
+    static bool IsIdempotentEndpoint(const CString& endpoint);
+    static bool IsTransientFailure(int statusCode);
+    static bool IsBatchRefused(int statusCode);         // Face batch answers that fall back to the first face alone
+    static int NextRetryDelayMs(int attempt);
+    static bool WaitBeforeRetry(HttpCancelToken* token, int delayMs);      // False if the token was cancelled
+    bool ProbeLeo();                                    // Half-open probe, bypasses the breaker
+    void ReportLiveness(bool cancelled);                // Feeds the outcome of a real call to the probe cache
+    void RefreshSettings();                             // Applies a newer config snapshot, if there is one
+    void ApplyTimeout(const CString& endpoint);         // Per-site timeout from the snapshot, else m_timeoutMs
+    
+    // Sends a payload in the negotiated wire format, falling back to JSON if Leo rejects MessagePack
+    bool SendPayload(const CString& endpoint,
+                    const BodyProducer& jsonBody,
+                    const BodyProducer& msgPackBody,
+                    SuccessCallback successCallback,
+                    ErrorCallback errorCallback);
+    
     CString SerializeMeasurementData(const MeasurementData& data);
-    CString SerializeAssemblyData(const AssemblyData& data);
     CString SerializePoint3D(const Point3D& point);
     CString SerializeHoleInfo(const HoleInfo& holeInfo);
     CString SerializeLocation(const Location& location);
     CString SerializeOrientationMatrix(const std::vector<std::vector<double>>& matrix);
     
-    bool ParseHttpResponse(const CString& response, HttpResponse& httpResponse);
+    // MessagePack encoders (doubles stored natively, strings length-prefixed)
+    std::string SerializeMeasurementDataMsgPack(const MeasurementData& data);
+    static void WriteMsgPackString(MsgPackWriter& writer, const CString& value);
+    static void WriteMsgPackPoint3D(MsgPackWriter& writer, const Point3D& point);
+    
     void LogMessage(const CString& message);
     
+    // work(i) for every i in [0, count), on the worker pool if there is one
+    void ParallelFor(size_t count, const std::function<void(size_t)>& work);
+    
     // Member variables
-    CString m_host;
+    CString m_host;                                     // Written under m_targetMutex; other threads read it under the lock too
     int m_port;
+    mutable std::mutex m_targetMutex;
     int m_timeoutMs;
     CString m_lastError;
     bool m_isConnected;
     bool m_loggingEnabled;
     CString m_configFilePath;
+    WireFormat m_wireFormat;
+    std::atomic<int> m_lastStatusCode;                  // Also read by GetDiagnostics on the web server thread
+    CandidateCallback m_candidateCallback;
+    bool m_responseTextEnabled;
+    ResponseBuffer m_responseBuffer;                    // Reused by every response (one thread sends requests)
+    
+    // Keeps the connection to m_host:m_port alive across requests
+    std::unique_ptr<LeoHttpTransport> m_transport;
+    std::shared_ptr<HttpCancelToken> m_cancelToken;     // Only the sending thread touches it
+    
+    LeoCircuitBreaker m_circuitBreaker;
+    LeoLivenessProbe m_liveness;
+    std::atomic<int> m_retryTotal;                      // Backed-off retries since startup
+    std::atomic<int> m_fastFailTotal;                   // Calls refused while the circuit was open
+    
+    // local.properties; only the sending thread touches m_settings
+    LeoConfigService* m_config;
+    LeoConfigService::Snapshot m_settings;
+    unsigned m_settingsGeneration;
+    LeoConfigService::SubscriptionId m_configSubscription;
+    int m_appliedTimeoutMs;                             // What the transport currently uses
     
-    // Configuration values
-    int m_defaultPort;
-    int m_defaultTimeout;
+    LeoWorkerPool* m_workerPool;
     
     // Constants
-    static const int DEFAULT_PORT = 4000;
-    static const int DEFAULT_TIMEOUT_MS = 5000;
-    static const int MAX_RETRY_COUNT = 3;
+    static const int DEFAULT_PORT = LEO_DESKTOP_PORT;
+    static const int DEFAULT_TIMEOUT_MS = HTTP_TIMEOUT_MS;
+    static const int MAX_RETRY_COUNT = HTTP_RETRY_COUNT;        // Attempts per idempotent call
     static const CString DEFAULT_HOST;
 };
\ No newline at end of file
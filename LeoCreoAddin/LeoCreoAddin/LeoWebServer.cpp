@@ -1,7 +1,9 @@
 #include "stdafx.h"
 #include "LeoWebServer.h"
 #include "LeoWebClient.h"
+#include "LeoPayload.h"
 #include "LogFileWriter.h"
+#include "LeoTrace.h"
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <sstream>
@@ -126,6 +128,12 @@ void LeoWebServer::SetRequestHandler(RequestHandlerCallback callback)
     LogMessage(_T("LeoWebServer: Request handler callback set"));
 }
 
+void LeoWebServer::SetDiagnosticsProvider(DiagnosticsProvider provider)
+{
+    m_diagnosticsProvider = provider;
+    LogMessage(_T("LeoWebServer: Diagnostics provider set"));
+}
+
 CString LeoWebServer::GetLastError() const
 {
     return m_lastError;
@@ -134,31 +142,45 @@ CString LeoWebServer::GetLastError() const
 void LeoWebServer::SetLoggingEnabled(bool enabled)
 {
     m_loggingEnabled = enabled;
+    LogFileWriter::SetLevel(LogCategory::Server, enabled ? LEO_LOG_LEVEL_INFO : LEO_LOG_LEVEL_OFF);
     CString status = enabled ? _T("enabled") : _T("disabled");
     LogMessage(_T("LeoWebServer: Logging ") + status);
 }
 
 void LeoWebServer::ServerThread()
 {
+    LeoTrace::NameThread("Leo web server");
     LogMessage(_T("LeoWebServer: Server thread started"));
     
     while (!m_shouldStop) {
         try {
-            HttpRequest request;
+            // Everything the previous request placed in the arena is released here in one step
+            m_requestArena.Reset();
+            HttpRequest request(&m_requestArena);
             
             // Wait for incoming requests with zero-latency response
             // The WaitForRequest method now uses select() with 0 timeout
             // This ensures immediate processing of incoming connections
             if (m_impl->WaitForRequest(request)) {
-                LogMessage(_T("LeoWebServer: Received request: ") + request.Method + _T(" ") + request.Path);
+                LEO_DEBUG(Server, _T("LeoWebServer: Received request: %s %s"), (LPCTSTR)request.Method, (LPCTSTR)request.Path);
+                
+                // Custom handlers get the decoded text body; the built-in parsers read RawBody directly
+                if (m_requestHandlerCallback && !IsMsgPackRequest(request)) {
+                    request.Body = HttpUtf8ToCString(request.RawBody.data(), request.RawBody.size());
+                }
                 
-                    // Handle the request
-    WebServerResponse response = HandleRequest(request);
+                // Handle the request
+                WebServerResponse response = HandleRequest(request);
                 
                 // Send the response
-                if (!m_impl->SendResponse(response)) {
+                if (!m_impl->SendResponse(response, &m_requestArena)) {
                     LogMessage(_T("LeoWebServer: Failed to send response"));
                 }
+                
+                const ArenaStats& stats = m_requestArena.GetStats();
+                LEO_TRACE(Server, _T("LeoWebServer: Request arena: %u allocations, %u bytes, %u new heap blocks (capacity %u bytes)"),
+                    static_cast<unsigned>(stats.Allocations), static_cast<unsigned>(stats.BytesAllocated),
+                    static_cast<unsigned>(stats.BlockAllocations), static_cast<unsigned>(stats.Capacity));
             }
             
             // Check for pending connections more frequently
@@ -176,6 +198,8 @@ void LeoWebServer::ServerThread()
 
 WebServerResponse LeoWebServer::HandleRequest(const HttpRequest& request)
 {
+    LEO_SPAN(Server, "LeoWebServer::HandleRequest");
+
     // Check if custom request handler is set
     if (m_requestHandlerCallback) {
         return m_requestHandlerCallback(request);
@@ -184,7 +208,7 @@ WebServerResponse LeoWebServer::HandleRequest(const HttpRequest& request)
     // Default request handling
     if (request.Method.CompareNoCase(_T("POST")) == 0) {
         if (request.Path.CompareNoCase(_T("/")) == 0) {
-            return HandlePartOpeningRequest(request.Body);
+            return HandlePartOpeningRequest(request);
         } else if (request.Path.CompareNoCase(_T("/health")) == 0) {
             return HandleHealthCheck();
         }
@@ -203,24 +227,34 @@ WebServerResponse LeoWebServer::HandleRequest(const HttpRequest& request)
     return response;
 }
 
-WebServerResponse LeoWebServer::HandlePartOpeningRequest(const CString& requestBody)
+WebServerResponse LeoWebServer::HandlePartOpeningRequest(const HttpRequest& request)
 {
     LogMessage(_T("LeoWebServer: Handling part opening request"));
     
     WebServerResponse response;
     
-    if (requestBody.IsEmpty()) {
+    if (request.RawBody.empty()) {
         response.StatusCode = 400;
         response.Body = CreateErrorResponse(_T("Request body is empty"));
         response.ContentType = _T("text/html");
         return response;
     }
     
-    // Parse the file download information
+    // Parse the file download information in the encoding announced by Content-Type
     FileDownloadInfo fileInfo;
-    if (!ParseFileDownloadInfo(requestBody, fileInfo)) {
+    bool isMsgPack = IsMsgPackRequest(request);
+    bool parsed = false;
+    try {
+        LEO_SPAN(Server, "Parse part opening request");
+        parsed = isMsgPack ? ParseFileDownloadInfoMsgPack(request.RawBody.data(), request.RawBody.size(), fileInfo)
+                           : ParseFileDownloadInfo(request.RawBody.data(), request.RawBody.size(), fileInfo, &m_requestArena);
+    } catch (const std::exception& e) {
+        LogMessage(_T("LeoWebServer: Exception parsing FileDownloadInfo: ") + CString(e.what()));
+    }
+    if (!parsed) {
         response.StatusCode = 400;
-        response.Body = CreateErrorResponse(_T("Invalid JSON format in request body"));
+        response.Body = CreateErrorResponse(isMsgPack ? _T("Invalid MessagePack format in request body")
+                                                      : _T("Invalid JSON format in request body"));
         response.ContentType = _T("text/html");
         return response;
     }
@@ -270,121 +304,20 @@ WebServerResponse LeoWebServer::HandleHealthCheck()
 {
     WebServerResponse response;
     response.StatusCode = 200;
-    response.Body = _T("<html><body><h1>Leo Web Server is running</h1></body></html>");
+    response.Body = _T("<html><body><h1>Leo Web Server is running</h1>");
+    if (m_diagnosticsProvider) {
+        try {
+            response.Body += _T("<pre>") + m_diagnosticsProvider() + _T("</pre>");
+        } catch (const std::exception& e) {
+            LogMessage(_T("LeoWebServer: Exception in diagnostics provider: ") + CString(e.what()));
+        }
+    }
+    response.Body += _T("</body></html>");
     response.ContentType = _T("text/html");
     
     return response;
 }
 
-bool LeoWebServer::ParseFileDownloadInfo(const CString& jsonData, FileDownloadInfo& fileInfo)
-{
-    try {
-        // Extract download path
-        CString downloadPath = ExtractJsonValue(jsonData, _T("downloadPath"));
-        if (!downloadPath.IsEmpty()) {
-            fileInfo.DownloadPath = downloadPath;
-        }
-        
-        // Extract location info
-        CString locationInfoJson = ExtractJsonValue(jsonData, _T("locationInfo"));
-        if (!locationInfoJson.IsEmpty()) {
-            LocationInfo locationInfo;
-            if (ParseLocationInfo(locationInfoJson, locationInfo)) {
-                fileInfo.LocationInfo = locationInfo;
-            }
-        }
-        
-        return true;
-        
-    } catch (const std::exception& e) {
-        LogMessage(_T("LeoWebServer: Exception parsing FileDownloadInfo: ") + CString(e.what()));
-        return false;
-    }
-}
-
-bool LeoWebServer::ParseLocationInfo(const CString& jsonData, LocationInfo& locationInfo)
-{
-    try {
-        // Parse location
-        CString locationJson = ExtractJsonValue(jsonData, _T("loc"));
-        if (!locationJson.IsEmpty()) {
-            Location location;
-            if (ParseLocation(locationJson, location)) {
-                locationInfo.Loc = location;
-            }
-        }
-        
-        // Parse orientation matrix
-        CString orientationJson = ExtractJsonValue(jsonData, _T("orientation"));
-        if (!orientationJson.IsEmpty()) {
-            std::vector<std::vector<double>> matrix;
-            if (ParseOrientationMatrix(orientationJson, matrix)) {
-                locationInfo.Orientation = matrix;
-            }
-        }
-        
-        return true;
-        
-    } catch (const std::exception& e) {
-        LogMessage(_T("LeoWebServer: Exception parsing LocationInfo: ") + CString(e.what()));
-        return false;
-    }
-}
-
-bool LeoWebServer::ParseLocation(const CString& jsonData, Location& location)
-{
-    try {
-        // Extract X, Y, Z coordinates
-        CString xStr = ExtractJsonValue(jsonData, _T("x"));
-        CString yStr = ExtractJsonValue(jsonData, _T("y"));
-        CString zStr = ExtractJsonValue(jsonData, _T("z"));
-        
-        if (!xStr.IsEmpty() && !yStr.IsEmpty() && !zStr.IsEmpty()) {
-            location.X = _ttof(xStr);
-            location.Y = _ttof(yStr);
-            location.Z = _ttof(zStr);
-            return true;
-        }
-        
-        return false;
-        
-    } catch (const std::exception& e) {
-        LogMessage(_T("LeoWebServer: Exception parsing Location: ") + CString(e.what()));
-        return false;
-    }
-}
-
-bool LeoWebServer::ParseOrientationMatrix(const CString& jsonData, std::vector<std::vector<double>>& matrix)
-{
-    try {
-        // Simple parsing for 3x3 matrix
-        // This is a basic implementation - you might want to use a proper JSON parser
-        matrix.clear();
-        matrix.resize(3);
-        
-        for (int i = 0; i < 3; i++) {
-            matrix[i].resize(3);
-            for (int j = 0; j < 3; j++) {
-                matrix[i][j] = (i == j) ? 1.0 : 0.0; // Default to identity matrix
-            }
-        }
-        
-        // Try to parse the actual values if they exist
-        // This is a simplified approach - in production, use a proper JSON parser
-        if (jsonData.Find(_T("[")) >= 0 && jsonData.Find(_T("]")) >= 0) {
-            // Basic matrix parsing (simplified)
-            // For now, we'll use the default identity matrix
-            LogMessage(_T("LeoWebServer: Using default identity matrix for orientation"));
-        }
-        
-        return true;
-        
-    } catch (const std::exception& e) {
-        LogMessage(_T("LeoWebServer: Exception parsing orientation matrix: ") + CString(e.what()));
-        return false;
-    }
-}
-
 CString LeoWebServer::CreateSuccessResponse()
 {
     return DEFAULT_RESPONSE;
@@ -400,70 +333,14 @@ CString LeoWebServer::CreateErrorResponse(const CString& errorMessage)
 void LeoWebServer::LogMessage(const CString& message)
 {
     if (m_loggingEnabled) {
-        LogFileWriter::WriteLog((const char*)CT2A(_T("LeoWebServer: ") + message));
+        LEO_INFO(Server, _T("LeoWebServer: %s"), (LPCTSTR)message);
     }
 }
 
-CString LeoWebServer::ExtractJsonValue(const CString& jsonData, const CString& key)
-{
-    // Simple JSON value extraction
-    // This is a basic implementation - in production, use a proper JSON parser
-    
-    CString searchKey = _T("\"") + key + _T("\":");
-    int keyPos = jsonData.Find(searchKey);
-    if (keyPos < 0) {
-        return _T("");
-    }
-    
-    int valueStart = keyPos + searchKey.GetLength();
-    
-    // Skip whitespace
-    while (valueStart < jsonData.GetLength() && 
-           (jsonData[valueStart] == _T(' ') || jsonData[valueStart] == _T('\t'))) {
-        valueStart++;
-    }
-    
-    if (valueStart >= jsonData.GetLength()) {
-        return _T("");
-    }
-    
-    // Find the end of the value
-    int valueEnd = valueStart;
-    bool inQuotes = false;
-    
-    if (jsonData[valueStart] == _T('"')) {
-        inQuotes = true;
-        valueStart++; // Skip opening quote
-        valueEnd = valueStart;
-        
-        while (valueEnd < jsonData.GetLength() && jsonData[valueEnd] != _T('"')) {
-            if (jsonData[valueEnd] == _T('\\') && valueEnd + 1 < jsonData.GetLength()) {
-                valueEnd += 2; // Skip escaped character
-            } else {
-                valueEnd++;
-            }
-        }
-    } else {
-        // Find next comma or closing brace/bracket
-        while (valueEnd < jsonData.GetLength() && 
-               jsonData[valueEnd] != _T(',') && 
-               jsonData[valueEnd] != _T('}') && 
-               jsonData[valueEnd] != _T(']')) {
-            valueEnd++;
-        }
-    }
-    
-    if (valueEnd > valueStart) {
-        return jsonData.Mid(valueStart, valueEnd - valueStart);
-    }
-    
-    return _T("");
-}
-
 // SimpleHttpServer implementation
 LeoWebServer::SimpleHttpServer::SimpleHttpServer()
     : m_isRunning(false)
-    , m_port(4100)
+    , m_port(DEFAULT_PORT)
     , m_serverSocket(INVALID_SOCKET)
     , m_lastClientSocket(INVALID_SOCKET)
 {
@@ -608,108 +485,56 @@ bool LeoWebServer::SimpleHttpServer::WaitForRequest(HttpRequest& request)
 
 bool LeoWebServer::SimpleHttpServer::ReadRequest(SOCKET clientSocket, HttpRequest& request)
 {
-    char buffer[8192];
-    int totalBytesReceived = 0;
-    int bytesReceived;
+    // Keep reading until the head is complete and Content-Length bytes of body are in
+    char chunk[8192];
+    HttpRequestReader reader(request, MAX_REQUEST_SIZE);
+    request.RawBody.reserve(sizeof(chunk));
     
     // Set socket to non-blocking mode for reading
     u_long mode = 1;
     ioctlsocket(clientSocket, FIONBIO, &mode);
     
-    // Read data with minimal timeout
-    fd_set readSet;
-    FD_ZERO(&readSet);
-    FD_SET(clientSocket, &readSet);
-    
-    timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 1000; // 1ms timeout for reading
-    
-    // Check if data is available
-    int result = select(0, &readSet, NULL, NULL, &timeout);
-    if (result <= 0) {
-        return false; // No data available
-    }
-    
-    // Read available data
-    bytesReceived = recv(clientSocket, buffer + totalBytesReceived, sizeof(buffer) - totalBytesReceived - 1, 0);
-    
-    if (bytesReceived > 0) {
-        totalBytesReceived += bytesReceived;
-        buffer[totalBytesReceived] = '\0';
+    while (!reader.IsComplete()) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(clientSocket, &readSet);
         
-        // Convert from UTF-8 to Unicode properly
-        CString rawRequest;
-        int wideLen = MultiByteToWideChar(CP_UTF8, 0, buffer, totalBytesReceived, NULL, 0);
-        if (wideLen > 0) {
-            wchar_t* wideBuffer = new wchar_t[wideLen + 1];
-            MultiByteToWideChar(CP_UTF8, 0, buffer, totalBytesReceived, wideBuffer, wideLen);
-            wideBuffer[wideLen] = L'\0';
-            rawRequest = wideBuffer;
-            delete[] wideBuffer;
-        } else {
-            // Fallback to ANSI if UTF-8 conversion fails
-            rawRequest = buffer;
+        // First segment keeps the original 1ms poll; later segments may take longer
+        bool first = request.RawBody.empty();
+        timeval timeout;
+        timeout.tv_sec = first ? 0 : REQUEST_READ_TIMEOUT_MS / 1000;
+        timeout.tv_usec = first ? 1000 : (REQUEST_READ_TIMEOUT_MS % 1000) * 1000;
+        
+        // Check if data is available
+        int result = select(0, &readSet, NULL, NULL, &timeout);
+        if (result <= 0) {
+            break; // No (more) data available
         }
         
-        return ParseHttpRequest(rawRequest, request);
-    }
-    
-    return false;
-}
-
-bool LeoWebServer::SimpleHttpServer::ParseHttpRequest(const CString& rawRequest, HttpRequest& request)
-{
-    // Simple HTTP request parsing
-    // Find first line (method and path)
-    int lineEnd = rawRequest.Find(_T("\r\n"));
-    if (lineEnd < 0) {
-        lineEnd = rawRequest.Find(_T("\n"));
-    }
-    
-    if (lineEnd < 0) {
-        return false;
-    }
-    
-    CString firstLine = rawRequest.Left(lineEnd);
-    
-    // Parse method and path
-    int space1 = firstLine.Find(_T(" "));
-    if (space1 < 0) {
-        return false;
-    }
-    
-    int space2 = firstLine.Find(_T(" "), space1 + 1);
-    if (space2 < 0) {
-        return false;
-    }
-    
-    request.Method = firstLine.Left(space1);
-    request.Path = firstLine.Mid(space1 + 1, space2 - space1 - 1);
-    
-    // Find body (after double CRLF)
-    int bodyStart = rawRequest.Find(_T("\r\n\r\n"));
-    if (bodyStart >= 0) {
-        request.Body = rawRequest.Mid(bodyStart + 4);
+        int bytesReceived = recv(clientSocket, chunk, sizeof(chunk), 0);
+        if (bytesReceived <= 0) {
+            break; // Peer closed or error
+        }
+        if (!reader.Append(chunk, bytesReceived)) {
+            return false;
+        }
     }
     
-    return true;
+    return reader.Finish();
 }
 
-bool LeoWebServer::SimpleHttpServer::SendResponse(const WebServerResponse& response)
+bool LeoWebServer::SimpleHttpServer::SendResponse(const WebServerResponse& response, RequestArena* arena)
 {
     if (m_lastClientSocket == INVALID_SOCKET) {
         return false;
     }
     
-    // Create HTTP response
-    CString httpResponse = CreateHttpResponse(response);
-    
-    // Convert to ANSI for sending
-    CT2A ansiResponse(httpResponse);
+    // Create HTTP response as UTF-8 bytes in the request arena
+    ArenaString httpResponse((ArenaAllocator<char>(arena)));
+    CreateHttpResponse(response, httpResponse);
     
     // Send response
-    int bytesSent = send(m_lastClientSocket, ansiResponse, (int)strlen(ansiResponse), 0);
+    int bytesSent = send(m_lastClientSocket, httpResponse.data(), static_cast<int>(httpResponse.size()), 0);
     
     // Close client socket
     closesocket(m_lastClientSocket);
@@ -717,38 +542,3 @@ bool LeoWebServer::SimpleHttpServer::SendResponse(const WebServerResponse& respo
     
     return (bytesSent > 0);
 }
-
-CString LeoWebServer::SimpleHttpServer::CreateHttpResponse(const WebServerResponse& response)
-{
-    CString httpResponse;
-    
-    // Status line
-    CString statusText;
-    switch (response.StatusCode) {
-        case 200: statusText = _T("OK"); break;
-        case 400: statusText = _T("Bad Request"); break;
-        case 404: statusText = _T("Not Found"); break;
-        case 500: statusText = _T("Internal Server Error"); break;
-        default: statusText = _T("Unknown"); break;
-    }
-        
-    httpResponse.Format(_T("HTTP/1.1 %d %s\r\n"), response.StatusCode, statusText);
-    
-    // Headers
-    httpResponse += _T("Content-Type: ") + response.ContentType + _T("\r\n");
-    CString contentLength;
-    contentLength.Format(_T("%d"), response.Body.GetLength());
-    httpResponse += _T("Content-Length: ") + contentLength + _T("\r\n");
-    httpResponse += _T("Connection: close\r\n");
-
-
-    
-    
-    // Empty line before body
-    httpResponse += _T("\r\n");
-    
-    // Body
-    httpResponse += response.Body;
-    
-    return httpResponse;
-}
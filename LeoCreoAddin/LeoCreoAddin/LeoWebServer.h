@@ -9,34 +9,18 @@
 #include <atomic>
 #include <map>
 #include <memory>
+#include <string>
+#include "LeoArena.h"
+#include "LeoHttpRequest.h"
+#include "LeoConfig.h"
 
 // Forward declarations
 struct FileDownloadInfo;
-struct LocationInfo;
-struct Location;
-
-// HTTP request structure
-struct HttpRequest {
-    CString Method;
-    CString Path;
-    CString Body;
-    std::map<CString, CString> Headers;
-    
-    HttpRequest() = default;
-};
-
-// Web server response structure
-struct WebServerResponse {
-    int StatusCode;
-    CString Body;
-    CString ContentType;
-    
-    WebServerResponse() : StatusCode(200), ContentType(_T("text/html")) {}
-};
 
 // Callback function types for file processing
 using FileProcessingCallback = std::function<void(const FileDownloadInfo&)>;
 using RequestHandlerCallback = std::function<WebServerResponse(const HttpRequest&)>;
+using DiagnosticsProvider = std::function<CString()>;
 
 // Leo Web Server class for receiving part opening requests
 class LeoWebServer {
@@ -45,7 +29,7 @@ public:
     ~LeoWebServer();
     
     // Server management
-    bool StartServer(int port = 4100);
+    bool StartServer(int port = DEFAULT_PORT);
     void StopServer();
     bool IsRunning() const;
     
@@ -59,6 +43,9 @@ public:
     // Request handling
     void SetRequestHandler(RequestHandlerCallback callback);
     
+    // Extra state reported by GET /health (called on the server thread)
+    void SetDiagnosticsProvider(DiagnosticsProvider provider);
+    
     // Utility methods
     CString GetLastError() const;
     void SetLoggingEnabled(bool enabled);
@@ -69,20 +56,13 @@ private:
     
     // Request handling methods
     WebServerResponse HandleRequest(const HttpRequest& request);
-    WebServerResponse HandlePartOpeningRequest(const CString& requestBody);
+    WebServerResponse HandlePartOpeningRequest(const HttpRequest& request);
     WebServerResponse HandleHealthCheck();
     
-    // JSON parsing methods
-    bool ParseFileDownloadInfo(const CString& jsonData, FileDownloadInfo& fileInfo);
-    bool ParseLocationInfo(const CString& jsonData, LocationInfo& locationInfo);
-    bool ParseLocation(const CString& jsonData, Location& location);
-    bool ParseOrientationMatrix(const CString& jsonData, std::vector<std::vector<double>>& matrix);
-    
     // Utility methods
     CString CreateSuccessResponse();
     CString CreateErrorResponse(const CString& errorMessage);
     void LogMessage(const CString& message);
-    CString ExtractJsonValue(const CString& jsonData, const CString& key);
     
     // Member variables
     int m_port;
@@ -92,13 +72,19 @@ private:
     CString m_lastError;
     bool m_loggingEnabled;
     
+    // Backs the receive buffer, structural index and response bytes of the request in flight;
+    // only touched by the server thread and reset once per request
+    RequestArena m_requestArena;
+    
     // Callbacks
     FileProcessingCallback m_fileProcessingCallback;
     RequestHandlerCallback m_requestHandlerCallback;
+    DiagnosticsProvider m_diagnosticsProvider;
     
     // Constants
-    static const int DEFAULT_PORT = 4100;
-    static const int MAX_REQUEST_SIZE = 8192;
+    static const int DEFAULT_PORT = LEO_WEB_SERVER_PORT;
+    static const int MAX_REQUEST_SIZE = 16 * 1024 * 1024;    // Large placement lists and batches
+    static const int REQUEST_READ_TIMEOUT_MS = 2000;          // Max idle time between body chunks
     static const CString DEFAULT_RESPONSE;
     
     // Simple HTTP server implementation
@@ -118,7 +104,7 @@ public:
     
     // Request handling
     bool WaitForRequest(HttpRequest& request);
-    bool SendResponse(const WebServerResponse& response);
+    bool SendResponse(const WebServerResponse& response, RequestArena* arena);
     
 private:
     // Server state
@@ -134,9 +120,5 @@ private:
     // Socket operations
     bool ReadRequest(SOCKET clientSocket, HttpRequest& request);
     bool SendHttpResponse(SOCKET clientSocket, const WebServerResponse& response);
-    
-    // HTTP parsing
-    bool ParseHttpRequest(const CString& rawRequest, HttpRequest& request);
-    CString CreateHttpResponse(const WebServerResponse& response);
 };
 
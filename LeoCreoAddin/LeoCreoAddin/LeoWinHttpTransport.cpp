@@ -0,0 +1,291 @@
+#include "stdafx.h"
+#include "LeoWinHttpTransport.h"
+#include "LeoConfig.h"
+#include "LogFileWriter.h"
+#include "LeoTrace.h"
+#include <winhttp.h>
+#include <cstdio>
+
+#pragma comment(lib, "winhttp.lib")
+
+LeoWinHttpTransport::LeoWinHttpTransport()
+    : m_host(L"localhost")
+    , m_port(0)
+    , m_timeoutMs(HTTP_TIMEOUT_MS)
+    , m_hSession(NULL)
+    , m_hConnect(NULL)
+    , m_hActiveRequest(NULL)
+{
+}
+
+LeoWinHttpTransport::~LeoWinHttpTransport()
+{
+    Reset();
+}
+
+void LeoWinHttpTransport::SetTarget(const std::string& host, int port)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // The pooled connection is bound to the old host and port
+    ResetLocked();
+    m_host = std::wstring(CA2W(host.c_str(), CP_UTF8));
+    m_port = port;
+}
+
+void LeoWinHttpTransport::SetTimeout(int timeoutMs)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_timeoutMs = timeoutMs;
+    // Apply to the live session; a new session picks the value up when it is opened
+    if (m_hSession) {
+        WinHttpSetTimeouts(m_hSession, 0, timeoutMs, timeoutMs, timeoutMs);
+    }
+}
+
+HttpTransportResult LeoWinHttpTransport::Execute(const HttpTransportRequest& request, HttpResponseSink& sink)
+{
+    HttpTransportResult result;
+    HINTERNET hRequest = NULL;
+    HttpCancelToken* token = request.CancelToken;
+    auto isCancelled = [token]() { return token && token->IsCancelled(); };
+
+    try {
+        // Reuse the pooled session and connection; only the request handle is per call
+        HINTERNET hConnect = AcquireConnection();
+        if (!hConnect) {
+            throw std::runtime_error(Failure("Failed to connect"));
+        }
+
+        // Create HTTP request (use 0 for HTTP, not WINHTTP_FLAG_SECURE)
+        std::wstring path(CA2W(request.Path.c_str(), CP_UTF8));
+        hRequest = WinHttpOpenRequest(hConnect, L"POST", path.c_str(),
+                                      NULL, WINHTTP_NO_REFERER,
+                                      WINHTTP_DEFAULT_ACCEPT_TYPES,
+                                      0); // 0 for HTTP, WINHTTP_FLAG_SECURE for HTTPS
+        if (!hRequest) {
+            throw std::runtime_error(Failure("Failed to create HTTP request"));
+        }
+
+        // Publish the handle so the token can abort the blocking calls below. A cancel that came
+        // earlier had no handle to close; Arm() refuses then and nothing is sent
+        SetActiveRequest(hRequest);
+        if (token && !token->Arm([this, hRequest]() { AbortActiveRequest(hRequest); })) {
+            throw std::runtime_error("Request cancelled before it was sent");
+        }
+
+        if (!request.Headers.empty()) {
+            std::wstring headers(CA2W(request.Headers.c_str(), CP_UTF8));
+            if (!WinHttpAddRequestHeaders(hRequest, headers.c_str(), static_cast<DWORD>(-1),
+                                          WINHTTP_ADDREQ_FLAG_ADD | WINHTTP_ADDREQ_FLAG_REPLACE)) {
+                throw std::runtime_error(Failure("Failed to add request headers"));
+            }
+        }
+
+        // Counting pass: the length goes into Content-Length without keeping the body around
+        uint64_t bodyLength = 0;
+        if (request.Body) {
+            LEO_SPAN(Http, "Measure request body");
+            ChunkedBodyWriter counter(nullptr);
+            (*request.Body)(counter);
+            bodyLength = counter.BytesWritten();
+        }
+        if (bodyLength > MAXDWORD) {
+            throw std::runtime_error("Request body exceeds 4 GB");
+        }
+
+        // Send the headers; the body follows in chunks
+        {
+            LEO_SPAN(Http, "Send request");
+            BOOL sendResult = WinHttpSendRequest(hRequest,
+                                                 WINHTTP_NO_ADDITIONAL_HEADERS,
+                                                 0,
+                                                 WINHTTP_NO_REQUEST_DATA,
+                                                 0,
+                                                 static_cast<DWORD>(bodyLength),
+                                                 0);
+            if (!sendResult || isCancelled()) {
+                throw std::runtime_error(Failure("Failed to send HTTP request"));
+            }
+
+            // Send pass: each chunk goes out as soon as the serializer fills it
+            if (request.Body) {
+                ChunkedBodyWriter writer([hRequest, &isCancelled](const char* data, size_t length) {
+                    while (length > 0) {
+                        DWORD written = 0;
+                        if (!WinHttpWriteData(hRequest, data, static_cast<DWORD>(length), &written) ||
+                            written == 0 || isCancelled()) {
+                            return false;
+                        }
+                        data += written;
+                        length -= written;
+                    }
+                    return true;
+                }, HTTP_BODY_CHUNK_SIZE);
+                (*request.Body)(writer);
+
+                if (!writer.Flush() || writer.BytesWritten() != bodyLength) {
+                    throw std::runtime_error(Failure("Failed to write HTTP request body"));
+                }
+            }
+        }
+
+        // Receive the response headers; on a trace this wait is Leo's own processing time
+        {
+            LEO_SPAN(Http, "Wait for response");
+            if (!WinHttpReceiveResponse(hRequest, NULL) || isCancelled()) {
+                throw std::runtime_error(Failure("Failed to receive HTTP response"));
+            }
+        }
+
+        DWORD statusCode = 0;
+        DWORD statusCodeSize = sizeof(statusCode);
+        if (!WinHttpQueryHeaders(hRequest,
+                                 WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                                 WINHTTP_HEADER_NAME_BY_INDEX,
+                                 &statusCode,
+                                 &statusCodeSize,
+                                 WINHTTP_NO_HEADER_INDEX)) {
+            statusCode = 0; // Default if we can't get status code
+        }
+
+        wchar_t contentType[128] = { 0 };
+        DWORD contentTypeSize = sizeof(contentType);
+        if (!WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_CONTENT_TYPE, WINHTTP_HEADER_NAME_BY_INDEX,
+                                 contentType, &contentTypeSize, WINHTTP_NO_HEADER_INDEX)) {
+            contentType[0] = 0;
+        }
+        sink.OnStatus(static_cast<int>(statusCode), std::string(CW2A(contentType, CP_UTF8)));
+
+        // Read the body straight into the sink's buffer
+        {
+            LEO_SPAN(Http, "Read response");
+            DWORD bytesAvailable = 0;
+            do {
+                bytesAvailable = 0;
+                if (WinHttpQueryDataAvailable(hRequest, &bytesAvailable) && bytesAvailable > 0) {
+                    char* dest = sink.PrepareBody(bytesAvailable);
+                    DWORD bytesRead = 0;
+
+                    if (WinHttpReadData(hRequest, dest, bytesAvailable, &bytesRead) && bytesRead > 0) {
+                        sink.CommitBody(bytesRead);
+                    }
+                }
+            } while (bytesAvailable > 0 && !isCancelled());
+        }
+
+        if (isCancelled()) {
+            throw std::runtime_error("Request cancelled while reading the response");
+        }
+
+        // Close the request; the socket goes back to the session's keep-alive pool
+        ReleaseActiveRequest(hRequest, token);
+        result.Completed = true;
+        return result;
+
+    } catch (const std::exception& e) {
+        // Drop the pooled connection so the next call reconnects, unless the failure was a
+        // deliberate cancel of a healthy connection
+        if (hRequest) {
+            ReleaseActiveRequest(hRequest, token);
+        }
+        result.Cancelled = isCancelled();
+        if (!result.Cancelled) {
+            Reset();
+        }
+        result.Error = e.what();
+        return result;
+    }
+}
+
+void LeoWinHttpTransport::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ResetLocked();
+}
+
+LPVOID LeoWinHttpTransport::AcquireConnection()
+{
+    LEO_SPAN(Http, "Acquire connection");
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_hSession) {
+        // Loopback only: skip proxy discovery entirely
+        m_hSession = WinHttpOpen(HTTP_USER_AGENT,
+                                 WINHTTP_ACCESS_TYPE_NO_PROXY,
+                                 WINHTTP_NO_PROXY_NAME,
+                                 WINHTTP_NO_PROXY_BYPASS, 0);
+        if (!m_hSession) {
+            return NULL;
+        }
+
+        // Set timeouts (resolve, connect, send, receive)
+        WinHttpSetTimeouts(m_hSession, 0, m_timeoutMs, m_timeoutMs, m_timeoutMs);
+        LogMessage("WinHTTP session opened");
+    }
+
+    if (!m_hConnect) {
+        m_hConnect = WinHttpConnect(m_hSession, m_host.c_str(), static_cast<INTERNET_PORT>(m_port), 0);
+        if (m_hConnect) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Connection opened to %s:%d", (const char*)CW2A(m_host.c_str()), m_port);
+            LogMessage(msg);
+        }
+    }
+
+    return m_hConnect;
+}
+
+void LeoWinHttpTransport::ResetLocked()
+{
+    if (m_hConnect) {
+        WinHttpCloseHandle(m_hConnect);
+        m_hConnect = NULL;
+    }
+    if (m_hSession) {
+        WinHttpCloseHandle(m_hSession);
+        m_hSession = NULL;
+    }
+}
+
+void LeoWinHttpTransport::SetActiveRequest(LPVOID hRequest)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hActiveRequest = hRequest;
+}
+
+void LeoWinHttpTransport::AbortActiveRequest(LPVOID hRequest)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_hActiveRequest == hRequest) {
+        // Closing the handle makes the blocked WinHTTP call fail with ERROR_WINHTTP_OPERATION_CANCELLED
+        WinHttpCloseHandle(hRequest);
+        m_hActiveRequest = NULL;
+        LogMessage("In-flight request cancelled");
+    }
+}
+
+void LeoWinHttpTransport::ReleaseActiveRequest(LPVOID hRequest, HttpCancelToken* token)
+{
+    // Once disarmed no abort can run, so a handle value WinHTTP hands out again is never closed twice
+    if (token) {
+        token->Disarm();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // If a cancel got here first the handle is already closed
+    if (m_hActiveRequest == hRequest) {
+        WinHttpCloseHandle(hRequest);
+        m_hActiveRequest = NULL;
+    }
+}
+
+std::string LeoWinHttpTransport::Failure(const char* what)
+{
+    char text[128];
+    snprintf(text, sizeof(text), "%s. Error: %lu", what, ::GetLastError());
+    return text;
+}
+
+void LeoWinHttpTransport::LogMessage(const char* message)
+{
+    LEO_INFO(Http, "LeoWinHttpTransport: %s", message);
+}
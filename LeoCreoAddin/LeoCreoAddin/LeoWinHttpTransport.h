@@ -0,0 +1,44 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include "LeoHttpTransport.h"
+
+// WinHTTP transport used by the add-in on Windows.
+// One session and connect handle are kept open, so WinHTTP reuses the keep-alive socket
+// across requests. Cancelling the request's token closes the request handle, which makes
+// the blocked WinHTTP call fail straight away.
+class LeoWinHttpTransport : public LeoHttpTransport {
+public:
+    LeoWinHttpTransport();
+    ~LeoWinHttpTransport();
+
+    void SetTarget(const std::string& host, int port) override;
+    void SetTimeout(int timeoutMs) override;
+    HttpTransportResult Execute(const HttpTransportRequest& request, HttpResponseSink& sink) override;
+    void Reset() override;
+    const char* Name() const override { return "winhttp"; }
+
+private:
+    LeoWinHttpTransport(const LeoWinHttpTransport&) = delete;
+    LeoWinHttpTransport& operator=(const LeoWinHttpTransport&) = delete;
+
+    LPVOID AcquireConnection();
+    void ResetLocked();
+    void SetActiveRequest(LPVOID hRequest);
+    void AbortActiveRequest(LPVOID hRequest);       // Runs on the cancelling thread
+    void ReleaseActiveRequest(LPVOID hRequest, HttpCancelToken* token);    // Closes the handle unless a cancel already did
+    static std::string Failure(const char* what);   // what plus the WinHTTP error code
+    void LogMessage(const char* message);
+
+    std::mutex m_mutex;
+    std::wstring m_host;
+    int m_port;
+    int m_timeoutMs;
+
+    // HINTERNET, kept as LPVOID so this header does not pull in winhttp.h, which clashes
+    // with the WinINet headers used elsewhere
+    LPVOID m_hSession;
+    LPVOID m_hConnect;
+    LPVOID m_hActiveRequest;
+};
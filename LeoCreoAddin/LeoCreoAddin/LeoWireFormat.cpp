@@ -0,0 +1,413 @@
+#include "stdafx.h"
+#include "LeoWireFormat.h"
+#include <cstring>
+
+// MsgPackWriter implementation
+
+void MsgPackWriter::Reserve(size_t bytes)
+{
+    m_buffer.reserve(bytes);
+}
+
+void MsgPackWriter::Clear()
+{
+    m_buffer.clear();
+}
+
+void MsgPackWriter::WriteBigEndian(uint64_t value, int byteCount)
+{
+    for (int i = byteCount - 1; i >= 0; --i) {
+        m_buffer.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+void MsgPackWriter::WriteMapHeader(uint32_t count)
+{
+    if (count < 16) {
+        m_buffer.push_back(static_cast<char>(0x80 | count));
+    } else if (count <= 0xFFFF) {
+        m_buffer.push_back(static_cast<char>(0xDE));
+        WriteBigEndian(count, 2);
+    } else {
+        m_buffer.push_back(static_cast<char>(0xDF));
+        WriteBigEndian(count, 4);
+    }
+}
+
+void MsgPackWriter::WriteArrayHeader(uint32_t count)
+{
+    if (count < 16) {
+        m_buffer.push_back(static_cast<char>(0x90 | count));
+    } else if (count <= 0xFFFF) {
+        m_buffer.push_back(static_cast<char>(0xDC));
+        WriteBigEndian(count, 2);
+    } else {
+        m_buffer.push_back(static_cast<char>(0xDD));
+        WriteBigEndian(count, 4);
+    }
+}
+
+void MsgPackWriter::WriteString(const char* str, size_t length)
+{
+    if (length < 32) {
+        m_buffer.push_back(static_cast<char>(0xA0 | length));
+    } else if (length <= 0xFF) {
+        m_buffer.push_back(static_cast<char>(0xD9));
+        WriteBigEndian(length, 1);
+    } else if (length <= 0xFFFF) {
+        m_buffer.push_back(static_cast<char>(0xDA));
+        WriteBigEndian(length, 2);
+    } else {
+        m_buffer.push_back(static_cast<char>(0xDB));
+        WriteBigEndian(length, 4);
+    }
+    m_buffer.append(str, length);
+}
+
+void MsgPackWriter::WriteString(const std::string& str)
+{
+    WriteString(str.data(), str.size());
+}
+
+void MsgPackWriter::WriteDouble(double value)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    m_buffer.push_back(static_cast<char>(0xCB));
+    WriteBigEndian(bits, 8);
+}
+
+void MsgPackWriter::WriteInt(int64_t value)
+{
+    if (value >= 0 && value < 128) {
+        m_buffer.push_back(static_cast<char>(value));
+    } else if (value < 0 && value >= -32) {
+        m_buffer.push_back(static_cast<char>(value));
+    } else {
+        m_buffer.push_back(static_cast<char>(0xD3));
+        WriteBigEndian(static_cast<uint64_t>(value), 8);
+    }
+}
+
+void MsgPackWriter::WriteBool(bool value)
+{
+    m_buffer.push_back(static_cast<char>(value ? 0xC3 : 0xC2));
+}
+
+void MsgPackWriter::WriteNil()
+{
+    m_buffer.push_back(static_cast<char>(0xC0));
+}
+
+// MsgPackReader implementation
+
+MsgPackReader::MsgPackReader(const char* data, size_t length)
+    : m_data(reinterpret_cast<const unsigned char*>(data))
+    , m_length(length)
+    , m_pos(0)
+{
+}
+
+bool MsgPackReader::ReadBigEndian(size_t offset, int byteCount, uint64_t& value) const
+{
+    if (offset + byteCount > m_length) {
+        return false;
+    }
+
+    value = 0;
+    for (int i = 0; i < byteCount; ++i) {
+        value = (value << 8) | m_data[offset + i];
+    }
+    return true;
+}
+
+MsgPackReader::ValueType MsgPackReader::PeekType() const
+{
+    if (AtEnd()) {
+        return ValueType::Invalid;
+    }
+
+    unsigned char tag = m_data[m_pos];
+    if (tag <= 0x7F || tag >= 0xE0) return ValueType::Int;
+    if ((tag & 0xF0) == 0x80) return ValueType::Map;
+    if ((tag & 0xF0) == 0x90) return ValueType::Array;
+    if ((tag & 0xE0) == 0xA0) return ValueType::String;
+
+    switch (tag) {
+        case 0xC0: return ValueType::Nil;
+        case 0xC2:
+        case 0xC3: return ValueType::Bool;
+        case 0xC4:
+        case 0xC5:
+        case 0xC6: return ValueType::Binary;
+        case 0xCA:
+        case 0xCB: return ValueType::Double;
+        case 0xCC: case 0xCD: case 0xCE: case 0xCF:
+        case 0xD0: case 0xD1: case 0xD2: case 0xD3: return ValueType::Int;
+        case 0xD9:
+        case 0xDA:
+        case 0xDB: return ValueType::String;
+        case 0xDC:
+        case 0xDD: return ValueType::Array;
+        case 0xDE:
+        case 0xDF: return ValueType::Map;
+        default: return ValueType::Invalid;
+    }
+}
+
+bool MsgPackReader::ReadMapHeader(uint32_t& count)
+{
+    if (AtEnd()) return false;
+
+    unsigned char tag = m_data[m_pos];
+    uint64_t value = 0;
+    if ((tag & 0xF0) == 0x80) {
+        count = tag & 0x0F;
+        m_pos += 1;
+        return true;
+    }
+    if (tag == 0xDE && ReadBigEndian(m_pos + 1, 2, value)) {
+        count = static_cast<uint32_t>(value);
+        m_pos += 3;
+        return true;
+    }
+    if (tag == 0xDF && ReadBigEndian(m_pos + 1, 4, value)) {
+        count = static_cast<uint32_t>(value);
+        m_pos += 5;
+        return true;
+    }
+    return false;
+}
+
+bool MsgPackReader::ReadArrayHeader(uint32_t& count)
+{
+    if (AtEnd()) return false;
+
+    unsigned char tag = m_data[m_pos];
+    uint64_t value = 0;
+    if ((tag & 0xF0) == 0x90) {
+        count = tag & 0x0F;
+        m_pos += 1;
+        return true;
+    }
+    if (tag == 0xDC && ReadBigEndian(m_pos + 1, 2, value)) {
+        count = static_cast<uint32_t>(value);
+        m_pos += 3;
+        return true;
+    }
+    if (tag == 0xDD && ReadBigEndian(m_pos + 1, 4, value)) {
+        count = static_cast<uint32_t>(value);
+        m_pos += 5;
+        return true;
+    }
+    return false;
+}
+
+bool MsgPackReader::ReadString(const char*& str, uint32_t& length)
+{
+    if (AtEnd()) return false;
+
+    unsigned char tag = m_data[m_pos];
+    size_t headerSize = 0;
+    uint64_t value = 0;
+
+    if ((tag & 0xE0) == 0xA0) {
+        value = tag & 0x1F;
+        headerSize = 1;
+    } else if (tag == 0xD9 && ReadBigEndian(m_pos + 1, 1, value)) {
+        headerSize = 2;
+    } else if (tag == 0xDA && ReadBigEndian(m_pos + 1, 2, value)) {
+        headerSize = 3;
+    } else if (tag == 0xDB && ReadBigEndian(m_pos + 1, 4, value)) {
+        headerSize = 5;
+    } else {
+        return false;
+    }
+
+    if (m_pos + headerSize + value > m_length) {
+        return false;
+    }
+
+    str = reinterpret_cast<const char*>(m_data + m_pos + headerSize);
+    length = static_cast<uint32_t>(value);
+    m_pos += headerSize + static_cast<size_t>(value);
+    return true;
+}
+
+bool MsgPackReader::ReadString(std::string& str)
+{
+    const char* data = nullptr;
+    uint32_t length = 0;
+    if (!ReadString(data, length)) {
+        return false;
+    }
+    str.assign(data, length);
+    return true;
+}
+
+bool MsgPackReader::ReadDouble(double& value)
+{
+    if (AtEnd()) return false;
+
+    unsigned char tag = m_data[m_pos];
+    uint64_t bits = 0;
+
+    if (tag == 0xCB && ReadBigEndian(m_pos + 1, 8, bits)) {
+        memcpy(&value, &bits, sizeof(value));
+        m_pos += 9;
+        return true;
+    }
+    if (tag == 0xCA && ReadBigEndian(m_pos + 1, 4, bits)) {
+        uint32_t bits32 = static_cast<uint32_t>(bits);
+        float f = 0.0f;
+        memcpy(&f, &bits32, sizeof(f));
+        value = f;
+        m_pos += 5;
+        return true;
+    }
+
+    int64_t intValue = 0;
+    if (ReadInt(intValue)) {
+        value = static_cast<double>(intValue);
+        return true;
+    }
+    return false;
+}
+
+bool MsgPackReader::ReadInt(int64_t& value)
+{
+    if (AtEnd()) return false;
+
+    unsigned char tag = m_data[m_pos];
+    uint64_t raw = 0;
+
+    if (tag <= 0x7F) {
+        value = tag;
+        m_pos += 1;
+        return true;
+    }
+    if (tag >= 0xE0) {
+        value = static_cast<int8_t>(tag);
+        m_pos += 1;
+        return true;
+    }
+
+    int byteCount = 0;
+    bool isSigned = false;
+    switch (tag) {
+        case 0xCC: byteCount = 1; break;
+        case 0xCD: byteCount = 2; break;
+        case 0xCE: byteCount = 4; break;
+        case 0xCF: byteCount = 8; break;
+        case 0xD0: byteCount = 1; isSigned = true; break;
+        case 0xD1: byteCount = 2; isSigned = true; break;
+        case 0xD2: byteCount = 4; isSigned = true; break;
+        case 0xD3: byteCount = 8; isSigned = true; break;
+        default: return false;
+    }
+
+    if (!ReadBigEndian(m_pos + 1, byteCount, raw)) {
+        return false;
+    }
+
+    if (isSigned && byteCount < 8) {
+        // Sign-extend the narrower two's complement value
+        uint64_t signBit = 1ULL << (byteCount * 8 - 1);
+        value = static_cast<int64_t>((raw ^ signBit) - signBit);
+    } else {
+        value = static_cast<int64_t>(raw);
+    }
+    m_pos += 1 + byteCount;
+    return true;
+}
+
+bool MsgPackReader::ReadBool(bool& value)
+{
+    if (AtEnd()) return false;
+
+    unsigned char tag = m_data[m_pos];
+    if (tag != 0xC2 && tag != 0xC3) {
+        return false;
+    }
+    value = (tag == 0xC3);
+    m_pos += 1;
+    return true;
+}
+
+bool MsgPackReader::ReadNil()
+{
+    if (AtEnd() || m_data[m_pos] != 0xC0) {
+        return false;
+    }
+    m_pos += 1;
+    return true;
+}
+
+bool MsgPackReader::Skip()
+{
+    // Iterative: nesting only adds to the count of values still to skip, so hostile input
+    // (thousands of nested array headers) cannot exhaust the stack
+    size_t start = m_pos;
+    uint64_t pending = 1;
+
+    while (pending > 0) {
+        // Every value takes at least one byte; more pending values than bytes left is truncated input
+        if (pending > m_length - m_pos) {
+            m_pos = start;
+            return false;
+        }
+        --pending;
+
+        uint32_t count = 0;
+        const char* str = nullptr;
+        uint32_t length = 0;
+        double d = 0.0;
+        int64_t i = 0;
+        bool b = false;
+        uint64_t value = 0;
+        bool ok = false;
+
+        switch (PeekType()) {
+            case ValueType::Nil:
+                ok = ReadNil();
+                break;
+            case ValueType::Bool:
+                ok = ReadBool(b);
+                break;
+            case ValueType::Int:
+                ok = ReadInt(i);
+                break;
+            case ValueType::Double:
+                ok = ReadDouble(d);
+                break;
+            case ValueType::String:
+                ok = ReadString(str, length);
+                break;
+            case ValueType::Binary: {
+                unsigned char tag = m_data[m_pos];
+                int byteCount = (tag == 0xC4) ? 1 : (tag == 0xC5) ? 2 : 4;
+                ok = ReadBigEndian(m_pos + 1, byteCount, value) && m_pos + 1 + byteCount + value <= m_length;
+                if (ok) {
+                    m_pos += 1 + byteCount + static_cast<size_t>(value);
+                }
+                break;
+            }
+            case ValueType::Array:
+                ok = ReadArrayHeader(count);
+                pending += count;
+                break;
+            case ValueType::Map:
+                ok = ReadMapHeader(count);
+                pending += 2 * static_cast<uint64_t>(count);
+                break;
+            default:
+                break;
+        }
+
+        if (!ok) {
+            m_pos = start;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Payload encodings understood on the add-in <-> Leo link.
+// JSON is the default; MessagePack is negotiated through the Content-Type header.
+enum class WireFormat {
+    Json,
+    MessagePack
+};
+
+// Minimal MessagePack encoder.
+// Doubles are always written as float64 and strings are length-prefixed UTF-8,
+// so no number formatting or escaping happens on the hot path.
+class MsgPackWriter {
+public:
+    MsgPackWriter() = default;
+
+    void Reserve(size_t bytes);
+    void Clear();
+
+    void WriteMapHeader(uint32_t count);
+    void WriteArrayHeader(uint32_t count);
+    void WriteString(const char* str, size_t length);
+    void WriteString(const std::string& str);
+    void WriteDouble(double value);
+    void WriteInt(int64_t value);
+    void WriteBool(bool value);
+    void WriteNil();
+
+    const std::string& Buffer() const { return m_buffer; }
+    std::string& Buffer() { return m_buffer; }
+
+private:
+    void WriteBigEndian(uint64_t value, int byteCount);
+
+    std::string m_buffer;
+};
+
+// Minimal MessagePack decoder working in place on a byte buffer.
+// Every Read* method returns false and leaves the cursor untouched on a type mismatch or truncated input.
+class MsgPackReader {
+public:
+    enum class ValueType {
+        Nil,
+        Bool,
+        Int,
+        Double,
+        String,
+        Binary,
+        Array,
+        Map,
+        Invalid
+    };
+
+    MsgPackReader(const char* data, size_t length);
+
+    ValueType PeekType() const;
+    bool AtEnd() const { return m_pos >= m_length; }
+    size_t Position() const { return m_pos; }
+
+    bool ReadMapHeader(uint32_t& count);
+    bool ReadArrayHeader(uint32_t& count);
+    bool ReadString(const char*& str, uint32_t& length);
+    bool ReadString(std::string& str);
+    bool ReadDouble(double& value);     // Accepts float32, float64 and integers
+    bool ReadInt(int64_t& value);
+    bool ReadBool(bool& value);
+    bool ReadNil();
+
+    // Skip one complete value including nested arrays and maps, to any depth without recursion
+    bool Skip();
+
+private:
+    bool ReadBigEndian(size_t offset, int byteCount, uint64_t& value) const;
+
+    const unsigned char* m_data;
+    size_t m_length;
+    size_t m_pos;
+};
@@ -0,0 +1,150 @@
+#include "stdafx.h"
+#include "LeoWorkerPool.h"
+#include "LogFileWriter.h"
+#include "LeoTrace.h"
+#include <algorithm>
+#include <exception>
+
+struct LeoWorkerPool::Batch {
+    const std::function<void(size_t)>* Work;
+    size_t Count;
+    std::atomic<size_t> Next;                   // Next index to hand out
+    int Active;                                 // Workers inside the batch; guarded by m_mutex
+    std::mutex ErrorMutex;
+    std::exception_ptr Error;                   // First exception thrown by Work
+
+    Batch(const std::function<void(size_t)>& work, size_t count)
+        : Work(&work), Count(count), Next(0), Active(0)
+    {
+    }
+};
+
+LeoWorkerPool::LeoWorkerPool(int maxThreads)
+    : m_shouldStop(false)
+    , m_maxThreads(maxThreads)
+    , m_batch(nullptr)
+    , m_generation(0)
+    , m_busy(false)
+{
+}
+
+LeoWorkerPool::~LeoWorkerPool()
+{
+    Stop();
+}
+
+void LeoWorkerPool::Start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_threads.empty()) {
+        return;
+    }
+
+    // The caller of ParallelFor works on the batch too, so one core is left for it
+    int cores = static_cast<int>(std::thread::hardware_concurrency());
+    int threads = (std::min)(m_maxThreads, cores - 1);
+
+    m_shouldStop = false;
+    for (int i = 0; i < threads; i++) {
+        m_threads.push_back(std::thread(&LeoWorkerPool::WorkerThread, this));
+    }
+    LEO_INFO(General, "Worker pool started with %d thread(s)", static_cast<int>(m_threads.size()));
+}
+
+void LeoWorkerPool::Stop()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shouldStop = true;
+        threads.swap(m_threads);
+    }
+    m_wakeUp.notify_all();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (!threads.empty()) {
+        LEO_INFO(General, "Worker pool stopped");
+    }
+}
+
+int LeoWorkerPool::GetThreadCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_threads.size());
+}
+
+void LeoWorkerPool::ParallelFor(size_t count, const std::function<void(size_t)>& work)
+{
+    bool pooled = count >= LEO_WORKER_MIN_ITEMS && GetThreadCount() > 0 && !m_busy.exchange(true);
+    if (!pooled) {
+        for (size_t i = 0; i < count; i++) {
+            work(i);
+        }
+        return;
+    }
+
+    LEO_SPAN(General, "LeoWorkerPool::ParallelFor");
+    Batch batch(work, count);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_batch = &batch;
+        m_generation++;
+    }
+    m_wakeUp.notify_all();
+
+    RunItems(batch);
+
+    // Every index is handed out; close the batch and wait for workers still on their last one
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_batch = nullptr;
+        m_batchDone.wait(lock, [&batch] { return batch.Active == 0; });
+    }
+    m_busy = false;
+
+    if (batch.Error) {
+        std::rethrow_exception(batch.Error);
+    }
+}
+
+void LeoWorkerPool::RunItems(Batch& batch)
+{
+    for (size_t i = batch.Next++; i < batch.Count; i = batch.Next++) {
+        try {
+            (*batch.Work)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(batch.ErrorMutex);
+            if (!batch.Error) {
+                batch.Error = std::current_exception();
+            }
+        }
+    }
+}
+
+void LeoWorkerPool::WorkerThread()
+{
+    LeoTrace::NameThread("Leo worker");
+
+    unsigned long long joined = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wakeUp.wait(lock, [this, joined] { return m_shouldStop || (m_batch != nullptr && m_generation != joined); });
+        if (m_shouldStop) {
+            break;
+        }
+
+        Batch* batch = m_batch;
+        joined = m_generation;
+        batch->Active++;
+        lock.unlock();
+
+        RunItems(*batch);
+
+        lock.lock();
+        if (--batch->Active == 0) {
+            m_batchDone.notify_all();
+        }
+    }
+}
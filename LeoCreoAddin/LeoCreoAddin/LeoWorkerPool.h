@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "LeoConfig.h"
+
+// Small fixed pool of threads for CPU-only work on batches, such as filling in a batch of face
+// measurements or encoding them for Leo.
+// ParallelFor hands out the indexes of one batch one at a time; the calling thread takes
+// indexes too and returns once every call has finished. The pool runs one batch at a time: a
+// second caller that arrives meanwhile, a batch below LEO_WORKER_MIN_ITEMS or a stopped pool
+// runs the whole batch on the calling thread instead.
+// Pro/TOOLKIT may only be called on Creo's UI thread, so the work must never call into Creo.
+class LeoWorkerPool {
+public:
+    explicit LeoWorkerPool(int maxThreads = LEO_WORKER_THREADS);
+    ~LeoWorkerPool();
+
+    void Start();           // At most maxThreads workers, and one less than the cores
+    void Stop();            // Joins the workers
+
+    // Calls work(i) for every i in [0, count). An exception thrown by work is rethrown here
+    // once the rest of the batch has finished.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& work);
+
+    int GetThreadCount() const;
+
+private:
+    LeoWorkerPool(const LeoWorkerPool&) = delete;
+    LeoWorkerPool& operator=(const LeoWorkerPool&) = delete;
+
+    struct Batch;
+
+    void WorkerThread();
+    static void RunItems(Batch& batch);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeUp;           // Workers: a new batch, or stop
+    std::condition_variable m_batchDone;        // ParallelFor: the last worker left the batch
+    std::vector<std::thread> m_threads;
+    bool m_shouldStop;
+    int m_maxThreads;
+    Batch* m_batch;                             // Open for workers to join; null between batches
+    unsigned long long m_generation;            // Counts batches, so a worker joins each one once
+    std::atomic<bool> m_busy;                   // A batch is running
+};
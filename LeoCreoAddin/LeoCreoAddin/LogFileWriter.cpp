@@ -1,10 +1,1241 @@
 #include "stdafx.h"
 #include "LogFileWriter.h"
+#include "LeoConfig.h"
+#include "LeoBinaryLog.h"
+#include "LeoFlightRecorder.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <cwchar>
+#include <cwctype>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <winioctl.h>
 
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+static_assert(LOG_MAX_RECORD_SLOTS < LOG_RING_SLOTS, "A line must fit in the ring");
+static_assert(static_cast<int>(LogCategory::Count) == LeoBinaryLog::CATEGORY_COUNT, "Update s_levels and LeoBinaryLog::CATEGORY_NAMES");
+static_assert(LOG_SLOT_BYTES <= 0xFFFF, "LogSlot::Length is 16 bits");
 
-LogFileWriter::LogFileWriter(const char* path= "D:\\LeoCreoAddin.log")
+// Production default: INFO and above for every category
+std::atomic<int> LogFileWriter::s_levels[static_cast<int>(LogCategory::Count)] = {
+	{ LEO_LOG_LEVEL_INFO }, { LEO_LOG_LEVEL_INFO }, { LEO_LOG_LEVEL_INFO }, { LEO_LOG_LEVEL_INFO }, { LEO_LOG_LEVEL_INFO }
+};
+
+std::atomic<bool> LogFileWriter::s_binary(false);
+std::atomic<long long> LogFileWriter::s_siteInterval(0);
+std::atomic<long long> LogFileWriter::s_siteTolerance(0);
+std::atomic<unsigned> LogFileWriter::s_traceSample(LOG_TRACE_SAMPLE_PERCENT);
+
+LogFileOptions::LogFileOptions()
+	: FileName(LOG_FILE_NAME)
+	, RotateBytes(LOG_ROTATE_MB * 1024ULL * 1024ULL)
+	, RotateHours(LOG_ROTATE_HOURS)
+	, KeepFiles(LOG_KEEP_FILES)
+	, KeepDays(LOG_KEEP_DAYS)
+	, Compress(LOG_COMPRESS_ROTATED)
+{
+}
+
+namespace {
+
+using namespace LeoBinaryLog;
+
+// What a queued record is and which file it goes to
+enum SlotKind : uint16_t {
+	SLOT_TEXT = 0,				// WriteLog line for the text log
+	SLOT_BINARY_TEXT = 1,		// WriteLog line in binary mode
+	SLOT_BINARY_EVENT = 2		// LogArgs of a LEO_* statement
+};
+
+// One ring slot. A record longer than LOG_SLOT_BYTES continues in the slots after its first.
+struct LogSlot {
+	int64_t Ticks;			// QueryPerformanceCounter when the record was logged
+	uint32_t Thread;		// Id of the thread that logged it
+	uint16_t Length;		// Bytes of Text in use
+	uint16_t Kind;			// SlotKind, set on the first slot of a record
+	uint32_t Continues;		// First slot of a record: how many slots after it belong to the same record
+	uint32_t Unused;
+	char Text[LOG_SLOT_BYTES];
+};
+
+// A record as the writer took it out of a ring; the bytes are in LogState::Records
+struct QueuedRecord {
+	int64_t Ticks;
+	uint32_t Thread;
+	SlotKind Kind;
+	size_t Offset;
+	size_t Length;
+};
+
+// Bounded single-producer, single-consumer ring. Each logging thread has its own, so the only
+// shared state a call touches is its own ring's head and the writer's tail.
+class LogRing {
+public:
+	LogRing()
+		: m_slots(new LogSlot[LOG_RING_SLOTS])
+		, m_head(0)
+		, m_tail(0)
+		, m_written(0)
+	{
+	}
+
+	// Producer only. False when the ring has no room for the whole record
+	bool TryPush(const char* text, size_t length, int64_t ticks, uint32_t thread, SlotKind kind)
+	{
+		const size_t maxLength = static_cast<size_t>(LOG_SLOT_BYTES) * LOG_MAX_RECORD_SLOTS;
+		if (length > maxLength) {
+			length = maxLength;
+		}
+		uint64_t count = length == 0 ? 1 : (length + LOG_SLOT_BYTES - 1) / LOG_SLOT_BYTES;
+
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		if (head + count - m_tail.load(std::memory_order_acquire) > LOG_RING_SLOTS) {
+			return false;
+		}
+		for (uint64_t i = 0; i < count; ++i) {
+			LogSlot& slot = m_slots[(head + i) & MASK];
+			size_t chunk = length < LOG_SLOT_BYTES ? length : LOG_SLOT_BYTES;
+			memcpy(slot.Text, text, chunk);
+			slot.Length = static_cast<uint16_t>(chunk);
+			slot.Kind = kind;
+			slot.Continues = static_cast<uint32_t>(i == 0 ? count - 1 : 0);
+			slot.Ticks = ticks;
+			slot.Thread = thread;
+			text += chunk;
+			length -= chunk;
+		}
+		m_head.store(head + count, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Appends the record's bytes to records; false when the ring is empty
+	bool Pop(std::string& records, QueuedRecord& record)
+	{
+		uint64_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		const LogSlot& first = m_slots[tail & MASK];
+		uint64_t count = 1 + first.Continues;
+		record.Ticks = first.Ticks;
+		record.Thread = first.Thread;
+		record.Kind = static_cast<SlotKind>(first.Kind);
+		record.Offset = records.size();
+		for (uint64_t i = 0; i < count; ++i) {
+			const LogSlot& slot = m_slots[(tail + i) & MASK];
+			records.append(slot.Text, slot.Length);
+		}
+		record.Length = records.size() - record.Offset;
+		m_tail.store(tail + count, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only, once the popped records are on disk
+	void MarkWritten() { m_written.store(m_tail.load(std::memory_order_relaxed), std::memory_order_release); }
+
+	uint64_t PushedPosition() const { return m_head.load(std::memory_order_acquire); }
+	uint64_t WrittenPosition() const { return m_written.load(std::memory_order_acquire); }
+	bool IsDrained() const { return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_relaxed); }
+	uint64_t Backlog() const
+	{
+		return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed);
+	}
+
+private:
+	static const uint64_t MASK = LOG_RING_SLOTS - 1;
+
+	// Padding keeps the producer's and the writer's counters on separate cache lines
+	std::unique_ptr<LogSlot[]> m_slots;
+	char m_padBefore[64];
+	std::atomic<uint64_t> m_head;			// Producer
+	char m_padBetween[64];
+	std::atomic<uint64_t> m_tail;			// Writer thread
+	std::atomic<uint64_t> m_written;		// Writer thread; what Flush waits for
+};
+
+// A logging thread's ring. Rings are never freed: once a thread ends and the writer has
+// drained its ring, the next new thread takes it over.
+struct ThreadLog {
+	LogRing Ring;
+	std::atomic<bool> InUse;
+
+	ThreadLog() : InUse(true) {}
+};
+
+// Hands the thread's ring back when the thread ends
+struct ThreadLogOwner {
+	ThreadLog* Log;
+	uint32_t Thread;
+
+	ThreadLogOwner() : Log(NULL), Thread(0) {}
+	~ThreadLogOwner()
+	{
+		if (Log) {
+			Log->InUse.store(false, std::memory_order_release);
+		}
+	}
+};
+
+thread_local ThreadLogOwner t_threadLog;
+
+// Pairs a performance-counter reading with the wall clock, taken once per batch; call sites only
+// read the counter
+struct LogClock {
+	int64_t Ticks;
+	int64_t WallMicros;			// Microseconds since 1970 at Ticks
+	int64_t Frequency;
+};
+
+int64_t LogTicks()
+{
+	LARGE_INTEGER ticks;
+	QueryPerformanceCounter(&ticks);
+	return ticks.QuadPart;
+}
+
+int64_t LogFrequency()
+{
+	static const int64_t frequency = []() {
+		LARGE_INTEGER value;
+		QueryPerformanceFrequency(&value);
+		return static_cast<int64_t>(value.QuadPart);
+	}();
+	return frequency;
+}
+
+LogClock ReadClock()
+{
+	LogClock clock;
+	clock.Frequency = LogFrequency();
+	clock.Ticks = LogTicks();
+	FILETIME now;
+	GetSystemTimePreciseAsFileTime(&now);
+	unsigned long long hundreds = (static_cast<unsigned long long>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+	clock.WallMicros = static_cast<int64_t>(hundreds / 10) - 11644473600000000LL;
+	return clock;
+}
+
+int64_t WallMicros(const LogClock& clock, int64_t ticks)
+{
+	int64_t delta = clock.Ticks - ticks;
+	return clock.WallMicros - (delta / clock.Frequency) * 1000000 - (delta % clock.Frequency) * 1000000 / clock.Frequency;
+}
+
+// One of the two log files (text and binary); writer thread only
+struct LogFile {
+	FILE* Handle;
+	std::wstring Path;
+	unsigned long long Size;
+	int64_t CreatedAt;						// For rotation by age
+	int64_t RetryRotationAt;				// After a failed rename (file locked by a viewer)
+
+	LogFile() : Handle(NULL), Size(0), CreatedAt(0), RetryRotationAt(0) {}
+};
+
+// Compresses and deletes rotated files off the writer thread. A request covers the whole folder,
+// so files left over from a session that ended mid-way are picked up by the next one.
+struct Housekeeping {
+	std::mutex Mutex;						// Everything below
+	std::condition_variable Wake;
+	std::thread Thread;
+	bool Started;
+	bool Stopping;
+	bool Requested;
+	std::wstring Directory;
+	std::wstring Paths[2];					// Active text and binary log; their rotated files are tidied
+	LogFileOptions Options;
+
+	Housekeeping() : Started(false), Stopping(false), Requested(false) {}
+};
+
+struct LogState {
+	std::atomic<bool> Running;				// Writer thread owns the file; WriteLog only queues
+	std::atomic<long long> Dropped;
+	std::atomic<bool> WakeRequested;		// Set by whoever wants a batch before the timer fires
+
+	std::mutex ThreadLogsMutex;				// Guards ThreadLogs; taken once per thread and per batch
+	std::vector<ThreadLog*> ThreadLogs;
+
+	std::mutex Mutex;						// Everything below
+	std::condition_variable WakeWriter;
+	std::condition_variable BatchWritten;
+	std::thread Writer;
+	bool Started;
+	bool Stopping;
+	bool Stopped;
+	long long ReportedDropped;
+	int64_t SessionStart;					// Microseconds; times in the binary file are relative to this
+	size_t DefinedFormats;					// Format records already in the binary file
+
+	std::mutex FormatsMutex;				// Guards Formats
+	std::vector<std::string> Formats;		// Complete format records; id n is Formats[n - 1]
+
+	std::mutex SitesMutex;					// Guards LimitedSites and their Format, Level and Category
+	std::vector<LogSite*> LimitedSites;		// Statements that have gone over their rate limit
+	int64_t LastSuppressedReport;			// Writer side, microseconds
+
+	std::mutex OptionsMutex;				// Guards PendingOptions and ResolvedDirectory
+	LogFileOptions PendingOptions;
+	std::wstring ResolvedDirectory;			// Copy of Directory for GetDirectory()
+	std::atomic<bool> OptionsChanged;		// Configure() was called since the last batch
+
+	// Writer-side files; Directory is empty until the paths are resolved
+	LogFileOptions Options;
+	std::wstring Directory;
+	LogFile Text;
+	LogFile Binary;
+	std::string Notice;						// Reported with the next batch, like dropped lines
+	Housekeeping Tidy;
+
+	// Writer-side scratch, reused across batches
+	std::vector<ThreadLog*> Draining;
+	std::string Records;
+	std::vector<QueuedRecord> Queued;
+	std::string Batch;
+	std::string BinaryHead;					// Session and format records for this batch
+	std::string BinaryBatch;
+	int64_t LastTime;
+	char TimeText[26];
+
+	LogState()
+		: Running(false)
+		, Dropped(0)
+		, WakeRequested(false)
+		, Started(false)
+		, Stopping(false)
+		, Stopped(false)
+		, ReportedDropped(0)
+		, SessionStart(0)
+		, DefinedFormats(0)
+		, LastSuppressedReport(0)
+		, OptionsChanged(false)
+		, LastTime(-1)
+	{
+		TimeText[0] = '\0';
+	}
+};
+
+// Never destroyed: lines may still arrive from global destructors while the DLL unloads
+LogState& State()
+{
+	static LogState* state = new LogState();
+	return *state;
+}
+
+// "[Sun Oct 18 09:30:00.123456 2026] [5124] text" followed by a blank line: the stamp the log has
+// always had, to the microsecond, and the id of the thread that logged the line
+void AppendLine(LogState& state, int64_t micros, uint32_t thread, const char* text, size_t length)
+{
+	int64_t seconds = micros / 1000000;
+	if (seconds != state.LastTime) {
+		time_t now = static_cast<time_t>(seconds);
+		strncpy(state.TimeText, ctime(&now), 24);	// Copy only the first 24 characters (excluding the newline)
+		state.TimeText[24] = '\0';
+		state.LastTime = seconds;
+	}
+	// Formatted by hand: snprintf here cost more than the rest of the writer's work per line
+	char stamp[64];
+	char* out = stamp;
+	*out++ = '[';
+	memcpy(out, state.TimeText, 19);
+	out += 19;
+	*out++ = '.';
+	int fraction = static_cast<int>(micros % 1000000);
+	for (int i = 5; i >= 0; --i, fraction /= 10) {
+		out[i] = static_cast<char>('0' + fraction % 10);
+	}
+	out += 6;
+	memcpy(out, state.TimeText + 19, 5);
+	out += 5;
+	*out++ = ']';
+	*out++ = ' ';
+	*out++ = '[';
+	char digits[10];
+	int count = 0;
+	do {
+		digits[count++] = static_cast<char>('0' + thread % 10);
+		thread /= 10;
+	} while (thread != 0);
+	while (count > 0) {
+		*out++ = digits[--count];
+	}
+	*out++ = ']';
+	*out++ = ' ';
+	state.Batch.append(stamp, out - stamp);
+	state.Batch.append(text, length);
+	state.Batch += "\n\n";
+}
+
+size_t EncodeUtf8(const wchar_t* text, char* out, size_t capacity);
+
+int64_t UnixTime(const FILETIME& time)
+{
+	unsigned long long ticks = (static_cast<unsigned long long>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+	return static_cast<int64_t>(ticks / 10000000ULL) - 11644473600LL;
+}
+
+std::wstring TrimSeparators(std::wstring path)
+{
+	while (path.size() > 3 && (path.back() == L'\\' || path.back() == L'/')) {
+		path.pop_back();
+	}
+	return path;
+}
+
+// Creates path and any missing parents; true if it is a folder afterwards
+bool CreateDirectories(const std::wstring& path)
+{
+	for (size_t i = 1; i < path.size(); ++i) {
+		if ((path[i] == L'\\' || path[i] == L'/') && path[i - 1] != L':' && path[i - 1] != L'\\') {
+			CreateDirectoryW(path.substr(0, i).c_str(), NULL);
+		}
+	}
+	CreateDirectoryW(path.c_str(), NULL);
+	DWORD attributes = GetFileAttributesW(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
+// %LOCALAPPDATA%\Leo\Logs, next to the outbox journal
+std::wstring DefaultDirectory()
+{
+	wchar_t base[MAX_PATH] = { 0 };
+	DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", base, MAX_PATH);
+	if (length == 0 || length >= MAX_PATH) {
+		return std::wstring();
+	}
+	return TrimSeparators(base) + L"\\Leo\\" + LOG_DIRECTORY_NAME;
+}
+
+std::wstring TempDirectory()
+{
+	wchar_t base[MAX_PATH] = { 0 };
+	DWORD length = GetTempPathW(MAX_PATH, base);
+	if (length == 0 || length >= MAX_PATH) {
+		return std::wstring();
+	}
+	return TrimSeparators(base);
+}
+
+// Picks the folder the first time a file is needed: log.dir, else the default folder, else %TEMP%.
+// A missing drive or a folder without write access must not stop logging.
+void ResolvePaths(LogState& state)
+{
+	if (!state.Directory.empty()) {
+		return;
+	}
+
+	std::wstring configured;
+	if (!state.Options.Directory.empty()) {
+		wchar_t expanded[MAX_PATH] = { 0 };
+		DWORD length = ExpandEnvironmentStringsW(state.Options.Directory.c_str(), expanded, MAX_PATH);
+		configured = TrimSeparators(length > 0 && length <= MAX_PATH ? std::wstring(expanded) : state.Options.Directory);
+	}
+	const std::wstring candidates[] = { configured, DefaultDirectory(), TempDirectory() };
+	for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]) && state.Directory.empty(); ++i) {
+		if (!candidates[i].empty() && CreateDirectories(candidates[i])) {
+			state.Directory = candidates[i];
+		}
+	}
+	if (state.Directory.empty()) {
+		state.Directory = L".";
+	}
+	{
+		std::lock_guard<std::mutex> lock(state.OptionsMutex);
+		state.ResolvedDirectory = state.Directory;
+	}
+
+	if (!configured.empty() && state.Directory != configured) {
+		std::wstring notice = L"LogFileWriter: cannot use log.dir " + configured + L", logging to " + state.Directory;
+		std::vector<char> utf8(notice.size() * 4 + 1);
+		state.Notice.assign(utf8.data(), EncodeUtf8(notice.c_str(), utf8.data(), utf8.size()));
+	}
+
+	std::wstring name = state.Options.FileName.empty() ? std::wstring(LOG_FILE_NAME) : state.Options.FileName;
+	size_t dot = name.find_last_of(L'.');
+	state.Text.Path = state.Directory + L"\\" + name;
+	state.Binary.Path = state.Directory + L"\\" + name.substr(0, dot) + L".blog";
+}
+
+// Appends to path, remembering its size and age. A file created here gets a fresh creation time:
+// NTFS tunnelling would otherwise hand it that of the file just rotated away under the same name.
+bool OpenLogFile(LogFile& file, const wchar_t* mode, int64_t now)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (GetFileAttributesExW(file.Path.c_str(), GetFileExInfoStandard, &data)) {
+		file.Size = (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		file.CreatedAt = UnixTime(data.ftCreationTime);
+	} else {
+		file.Size = 0;
+	}
+
+	_wfopen_s(&file.Handle, file.Path.c_str(), mode);
+	if (!file.Handle) {
+		return false;
+	}
+	if (file.Size == 0) {
+		file.CreatedAt = now;
+		HANDLE handle = CreateFileW(file.Path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+									NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (handle != INVALID_HANDLE_VALUE) {
+			FILETIME created;
+			GetSystemTimeAsFileTime(&created);
+			SetFileTime(handle, &created, NULL, NULL);
+			CloseHandle(handle);
+		}
+	}
+	return true;
+}
+
+void CloseLogFile(LogFile& file)
+{
+	if (file.Handle) {
+		fclose(file.Handle);
+		file.Handle = NULL;
+	}
+}
+
+// "LeoCreoAddin.log" -> "LeoCreoAddin.20261018-093000.log"; a numbered suffix if that is taken
+std::wstring RotatedPath(const std::wstring& path, int64_t now)
+{
+	size_t dot = path.find_last_of(L'.');
+	size_t separator = path.find_last_of(L"\\/");
+	if (dot == std::wstring::npos || (separator != std::wstring::npos && dot < separator)) {
+		dot = path.size();
+	}
+
+	time_t value = static_cast<time_t>(now);
+	struct tm local;
+	wchar_t stamp[32] = { 0 };
+	if (localtime_s(&local, &value) == 0) {
+		wcsftime(stamp, sizeof(stamp) / sizeof(stamp[0]), L"%Y%m%d-%H%M%S", &local);
+	}
+
+	std::wstring rotated = path.substr(0, dot) + L"." + stamp + path.substr(dot);
+	for (int i = 2; GetFileAttributesW(rotated.c_str()) != INVALID_FILE_ATTRIBUTES && i < 100; ++i) {
+		rotated = path.substr(0, dot) + L"." + stamp + L"-" + std::to_wstring(i) + path.substr(dot);
+	}
+	return rotated;
+}
+
+// <stem>.<yyyyMMdd-HHmmss>[-n]<extension>, as written by RotatedPath
+bool IsRotatedName(const std::wstring& name, const std::wstring& stem, const std::wstring& extension)
+{
+	if (name.size() < stem.size() + 1 + 15 + extension.size() || name.compare(0, stem.size() + 1, stem + L".") != 0
+		|| name.compare(name.size() - extension.size(), extension.size(), extension) != 0) {
+		return false;
+	}
+	std::wstring middle = name.substr(stem.size() + 1, name.size() - stem.size() - 1 - extension.size());
+	for (size_t i = 0; i < middle.size(); ++i) {
+		bool dash = i == 8 || i == 15;
+		if (dash ? middle[i] != L'-' : !iswdigit(middle[i])) {
+			return false;
+		}
+	}
+	return middle.size() != 16;
+}
+
+// NTFS compression leaves the file readable by any editor; it quietly fails on FAT and some shares
+void CompressFile(const std::wstring& path)
+{
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	USHORT format = COMPRESSION_FORMAT_DEFAULT;
+	DWORD returned = 0;
+	DeviceIoControl(file, FSCTL_SET_COMPRESSION, &format, sizeof(format), NULL, 0, &returned, NULL);
+	CloseHandle(file);
+}
+
+// Keeps the newest KeepFiles rotated copies of one log that are younger than KeepDays and
+// compresses them if asked; returns how many files were deleted
+int TidyRotated(const std::wstring& directory, const std::wstring& path, const LogFileOptions& options)
+{
+	size_t separator = path.find_last_of(L"\\/");
+	std::wstring name = separator == std::wstring::npos ? path : path.substr(separator + 1);
+	size_t dot = name.find_last_of(L'.');
+	std::wstring stem = dot == std::wstring::npos ? name : name.substr(0, dot);
+	std::wstring extension = dot == std::wstring::npos ? std::wstring() : name.substr(dot);
+
+	struct Rotated {
+		std::wstring Name;
+		std::wstring Stamp;		// yyyyMMdd-HHmmss
+		long Sequence;			// 2, 3, ... for files rotated within the same second
+		int64_t WrittenAt;
+		bool Compressed;
+		bool operator<(const Rotated& other) const		// Newest first
+		{
+			return Stamp != other.Stamp ? Stamp > other.Stamp : Sequence > other.Sequence;
+		}
+	};
+	std::vector<Rotated> rotated;
+
+	WIN32_FIND_DATAW found;
+	HANDLE search = FindFirstFileW((directory + L"\\" + stem + L".*" + extension).c_str(), &found);
+	if (search == INVALID_HANDLE_VALUE) {
+		return 0;
+	}
+	do {
+		if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && IsRotatedName(found.cFileName, stem, extension)) {
+			std::wstring stamp = std::wstring(found.cFileName).substr(stem.size() + 1, 15);
+			const wchar_t* sequence = found.cFileName + stem.size() + 1 + 15;
+			Rotated file = { found.cFileName, stamp, *sequence == L'-' ? wcstol(sequence + 1, NULL, 10) : 1,
+							 UnixTime(found.ftLastWriteTime), (found.dwFileAttributes & FILE_ATTRIBUTE_COMPRESSED) != 0 };
+			rotated.push_back(file);
+		}
+	} while (FindNextFileW(search, &found));
+	FindClose(search);
+
+	std::sort(rotated.begin(), rotated.end());
+	int64_t oldest = static_cast<int64_t>(time(NULL)) - options.KeepDays * 86400LL;
+	int deleted = 0;
+	for (size_t i = 0; i < rotated.size(); ++i) {
+		std::wstring full = directory + L"\\" + rotated[i].Name;
+		if (static_cast<int>(i) >= options.KeepFiles || (options.KeepDays > 0 && rotated[i].WrittenAt < oldest)) {
+			if (DeleteFileW(full.c_str())) {
+				++deleted;
+			}
+		} else if (options.Compress && !rotated[i].Compressed) {
+			CompressFile(full);
+		}
+	}
+	return deleted;
+}
+
+void HousekeepingThread(Housekeeping& work)
+{
+	std::unique_lock<std::mutex> lock(work.Mutex);
+	for (;;) {
+		work.Wake.wait(lock, [&work]() { return work.Stopping || work.Requested; });
+		if (work.Stopping) {
+			break;
+		}
+		work.Requested = false;
+		std::wstring directory = work.Directory;
+		std::wstring paths[2] = { work.Paths[0], work.Paths[1] };
+		LogFileOptions options = work.Options;
+		lock.unlock();
+
+		int deleted = TidyRotated(directory, paths[0], options) + TidyRotated(directory, paths[1], options);
+		if (deleted > 0) {
+			char text[96];
+			snprintf(text, sizeof(text), "LogFileWriter: deleted %d old log file(s)", deleted);
+			LogFileWriter::WriteLog(text);
+		}
+		lock.lock();
+	}
+}
+
+// Asks the housekeeping thread to tidy the log folder; starts it the first time
+void RequestHousekeeping(LogState& state)
+{
+	Housekeeping& work = state.Tidy;
+	std::lock_guard<std::mutex> lock(work.Mutex);
+	if (work.Stopping) {
+		return;
+	}
+	work.Directory = state.Directory;
+	work.Paths[0] = state.Text.Path;
+	work.Paths[1] = state.Binary.Path;
+	work.Options = state.Options;
+	work.Requested = true;
+	if (!work.Started) {
+		work.Started = true;
+		try {
+			work.Thread = std::thread(HousekeepingThread, std::ref(work));
+		} catch (const std::exception&) {
+			work.Stopping = true;
+			return;
+		}
+	}
+	work.Wake.notify_one();
+}
+
+void StopHousekeeping(LogState& state)
+{
+	std::thread thread;
+	{
+		std::lock_guard<std::mutex> lock(state.Tidy.Mutex);
+		state.Tidy.Stopping = true;
+		thread.swap(state.Tidy.Thread);
+	}
+	state.Tidy.Wake.notify_one();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+// Picks up Configure(). A new folder or name closes both files; the next write opens the new ones.
+void ApplyOptions(LogState& state)
+{
+	if (!state.OptionsChanged.exchange(false, std::memory_order_acquire)) {
+		return;
+	}
+	LogFileOptions options;
+	{
+		std::lock_guard<std::mutex> lock(state.OptionsMutex);
+		options = state.PendingOptions;
+	}
+	bool moved = options.Directory != state.Options.Directory || options.FileName != state.Options.FileName;
+	state.Options = options;
+	if (moved) {
+		CloseLogFile(state.Text);
+		CloseLogFile(state.Binary);
+		state.Directory.clear();
+	}
+	if (!state.Directory.empty()) {
+		RequestHousekeeping(state);		// Retention may have changed
+	}
+}
+
+// Once the paths are known; also tidies the folder the first time
+void PreparePaths(LogState& state)
+{
+	ApplyOptions(state);
+	if (state.Directory.empty()) {
+		ResolvePaths(state);
+		RequestHousekeeping(state);
+	}
+}
+
+// Renames a file that grew past RotateBytes or is older than RotateHours. The writer opens a
+// new file on its next write; a file it cannot rename (open in a viewer) is retried a minute later.
+void RotateIfDue(LogState& state, LogFile& file, int64_t now)
+{
+	if (!file.Handle || file.Size == 0 || now < file.RetryRotationAt) {
+		return;
+	}
+	bool full = state.Options.RotateBytes > 0 && file.Size >= state.Options.RotateBytes;
+	bool old = state.Options.RotateHours > 0 && now - file.CreatedAt >= state.Options.RotateHours * 3600LL;
+	if (!full && !old) {
+		return;
+	}
+
+	CloseLogFile(file);
+	if (MoveFileExW(file.Path.c_str(), RotatedPath(file.Path, now).c_str(), 0)) {
+		file.RetryRotationAt = 0;
+		RequestHousekeeping(state);
+	} else {
+		file.RetryRotationAt = now + 60;
+	}
+}
+
+size_t VarintLength(uint64_t value)
+{
+	size_t length = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		++length;
+	}
+	return length;
+}
+
+// Opens the binary log if needed. Every open starts a session with its own format dictionary,
+// so a file never depends on records written before it was opened.
+bool OpenBinaryFile(LogState& state, int64_t micros)
+{
+	if (state.Binary.Handle) {
+		return true;
+	}
+	PreparePaths(state);
+	if (!OpenLogFile(state.Binary, L"ab", micros / 1000000)) {
+		return false;
+	}
+	if (state.Binary.Size == 0) {
+		state.BinaryHead.append(MAGIC, MAGIC_LENGTH);
+	}
+
+	char body[8 + 10];
+	for (int i = 0; i < 8; ++i) {
+		body[i] = static_cast<char>((static_cast<uint64_t>(micros) >> (8 * i)) & 0xFF);
+	}
+	size_t length = 8 + PutVarint(static_cast<uint64_t>(GetCurrentProcessId()), body + 8);
+	state.BinaryHead += static_cast<char>(RECORD_SESSION);
+	AppendVarint(state.BinaryHead, length);
+	state.BinaryHead.append(body, length);
+
+	state.SessionStart = micros;
+	state.DefinedFormats = 0;
+	return true;
+}
+
+// Frames one queued binary record; its time is stored as an offset from the session start
+void AppendBinary(LogState& state, int64_t micros, uint32_t thread, SlotKind kind, const char* data, size_t length)
+{
+	uint64_t offset = ZigZag(micros - state.SessionStart);
+	state.BinaryBatch += static_cast<char>(kind == SLOT_BINARY_EVENT ? RECORD_EVENT : RECORD_TEXT);
+	AppendVarint(state.BinaryBatch, VarintLength(offset) + VarintLength(thread) + length);
+	AppendVarint(state.BinaryBatch, offset);
+	AppendVarint(state.BinaryBatch, thread);
+	state.BinaryBatch.append(data, length);
+}
+
+// Format records the file has not seen yet go first: every event in the batch was queued
+// after its format was registered
+void WriteBinaryBatch(LogState& state)
+{
+	if (state.BinaryBatch.empty() || !state.Binary.Handle) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(state.FormatsMutex);
+		for (; state.DefinedFormats < state.Formats.size(); ++state.DefinedFormats) {
+			state.BinaryHead += state.Formats[state.DefinedFormats];
+		}
+	}
+	fwrite(state.BinaryHead.data(), 1, state.BinaryHead.size(), state.Binary.Handle);
+	fwrite(state.BinaryBatch.data(), 1, state.BinaryBatch.size(), state.Binary.Handle);
+	fflush(state.Binary.Handle);
+	state.Binary.Size += state.BinaryHead.size() + state.BinaryBatch.size();
+}
+
+// Lines from the logger itself (dropped lines, a bad log.dir) go to the file in use
+void AppendNotice(LogState& state, const char* text, size_t length, int64_t micros)
+{
+	uint32_t thread = static_cast<uint32_t>(GetCurrentThreadId());
+	if (LogFileWriter::IsBinary() && OpenBinaryFile(state, micros)) {
+		AppendBinary(state, micros, thread, SLOT_BINARY_TEXT, text, length);
+	} else {
+		AppendLine(state, micros, thread, text, length);
+	}
+}
+
+// "INFO Geometry: 1234 more like "Element ID: %d" suppressed (rate limit)" for each statement
+// that went over its limit since the last report
+void ReportSuppressed(LogState& state, int64_t micros)
+{
+	std::lock_guard<std::mutex> lock(state.SitesMutex);
+	for (size_t i = 0; i < state.LimitedSites.size(); ++i) {
+		LogSite& site = *state.LimitedSites[i];
+		unsigned suppressed = site.Suppressed.exchange(0, std::memory_order_relaxed);
+		if (suppressed == 0) {
+			continue;
+		}
+		char format[81];
+		size_t length;
+		if (site.WideFormat) {
+			length = EncodeUtf8(static_cast<const wchar_t*>(site.Format), format, sizeof(format) - 1);
+		} else {
+			length = strnlen(static_cast<const char*>(site.Format), sizeof(format) - 1);
+			memcpy(format, site.Format, length);
+		}
+		format[length] = '\0';
+
+		char text[192];
+		int used = snprintf(text, sizeof(text), "%s %s: %u more like \"%s\" suppressed (rate limit)",
+			LEVEL_NAMES[site.Level], CATEGORY_NAMES[static_cast<int>(site.Category)], suppressed, format);
+		if (used > 0) {
+			AppendNotice(state, text, (std::min)(static_cast<size_t>(used), sizeof(text) - 1), micros);
+		}
+	}
+}
+
+// Writes whatever the ring holds in one go. Called by the writer thread, or under Mutex once it is gone.
+void WriteBatch(LogState& state)
+{
+	state.Batch.clear();
+	state.BinaryHead.clear();
+	state.BinaryBatch.clear();
+
+	state.Records.clear();
+	state.Queued.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(state.ThreadLogsMutex);
+		state.Draining = state.ThreadLogs;
+	}
+	QueuedRecord record;
+	for (size_t i = 0; i < state.Draining.size(); ++i) {
+		while (state.Draining[i]->Ring.Pop(state.Records, record)) {
+			state.Queued.push_back(record);
+		}
+	}
+	// Each ring is in order; merging them by counter puts the batch in the order lines were logged
+	std::stable_sort(state.Queued.begin(), state.Queued.end(), [](const QueuedRecord& a, const QueuedRecord& b) {
+		return a.Ticks < b.Ticks;
+	});
+
+	// Rotate before anything is queued for the binary file: a new file needs a new session
+	LogClock clock = ReadClock();
+	int64_t nowMicros = clock.WallMicros;
+	int64_t now = nowMicros / 1000000;
+	PreparePaths(state);
+	RotateIfDue(state, state.Text, now);
+	RotateIfDue(state, state.Binary, now);
+
+	for (size_t i = 0; i < state.Queued.size(); ++i) {
+		const QueuedRecord& queued = state.Queued[i];
+		const char* data = state.Records.data() + queued.Offset;
+		int64_t micros = WallMicros(clock, queued.Ticks);
+		if (queued.Kind == SLOT_TEXT) {
+			AppendLine(state, micros, queued.Thread, data, queued.Length);
+		} else if (OpenBinaryFile(state, nowMicros)) {
+			AppendBinary(state, micros, queued.Thread, queued.Kind, data, queued.Length);
+		}
+	}
+
+	long long dropped = state.Dropped.load(std::memory_order_relaxed);
+	if (dropped != state.ReportedDropped) {
+		char text[96];
+		snprintf(text, sizeof(text), "LogFileWriter: %lld line(s) dropped, log buffer full", dropped - state.ReportedDropped);
+		AppendNotice(state, text, strlen(text), nowMicros);
+		state.ReportedDropped = dropped;
+	}
+	if (!state.Notice.empty()) {
+		AppendNotice(state, state.Notice.data(), state.Notice.size(), nowMicros);
+		state.Notice.clear();
+	}
+	// Once a second, and for the last batch
+	if (nowMicros - state.LastSuppressedReport >= LOG_SUPPRESSED_REPORT_MS * 1000LL || !state.Running.load(std::memory_order_relaxed)) {
+		ReportSuppressed(state, nowMicros);
+		state.LastSuppressedReport = nowMicros;
+	}
+
+	if (!state.Batch.empty()) {
+		if (state.Text.Handle || OpenLogFile(state.Text, L"a", now)) {
+			fwrite(state.Batch.data(), 1, state.Batch.size(), state.Text.Handle);
+			fflush(state.Text.Handle);
+			state.Text.Size += state.Batch.size();
+		}
+	}
+	WriteBinaryBatch(state);
+	for (size_t i = 0; i < state.Draining.size(); ++i) {
+		state.Draining[i]->Ring.MarkWritten();
+	}
+}
+
+void WriterThread(LogState& state)
+{
+	std::unique_lock<std::mutex> lock(state.Mutex);
+	for (;;) {
+		state.WakeWriter.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS), [&state]() {
+			return state.Stopping || state.WakeRequested.load(std::memory_order_acquire);
+		});
+		state.WakeRequested.store(false, std::memory_order_release);
+		bool stopping = state.Stopping;
+
+		lock.unlock();
+		WriteBatch(state);
+		lock.lock();
+
+		state.BatchWritten.notify_all();
+		if (stopping) {
+			break;
+		}
+	}
+}
+
+bool StartWriter(LogState& state)
+{
+	std::lock_guard<std::mutex> lock(state.Mutex);
+	if (state.Stopped) {
+		return false;
+	}
+	if (!state.Started) {
+		state.Started = true;
+		try {
+			state.Writer = std::thread(WriterThread, std::ref(state));
+		} catch (const std::exception&) {
+			state.Stopped = true;
+			return false;
+		}
+		state.Running.store(true, std::memory_order_release);
+	}
+	return true;
+}
+
+// "DEBUG Geometry: text"
+void WriteTagged(int level, LogCategory category, const char* text)
+{
+	if (level < LEO_LOG_LEVEL_TRACE || level > LEO_LOG_LEVEL_ERROR) {
+		level = LEO_LOG_LEVEL_INFO;
+	}
+	std::string line(LEVEL_NAMES[level]);
+	line += ' ';
+	line += CATEGORY_NAMES[static_cast<int>(category)];
+	line += ": ";
+	line += text;
+	LogFileWriter::WriteLog(line.c_str());
+}
+
+// Used once the writer thread is gone: the old open, append, close per line
+void WriteDirect(LogState& state, const char* log, size_t length, int64_t micros, uint32_t thread)
+{
+	std::lock_guard<std::mutex> lock(state.Mutex);
+	state.Batch.clear();
+	AppendLine(state, micros, thread, log, length);
+
+	PreparePaths(state);
+	if (OpenLogFile(state.Text, L"a", micros / 1000000)) {
+		fwrite(state.Batch.data(), 1, state.Batch.size(), state.Text.Handle);
+		CloseLogFile(state.Text);
+	}
+}
+
+void WriteDirectBinary(LogState& state, const char* data, size_t length, int64_t micros, uint32_t thread, SlotKind kind)
+{
+	std::lock_guard<std::mutex> lock(state.Mutex);
+	state.BinaryHead.clear();
+	state.BinaryBatch.clear();
+	if (!OpenBinaryFile(state, micros)) {
+		return;
+	}
+	AppendBinary(state, micros, thread, kind, data, length);
+	WriteBinaryBatch(state);
+	CloseLogFile(state.Binary);
+}
+
+// The calling thread's ring, claimed on its first line
+ThreadLog* CurrentThreadLog(LogState& state)
+{
+	ThreadLogOwner& owner = t_threadLog;
+	if (owner.Log) {
+		return owner.Log;
+	}
+
+	std::lock_guard<std::mutex> lock(state.ThreadLogsMutex);
+	for (size_t i = 0; i < state.ThreadLogs.size() && !owner.Log; ++i) {
+		ThreadLog* log = state.ThreadLogs[i];
+		if (!log->InUse.load(std::memory_order_acquire) && log->Ring.IsDrained()) {
+			log->InUse.store(true, std::memory_order_relaxed);
+			owner.Log = log;
+		}
+	}
+	if (!owner.Log) {
+		owner.Log = new ThreadLog();
+		state.ThreadLogs.push_back(owner.Log);
+	}
+	owner.Thread = static_cast<uint32_t>(GetCurrentThreadId());
+	return owner.Log;
+}
+
+void Enqueue(const char* data, size_t length, SlotKind kind)
+{
+	LogState& state = State();
+	int64_t ticks = LogTicks();
+
+	// Copied before queueing, so the record is in the mapped file even if it is dropped below
+	// or the process dies before the writer gets to it
+	if (LeoFlightRecorder::IsEnabled()) {
+		LeoFlightRecorder::Append(kind == SLOT_BINARY_EVENT ? FLIGHT_EVENT : FLIGHT_TEXT, ticks,
+			static_cast<uint32_t>(GetCurrentThreadId()), data, length);
+	}
+
+	if (!state.Running.load(std::memory_order_acquire) && !StartWriter(state)) {
+		int64_t micros = WallMicros(ReadClock(), ticks);
+		uint32_t thread = static_cast<uint32_t>(GetCurrentThreadId());
+		if (kind == SLOT_TEXT) {
+			WriteDirect(state, data, length, micros, thread);
+		} else {
+			WriteDirectBinary(state, data, length, micros, thread, kind);
+		}
+		return;
+	}
+
+	ThreadLog* log = CurrentThreadLog(state);
+	uint32_t thread = t_threadLog.Thread;
+	if (log->Ring.TryPush(data, length, ticks, thread, kind)) {
+		// The writer drains on a timer; only a filling ring is worth waking it for
+		if (log->Ring.Backlog() >= LOG_RING_SLOTS / 2 && !state.WakeRequested.exchange(true)) {
+			state.WakeWriter.notify_one();
+		}
+		return;
+	}
+
+	// Full: give the writer a moment, then drop the line rather than stall Creo's UI thread
+	state.WakeRequested.store(true, std::memory_order_release);
+	state.WakeWriter.notify_one();
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(LOG_OVERFLOW_WAIT_MS);
+	do {
+		std::this_thread::yield();
+		if (log->Ring.TryPush(data, length, ticks, thread, kind)) {
+			return;
+		}
+	} while (std::chrono::steady_clock::now() < deadline);
+
+	state.Dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// UTF-16 (UTF-32 where wchar_t is 32 bits) to UTF-8, stopping before a character that does not fit
+size_t EncodeUtf8(const wchar_t* text, char* out, size_t capacity)
+{
+	size_t used = 0;
+	while (*text) {
+		uint32_t c = static_cast<uint32_t>(*text++);
+		if (c >= 0xD800 && c <= 0xDBFF && *text >= 0xDC00 && *text <= 0xDFFF) {
+			c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<uint32_t>(*text++) - 0xDC00);
+		}
+		char bytes[4];
+		size_t count;
+		if (c < 0x80) {
+			bytes[0] = static_cast<char>(c);
+			count = 1;
+		} else if (c < 0x800) {
+			bytes[0] = static_cast<char>(0xC0 | (c >> 6));
+			bytes[1] = static_cast<char>(0x80 | (c & 0x3F));
+			count = 2;
+		} else if (c < 0x10000) {
+			bytes[0] = static_cast<char>(0xE0 | (c >> 12));
+			bytes[1] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			bytes[2] = static_cast<char>(0x80 | (c & 0x3F));
+			count = 3;
+		} else {
+			bytes[0] = static_cast<char>(0xF0 | (c >> 18));
+			bytes[1] = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			bytes[2] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			bytes[3] = static_cast<char>(0x80 | (c & 0x3F));
+			count = 4;
+		}
+		if (used + count > capacity) {
+			break;
+		}
+		memcpy(out + used, bytes, count);
+		used += count;
+	}
+	return used;
+}
+
+// Builds the format record once; the writer copies it into each binary file that needs it
+unsigned AddFormat(int level, LogCategory category, const char* format, size_t length)
+{
+	LogState& state = State();
+	std::lock_guard<std::mutex> lock(state.FormatsMutex);
+	unsigned id = static_cast<unsigned>(state.Formats.size() + 1);
+
+	std::string body;
+	AppendVarint(body, id);
+	body += static_cast<char>(level);
+	body += static_cast<char>(category);
+	body.append(format, length);
+
+	std::string record(1, static_cast<char>(RECORD_FORMAT));
+	AppendVarint(record, body.size());
+	record += body;
+	state.Formats.push_back(record);
+	LeoFlightRecorder::AddFormat(record.data(), record.size());
+	return id;
+}
+
+}
+
+LogArgs::LogArgs(unsigned formatId)
+	: m_length(0)
+	, m_full(false)
+{
+	PutVarint(formatId);
+}
+
+bool LogArgs::Reserve(size_t bytes)
+{
+	if (!m_full && m_length + bytes > sizeof(m_data)) {
+		m_full = true;
+	}
+	return !m_full;
+}
+
+void LogArgs::PutVarint(unsigned long long value)
+{
+	m_length += LeoBinaryLog::PutVarint(value, m_data + m_length);
+}
+
+void LogArgs::AddSigned(long long value)
+{
+	if (Reserve(11)) {
+		m_data[m_length++] = ARG_SIGNED;
+		PutVarint(ZigZag(value));
+	}
+}
+
+void LogArgs::AddUnsigned(unsigned long long value)
+{
+	if (Reserve(11)) {
+		m_data[m_length++] = ARG_UNSIGNED;
+		PutVarint(value);
+	}
+}
+
+void LogArgs::AddDouble(double value)
+{
+	if (Reserve(9)) {
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		m_data[m_length++] = ARG_DOUBLE;
+		for (int i = 0; i < 8; ++i) {
+			m_data[m_length++] = static_cast<char>((bits >> (8 * i)) & 0xFF);
+		}
+	}
+}
+
+void LogArgs::AddPointer(const void* value)
+{
+	if (Reserve(11)) {
+		m_data[m_length++] = ARG_POINTER;
+		PutVarint(reinterpret_cast<uintptr_t>(value));
+	}
+}
+
+void LogArgs::AddString(const char* value)
+{
+	if (value == NULL) {
+		if (Reserve(1)) {
+			m_data[m_length++] = ARG_NULL_STRING;
+		}
+		return;
+	}
+	AddUtf8(value, strlen(value));
+}
+
+void LogArgs::AddString(const wchar_t* value)
+{
+	if (value == NULL) {
+		AddString(static_cast<const char*>(NULL));
+		return;
+	}
+	char utf8[LOG_BINARY_ARGS_BYTES];
+	AddUtf8(utf8, EncodeUtf8(value, utf8, sizeof(utf8)));
+}
+
+// Cuts the string (on a character boundary) to what is left; nothing is added after a cut string
+void LogArgs::AddUtf8(const char* value, size_t length)
+{
+	if (!Reserve(1 + 10 + 1)) {
+		return;
+	}
+	size_t room = sizeof(m_data) - m_length - 1 - 10;
+	if (length > room) {
+		length = room;
+		while (length > 0 && (static_cast<unsigned char>(value[length]) & 0xC0) == 0x80) {
+			--length;
+		}
+		m_full = true;
+	}
+	m_data[m_length++] = ARG_STRING;
+	PutVarint(length);
+	memcpy(m_data + m_length, value, length);
+	m_length += length;
+}
+
+LogFileWriter::LogFileWriter(const char* path)
 {
-	//fopen_s(&logFile, path, "a"); // Append mode
+	LogFileOptions options;
+	std::wstring fullPath((LPCWSTR)CA2W(path));
+	size_t separator = fullPath.find_last_of(L"\\/");
+	if (separator == std::wstring::npos) {
+		options.FileName = fullPath;
+	} else {
+		options.Directory = fullPath.substr(0, separator);
+		options.FileName = fullPath.substr(separator + 1);
+	}
+	Configure(options);
 }
 
 LogFileWriter::~LogFileWriter()
@@ -14,16 +1245,244 @@ LogFileWriter::~LogFileWriter()
 
 void LogFileWriter::WriteLog(const char* log){
 
-	FILE* logFile;
-	fopen_s(&logFile, "D:\\LeoCreoAddin.log", "a");
-	if (logFile != NULL) {
-		time_t now;
-		time(&now);
-		
-		char timeStr[26];
-		strncpy(timeStr, ctime(&now), 24); // Copy only the first 24 characters (excluding the newline)
-		timeStr[24] = '\0'; // Ensure null termination
-		fprintf(logFile, "[%s] %s\n\n", timeStr, log);
-	}
-	fclose(logFile);
+	if (log == NULL) {
+		return;
+	}
+	Enqueue(log, strlen(log), IsBinary() ? SLOT_BINARY_TEXT : SLOT_TEXT);
+}
+
+void LogFileWriter::Configure(const LogFileOptions& options)
+{
+	LogState& state = State();
+	{
+		std::lock_guard<std::mutex> lock(state.OptionsMutex);
+		state.PendingOptions = options;
+	}
+	state.OptionsChanged.store(true, std::memory_order_release);
+}
+
+void LogFileWriter::WriteRecord(const LogArgs& args)
+{
+	Enqueue(args.Data(), args.Length(), SLOT_BINARY_EVENT);
+}
+
+unsigned LogFileWriter::RegisterFormat(int level, LogCategory category, const char* format)
+{
+	return AddFormat(level, category, format, strlen(format));
+}
+
+unsigned LogFileWriter::RegisterFormat(int level, LogCategory category, const wchar_t* format)
+{
+	std::vector<char> utf8(wcslen(format) * 4 + 1);
+	return AddFormat(level, category, utf8.data(), EncodeUtf8(format, utf8.data(), utf8.size()));
+}
+
+std::vector<std::string> LogFileWriter::GetFormats()
+{
+	LogState& state = State();
+	std::lock_guard<std::mutex> lock(state.FormatsMutex);
+	return state.Formats;
+}
+
+void LogFileWriter::SetBinary(bool binary)
+{
+	s_binary.store(binary, std::memory_order_relaxed);
+}
+
+void LogFileWriter::WriteLogf(int level, LogCategory category, const char* format, ...)
+{
+	char text[512];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	if (length < 0) {
+		WriteTagged(level, category, format);
+	} else if (static_cast<size_t>(length) < sizeof(text)) {
+		WriteTagged(level, category, text);
+	} else {
+		// Long line: format again into a buffer of the right size
+		std::string longText(static_cast<size_t>(length) + 1, '\0');
+		va_start(args, format);
+		vsnprintf(&longText[0], longText.size(), format, args);
+		va_end(args);
+		WriteTagged(level, category, longText.c_str());
+	}
+}
+
+void LogFileWriter::WriteLogf(int level, LogCategory category, const wchar_t* format, ...)
+{
+	CString text;
+	va_list args;
+	va_start(args, format);
+	text.FormatV(format, args);
+	va_end(args);
+	WriteTagged(level, category, CT2A(text));
+}
+
+void LogFileWriter::SetRateLimit(int perSecond, int burst)
+{
+	long long interval = perSecond > 0 ? LogFrequency() / perSecond : 0;
+	s_siteTolerance.store(interval * (burst > 1 ? burst - 1 : 0), std::memory_order_relaxed);
+	s_siteInterval.store(interval, std::memory_order_relaxed);
+}
+
+void LogFileWriter::SetTraceSampling(int percent)
+{
+	s_traceSample.store(static_cast<unsigned>(percent < 0 ? 0 : percent > 100 ? 100 : percent), std::memory_order_relaxed);
+}
+
+// The token bucket is kept as the time at which it would be full again (the generic cell rate
+// algorithm): a line is let through unless that time is more than the burst ahead of now, and
+// each line moves it one interval on. One compare-and-swap, no refill timer.
+bool LogFileWriter::Admit(LogSite& site, int level, LogCategory category, const void* format, bool wideFormat)
+{
+	if (level == LEO_LOG_LEVEL_TRACE) {
+		unsigned sample = s_traceSample.load(std::memory_order_relaxed);
+		if (sample < 100) {
+			// xorshift64, seeded per thread
+			static thread_local uint64_t random = 0x9E3779B97F4A7C15ULL ^ (static_cast<uint64_t>(GetCurrentThreadId()) << 17) ^ static_cast<uint64_t>(LogTicks());
+			random ^= random << 13;
+			random ^= random >> 7;
+			random ^= random << 17;
+			if ((random >> 32) % 100 >= sample) {
+				return false;
+			}
+		}
+	}
+
+	long long interval = s_siteInterval.load(std::memory_order_relaxed);
+	if (interval == 0) {
+		return true;
+	}
+	long long tolerance = s_siteTolerance.load(std::memory_order_relaxed);
+	long long now = LogTicks();
+	long long due = site.NextDue.load(std::memory_order_relaxed);
+	for (;;) {
+		if (due - tolerance > now) {
+			break;
+		}
+		if (site.NextDue.compare_exchange_weak(due, (due > now ? due : now) + interval, std::memory_order_relaxed)) {
+			return true;
+		}
+	}
+
+	site.Suppressed.fetch_add(1, std::memory_order_relaxed);
+	if (!site.Listed.load(std::memory_order_relaxed)) {
+		LogState& state = State();
+		std::lock_guard<std::mutex> lock(state.SitesMutex);
+		if (!site.Listed.load(std::memory_order_relaxed)) {
+			site.Format = format;
+			site.WideFormat = wideFormat;
+			site.Level = level < LEO_LOG_LEVEL_TRACE || level > LEO_LOG_LEVEL_ERROR ? LEO_LOG_LEVEL_INFO : level;
+			site.Category = category;
+			state.LimitedSites.push_back(&site);
+			site.Listed.store(true, std::memory_order_relaxed);
+		}
+	}
+	return false;
+}
+
+void LogFileWriter::SetLevel(LogCategory category, int level)
+{
+	s_levels[static_cast<int>(category)].store(level, std::memory_order_relaxed);
+}
+
+void LogFileWriter::SetLevel(int level)
+{
+	for (int i = 0; i < static_cast<int>(LogCategory::Count); ++i) {
+		s_levels[i].store(level, std::memory_order_relaxed);
+	}
+}
+
+int LogFileWriter::ParseLevel(const char* name)
+{
+	for (int level = LEO_LOG_LEVEL_TRACE; level <= LEO_LOG_LEVEL_OFF; ++level) {
+		if (_stricmp(name, LEVEL_NAMES[level]) == 0) {
+			return level;
+		}
+	}
+	return -1;
+}
+
+bool LogFileWriter::ParseCategory(const char* name, LogCategory& category)
+{
+	for (int i = 0; i < static_cast<int>(LogCategory::Count); ++i) {
+		if (_stricmp(name, CATEGORY_NAMES[i]) == 0) {
+			category = static_cast<LogCategory>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void LogFileWriter::Flush()
+{
+	LogState& state = State();
+	if (!state.Running.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	// What every thread has queued so far
+	std::vector<std::pair<ThreadLog*, uint64_t> > targets;
+	{
+		std::lock_guard<std::mutex> lock(state.ThreadLogsMutex);
+		for (size_t i = 0; i < state.ThreadLogs.size(); ++i) {
+			targets.push_back(std::make_pair(state.ThreadLogs[i], state.ThreadLogs[i]->Ring.PushedPosition()));
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(state.Mutex);
+	state.WakeRequested.store(true, std::memory_order_release);
+	state.WakeWriter.notify_one();
+	state.BatchWritten.wait_for(lock, std::chrono::seconds(1), [&state, &targets]() {
+		for (size_t i = 0; i < targets.size(); ++i) {
+			if (targets[i].first->Ring.WrittenPosition() < targets[i].second) {
+				return !state.Running.load();
+			}
+		}
+		return true;
+	});
+}
+
+void LogFileWriter::Shutdown()
+{
+	LogState& state = State();
+	std::thread writer;
+	{
+		std::lock_guard<std::mutex> lock(state.Mutex);
+		if (state.Stopped) {
+			return;
+		}
+		state.Stopping = true;
+		writer.swap(state.Writer);
+	}
+	StopHousekeeping(state);
+	state.WakeWriter.notify_one();
+
+	if (writer.joinable()) {
+		writer.join();
+	}
+
+	std::lock_guard<std::mutex> lock(state.Mutex);
+	state.Running.store(false, std::memory_order_release);
+	state.Stopped = true;
+
+	// Lines queued while the writer was finishing its last batch
+	WriteBatch(state);
+	CloseLogFile(state.Text);
+	CloseLogFile(state.Binary);
+}
+
+std::wstring LogFileWriter::GetDirectory()
+{
+	LogState& state = State();
+	std::lock_guard<std::mutex> lock(state.OptionsMutex);
+	return state.ResolvedDirectory;
+}
+
+long long LogFileWriter::GetDroppedCount()
+{
+	return State().Dropped.load(std::memory_order_relaxed);
 }
@@ -1,15 +1,257 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <type_traits>
+#include <vector>
+#include "LeoConfig.h"
 
+// Severity levels; plain numbers so the preprocessor can compare them
+#define LEO_LOG_LEVEL_TRACE 0
+#define LEO_LOG_LEVEL_DEBUG 1
+#define LEO_LOG_LEVEL_INFO 2
+#define LEO_LOG_LEVEL_WARN 3
+#define LEO_LOG_LEVEL_ERROR 4
+#define LEO_LOG_LEVEL_OFF 5
+
+// Statements below this level are not compiled at all: Release builds keep INFO and above,
+// so trace logging in the geometry and HTTP paths costs nothing there
+#ifndef LEO_LOG_COMPILED_LEVEL
+#ifdef _DEBUG
+#define LEO_LOG_COMPILED_LEVEL LEO_LOG_LEVEL_TRACE
+#else
+#define LEO_LOG_COMPILED_LEVEL LEO_LOG_LEVEL_INFO
+#endif
+#endif
+
+// Per-module switches; each has its own runtime level (log.level.<name> in local.properties)
+enum class LogCategory {
+	General,		// Add-in entry points and menu actions
+	Geometry,		// Face analysis and part placement
+	Http,			// Leo client, transports, async queue, outbox
+	Server,			// The add-in's web server
+	Config,
+	Count
+};
+
+// Raw argument bytes of one binary record, in the layout described in LeoBinaryLog.h.
+// Arguments that no longer fit are left out; the decoder shows them as missing.
+class LogArgs
+{
+public:
+	explicit LogArgs(unsigned formatId);
+
+	void AddSigned(long long value);
+	void AddUnsigned(unsigned long long value);
+	void AddDouble(double value);
+	void AddPointer(const void* value);
+	void AddString(const char* value);
+	void AddString(const wchar_t* value);		// Stored as UTF-8
+
+	const char* Data() const { return m_data; }
+	size_t Length() const { return m_length; }
+
+private:
+	bool Reserve(size_t bytes);
+	void PutVarint(unsigned long long value);
+	void AddUtf8(const char* value, size_t length);
+
+	size_t m_length;
+	bool m_full;
+	char m_data[LOG_BINARY_ARGS_BYTES];
+};
+
+// Picks the encoding from the argument's type, the way printf would read it
+template <typename T, bool = std::is_enum<T>::value>
+struct LogArgInteger { typedef T type; };
+template <typename T>
+struct LogArgInteger<T, true> { typedef typename std::underlying_type<T>::type type; };
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type AddLogArg(LogArgs& args, T value)
+{
+	if (std::is_signed<typename LogArgInteger<T>::type>::value) {
+		args.AddSigned(static_cast<long long>(value));
+	} else {
+		args.AddUnsigned(static_cast<unsigned long long>(value));
+	}
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type AddLogArg(LogArgs& args, T value)
+{
+	args.AddDouble(static_cast<double>(value));
+}
+
+inline void AddLogArg(LogArgs& args, const char* value) { args.AddString(value); }
+inline void AddLogArg(LogArgs& args, const wchar_t* value) { args.AddString(value); }
+inline void AddLogArg(LogArgs& args, const void* value) { args.AddPointer(value); }
+
+// State of one LEO_* statement, kept in a static next to it. Constant-initialized, so the
+// statement pays no guard check.
+struct LogSite {
+	std::atomic<unsigned> FormatId;			// Binary format id, 0 until first used
+	std::atomic<long long> NextDue;			// Rate limit: counter ticks at which the site's bucket is full again
+	std::atomic<unsigned> Suppressed;		// Statements over the limit since the last summary
+	std::atomic<bool> Listed;				// Known to the writer, which reports Suppressed
+
+	// Set once, under the writer's lock, when the site is listed
+	const void* Format;
+	bool WideFormat;
+	int Level;
+	LogCategory Category;
+
+	constexpr LogSite()
+		: FormatId(0), NextDue(0), Suppressed(0), Listed(false)
+		, Format(nullptr), WideFormat(false), Level(0), Category(LogCategory::General)
+	{
+	}
+};
+
+// Where the log files go and how long they live; applied with LogFileWriter::Configure
+struct LogFileOptions {
+	std::wstring Directory;				// Empty: %LOCALAPPDATA%\Leo\LOG_DIRECTORY_NAME
+	std::wstring FileName;				// Text log; the binary log uses the same name with .blog
+	unsigned long long RotateBytes;		// A file is rotated once it grows past this (0: never)
+	int RotateHours;					// Or once it is this old (0: never)
+	int KeepFiles;						// Rotated files kept per log
+	int KeepDays;						// Rotated files older than this are deleted (0: no age limit)
+	bool Compress;						// NTFS-compress rotated files
+
+	LogFileOptions();
+};
+
+// Asynchronous file logger.
+// WriteLog() reads the performance counter, copies the line into the calling thread's own ring
+// buffer and returns; one background thread drains all rings in batches, merges them by time and
+// writes them to a log file that stays open. Wall-clock time is worked out once per batch, so each
+// line gets a microsecond timestamp and its thread id without a clock call of its own. When a
+// ring is full its thread waits at most LOG_OVERFLOW_WAIT_MS for room and then drops the line;
+// the writer reports how many lines were dropped. Safe to call from any thread.
+// In binary mode (SetBinary) the LEO_* macros skip formatting altogether: each statement records
+// its format id and raw arguments in the .blog file, and LeoLogDecode turns that back into
+// the usual text. Plain WriteLog lines go to the same file as text records.
+// Each LEO_* statement has its own token bucket (SetRateLimit), so a statement inside a loop over
+// a large model cannot flood the log: past the burst it passes at the set rate, and the writer
+// reports how many of its lines were suppressed about once a second. TRACE statements can also
+// be sampled (SetTraceSampling).
+// The writer thread also rotates the files: a full or old log is renamed to
+// <name>.<yyyyMMdd-HHmmss>.log and a new one started. Compressing and deleting rotated files
+// happens on a separate housekeeping thread, so neither callers nor the writer wait for it.
 class LogFileWriter
 {
 private:
 	//static FILE* logFile;
+	static std::atomic<int> s_levels[static_cast<int>(LogCategory::Count)];
+	static std::atomic<bool> s_binary;
+	static std::atomic<long long> s_siteInterval;			// Counter ticks per line at the rate limit; 0: none
+	static std::atomic<long long> s_siteTolerance;			// Ticks of burst allowed ahead of the rate
+	static std::atomic<unsigned> s_traceSample;				// Percent
 
 public:
-	LogFileWriter(const char*);
+	explicit LogFileWriter(const char* path);	// Sends the text log to path (same as Configure)
 	~LogFileWriter();
 	static void WriteLog(const char*);
+
+	// Takes effect with the next batch; a new directory or name closes the current files
+	static void Configure(const LogFileOptions& options);
+
+	// Printf-style line tagged with level and category; use through the LEO_* macros below.
+	// The wide form takes the same format strings as CString::Format.
+	static void WriteLogf(int level, LogCategory category, const char* format, ...);
+	static void WriteLogf(int level, LogCategory category, const wchar_t* format, ...);
+
+	// Formatted text, or a binary record in binary mode, unless the statement is over its rate
+	// limit or sampled out; use through the LEO_* macros below.
+	template <typename Char, typename... Args>
+	static void WriteStatement(LogSite& site, int level, LogCategory category, const Char* format, const Args&... args)
+	{
+		if (!Admit(site, level, category, format, sizeof(Char) != 1)) {
+			return;
+		}
+		if (!s_binary.load(std::memory_order_relaxed)) {
+			WriteLogf(level, category, format, args...);
+			return;
+		}
+		unsigned id = site.FormatId.load(std::memory_order_acquire);
+		if (id == 0) {
+			id = RegisterFormat(level, category, format);
+			site.FormatId.store(id, std::memory_order_release);
+		}
+		LogArgs encoded(id);
+		int unused[] = { 0, (AddLogArg(encoded, args), 0)... };
+		(void)unused;
+		WriteRecord(encoded);
+	}
+
+	static void SetBinary(bool binary);
+	static bool IsBinary() { return s_binary.load(std::memory_order_relaxed); }
+
+	// Binary mode plumbing for WriteStatement: a new format id, and queueing one record
+	static unsigned RegisterFormat(int level, LogCategory category, const char* format);
+	static unsigned RegisterFormat(int level, LogCategory category, const wchar_t* format);
+	static void WriteRecord(const LogArgs& args);
+	static std::vector<std::string> GetFormats();			// Format records registered so far
+
+	// Runtime filter; one relaxed atomic load
+	static bool IsEnabled(int level, LogCategory category)
+	{
+		return level >= s_levels[static_cast<int>(category)].load(std::memory_order_relaxed);
+	}
+	static void SetLevel(LogCategory category, int level);
+	static void SetLevel(int level);						// Every category
+
+	// Per statement: perSecond lines a second after a burst of burst lines (perSecond 0: no limit)
+	static void SetRateLimit(int perSecond, int burst);
+	static void SetTraceSampling(int percent);				// Share of TRACE statements written, 0-100
+
+	// Rate limit and sampling for one statement; false if it is to be skipped
+	static bool Admit(LogSite& site, int level, LogCategory category, const void* format, bool wideFormat);
+	static int ParseLevel(const char* name);				// "trace" ... "off"; -1 if unknown
+	static bool ParseCategory(const char* name, LogCategory& category);
+
+	// Blocks until every line queued so far has been written (or a second has passed)
+	static void Flush();
+
+	// Drains the ring and stops the writer thread (call from user_terminate); later lines are
+	// written synchronously
+	static void Shutdown();
+
+	// Folder the log files go to; empty until the writer has opened its first file
+	static std::wstring GetDirectory();
+
+	static long long GetDroppedCount();
 };
 
+// Arguments are evaluated only when the level is enabled for the category. Each statement keeps
+// its own binary format id and rate limit.
+#define LEO_LOG(level, category, ...) \
+	do { \
+		if (LogFileWriter::IsEnabled((level), LogCategory::category)) { \
+			static LogSite leoLogSite; \
+			LogFileWriter::WriteStatement(leoLogSite, (level), LogCategory::category, __VA_ARGS__); \
+		} \
+	} while (0)
+
+#if LEO_LOG_COMPILED_LEVEL <= LEO_LOG_LEVEL_TRACE
+#define LEO_TRACE(category, ...) LEO_LOG(LEO_LOG_LEVEL_TRACE, category, __VA_ARGS__)
+#else
+#define LEO_TRACE(category, ...) ((void)0)
+#endif
+
+#if LEO_LOG_COMPILED_LEVEL <= LEO_LOG_LEVEL_DEBUG
+#define LEO_DEBUG(category, ...) LEO_LOG(LEO_LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#else
+#define LEO_DEBUG(category, ...) ((void)0)
+#endif
+
+#if LEO_LOG_COMPILED_LEVEL <= LEO_LOG_LEVEL_INFO
+#define LEO_INFO(category, ...) LEO_LOG(LEO_LOG_LEVEL_INFO, category, __VA_ARGS__)
+#else
+#define LEO_INFO(category, ...) ((void)0)
+#endif
+
+#define LEO_WARN(category, ...) LEO_LOG(LEO_LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define LEO_ERROR(category, ...) LEO_LOG(LEO_LOG_LEVEL_ERROR, category, __VA_ARGS__)
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#ifdef _WIN32
+
 #ifndef VC_EXTRALEAN
 #define VC_EXTRALEAN // Exclude rarely used material from Windows headers
 #endif
@@ -70,3 +72,10 @@
 #include <ProWindows.h>
 #include <ProCore.h>
 #include <shellapi.h> // For ShellExecuteEx
+
+#else
+
+// LeoTests builds the portable modules on Linux and macOS
+#include "LeoPosixCompat.h"
+
+#endif // _WIN32
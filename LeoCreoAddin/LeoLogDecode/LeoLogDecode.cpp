@@ -0,0 +1,644 @@
+// LeoLogDecode: turns a binary add-in log (log.format=binary) or a flight record back into the
+// text log format.
+//
+//   LeoLogDecode LeoCreoAddin.blog [LeoCreoAddin.decoded.log]
+//   LeoLogDecode %LOCALAPPDATA%\Leo\LeoCreoAddin.20261018-093000.crash.flight
+//
+// Without an output file the text goes to stdout. The record layouts are described in
+// LeoBinaryLog.h; a file cut short by a crash decodes up to its last complete record. A flight
+// record is printed in time order and ends with the spans that were still open, which for a
+// crash is where each thread was.
+
+#include "LeoBinaryLog.h"
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace LeoBinaryLog;
+
+namespace {
+
+struct FormatDef {
+    int Level;
+    int Category;
+    std::string Text;
+};
+
+struct Arg {
+    char Tag;
+    long long Signed;
+    unsigned long long Unsigned;
+    double Double;
+    std::string Text;
+};
+
+bool ReadFile(const char* path, std::string& data)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, read);
+    }
+    fclose(file);
+    return true;
+}
+
+// Same "[Sun Oct 18 09:30:00.123456 2026] [5124] " prefix as the text log
+std::string LinePrefix(long long micros, uint64_t thread)
+{
+    time_t seconds = static_cast<time_t>(micros / 1000000);
+    const char* text = ctime(&seconds);
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "[%.19s.%06d%.5s] [%llu] ", text ? text : "(bad time)         ",
+             static_cast<int>(micros % 1000000), text ? text + 19 : "", static_cast<unsigned long long>(thread));
+    return prefix;
+}
+
+void AppendUtf8(std::string& out, unsigned long long c)
+{
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    } else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        out += static_cast<char>(0xE0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | ((c >> 18) & 0x07));
+        out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+template <typename T>
+void AppendPrintf(std::string& out, const std::string& spec, T value)
+{
+    int length = snprintf(NULL, 0, spec.c_str(), value);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> buffer(static_cast<size_t>(length) + 1);
+    snprintf(buffer.data(), buffer.size(), spec.c_str(), value);
+    out.append(buffer.data(), static_cast<size_t>(length));
+}
+
+long long AsSigned(const Arg& arg)
+{
+    switch (arg.Tag) {
+    case ARG_SIGNED: return arg.Signed;
+    case ARG_DOUBLE: return static_cast<long long>(arg.Double);
+    default: return static_cast<long long>(arg.Unsigned);
+    }
+}
+
+unsigned long long AsUnsigned(const Arg& arg)
+{
+    switch (arg.Tag) {
+    case ARG_SIGNED: return static_cast<unsigned long long>(arg.Signed);
+    case ARG_DOUBLE: return static_cast<unsigned long long>(arg.Double);
+    default: return arg.Unsigned;
+    }
+}
+
+double AsDouble(const Arg& arg)
+{
+    switch (arg.Tag) {
+    case ARG_DOUBLE: return arg.Double;
+    case ARG_SIGNED: return static_cast<double>(arg.Signed);
+    default: return static_cast<double>(arg.Unsigned);
+    }
+}
+
+std::string AsString(const Arg& arg)
+{
+    switch (arg.Tag) {
+    case ARG_STRING: return arg.Text;
+    case ARG_NULL_STRING: return "(null)";
+    case ARG_DOUBLE: {
+        std::string text;
+        AppendPrintf(text, "%f", arg.Double);
+        return text;
+    }
+    case ARG_SIGNED: return std::to_string(arg.Signed);
+    default: return std::to_string(arg.Unsigned);
+    }
+}
+
+// printf/CString::Format conversions, with the values the call site passed. Length modifiers
+// (l, ll, h, I64, ...) are dropped because every value was widened when it was recorded, and
+// %s/%S/%ls all mean "the string", which is stored as UTF-8 whatever its original width.
+std::string FormatEvent(const std::string& format, const std::vector<Arg>& args)
+{
+    std::string out;
+    size_t next = 0;
+    const size_t n = format.size();
+
+    for (size_t i = 0; i < n; ++i) {
+        if (format[i] != '%') {
+            out += format[i];
+            continue;
+        }
+        if (i + 1 < n && format[i + 1] == '%') {
+            out += '%';
+            ++i;
+            continue;
+        }
+
+        size_t j = i + 1;
+        std::string spec("%");
+        while (j < n && strchr("-+ #0", format[j])) {
+            spec += format[j++];
+        }
+        for (int part = 0; part < 2; ++part) {
+            if (part == 1) {
+                if (j >= n || format[j] != '.') {
+                    break;
+                }
+                spec += format[j++];
+            }
+            if (j < n && format[j] == '*') {
+                spec += next < args.size() ? std::to_string(AsSigned(args[next++])) : std::string("0");
+                ++j;
+            }
+            while (j < n && format[j] >= '0' && format[j] <= '9') {
+                spec += format[j++];
+            }
+        }
+        while (j < n && strchr("hlLqjztw", format[j])) {
+            ++j;
+        }
+        if (j < n && format[j] == 'I') {
+            ++j;
+            if (format.compare(j, 2, "64") == 0 || format.compare(j, 2, "32") == 0) {
+                j += 2;
+            }
+        }
+        if (j >= n) {
+            out.append(format, i, std::string::npos);
+            break;
+        }
+
+        char conversion = format[j];
+        if (!strchr("diuoxXcCeEfFgGaAsSpnZ", conversion)) {
+            out.append(format, i, j - i + 1);
+            i = j;
+            continue;
+        }
+        i = j;
+        if (next >= args.size()) {
+            out += "<missing>";
+            continue;
+        }
+        const Arg& arg = args[next++];
+
+        switch (conversion) {
+        case 'd':
+        case 'i':
+            AppendPrintf(out, spec + "ll" + conversion, AsSigned(arg));
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            AppendPrintf(out, spec + "ll" + conversion, AsUnsigned(arg));
+            break;
+        case 'c':
+        case 'C':
+            AppendUtf8(out, AsUnsigned(arg));
+            break;
+        case 'p':
+            AppendPrintf(out, std::string("%016llX"), AsUnsigned(arg));
+            break;
+        case 'n':
+            break;
+        case 's':
+        case 'S':
+        case 'Z':
+            AppendPrintf(out, spec + 's', AsString(arg).c_str());
+            break;
+        default:
+            AppendPrintf(out, spec + conversion, AsDouble(arg));
+            break;
+        }
+    }
+    return out;
+}
+
+bool ReadArgs(const std::string& body, size_t pos, std::vector<Arg>& args)
+{
+    const char* data = body.data();
+    const size_t length = body.size();
+    args.clear();
+    while (pos < length) {
+        Arg arg;
+        arg.Tag = data[pos++];
+        arg.Signed = 0;
+        arg.Unsigned = 0;
+        arg.Double = 0.0;
+        uint64_t value = 0;
+        switch (arg.Tag) {
+        case ARG_SIGNED:
+            if (!GetVarint(data, length, pos, value)) {
+                return false;
+            }
+            arg.Signed = UnZigZag(value);
+            break;
+        case ARG_UNSIGNED:
+        case ARG_POINTER:
+            if (!GetVarint(data, length, pos, value)) {
+                return false;
+            }
+            arg.Unsigned = value;
+            break;
+        case ARG_DOUBLE: {
+            if (length - pos < 8) {
+                return false;
+            }
+            uint64_t bits = 0;
+            for (int i = 0; i < 8; ++i) {
+                bits |= static_cast<uint64_t>(static_cast<uint8_t>(data[pos + i])) << (8 * i);
+            }
+            memcpy(&arg.Double, &bits, sizeof(bits));
+            pos += 8;
+            break;
+        }
+        case ARG_STRING:
+            if (!GetVarint(data, length, pos, value) || value > length - pos) {
+                return false;
+            }
+            arg.Text.assign(data + pos, static_cast<size_t>(value));
+            pos += static_cast<size_t>(value);
+            break;
+        case ARG_NULL_STRING:
+            break;
+        default:
+            return false;
+        }
+        args.push_back(arg);
+    }
+    return true;
+}
+
+typedef std::map<uint64_t, FormatDef> FormatMap;
+
+// Adds a format record body (id, level, category, text) to formats
+bool ReadFormat(const std::string& body, FormatMap& formats)
+{
+    size_t at = 0;
+    uint64_t id = 0;
+    if (!GetVarint(body.data(), body.size(), at, id) || body.size() - at < 2) {
+        return false;
+    }
+    FormatDef def;
+    def.Level = static_cast<uint8_t>(body[at]);
+    def.Category = static_cast<uint8_t>(body[at + 1]);
+    def.Text = body.substr(at + 2);
+    formats[id] = def;
+    return true;
+}
+
+// "INFO Http: <formatted text>" for an event whose arguments start at pos in body
+std::string DescribeEvent(const FormatMap& formats, uint64_t id, const std::string& body, size_t pos, std::vector<Arg>& args)
+{
+    FormatMap::const_iterator def = formats.find(id);
+    if (def == formats.end()) {
+        return "<unknown format " + std::to_string(id) + ">";
+    }
+    int level = def->second.Level < LEVEL_COUNT ? def->second.Level : 2;
+    std::string line(LEVEL_NAMES[level]);
+    line += ' ';
+    line += def->second.Category < CATEGORY_COUNT ? CATEGORY_NAMES[def->second.Category] : "?";
+    line += ": ";
+    if (!ReadArgs(body, pos, args)) {
+        line += "<bad arguments> ";
+    }
+    line += FormatEvent(def->second.Text, args);
+    return line;
+}
+
+// A flight record reassembled from its slots
+struct FlightRecord {
+    uint64_t Sequence;
+    int64_t Ticks;
+    uint32_t Thread;
+    uint8_t Kind;
+    std::string Data;
+};
+
+struct OpenSpan {
+    std::string Name;
+    long long Micros;
+};
+
+std::string FormatSeconds(long long micros)
+{
+    char text[32];
+    if (micros < 1000000) {
+        snprintf(text, sizeof(text), "%.3f ms", micros / 1000.0);
+    } else {
+        snprintf(text, sizeof(text), "%.3f s", micros / 1000000.0);
+    }
+    return text;
+}
+
+int DecodeFlight(const std::string& data, FILE* out, const char* path)
+{
+    const size_t ringStart = FLIGHT_HEADER_BYTES + FLIGHT_FORMAT_BYTES;
+    FlightHeader header;
+    if (data.size() < ringStart) {
+        fprintf(stderr, "LeoLogDecode: %s is cut short\n", path);
+        return 1;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.Version != FLIGHT_VERSION || header.Frequency <= 0) {
+        fprintf(stderr, "LeoLogDecode: %s was written by a different add-in version\n", path);
+        return 1;
+    }
+
+    FormatMap formats;
+    size_t formatEnd = FLIGHT_HEADER_BYTES + (std::min)(static_cast<size_t>(header.FormatBytes), FLIGHT_FORMAT_BYTES);
+    for (size_t pos = FLIGHT_HEADER_BYTES; pos < formatEnd; ) {
+        size_t bodyPos = pos + 1;
+        uint64_t bodyLength = 0;
+        if (!GetVarint(data.data(), formatEnd, bodyPos, bodyLength) || bodyLength > formatEnd - bodyPos) {
+            break;
+        }
+        if (static_cast<uint8_t>(data[pos]) == RECORD_FORMAT) {
+            ReadFormat(data.substr(bodyPos, static_cast<size_t>(bodyLength)), formats);
+        }
+        pos = bodyPos + static_cast<size_t>(bodyLength);
+    }
+
+    // Slots by sequence; one still marked FLIGHT_WRITING was torn by the crash
+    uint64_t slotCount = (std::min)(static_cast<uint64_t>(header.SlotCount), static_cast<uint64_t>((data.size() - ringStart) / FLIGHT_SLOT_BYTES));
+    std::map<uint64_t, FlightSlot> slots;
+    long long torn = 0;
+    for (uint64_t i = 0; i < slotCount; ++i) {
+        FlightSlot slot;
+        memcpy(&slot, data.data() + ringStart + i * FLIGHT_SLOT_BYTES, sizeof(slot));
+        if (slot.Sequence == FLIGHT_WRITING) {
+            ++torn;
+        } else if (slot.Sequence != 0 && (slot.Sequence - 1) % slotCount == i && slot.Length <= sizeof(slot.Data)) {
+            slots[slot.Sequence] = slot;
+        }
+    }
+
+    std::vector<FlightRecord> records;
+    long long incomplete = 0;
+    for (std::map<uint64_t, FlightSlot>::const_iterator it = slots.begin(); it != slots.end(); ++it) {
+        const FlightSlot& first = it->second;
+        if (first.Kind == FLIGHT_CONTINUATION) {
+            continue;
+        }
+        FlightRecord record;
+        record.Sequence = first.Sequence;
+        record.Ticks = first.Ticks;
+        record.Thread = first.Thread;
+        record.Kind = first.Kind;
+        record.Data.assign(first.Data, first.Length);
+        bool complete = true;
+        for (uint64_t i = 1; i <= first.Continues && complete; ++i) {
+            std::map<uint64_t, FlightSlot>::const_iterator next = slots.find(first.Sequence + i);
+            complete = next != slots.end() && next->second.Kind == FLIGHT_CONTINUATION;
+            if (complete) {
+                record.Data.append(next->second.Data, next->second.Length);
+            }
+        }
+        if (complete) {
+            records.push_back(record);
+        } else {
+            ++incomplete;
+        }
+    }
+
+    // Slots are claimed in sequence order but stamped just before, so threads can interleave
+    // by a few microseconds
+    std::stable_sort(records.begin(), records.end(), [](const FlightRecord& a, const FlightRecord& b) { return a.Ticks < b.Ticks; });
+
+    const int64_t frequency = header.Frequency;
+    auto toMicros = [&header, frequency](int64_t ticks) {
+        int64_t delta = ticks - header.AnchorTicks;
+        return static_cast<long long>(header.AnchorMicros + (delta / frequency) * 1000000 + (delta % frequency) * 1000000 / frequency);
+    };
+
+    std::string line = "=== Flight record of process " + std::to_string(header.ProcessId) + ", started "
+        + LinePrefix(header.AnchorMicros, 0).substr(1, 31) + ", " + std::to_string(records.size()) + " records";
+    if (!slots.empty() && slots.begin()->first > 1) {
+        line += ", older ones overwritten";
+    }
+    line += " ===";
+    fwrite(line.data(), 1, line.size(), out);
+    fputs("\n\n", out);
+
+    std::map<uint32_t, std::vector<OpenSpan> > openSpans;
+    std::vector<Arg> args;
+    long long lastMicros = header.AnchorMicros;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const FlightRecord& record = records[i];
+        long long micros = toMicros(record.Ticks);
+        lastMicros = (std::max)(lastMicros, micros);
+        line = LinePrefix(micros, record.Thread);
+        size_t at = 0;
+        uint64_t value = 0;
+
+        switch (record.Kind) {
+        case FLIGHT_TEXT:
+            line += record.Data;
+            break;
+
+        case FLIGHT_EVENT:
+            if (!GetVarint(record.Data.data(), record.Data.size(), at, value)) {
+                line += "<bad event>";
+            } else {
+                line += DescribeEvent(formats, value, record.Data, at, args);
+            }
+            break;
+
+        case FLIGHT_SPAN_BEGIN:
+        case FLIGHT_SPAN_END: {
+            uint64_t duration = 0;
+            if ((record.Kind == FLIGHT_SPAN_END && !GetVarint(record.Data.data(), record.Data.size(), at, duration)) || at >= record.Data.size()) {
+                line += "<bad span>";
+                break;
+            }
+            uint8_t category = static_cast<uint8_t>(record.Data[at]);
+            std::string name = record.Data.substr(at + 1);
+            line += "SPAN ";
+            line += category < CATEGORY_COUNT ? CATEGORY_NAMES[category] : "?";
+            line += ": " + name;
+
+            std::vector<OpenSpan>& stack = openSpans[record.Thread];
+            if (record.Kind == FLIGHT_SPAN_BEGIN) {
+                OpenSpan span = { name, micros };
+                stack.push_back(span);
+                line += " begins";
+            } else {
+                for (size_t j = stack.size(); j > 0; --j) {
+                    if (stack[j - 1].Name == name) {
+                        stack.erase(stack.begin() + static_cast<std::ptrdiff_t>(j - 1));
+                        break;
+                    }
+                }
+                long long durationMicros = static_cast<long long>((duration / frequency) * 1000000 + (duration % frequency) * 1000000 / frequency);
+                line += " ends after " + FormatSeconds(durationMicros);
+            }
+            break;
+        }
+
+        default:
+            line.clear();       // Written by a newer add-in; skip it
+            break;
+        }
+
+        if (!line.empty()) {
+            fwrite(line.data(), 1, line.size(), out);
+            fputs("\n\n", out);
+        }
+    }
+
+    if (header.State == FLIGHT_CLOSED) {
+        line = "=== The session shut down cleanly ===";
+    } else {
+        line = "=== The session did not shut down; the last record is from " + LinePrefix(lastMicros, 0).substr(1, 31) + " ===";
+    }
+    fwrite(line.data(), 1, line.size(), out);
+    fputs("\n\n", out);
+
+    // What each thread was inside when the record ends
+    for (std::map<uint32_t, std::vector<OpenSpan> >::const_iterator it = openSpans.begin(); it != openSpans.end(); ++it) {
+        for (size_t j = 0; j < it->second.size(); ++j) {
+            const OpenSpan& span = it->second[j];
+            line = "Still open on thread " + std::to_string(it->first) + ": " + span.Name + ", for "
+                + FormatSeconds(lastMicros - span.Micros) + " before the last record";
+            fwrite(line.data(), 1, line.size(), out);
+            fputs("\n\n", out);
+        }
+    }
+
+    fprintf(stderr, "LeoLogDecode: %zu records, %lld torn and %lld incomplete skipped\n", records.size(), torn, incomplete);
+    return 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: LeoLogDecode <binary log or flight record> [output file]\n");
+        return 2;
+    }
+
+    std::string data;
+    if (!ReadFile(argv[1], data)) {
+        fprintf(stderr, "LeoLogDecode: cannot read %s\n", argv[1]);
+        return 1;
+    }
+    bool flight = data.compare(0, MAGIC_LENGTH, FLIGHT_MAGIC, MAGIC_LENGTH) == 0;
+    if (!flight && data.compare(0, MAGIC_LENGTH, MAGIC, MAGIC_LENGTH) != 0) {
+        fprintf(stderr, "LeoLogDecode: %s is not a binary Leo log, or was written by an older add-in\n", argv[1]);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (argc == 3) {
+        out = fopen(argv[2], "w");
+        if (!out) {
+            fprintf(stderr, "LeoLogDecode: cannot write %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    if (flight) {
+        int result = DecodeFlight(data, out, argv[1]);
+        if (out != stdout) {
+            fclose(out);
+        }
+        return result;
+    }
+
+    FormatMap formats;
+    std::vector<Arg> args;
+    long long sessionStart = 0;
+    long long records = 0;
+    size_t pos = MAGIC_LENGTH;
+
+    while (pos < data.size()) {
+        uint8_t type = static_cast<uint8_t>(data[pos]);
+        size_t bodyPos = pos + 1;
+        uint64_t bodyLength = 0;
+        if (!GetVarint(data.data(), data.size(), bodyPos, bodyLength) || bodyLength > data.size() - bodyPos) {
+            fprintf(stderr, "LeoLogDecode: file ends inside a record at offset %zu\n", pos);
+            break;
+        }
+        std::string body = data.substr(bodyPos, static_cast<size_t>(bodyLength));
+        pos = bodyPos + static_cast<size_t>(bodyLength);
+        ++records;
+
+        size_t at = 0;
+        uint64_t value = 0;
+        std::string line;
+        switch (type) {
+        case RECORD_SESSION:
+            sessionStart = 0;
+            for (size_t i = 0; i < 8 && i < body.size(); ++i) {
+                sessionStart |= static_cast<long long>(static_cast<uint8_t>(body[i])) << (8 * i);
+            }
+            formats.clear();
+            break;
+
+        case RECORD_FORMAT:
+            if (!ReadFormat(body, formats)) {
+                fprintf(stderr, "LeoLogDecode: bad format record at offset %zu\n", bodyPos - 1);
+            }
+            break;
+
+        case RECORD_EVENT: {
+            uint64_t offset = 0;
+            uint64_t thread = 0;
+            uint64_t id = 0;
+            if (!GetVarint(body.data(), body.size(), at, offset) || !GetVarint(body.data(), body.size(), at, thread)
+                || !GetVarint(body.data(), body.size(), at, id)) {
+                fprintf(stderr, "LeoLogDecode: bad event record at offset %zu\n", bodyPos - 1);
+                break;
+            }
+            line = LinePrefix(sessionStart + UnZigZag(offset), thread) + DescribeEvent(formats, id, body, at, args);
+            break;
+        }
+
+        case RECORD_TEXT: {
+            uint64_t thread = 0;
+            if (!GetVarint(body.data(), body.size(), at, value) || !GetVarint(body.data(), body.size(), at, thread)) {
+                fprintf(stderr, "LeoLogDecode: bad text record at offset %zu\n", bodyPos - 1);
+                break;
+            }
+            line = LinePrefix(sessionStart + UnZigZag(value), thread) + body.substr(at);
+            break;
+        }
+
+        default:
+            break;      // Written by a newer add-in; skip it
+        }
+
+        if (!line.empty()) {
+            fwrite(line.data(), 1, line.size(), out);
+            fputs("\n\n", out);
+        }
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    fprintf(stderr, "LeoLogDecode: %lld records, %zu bytes\n", records, data.size());
+    return 0;
+}
@@ -0,0 +1,291 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+#include "LeoBodyStream.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Stands in for WinHttpWriteData / send(): records every chunk and can fail on a given call
+class MockChunkSink {
+public:
+    explicit MockChunkSink(size_t failOnCall = 0) : Calls(0), m_failOnCall(failOnCall) {}
+
+    BodyChunkSink Bind()
+    {
+        return [this](const char* data, size_t length) {
+            ++Calls;
+            if (Calls == m_failOnCall) {
+                return false;
+            }
+            Chunks.push_back(std::string(data, length));
+            Bytes.append(data, length);
+            return true;
+        };
+    }
+
+    size_t Calls;
+    std::vector<std::string> Chunks;
+    std::string Bytes;
+
+private:
+    size_t m_failOnCall;
+};
+
+// A body built from every kind of write a serializer makes, pieces of random size around the
+// chunk size included. It produces the same bytes on every run, as a BodyProducer must.
+BodyProducer RandomProducer(uint64_t seed, size_t pieces)
+{
+    return [seed, pieces](ChunkedBodyWriter& out) {
+        LeoTestRandom random(seed);
+        std::string piece;
+        for (size_t n = 0; n < pieces; ++n) {
+            switch (random.Below(6)) {
+            case 0:
+                out.Put(static_cast<char>('a' + random.Below(26)));
+                break;
+            case 1:
+                piece.assign(random.Below(40), 'w');
+                out.Write(piece);
+                break;
+            case 2:
+                piece.assign(random.Below(200 * 1000), 'L');    // Often at least one chunk: bypasses the buffer
+                out.Write(piece.data(), piece.size());
+                break;
+            case 3:
+                out.Write("\"key\":");
+                break;
+            case 4:
+                piece = "C:\\Parts\\\"quoted\"\n\x01 caf\xC3\xA9";
+                WriteJsonString(out, piece.data(), piece.size());
+                break;
+            default:
+                WriteJsonNumber(out, (static_cast<double>(random.Next() % 2000000) - 1e6) / 7.0);
+                break;
+            }
+        }
+    };
+}
+
+// What the transports do: a counting pass for Content-Length, then the send pass
+struct TwoPassResult {
+    uint64_t ContentLength;
+    uint64_t BytesWritten;
+    bool Flushed;
+};
+
+TwoPassResult RunTwoPasses(const BodyProducer& producer, MockChunkSink& sink, size_t chunkSize)
+{
+    ChunkedBodyWriter counter(nullptr);
+    producer(counter);
+
+    ChunkedBodyWriter writer(sink.Bind(), chunkSize);
+    producer(writer);
+    TwoPassResult result;
+    result.Flushed = writer.Flush();
+    result.ContentLength = counter.BytesWritten();
+    result.BytesWritten = writer.BytesWritten();
+    return result;
+}
+
+std::string JsonString(const std::string& text)
+{
+    MockChunkSink sink;
+    ChunkedBodyWriter writer(sink.Bind(), 16);
+    WriteJsonString(writer, text.data(), text.size());
+    writer.Flush();
+    return sink.Bytes;
+}
+
+std::string JsonNumber(double value)
+{
+    MockChunkSink sink;
+    ChunkedBodyWriter writer(sink.Bind());
+    WriteJsonNumber(writer, value);
+    writer.Flush();
+    return sink.Bytes;
+}
+
+}
+
+LEO_TEST(BodyWriterCountingAndSendPassesAgree)
+{
+    // The reference is the body collected in one piece, through a buffer larger than the body
+    const size_t chunkSizes[] = { 1, 2, 7, 64, 1000, 4096, 64 * 1024, 1024 * 1024 };
+    for (uint64_t seed = 1; seed <= 12; ++seed) {
+        BodyProducer producer = RandomProducer(seed, 300);
+        ChunkedBodyWriter measure(nullptr);
+        producer(measure);
+        MockChunkSink reference;
+        ChunkedBodyWriter whole(reference.Bind(), static_cast<size_t>(measure.BytesWritten()) + 1);
+        producer(whole);
+        LEO_CHECK(whole.Flush());
+        LEO_CHECK(reference.Chunks.size() == 1);
+
+        for (size_t chunkSize : chunkSizes) {
+            MockChunkSink sink;
+            TwoPassResult result = RunTwoPasses(producer, sink, chunkSize);
+            LEO_CHECK(result.Flushed);
+            LEO_CHECK(result.ContentLength == reference.Bytes.size());
+            LEO_CHECK(result.BytesWritten == result.ContentLength);
+            LEO_CHECK(sink.Bytes == reference.Bytes);
+
+            // No empty chunks, and the sink sees one call per chunk counted
+            for (const std::string& chunk : sink.Chunks) {
+                LEO_CHECK(!chunk.empty());
+            }
+            LEO_CHECK(sink.Calls == sink.Chunks.size());
+        }
+    }
+}
+
+LEO_TEST(BodyWriterChunkBoundaries)
+{
+    // Writes that exactly fill, overflow and bypass the buffer
+    MockChunkSink sink;
+    ChunkedBodyWriter writer(sink.Bind(), 8);
+    writer.Write("12345678");           // A whole chunk goes straight out
+    writer.Write("abc");
+    writer.Write("defgh");              // Fills the buffer exactly; stays buffered
+    writer.Put('i');                    // Full buffer is sent first
+    writer.Write("0123456789");         // Buffered "i" first, then the large piece by itself
+    LEO_CHECK(writer.Flush());
+    LEO_CHECK(writer.Flush());          // Nothing left; no empty chunk
+
+    const char* expected[] = { "12345678", "abcdefgh", "i", "0123456789" };
+    LEO_CHECK(sink.Chunks.size() == 4);
+    for (size_t i = 0; i < sink.Chunks.size() && i < 4; ++i) {
+        LEO_CHECK(sink.Chunks[i] == expected[i]);
+    }
+    LEO_CHECK(writer.ChunksSent() == 4);
+    LEO_CHECK(writer.BytesWritten() == 8 + 3 + 5 + 1 + 10);
+}
+
+LEO_TEST(BodyWriterStopsAfterSinkFailure)
+{
+    BodyProducer producer = RandomProducer(36, 400);
+    MockChunkSink healthy;
+    TwoPassResult expected = RunTwoPasses(producer, healthy, 1000);
+    LEO_CHECK(healthy.Calls > 3);
+
+    // The third chunk fails: nothing more reaches the sink and Flush reports it
+    MockChunkSink failing(3);
+    ChunkedBodyWriter writer(failing.Bind(), 1000);
+    producer(writer);
+    LEO_CHECK(!writer.Flush());
+    LEO_CHECK(writer.Failed());
+    LEO_CHECK(failing.Calls == 3);
+    LEO_CHECK(writer.ChunksSent() == 2);
+    LEO_CHECK(failing.Bytes == healthy.Bytes.substr(0, failing.Bytes.size()));
+
+    // The count still covers the whole body, so it is never mistaken for a complete upload
+    LEO_CHECK(writer.BytesWritten() == expected.ContentLength);
+}
+
+LEO_TEST(BodyWriterJsonStringEscapes)
+{
+    LEO_CHECK(JsonString("") == "\"\"");
+    LEO_CHECK(JsonString("plain") == "\"plain\"");
+    LEO_CHECK(JsonString("a\"b\\c") == "\"a\\\"b\\\\c\"");
+    LEO_CHECK(JsonString("\n\r\t") == "\"\\n\\r\\t\"");
+    LEO_CHECK(JsonString(std::string("\x00\x01\x1f", 3)) == "\"\\u0000\\u0001\\u001f\"");
+
+    // UTF-8 and DEL pass through untouched
+    LEO_CHECK(JsonString("caf\xC3\xA9 \xF0\x9F\x94\xA9\x7f") == "\"caf\xC3\xA9 \xF0\x9F\x94\xA9\x7f\"");
+
+    // Every byte value, through a 16-byte buffer so escapes straddle chunk boundaries
+    std::string all;
+    for (int c = 0; c < 256; ++c) {
+        all.push_back(static_cast<char>(c));
+    }
+    std::string json = JsonString(all);
+    size_t unescaped = 0;
+    for (size_t i = 1; i + 1 < json.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(json[i]);
+        LEO_CHECK(c >= 0x20);
+        unescaped += json[i] == '\\' ? 0 : 1;
+        if (json[i] == '\\') {
+            ++i;
+        }
+    }
+    LEO_CHECK(unescaped > 200);
+}
+
+LEO_TEST(BodyWriterJsonNumbersRoundTrip)
+{
+    LEO_CHECK(JsonNumber(0.0) == "0");
+    LEO_CHECK(JsonNumber(-2.5) == "-2.5");
+    LEO_CHECK(JsonNumber(std::numeric_limits<double>::quiet_NaN()) == "null");
+    LEO_CHECK(JsonNumber(std::numeric_limits<double>::infinity()) == "null");
+    LEO_CHECK(JsonNumber(0.1 + 0.2) == "0.30000000000000004");
+
+    LeoTestRandom random(3636);
+    for (int n = 0; n < 20000; ++n) {
+        uint64_t bits = random.Next();
+        double value = 0.0;
+        memcpy(&value, &bits, sizeof(value));
+        if (!std::isfinite(value)) {
+            continue;
+        }
+        std::string text = JsonNumber(value);
+        LEO_CHECK(strtod(text.c_str(), nullptr) == value);
+    }
+}
+
+LEO_BENCH(BodyWriterThroughput)
+{
+    // A placement-style body: many short writes, as the assembly serializers make them
+    BodyProducer producer = [](ChunkedBodyWriter& out) {
+        out.Write("{\"AssemblyRoot\":\"C:\\\\Work\\\\top.asm\",\"ChildrenList\":[");
+        for (int n = 0; n < 20000; ++n) {
+            if (n) {
+                out.Put(',');
+            }
+            out.Write("{\"Name\":");
+            WriteJsonString(out, "part_with_a_longer_name.prt", 27);
+            out.Write(",\"Loc\":{\"X\":");
+            WriteJsonNumber(out, n * 0.125);
+            out.Write(",\"Y\":");
+            WriteJsonNumber(out, -1.25);
+            out.Write(",\"Z\":");
+            WriteJsonNumber(out, 300.0);
+            out.Write("}}");
+        }
+        out.Write("]}");
+    };
+
+    ChunkedBodyWriter counter(nullptr);
+    producer(counter);
+    double megabytes = counter.BytesWritten() / 1e6;
+
+    double countNs = LeoMeasureNs(20, [&] {
+        ChunkedBodyWriter writer(nullptr);
+        producer(writer);
+        LeoBenchSink(writer.BytesWritten());
+    });
+    uint64_t sent = 0;
+    double sendNs = LeoMeasureNs(20, [&] {
+        ChunkedBodyWriter writer([&sent](const char*, size_t length) { sent += length; return true; });
+        producer(writer);
+        writer.Flush();
+    });
+    double bufferNs = LeoMeasureNs(20, [&] {
+        std::string body;
+        ChunkedBodyWriter writer([&body](const char* data, size_t length) { body.append(data, length); return true; });
+        producer(writer);
+        writer.Flush();
+        LeoBenchSink(body.size());
+    });
+    LeoBenchSink(sent);
+
+    char label[96];
+    snprintf(label, sizeof(label), "counting pass, %.1f MB placement body", megabytes);
+    LeoBenchReport(label, megabytes * 1e9 / countNs, "MB/s");
+    LeoBenchReport("send pass, 64 KB chunks", megabytes * 1e9 / sendNs, "MB/s");
+    LeoBenchReport("send pass collecting the whole body", megabytes * 1e9 / bufferNs, "MB/s");
+}
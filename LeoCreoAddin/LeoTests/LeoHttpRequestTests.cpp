@@ -0,0 +1,134 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+#include "LeoHttpRequest.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace {
+
+const size_t kMaxRequestSize = 16 * 1024 * 1024;
+
+std::string Wire(const std::string& head, const std::string& body)
+{
+    return head + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Feeds wire to a reader in segments of the given size, as ReadRequest does with each recv()
+bool ReadInSegments(const std::string& wire, size_t segment, HttpRequest& request)
+{
+    HttpRequestReader reader(request, kMaxRequestSize);
+    for (size_t offset = 0; offset < wire.size() && !reader.IsComplete(); offset += segment) {
+        if (!reader.Append(wire.data() + offset, (std::min)(segment, wire.size() - offset))) {
+            return false;
+        }
+    }
+    return reader.Finish();
+}
+
+}
+
+LEO_TEST(HttpRequestReaderSplitsHeadAndBodyAtAnySegmentSize)
+{
+    // Binary body with CR LF pairs of its own, and a blank line that straddles segments
+    const char raw[] = "\x82\xA1k\r\n\r\n\xC0\x00tail";
+    std::string body(raw, sizeof(raw));                 // Trailing NUL included
+    std::string wire = Wire("POST /health HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type:  Application/MsgPack \r\n", body);
+
+    for (size_t segment = 1; segment <= wire.size(); ++segment) {
+        RequestArena arena;
+        HttpRequest request(&arena);
+        LEO_CHECK(ReadInSegments(wire, segment, request));
+        LEO_CHECK(request.Method == _T("POST"));
+        LEO_CHECK(request.Path == _T("/health"));
+        LEO_CHECK(request.Headers[_T("host")] == _T("127.0.0.1"));
+        LEO_CHECK(request.Headers[_T("content-type")] == _T("Application/MsgPack"));
+        LEO_CHECK(std::string(request.RawBody.data(), request.RawBody.size()) == body);
+        LEO_CHECK(IsMsgPackRequest(request));
+    }
+}
+
+LEO_TEST(HttpRequestReaderStopsAtContentLength)
+{
+    RequestArena arena;
+    HttpRequest request(&arena);
+    HttpRequestReader reader(request, kMaxRequestSize);
+    std::string wire = Wire("POST / HTTP/1.1\r\n", "{}");
+
+    LEO_CHECK(reader.Append(wire.data(), wire.size() - 1));
+    LEO_CHECK(!reader.IsComplete());
+    LEO_CHECK(reader.Append(wire.data() + wire.size() - 1, 1));
+    LEO_CHECK(reader.IsComplete());
+    LEO_CHECK(reader.Finish());
+    LEO_CHECK(std::string(request.RawBody.data(), request.RawBody.size()) == "{}");
+    LEO_CHECK(!IsMsgPackRequest(request));
+}
+
+LEO_TEST(HttpRequestReaderPassesTruncatedBodiesOn)
+{
+    // The peer went quiet before Content-Length bytes: the decoders see what arrived
+    RequestArena arena;
+    HttpRequest request(&arena);
+    HttpRequestReader reader(request, kMaxRequestSize);
+    std::string body = "{\"downloadPath\":\"C:\\\\part.prt\"}";
+    std::string wire = Wire("POST / HTTP/1.1\r\n", body);
+    wire.resize(wire.size() - 10);
+
+    LEO_CHECK(reader.Append(wire.data(), wire.size()));
+    LEO_CHECK(!reader.IsComplete());
+    LEO_CHECK(reader.Finish());
+    LEO_CHECK(std::string(request.RawBody.data(), request.RawBody.size()) == body.substr(0, body.size() - 10));
+}
+
+LEO_TEST(HttpRequestReaderRejectsBadHeadsAndOversizedRequests)
+{
+    {
+        RequestArena arena;
+        HttpRequest request(&arena);
+        HttpRequestReader reader(request, kMaxRequestSize);
+        const char wire[] = "GARBAGE\r\n\r\n";
+        LEO_CHECK(!reader.Append(wire, strlen(wire)));
+    }
+    {
+        RequestArena arena;
+        HttpRequest request(&arena);
+        HttpRequestReader reader(request, 64);
+        std::string wire = Wire("POST / HTTP/1.1\r\n", std::string(100, 'x'));
+        LEO_CHECK(!reader.Append(wire.data(), wire.size()));
+    }
+    {
+        // Nothing received at all
+        RequestArena arena;
+        HttpRequest request(&arena);
+        HttpRequestReader reader(request, kMaxRequestSize);
+        LEO_CHECK(!reader.Finish());
+    }
+    {
+        // No blank line: everything is taken as head
+        RequestArena arena;
+        HttpRequest request(&arena);
+        HttpRequestReader reader(request, kMaxRequestSize);
+        const char wire[] = "GET /health HTTP/1.1\r\nHost: leo\r\n";
+        LEO_CHECK(reader.Append(wire, strlen(wire)));
+        LEO_CHECK(reader.Finish());
+        LEO_CHECK(request.Path == _T("/health"));
+        LEO_CHECK(request.Headers[_T("host")] == _T("leo"));
+        LEO_CHECK(request.RawBody.empty());
+    }
+}
+
+LEO_TEST(HttpResponseCountsUtf8Bytes)
+{
+    RequestArena arena;
+    WebServerResponse response;
+    response.StatusCode = 404;
+    response.Body = _T("<p>File not found: C:\\Teile\\Halterung_\x00E4\x4E2D.prt</p>");
+
+    ArenaString bytes((ArenaAllocator<char>(&arena)));
+    CreateHttpResponse(response, bytes);
+    std::string text(bytes.data(), bytes.size());
+
+    std::string body = "<p>File not found: C:\\Teile\\Halterung_\xC3\xA4\xE4\xB8\xAD.prt</p>";
+    LEO_CHECK(text == "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nContent-Length: "
+                      + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+}
@@ -0,0 +1,913 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+#include "LeoJsonIndex.h"
+#include "LeoPayload.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct IndexSnapshot {
+    bool Ok;
+    bool UsedAvx2;
+    std::vector<uint32_t> Positions;
+    std::vector<uint32_t> Matches;
+};
+
+IndexSnapshot BuildIndex(const std::string& json, JsonStructuralIndex::Pass pass)
+{
+    JsonStructuralIndex index;
+    IndexSnapshot snapshot;
+    snapshot.Ok = index.Build(json.data(), json.size(), pass);
+    snapshot.UsedAvx2 = index.UsedAvx2();
+    for (size_t i = 0; i < index.Size(); ++i) {
+        snapshot.Positions.push_back(index.Position(i));
+        if (snapshot.Ok) {
+            snapshot.Matches.push_back(index.Match(i));
+        }
+    }
+    return snapshot;
+}
+
+// True if the AVX2 and scalar passes agree on json; reports the first input that differs
+bool PassesAgree(const std::string& json)
+{
+    IndexSnapshot vector = BuildIndex(json, JsonStructuralIndex::Pass::Auto);
+    IndexSnapshot scalar = BuildIndex(json, JsonStructuralIndex::Pass::Scalar);
+    if (vector.Ok == scalar.Ok && vector.Positions == scalar.Positions && vector.Matches == scalar.Matches) {
+        return true;
+    }
+    printf("    passes differ on %zu bytes: \"%s\"\n", json.size(), json.c_str());
+    return false;
+}
+
+// A placement-style payload of about the given size
+std::string PlacementPayload(size_t bytes)
+{
+    std::string json = "{\"AssemblyRoot\":\"C:\\\\Work\\\\top.asm\",\"ChildrenList\":[";
+    for (int n = 0; json.size() < bytes; ++n) {
+        char child[256];
+        snprintf(child, sizeof(child),
+                 "%s{\"Name\":\"part_%d \\\"rev B\\\"\",\"LocalPath\":\"C:\\\\Parts\\\\part_%d.prt\","
+                 "\"Locations\":[{\"Loc\":{\"X\":%d.5,\"Y\":-1.25,\"Z\":3e2}}]}",
+                 n ? "," : "", n, n, n);
+        json += child;
+    }
+    return json + "]}";
+}
+
+}
+
+LEO_TEST(JsonIndexScalarPositions)
+{
+    // Escaped quotes and structurals inside strings are not structural
+    std::string json = "{\"a\\\"b\":[1,\"x,{y}\"],\"c\\\\\":2}";
+    IndexSnapshot index = BuildIndex(json, JsonStructuralIndex::Pass::Scalar);
+    std::string structurals;
+    for (uint32_t position : index.Positions) {
+        structurals += json[position];
+    }
+    LEO_CHECK(index.Ok);
+    LEO_CHECK(!index.UsedAvx2);
+    LEO_CHECK(structurals == "{\"\":[,\"\"],\"\":}");
+    LEO_CHECK(index.Matches.front() == index.Positions.size() - 1);
+
+    LEO_CHECK(!BuildIndex("{\"open", JsonStructuralIndex::Pass::Scalar).Ok);
+    LEO_CHECK(!BuildIndex("{\"a\":[1}", JsonStructuralIndex::Pass::Scalar).Ok);
+    LEO_CHECK(!BuildIndex("{\"a\\\"}", JsonStructuralIndex::Pass::Scalar).Ok);
+}
+
+LEO_TEST(JsonIndexAvx2MatchesScalarOnBackslashRunsAtBlockEdges)
+{
+    if (!JsonStructuralIndex::IsAvx2Supported()) {
+        printf("    no AVX2 on this CPU; both passes are scalar\n");
+    }
+
+    // A run of backslashes ends right before a quote. Placing the run so it straddles each
+    // 32-byte half and each 64-byte block edge exercises the escape carry between blocks;
+    // an odd run escapes the quote, an even one does not.
+    for (size_t lead = 0; lead < 140; ++lead) {
+        for (size_t run = 1; run <= 70; run += (run < 10 ? 1 : 17)) {
+            std::string json = "{\"k\":\"";
+            json.append(lead, 'x');
+            json.append(run, '\\');
+            json += "\",\"n\":[1,2],\"s\":\"\\\"q\\\"\"}";
+            LEO_CHECK(PassesAgree(json));
+
+            // Same run outside any string, where the passes must still agree on malformed input
+            std::string bare(lead, ' ');
+            bare.append(run, '\\');
+            bare += "\"a\",{}";
+            LEO_CHECK(PassesAgree(bare));
+        }
+    }
+}
+
+LEO_TEST(JsonIndexAvx2MatchesScalarOnFuzzedJson)
+{
+    // Random documents from a small alphabet heavy in backslashes and quotes, so escape runs and
+    // string state keep crossing block boundaries at random offsets
+    static const char alphabet[] = "\\\\\\\"\"{}[]:,ab 1";
+    LeoTestRandom random(27);
+    int failures = 0;
+    for (int round = 0; round < 30000 && failures < 5; ++round) {
+        std::string json(random.Below(300), ' ');
+        for (char& c : json) {
+            c = alphabet[random.Below(sizeof(alphabet) - 1)];
+        }
+        if (!PassesAgree(json)) {
+            ++failures;
+        }
+    }
+    LEO_CHECK(failures == 0);
+
+    // Well-formed payloads of every length around the block sizes, cut at each end
+    std::string payload = PlacementPayload(4096);
+    for (size_t length = 0; length < 300; ++length) {
+        LEO_CHECK(PassesAgree(payload.substr(0, length)));
+        LEO_CHECK(PassesAgree(payload.substr(payload.size() - length)));
+    }
+    LEO_CHECK(PassesAgree(payload));
+    LEO_CHECK(BuildIndex(payload, JsonStructuralIndex::Pass::Auto).Ok);
+}
+
+namespace {
+
+// Reference JSON parser for the differential tests: a plain recursive-descent reading of
+// RFC 8259 that shares no code with the structural index. Documents are objects or arrays,
+// as everything Leo sends.
+struct RefValue {
+    char Kind;                          // '{', '[', '"', 'n' number, 't' true, 'f' false, 'z' null
+    std::string Text;                   // Unescaped string, or the number literal
+    bool Escaped;                       // The string literal contained escapes
+    double Number;
+    std::vector<std::string> Keys;      // Object member names, in document order
+    std::vector<RefValue> Values;       // Object member values or array elements
+
+    RefValue() : Kind(0), Escaped(false), Number(0.0) {}
+
+    bool operator==(const RefValue& other) const
+    {
+        return Kind == other.Kind && Text == other.Text && Number == other.Number &&
+               Keys == other.Keys && Values == other.Values;
+    }
+};
+
+class RefParser {
+public:
+    static bool Parse(const std::string& json, RefValue& root)
+    {
+        RefParser parser(json);
+        parser.SkipWhitespace();
+        if (parser.Peek() != '{' && parser.Peek() != '[') {
+            return false;
+        }
+        if (!parser.ParseValue(root)) {
+            return false;
+        }
+        parser.SkipWhitespace();
+        return parser.m_pos == json.size();
+    }
+
+    // True if text is exactly one JSON number
+    static bool IsNumber(const std::string& text, double& number)
+    {
+        RefParser parser(text);
+        RefValue value;
+        if (!parser.ParseNumber(value) || parser.m_pos != text.size()) {
+            return false;
+        }
+        number = value.Number;
+        return true;
+    }
+
+private:
+    explicit RefParser(const std::string& json) : m_json(json), m_pos(0) {}
+
+    bool AtEnd() const { return m_pos >= m_json.size(); }
+    char Peek() const { return AtEnd() ? '\0' : m_json[m_pos]; }
+    bool IsDigitHere() const { return !AtEnd() && m_json[m_pos] >= '0' && m_json[m_pos] <= '9'; }
+
+    bool Consume(char c)
+    {
+        if (AtEnd() || m_json[m_pos] != c) {
+            return false;
+        }
+        ++m_pos;
+        return true;
+    }
+
+    bool ConsumeWord(const char* word)
+    {
+        size_t length = strlen(word);
+        if (m_json.compare(m_pos, length, word) != 0) {
+            return false;
+        }
+        m_pos += length;
+        return true;
+    }
+
+    void SkipWhitespace()
+    {
+        while (!AtEnd() && (m_json[m_pos] == ' ' || m_json[m_pos] == '\t' || m_json[m_pos] == '\r' || m_json[m_pos] == '\n')) {
+            ++m_pos;
+        }
+    }
+
+    bool ParseValue(RefValue& value)
+    {
+        SkipWhitespace();
+        switch (Peek()) {
+            case '{': return ParseObject(value);
+            case '[': return ParseArray(value);
+            case '"':
+                value.Kind = '"';
+                return ParseString(value.Text, value.Escaped);
+            default:
+                break;
+        }
+        if (ConsumeWord("true")) {
+            value.Kind = 't';
+            return true;
+        }
+        if (ConsumeWord("false")) {
+            value.Kind = 'f';
+            return true;
+        }
+        if (ConsumeWord("null")) {
+            value.Kind = 'z';
+            return true;
+        }
+        return ParseNumber(value);
+    }
+
+    bool ParseObject(RefValue& value)
+    {
+        value.Kind = '{';
+        ++m_pos;
+        SkipWhitespace();
+        if (Consume('}')) {
+            return true;
+        }
+        for (;;) {
+            SkipWhitespace();
+            std::string key;
+            bool escaped = false;
+            if (Peek() != '"' || !ParseString(key, escaped)) {
+                return false;
+            }
+            SkipWhitespace();
+            if (!Consume(':')) {
+                return false;
+            }
+            value.Keys.push_back(key);
+            value.Values.emplace_back();
+            if (!ParseValue(value.Values.back())) {
+                return false;
+            }
+            SkipWhitespace();
+            if (Consume('}')) {
+                return true;
+            }
+            if (!Consume(',')) {
+                return false;
+            }
+        }
+    }
+
+    bool ParseArray(RefValue& value)
+    {
+        value.Kind = '[';
+        ++m_pos;
+        SkipWhitespace();
+        if (Consume(']')) {
+            return true;
+        }
+        for (;;) {
+            value.Values.emplace_back();
+            if (!ParseValue(value.Values.back())) {
+                return false;
+            }
+            SkipWhitespace();
+            if (Consume(']')) {
+                return true;
+            }
+            if (!Consume(',')) {
+                return false;
+            }
+        }
+    }
+
+    bool ParseHex4(uint32_t& unit)
+    {
+        if (m_pos + 4 > m_json.size()) {
+            return false;
+        }
+        char digits[5] = { m_json[m_pos], m_json[m_pos + 1], m_json[m_pos + 2], m_json[m_pos + 3], '\0' };
+        char* end = nullptr;
+        unit = static_cast<uint32_t>(strtoul(digits, &end, 16));
+        if (end != digits + 4 || digits[0] == '+' || digits[0] == '-' || digits[0] == ' ') {
+            return false;
+        }
+        m_pos += 4;
+        return true;
+    }
+
+    // UTF-8, with unpaired surrogates written as three bytes like any other code point
+    static void AppendCodePoint(std::string& out, uint32_t codePoint)
+    {
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    bool ParseString(std::string& out, bool& escaped)
+    {
+        ++m_pos;
+        while (!AtEnd()) {
+            unsigned char c = static_cast<unsigned char>(m_json[m_pos++]);
+            if (c == '"') {
+                return true;
+            }
+            if (c < 0x20) {
+                return false;
+            }
+            if (c != '\\') {
+                out += static_cast<char>(c);
+                continue;
+            }
+            escaped = true;
+            if (AtEnd()) {
+                return false;
+            }
+            switch (m_json[m_pos++]) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t unit = 0;
+                    if (!ParseHex4(unit)) {
+                        return false;
+                    }
+                    // A high surrogate directly followed by an escaped low one is one code point
+                    size_t mark = m_pos;
+                    uint32_t low = 0;
+                    if (unit >= 0xD800 && unit <= 0xDBFF && ConsumeWord("\\u")) {
+                        if (ParseHex4(low) && low >= 0xDC00 && low <= 0xDFFF) {
+                            unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                        } else {
+                            m_pos = mark;
+                        }
+                    }
+                    AppendCodePoint(out, unit);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool ParseNumber(RefValue& value)
+    {
+        size_t start = m_pos;
+        Consume('-');
+        if (!Consume('0')) {
+            if (!IsDigitHere()) {
+                return false;
+            }
+            while (IsDigitHere()) {
+                ++m_pos;
+            }
+        }
+        if (Consume('.')) {
+            if (!IsDigitHere()) {
+                return false;
+            }
+            while (IsDigitHere()) {
+                ++m_pos;
+            }
+        }
+        if (Consume('e') || Consume('E')) {
+            if (!Consume('+')) {
+                Consume('-');
+            }
+            if (!IsDigitHere()) {
+                return false;
+            }
+            while (IsDigitHere()) {
+                ++m_pos;
+            }
+        }
+        value.Kind = 'n';
+        value.Text = m_json.substr(start, m_pos - start);
+        value.Number = strtod(value.Text.c_str(), nullptr);
+        return true;
+    }
+
+    const std::string& m_json;
+    size_t m_pos;
+};
+
+bool ConvertIndexValue(const JsonIndexReader& reader, const JsonValue& value, RefValue& out)
+{
+    ArenaString text;
+    switch (value.Kind) {
+        case '{':
+            out.Kind = '{';
+            return reader.ForEachMember(value, [&](const char* key, size_t keyLength, const JsonValue& member) {
+                JsonValue name;
+                name.Kind = '"';
+                name.Text = key;
+                name.TextLength = keyLength;
+                if (!reader.GetString(name, text)) {
+                    return false;
+                }
+                out.Keys.push_back(std::string(text.data(), text.size()));
+                out.Values.emplace_back();
+                return ConvertIndexValue(reader, member, out.Values.back());
+            });
+        case '[':
+            out.Kind = '[';
+            return reader.ForEachElement(value, [&](const JsonValue& element) {
+                out.Values.emplace_back();
+                return ConvertIndexValue(reader, element, out.Values.back());
+            });
+        case '"':
+            out.Kind = '"';
+            if (!reader.GetString(value, text)) {
+                return false;
+            }
+            out.Text.assign(text.data(), text.size());
+            return true;
+        default: {
+            std::string literal(value.Text, value.TextLength);
+            out.Kind = literal == "true" ? 't' : literal == "false" ? 'f' : literal == "null" ? 'z' : 'n';
+            if (out.Kind != 'n') {
+                return true;
+            }
+            out.Text = literal;
+            return reader.GetDouble(value, out.Number);
+        }
+    }
+}
+
+// Every value of json, decoded through the structural index and JsonIndexReader
+bool DecodeThroughIndex(const std::string& json, RefValue& root)
+{
+    JsonStructuralIndex index;
+    if (!index.Build(json.data(), json.size())) {
+        return false;
+    }
+    JsonIndexReader reader(index);
+    JsonValue value;
+    return reader.IsWellFormed() && reader.Root(value) && ConvertIndexValue(reader, value, root);
+}
+
+std::string AsciiLowered(std::string text)
+{
+    for (char& c : text) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    return text;
+}
+
+// Bare numbers, or quoted ones written out verbatim
+bool RefNumber(const RefValue& value, double& number)
+{
+    if (value.Kind == 'n') {
+        number = value.Number;
+        return true;
+    }
+    return value.Kind == '"' && !value.Escaped && RefParser::IsNumber(value.Text, number);
+}
+
+// FileDownloadInfo from the reference parse, following the rules stated in LeoPayload.h
+bool RefParseFileDownloadInfo(const std::string& json, FileDownloadInfo& info)
+{
+    RefValue root;
+    if (!RefParser::Parse(json, root) || root.Kind != '{') {
+        return false;
+    }
+
+    for (size_t i = 0; i < root.Keys.size(); ++i) {
+        std::string name = AsciiLowered(root.Keys[i]);
+        const RefValue& value = root.Values[i];
+        if (name == "downloadpath" && value.Kind == '"' && !value.Text.empty()) {
+            int length = MultiByteToWideChar(CP_UTF8, 0, value.Text.data(), static_cast<int>(value.Text.size()), NULL, 0);
+            CString path;
+            MultiByteToWideChar(CP_UTF8, 0, value.Text.data(), static_cast<int>(value.Text.size()), path.GetBuffer(length), length);
+            path.ReleaseBuffer(length);
+            info.DownloadPath = path;
+        }
+        if (name != "locationinfo" || value.Kind != '{') {
+            continue;
+        }
+
+        for (size_t j = 0; j < value.Keys.size(); ++j) {
+            std::string member = AsciiLowered(value.Keys[j]);
+            const RefValue& field = value.Values[j];
+            if (member == "loc" && field.Kind == '{') {
+                double coords[3] = { 0.0, 0.0, 0.0 };
+                bool found[3] = { false, false, false };
+                for (size_t k = 0; k < field.Keys.size(); ++k) {
+                    std::string axis = AsciiLowered(field.Keys[k]);
+                    int index = axis == "x" ? 0 : axis == "y" ? 1 : axis == "z" ? 2 : -1;
+                    if (index >= 0) {
+                        double number = 0.0;
+                        found[index] = RefNumber(field.Values[k], number);
+                        if (found[index]) {
+                            coords[index] = number;
+                        }
+                    }
+                }
+                if (found[0] && found[1] && found[2]) {
+                    info.LocationInfo.Loc = Location(coords[0], coords[1], coords[2]);
+                }
+            } else if (member == "orientation") {
+                std::vector<std::vector<double>> matrix(3, std::vector<double>(3, 0.0));
+                bool ok = field.Kind == '[' && field.Values.size() == 3;
+                for (size_t row = 0; ok && row < 3; ++row) {
+                    const RefValue& cells = field.Values[row];
+                    ok = cells.Kind == '[' && cells.Values.size() == 3;
+                    for (size_t column = 0; ok && column < 3; ++column) {
+                        ok = RefNumber(cells.Values[column], matrix[row][column]);
+                    }
+                }
+                info.LocationInfo.Orientation = ok ? matrix : LocationInfo().Orientation;
+            }
+        }
+    }
+    return true;
+}
+
+bool SameFileDownloadInfo(const FileDownloadInfo& a, const FileDownloadInfo& b)
+{
+    return a.DownloadPath == b.DownloadPath && a.LocationInfo.Loc.X == b.LocationInfo.Loc.X &&
+           a.LocationInfo.Loc.Y == b.LocationInfo.Loc.Y && a.LocationInfo.Loc.Z == b.LocationInfo.Loc.Z &&
+           a.LocationInfo.Orientation == b.LocationInfo.Orientation;
+}
+
+// True if JsonIndexReader and ParseFileDownloadInfo accept exactly what the reference accepts
+// and decode the same values; reports the first input that differs
+bool DecodersAgree(const std::string& json)
+{
+    RefValue expected;
+    RefValue actual;
+    bool referenceOk = RefParser::Parse(json, expected);
+    bool indexOk = DecodeThroughIndex(json, actual);
+
+    FileDownloadInfo expectedInfo;
+    FileDownloadInfo actualInfo;
+    RequestArena arena;
+    bool referenceInfoOk = RefParseFileDownloadInfo(json, expectedInfo);
+    bool infoOk = ParseFileDownloadInfo(json.data(), json.size(), actualInfo, &arena);
+
+    if (referenceOk == indexOk && (!referenceOk || expected == actual) &&
+        referenceInfoOk == infoOk && (!referenceInfoOk || SameFileDownloadInfo(expectedInfo, actualInfo))) {
+        return true;
+    }
+    printf("    decoders differ (reference %d/%d, index reader %d, ParseFileDownloadInfo %d) on %zu bytes: \"%s\"\n",
+           referenceOk, referenceInfoOk, indexOk, infoOk, json.size(), json.c_str());
+    return false;
+}
+
+// Random part opening requests, heavy in escapes, odd spellings and values of the wrong shape
+class PayloadGenerator {
+public:
+    explicit PayloadGenerator(uint64_t seed) : m_random(seed) {}
+
+    std::string Document()
+    {
+        std::vector<std::string> members;
+        if (m_random.Below(5)) {
+            members.push_back(Member("downloadPath", m_random.Below(6) ? String() : m_random.Below(2) ? "\"\"" : Value(1)));
+        }
+        if (m_random.Below(5)) {
+            members.push_back(Member("locationInfo", m_random.Below(8) ? LocationInfoValue() : Value(1)));
+        }
+        for (size_t n = m_random.Below(4); n > 0; --n) {
+            members.push_back(Member(m_random.Below(2) ? "loc" : "extra", Value(0)));
+        }
+        return Object(members);
+    }
+
+    std::string Value(int depth)
+    {
+        switch (m_random.Below(depth > 2 ? 3 : 5)) {
+            case 0: return String();
+            case 1: return Number();
+            case 2: {
+                static const char* const literals[] = { "true", "false", "null" };
+                return literals[m_random.Below(3)];
+            }
+            case 3: {
+                std::vector<std::string> members;
+                for (size_t n = m_random.Below(4); n > 0; --n) {
+                    members.push_back(Member("k", Value(depth + 1)));
+                }
+                return Object(members);
+            }
+            default: {
+                std::vector<std::string> elements;
+                for (size_t n = m_random.Below(4); n > 0; --n) {
+                    elements.push_back(Value(depth + 1));
+                }
+                return Array(elements);
+            }
+        }
+    }
+
+private:
+    std::string Space()
+    {
+        static const char* const spaces[] = { "", "", "", " ", "\n  ", "\t", "\r\n" };
+        return spaces[m_random.Below(sizeof(spaces) / sizeof(spaces[0]))];
+    }
+
+    std::string Object(std::vector<std::string> members)
+    {
+        // Shuffled, so known members come in any order
+        for (size_t i = members.size(); i > 1; --i) {
+            std::swap(members[i - 1], members[m_random.Below(i)]);
+        }
+        std::string json = "{" + Space();
+        for (size_t i = 0; i < members.size(); ++i) {
+            json += (i ? "," + Space() : std::string()) + members[i] + Space();
+        }
+        return json + "}";
+    }
+
+    std::string Array(const std::vector<std::string>& elements)
+    {
+        std::string json = "[" + Space();
+        for (size_t i = 0; i < elements.size(); ++i) {
+            json += (i ? "," + Space() : std::string()) + elements[i] + Space();
+        }
+        return json + "]";
+    }
+
+    // The name in random letter case, sometimes with one letter written as a \u escape
+    std::string Member(const char* name, const std::string& value)
+    {
+        std::string key;
+        size_t escapeAt = m_random.Below(6) ? std::string::npos : m_random.Below(strlen(name));
+        for (size_t i = 0; name[i]; ++i) {
+            char c = name[i];
+            if (m_random.Below(3) == 0) {
+                c = (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+            }
+            if (i == escapeAt) {
+                char escape[16];
+                snprintf(escape, sizeof(escape), "\\u%04X", static_cast<unsigned>(static_cast<unsigned char>(c)));
+                key += escape;
+            } else {
+                key += c;
+            }
+        }
+        return "\"" + key + "\"" + Space() + ":" + Space() + value;
+    }
+
+    std::string String()
+    {
+        static const char* const pieces[] = {
+            "C:", "Parts", "part_7.prt", " ", "rev B", "{[:,]}",
+            "\\\"", "\\\\", "\\\\\\\\", "\\/", "\\b", "\\f", "\\n", "\\r", "\\t",
+            "\\u0041", "\\u00e9", "\\u65E5", "\\u0000", "\\ud83d\\ude00", "\\uD800", "\\udc00", "\\ud83d\\u0041",
+            "\xc3\xa9", "\xe6\x97\xa5\xe6\x9c\xac", "\xf0\x9f\x98\x80", "\xff", "\x7f",
+            "1.5", "-2e3"
+        };
+        std::string text = "\"";
+        for (size_t n = m_random.Below(7); n > 0; --n) {
+            text += pieces[m_random.Below(sizeof(pieces) / sizeof(pieces[0]))];
+        }
+        return text + "\"";
+    }
+
+    std::string Number()
+    {
+        static const char* const forms[] = {
+            "0", "-0", "7", "-12", "3.25", "-0.5", "1e3", "2.5E-7", "1E+2", "6.02214076e23", "1e400",
+            "123456789012345678901234567890", "0.000000000000000000000000000000000000000000000000000000000000000000001"
+        };
+        if (m_random.Below(3) == 0) {
+            char number[32];
+            snprintf(number, sizeof(number), "%.17g", (static_cast<double>(m_random.Next() % 2000001) - 1000000.0) / 1024.0);
+            return number;
+        }
+        return forms[m_random.Below(sizeof(forms) / sizeof(forms[0]))];
+    }
+
+    std::string Coordinate()
+    {
+        switch (m_random.Below(10)) {
+            case 0: return "\"" + Number() + "\"";
+            case 1: return Value(1);
+            default: return Number();
+        }
+    }
+
+    std::string LocationInfoValue()
+    {
+        std::vector<std::string> members;
+        if (m_random.Below(6)) {
+            std::vector<std::string> axes;
+            static const char* const names[] = { "x", "y", "z", "x", "w" };
+            for (const char* axis : names) {
+                if (m_random.Below(axis[0] == 'x' && !axes.empty() ? 8 : 1) == 0 || (axis[0] != 'w' && m_random.Below(10))) {
+                    axes.push_back(Member(axis, Coordinate()));
+                }
+            }
+            members.push_back(Member("loc", m_random.Below(10) ? Object(axes) : Value(2)));
+        }
+        if (m_random.Below(6)) {
+            members.push_back(Member("orientation", Orientation()));
+        }
+        if (m_random.Below(4) == 0) {
+            members.push_back(Member("scale", Value(1)));
+        }
+        return Object(members);
+    }
+
+    std::string Orientation()
+    {
+        size_t rows = m_random.Below(4) ? 3 : m_random.Below(5);
+        std::vector<std::string> matrix;
+        for (size_t row = 0; row < rows; ++row) {
+            size_t columns = m_random.Below(6) ? 3 : m_random.Below(5);
+            std::vector<std::string> cells;
+            for (size_t column = 0; column < columns; ++column) {
+                cells.push_back(Coordinate());
+            }
+            matrix.push_back(Array(cells));
+        }
+        return m_random.Below(12) ? Array(matrix) : Value(1);
+    }
+
+    LeoTestRandom m_random;
+};
+
+// One random edit drawn from the characters that matter to a JSON tokenizer
+std::string Mutate(std::string json, LeoTestRandom& random)
+{
+    static const char alphabet[] = "{}[]:,\"\\ tfnu0-.eE+\x01";
+    size_t at = random.Below(json.size() + 1);
+    char c = alphabet[random.Below(sizeof(alphabet) - 1)];
+    switch (random.Below(4)) {
+        case 0:
+            if (at < json.size()) {
+                json.erase(at, 1);
+            }
+            break;
+        case 1:
+            json.insert(at, 1, c);
+            break;
+        case 2:
+            if (at < json.size()) {
+                json[at] = c;
+            }
+            break;
+        default:
+            json.resize(at);
+            break;
+    }
+    return json;
+}
+
+}
+
+LEO_TEST(JsonIndexReaderAgreesWithReferenceParser)
+{
+    static const char* const documents[] = {
+        "{\"downloadPath\":\"C:\\\\Parts\\\\a.prt\"}",
+        "{\"down\\u006coadPath\":\"a.prt\",\"LOCATIONINFO\":{\"Loc\":{\"X\":1,\"y\":-2.5,\"z\":3e2}}}",
+        "{\"DOWNLOADPATH\":\"first\",\"downloadPath\":\"\"}",
+        "{\"locationInfo\":{\"loc\":{\"x\":\"1.5\",\"y\":\"-2\",\"z\":\"3e1\"}}}",
+        "{\"locationInfo\":{\"loc\":{\"x\":\"\\u0031\",\"y\":1,\"z\":1}}}",
+        "{\"locationInfo\":{\"loc\":{\"x\":1,\"y\":2}}}",
+        "{\"locationInfo\":{\"loc\":{\"x\":1,\"y\":2,\"z\":3,\"x\":\"no\"}}}",
+        "{\"locationInfo\":{\"loc\":{\"x\":1234567890123456789012345678901234567890123456789012345678901234567890,\"y\":0,\"z\":0}}}",
+        "{\"locationInfo\":{\"orientation\":[[0,-1,0],[1,0,0],[0,0,1]]}}",
+        "{\"locationInfo\":{\"orientation\":[[0,-1,0],[1,0,0]]}}",
+        "{\"locationInfo\":{\"orientation\":[[0,-1,0],[1,0,0],[0,0,true]]}}",
+        "{\"downloadPath\":\"\\ud83d\\ude00 \\ud83d \\udc00 \\u0000 \\\"q\\\" \\/ \\b\\f\\n\\r\\t\"}",
+        "{\"downloadPath\":\"\xe6\x97\xa5\xe6\x9c\xac \xff\"}",
+        "{\"extra\":{\"a\":[1,{\"b\":[]},[ ],{ }],\"c\":null},\"downloadPath\":\"a\"}",
+        " \r\n\t{ \"downloadPath\" : \"a\" } \n",
+        "{}",
+        "[]",
+        "[1,\"two\",[3],{\"four\":4},true,false,null]",
+    };
+    for (const char* json : documents) {
+        RefValue root;
+        LEO_CHECK(RefParser::Parse(json, root));
+        LEO_CHECK(DecodersAgree(json));
+    }
+
+    // Known members decode through the escapes and mixed case above
+    FileDownloadInfo info;
+    RequestArena arena;
+    LEO_CHECK(ParseFileDownloadInfo(documents[1], strlen(documents[1]), info, &arena));
+    LEO_CHECK(info.DownloadPath == _T("a.prt") && info.LocationInfo.Loc.Y == -2.5 && info.LocationInfo.Loc.Z == 300.0);
+
+    PayloadGenerator generator(2027);
+    int failures = 0;
+    for (int round = 0; round < 20000 && failures < 5; ++round) {
+        std::string json = round % 4 ? generator.Document() : generator.Value(0);
+        if (json[0] != '{' && json[0] != '[') {
+            json = "[" + json + "]";
+        }
+        RefValue root;
+        LEO_CHECK(RefParser::Parse(json, root));
+        if (!DecodersAgree(json)) {
+            ++failures;
+        }
+    }
+    LEO_CHECK(failures == 0);
+}
+
+LEO_TEST(JsonIndexReaderRejectsWhatReferenceRejects)
+{
+    static const char* const documents[] = {
+        "", "  ", "1", "\"a\"", "null", "{", "[}", "{,}", "{]",
+        "{\"downloadPath\":\"a.prt\"} x", "{\"downloadPath\":\"a.prt\"}{}", "{\"downloadPath\":\"a.prt\"},",
+        "{\"downloadPath\":\"a.prt\",}", "{\"downloadPath\" \"a.prt\"}", "{\"downloadPath\"::\"a.prt\"}",
+        "{downloadPath:\"a.prt\"}", "{'downloadPath':'a.prt'}", "{\"downloadPath\":\"a\x01.prt\"}",
+        "{\"downloadPath\":\"a\tb\"}", "{\"downloadPath\":\"a\\x.prt\"}", "{\"downloadPath\":\"\\u12G4\"}",
+        "{\"downloadPath\":\"\\u12\"}", "{\"a\":1,,\"b\":2}", "{\"a\":1 \"b\":2}", "{\"a\"}", "{\"a\":}",
+        "{\"junk\":tru}", "{\"junk\":nul}", "{\"junk\":True}", "{\"junk\":01}", "{\"junk\":1.}", "{\"junk\":.5}",
+        "{\"junk\":+1}", "{\"junk\":-}", "{\"junk\":1e}", "{\"junk\":1e+}", "{\"junk\":NaN}", "{\"junk\":Infinity}",
+        "{\"junk\":1 2}", "{\"junk\":[1,]}", "{\"junk\":[,1]}", "{\"junk\":[1 2]}", "{\"junk\":[\"a\" \"b\"]}",
+        "{\"locationInfo\":{\"loc\":{\"x\":0x10,\"y\":1,\"z\":1}}}", "[1,{\"a\":1]}",
+        "{\"a\":\"\\\"}", "{\"a\":\\\"b\"}", "{\"a\":\"b\"\\}",
+    };
+    for (const char* json : documents) {
+        RefValue root;
+        LEO_CHECK(!RefParser::Parse(json, root));
+        LEO_CHECK(DecodersAgree(json));
+    }
+
+    // Single-character edits of valid requests: truncations, stray separators, broken escapes
+    PayloadGenerator generator(2028);
+    LeoTestRandom random(2029);
+    int failures = 0;
+    int rejected = 0;
+    for (int round = 0; round < 30000 && failures < 5; ++round) {
+        std::string json = Mutate(generator.Document(), random);
+        if (random.Below(3) == 0) {
+            json = Mutate(json, random);
+        }
+        RefValue root;
+        rejected += RefParser::Parse(json, root) ? 0 : 1;
+        if (!DecodersAgree(json)) {
+            ++failures;
+        }
+    }
+    LEO_CHECK(failures == 0);
+    LEO_CHECK(rejected > 10000);
+}
+
+LEO_BENCH(JsonIndexBuild)
+{
+    // Placement lists and batches run from one to ten megabytes
+    static const size_t sizes[] = { 1, 4, 10 };
+    for (size_t megabytes : sizes) {
+        std::string payload = PlacementPayload(megabytes * 1024 * 1024);
+        int iterations = static_cast<int>(50 / megabytes);
+        JsonStructuralIndex index;
+        JsonIndexReader reader(index);
+        double scalarNs = LeoMeasureNs(iterations, [&] { LeoBenchSink(index.Build(payload.data(), payload.size(), JsonStructuralIndex::Pass::Scalar)); });
+        double autoNs = LeoMeasureNs(iterations, [&] { LeoBenchSink(index.Build(payload.data(), payload.size())); });
+        double checkNs = LeoMeasureNs(iterations, [&] { LeoBenchSink(reader.IsWellFormed()); });
+
+        char what[96];
+        snprintf(what, sizeof(what), "scalar pass, %zu MB placement payload", megabytes);
+        LeoBenchReport(what, payload.size() * 1e3 / scalarNs, "MB/s");
+        snprintf(what, sizeof(what), "%s, %zu MB placement payload", index.UsedAvx2() ? "AVX2 pass" : "auto pass (no AVX2)", megabytes);
+        LeoBenchReport(what, payload.size() * 1e3 / autoNs, "MB/s");
+        snprintf(what, sizeof(what), "IsWellFormed, %zu MB placement payload", megabytes);
+        LeoBenchReport(what, payload.size() * 1e3 / checkNs, "MB/s");
+    }
+}
@@ -0,0 +1,264 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+#include "LeoPayloadKeys.h"
+#include "LeoPayload.h"
+#include "LeoResponseParser.h"
+#include "LeoWireFormat.h"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A larger set, as a payload struct with many members would have
+constexpr KeyName kMeasurementKeys[] = {
+    Key("Area"), Key("Perimeter"), Key("Radius"), Key("Diameter"), Key("CenterPoint"), Key("Normal"),
+    Key("IsHole"), Key("SurfaceType"), Key("HoleInfo"), Key("ClickLocation"), Key("ThreadSize"),
+    Key("HoleDiameter"), Key("HoleDepth"), Key("Standard"), Key("ThreadClass"), Key("HoleType"),
+    Key("X"), Key("Y"), Key("Z"), Key("Name"), Key("LocalPath"), Key("Locations"), Key("Orientation"),
+    Key("AssemblyRoot"), Key("UserInstruction"), Key("ChildrenList"), Key("Faces"), Key("Loc")
+};
+constexpr auto kMeasurementTable = MakeKeyTable(kMeasurementKeys);
+
+// Lookup happens in the compiler for constant keys
+static_assert(kMeasurementTable.IsPerfect(), "Key tables must be collision-free");
+static_assert(kCandidateTable.Find("LOCALPATH", 9) == 2, "Find is usable in constant expressions");
+
+// The decoders switch on the enumerators, so each must be its key's index, in the spelling
+// the other side sends
+static_assert(kResponseTable.Find("status", 6) == kStatus && kResponseTable.Find("message", 7) == kMessage &&
+              kResponseTable.Find("candidates", 10) == kCandidates, "ResponseKey order");
+static_assert(kCandidateTable.Find("name", 4) == kName && kCandidateTable.Find("path", 4) == kPath &&
+              kCandidateTable.Find("localPath", 9) == kLocalPath && kCandidateTable.Find("score", 5) == kScore,
+              "CandidateKey order");
+static_assert(kFileDownloadInfoTable.Find("DownloadPath", 12) == kDownloadPath &&
+              kFileDownloadInfoTable.Find("LocationInfo", 12) == kLocationInfo, "FileDownloadInfoKey order");
+static_assert(kLocationInfoTable.Find("Loc", 3) == kLoc && kLocationInfoTable.Find("Orientation", 11) == kOrientation,
+              "LocationInfoKey order");
+static_assert(kLocationTable.Find("X", 1) == kX && kLocationTable.Find("Y", 1) == kY && kLocationTable.Find("Z", 1) == kZ,
+              "LocationKey order");
+
+std::string WithCase(const KeyName& key, int variant)
+{
+    std::string text(key.Text, key.Length);
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        switch (variant) {
+        case 0: break;
+        case 1: text[i] = static_cast<char>(tolower(c)); break;
+        case 2: text[i] = static_cast<char>(toupper(c)); break;
+        default: text[i] = static_cast<char>(i % 2 ? toupper(c) : tolower(c)); break;
+        }
+    }
+    return text;
+}
+
+template <size_t N, size_t Slots>
+void CheckTable(const KeyDispatchTable<N, Slots>& table, const KeyName (&keys)[N])
+{
+    LEO_CHECK(table.IsPerfect());
+    for (size_t i = 0; i < N; ++i) {
+        for (int variant = 0; variant < 4; ++variant) {
+            std::string text = WithCase(keys[i], variant);
+            LEO_CHECK(table.Find(text.data(), text.size()) == static_cast<int>(i));
+        }
+
+        // Near misses: prefix, extension, one character changed
+        std::string key(keys[i].Text, keys[i].Length);
+        LEO_CHECK(table.Find(key.data(), key.size() - 1) == -1);
+        std::string longer = key + "s";
+        LEO_CHECK(table.Find(longer.data(), longer.size()) == -1);
+        for (size_t pos = 0; pos < key.size(); ++pos) {
+            std::string changed = key;
+            changed[pos] = changed[pos] == '_' ? '-' : '_';
+            LEO_CHECK(table.Find(changed.data(), changed.size()) == -1);
+        }
+    }
+    LEO_CHECK(table.Find("", 0) == -1);
+}
+
+template <size_t N, size_t Slots>
+int LinearFind(const KeyDispatchTable<N, Slots>&, const KeyName (&keys)[N], const char* key, size_t length)
+{
+    for (size_t i = 0; i < N; ++i) {
+        if (keys[i].Length == length && KeyEqualsNoCase(keys[i].Text, key, length)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+}
+
+LEO_TEST(KeyDispatchFindsEveryKeyInAnyCase)
+{
+    CheckTable(kResponseTable, kResponseKeys);
+    CheckTable(kCandidateTable, kCandidateKeys);
+    CheckTable(kFileDownloadInfoTable, kFileDownloadInfoKeys);
+    CheckTable(kLocationInfoTable, kLocationInfoKeys);
+    CheckTable(kLocationTable, kLocationKeys);
+    CheckTable(kMeasurementTable, kMeasurementKeys);
+}
+
+LEO_TEST(KeyDispatchRejectsKeysOfOtherTables)
+{
+    LEO_CHECK(kResponseTable.Find("name", 4) == -1);
+    LEO_CHECK(kCandidateTable.Find("status", 6) == -1);
+    LEO_CHECK(kLocationTable.Find("loc", 3) == -1);
+    LEO_CHECK(kLocationInfoTable.Find("x", 1) == -1);
+    LEO_CHECK(kFileDownloadInfoTable.Find("path", 4) == -1);
+
+    // Only ASCII letters fold; "É" (C3 89) and "é" (C3 A9) are different keys
+    constexpr KeyName accented[] = { Key("caf\xC3\xA9") };
+    constexpr auto table = MakeKeyTable(accented);
+    LEO_CHECK(table.Find("CAF\xC3\xA9", 5) == 0);
+    LEO_CHECK(table.Find("CAF\xC3\x89", 5) == -1);
+
+    // Folding is plain ASCII: '@' and '`' sit next to the letters but are not case pairs
+    LEO_CHECK(kLocationTable.Find("@", 1) == -1);
+    LEO_CHECK(kLocationTable.Find("`", 1) == -1);
+}
+
+LEO_TEST(KeyDispatchAgreesWithLinearSearchOnRandomKeys)
+{
+    // Random short keys over letters that occur in the key sets: the table must answer exactly
+    // what a case-insensitive linear search answers
+    static const char letters[] = "aAcCdDeEhHiIlLmMnNoOpPrRsStTuUxXyYzZ_";
+    LeoTestRandom random(29);
+    for (int round = 0; round < 200000; ++round) {
+        char key[16];
+        size_t length = 1 + random.Below(12);
+        for (size_t i = 0; i < length; ++i) {
+            key[i] = letters[random.Below(sizeof(letters) - 1)];
+        }
+        LEO_CHECK(kMeasurementTable.Find(key, length) == LinearFind(kMeasurementTable, kMeasurementKeys, key, length));
+        LEO_CHECK(kCandidateTable.Find(key, length) == LinearFind(kCandidateTable, kCandidateKeys, key, length));
+    }
+    for (size_t i = 0; i < sizeof(kMeasurementKeys) / sizeof(kMeasurementKeys[0]); ++i) {
+        std::string upper = WithCase(kMeasurementKeys[i], 2);
+        LEO_CHECK(kCandidateTable.Find(upper.data(), upper.size()) ==
+                  LinearFind(kCandidateTable, kCandidateKeys, upper.data(), upper.size()));
+    }
+}
+
+LEO_BENCH(KeyDispatchLookup)
+{
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < sizeof(kMeasurementKeys) / sizeof(kMeasurementKeys[0]); ++i) {
+        keys.push_back(WithCase(kMeasurementKeys[i], static_cast<int>(i % 4)));
+        keys.push_back(keys.back() + "x");      // A miss for every hit
+    }
+
+    double tableNs = LeoMeasureNs(20000, [&] {
+        int sum = 0;
+        for (const std::string& key : keys) {
+            sum += kMeasurementTable.Find(key.data(), key.size());
+        }
+        LeoBenchSink(static_cast<uint64_t>(sum));
+    });
+    double linearNs = LeoMeasureNs(20000, [&] {
+        int sum = 0;
+        for (const std::string& key : keys) {
+            sum += LinearFind(kMeasurementTable, kMeasurementKeys, key.data(), key.size());
+        }
+        LeoBenchSink(static_cast<uint64_t>(sum));
+    });
+    LeoBenchReport("perfect hash, 28 keys, half misses", tableNs / keys.size(), "ns/lookup");
+    LeoBenchReport("linear case-insensitive compare", linearNs / keys.size(), "ns/lookup");
+}
+
+LEO_BENCH(KeyDispatchDecodeThroughput)
+{
+    // The same tables end to end: whole payloads decoded, in the spelling each side sends
+    std::string request = "{\"DownloadPath\":\"C:\\\\Users\\\\leo\\\\Downloads\\\\bracket_0042.prt\",\"LocationInfo\":"
+                          "{\"Loc\":{\"X\":12.5,\"Y\":-3.25,\"Z\":140.0},\"Orientation\":[[0,-1,0],[1,0,0],[0,0,1]]}}";
+    MsgPackWriter writer;
+    writer.WriteMapHeader(2);
+    writer.WriteString(std::string("DownloadPath"));
+    writer.WriteString(std::string("C:\\Users\\leo\\Downloads\\bracket_0042.prt"));
+    writer.WriteString(std::string("LocationInfo"));
+    writer.WriteMapHeader(2);
+    writer.WriteString(std::string("Loc"));
+    writer.WriteMapHeader(3);
+    writer.WriteString(std::string("X"));
+    writer.WriteDouble(12.5);
+    writer.WriteString(std::string("Y"));
+    writer.WriteDouble(-3.25);
+    writer.WriteString(std::string("Z"));
+    writer.WriteDouble(140.0);
+    writer.WriteString(std::string("Orientation"));
+    writer.WriteArrayHeader(3);
+    for (int row = 0; row < 3; ++row) {
+        writer.WriteArrayHeader(3);
+        for (int column = 0; column < 3; ++column) {
+            writer.WriteDouble(row == column ? 1.0 : 0.0);
+        }
+    }
+    std::string requestMsgPack = writer.Buffer();
+
+    // A response listing 50 candidates
+    const int candidates = 50;
+    std::string response = "{\"status\":\"ok\",\"candidates\":[";
+    writer.Clear();
+    writer.WriteMapHeader(3);
+    writer.WriteString(std::string("status"));
+    writer.WriteString(std::string("ok"));
+    writer.WriteString(std::string("candidates"));
+    writer.WriteArrayHeader(candidates);
+    for (int n = 0; n < candidates; ++n) {
+        char name[32];
+        char path[64];
+        snprintf(name, sizeof(name), "Bracket %d", n);
+        snprintf(path, sizeof(path), "C:\\Parts\\bracket_%d.prt", n);
+        char candidate[160];
+        snprintf(candidate, sizeof(candidate), "%s{\"name\":\"%s\",\"localPath\":\"C:\\\\Parts\\\\bracket_%d.prt\",\"score\":0.%03d}",
+                 n ? "," : "", name, n, 999 - n);
+        response += candidate;
+        writer.WriteMapHeader(3);
+        writer.WriteString(std::string("name"));
+        writer.WriteString(std::string(name));
+        writer.WriteString(std::string("localPath"));
+        writer.WriteString(std::string(path));
+        writer.WriteString(std::string("score"));
+        writer.WriteDouble((999 - n) / 1000.0);
+    }
+    response += "],\"message\":\"50 candidates\"}";
+    writer.WriteString(std::string("message"));
+    writer.WriteString(std::string("50 candidates"));
+    std::string responseMsgPack = writer.Buffer();
+
+    RequestArena arena;
+    auto decodeRequest = [&](bool msgPack) {
+        return LeoMeasureNs(100000, [&] {
+            arena.Reset();
+            FileDownloadInfo info;
+            LeoBenchSink(msgPack ? ParseFileDownloadInfoMsgPack(requestMsgPack.data(), requestMsgPack.size(), info)
+                                 : ParseFileDownloadInfo(request.data(), request.size(), info, &arena));
+        });
+    };
+    auto decodeResponse = [&](WireFormat format, const std::string& body) {
+        return LeoMeasureNs(5000, [&] {
+            LeoResponseParser parser(format);
+            parser.Feed(body.data(), body.size());
+            LeoResponseData data;
+            LeoBenchSink(parser.Finish(data) ? data.Candidates.size() : 0);
+        });
+    };
+
+    double requestJsonNs = decodeRequest(false);
+    double requestMsgPackNs = decodeRequest(true);
+    double responseJsonNs = decodeResponse(WireFormat::Json, response);
+    double responseMsgPackNs = decodeResponse(WireFormat::MessagePack, responseMsgPack);
+
+    char label[96];
+    snprintf(label, sizeof(label), "part opening request, JSON (%zu B)", request.size());
+    LeoBenchReport(label, requestJsonNs, "ns/request");
+    snprintf(label, sizeof(label), "part opening request, MessagePack (%zu B)", requestMsgPack.size());
+    LeoBenchReport(label, requestMsgPackNs, "ns/request");
+    snprintf(label, sizeof(label), "Leo response, %d candidates, JSON", candidates);
+    LeoBenchReport(label, response.size() * 1e3 / responseJsonNs, "MB/s");
+    snprintf(label, sizeof(label), "Leo response, %d candidates, MessagePack", candidates);
+    LeoBenchReport(label, responseMsgPack.size() * 1e3 / responseMsgPackNs, "MB/s");
+}
@@ -0,0 +1,323 @@
+#include "LeoMockServer.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const size_t MAX_REQUEST_HEAD = 64 * 1024;
+
+static const char* ReasonPhrase(int statusCode)
+{
+    switch (statusCode) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 415: return "Unsupported Media Type";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "Status";
+    }
+}
+
+LeoMockServer::LeoMockServer()
+    : m_stopping(false)
+    , m_listener(-1)
+    , m_port(0)
+    , m_connectionCount(0)
+    , m_requestCount(0)
+{
+    m_default.Served = 0;
+}
+
+LeoMockServer::~LeoMockServer()
+{
+    Stop();
+}
+
+bool LeoMockServer::Start()
+{
+    m_listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listener < 0) {
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if (bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(m_listener, 128) != 0 ||
+        getsockname(m_listener, reinterpret_cast<sockaddr*>(&address), &addressLength) != 0) {
+        close(m_listener);
+        m_listener = -1;
+        return false;
+    }
+    m_port = ntohs(address.sin_port);
+
+    m_stopping = false;
+    m_acceptThread = std::thread(&LeoMockServer::AcceptLoop, this);
+    return true;
+}
+
+void LeoMockServer::Stop()
+{
+    std::vector<std::thread> connections;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        for (int socket : m_sockets) {
+            shutdown(socket, SHUT_RDWR);
+        }
+    }
+    m_stopSignal.notify_all();
+
+    if (m_acceptThread.joinable()) {
+        m_acceptThread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        connections.swap(m_connectionThreads);
+    }
+    for (std::thread& connection : connections) {
+        connection.join();
+    }
+    if (m_listener >= 0) {
+        close(m_listener);
+        m_listener = -1;
+    }
+}
+
+void LeoMockServer::SetResponse(const MockResponse& response)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_default.Response = response;
+    m_default.Served = 0;
+}
+
+void LeoMockServer::SetResponse(const std::string& path, const MockResponse& response)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Route& route = m_routes[path];
+    route.Response = response;
+    route.Served = 0;
+}
+
+int LeoMockServer::GetConnectionCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_connectionCount;
+}
+
+int LeoMockServer::GetRequestCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requestCount;
+}
+
+MockRequest LeoMockServer::GetLastRequest() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastRequest;
+}
+
+void LeoMockServer::AcceptLoop()
+{
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) {
+                return;
+            }
+        }
+
+        // Short polls, so Stop() does not depend on shutdown() waking accept()
+        pollfd entry;
+        entry.fd = m_listener;
+        entry.events = POLLIN;
+        entry.revents = 0;
+        if (poll(&entry, 1, 20) <= 0) {
+            continue;
+        }
+        int socket = accept(m_listener, nullptr, nullptr);
+        if (socket < 0) {
+            continue;
+        }
+        int noDelay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            close(socket);
+            return;
+        }
+        m_sockets.insert(socket);
+        m_connectionCount++;
+        m_connectionThreads.push_back(std::thread(&LeoMockServer::Serve, this, socket));
+    }
+}
+
+void LeoMockServer::Serve(int socket)
+{
+    std::string buffer;
+    MockRequest request;
+    while (ReadRequest(socket, buffer, request)) {
+        MockResponse response;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto found = m_routes.find(request.Path);
+            Route& route = found != m_routes.end() ? found->second : m_default;
+            response = route.Response;
+            if (route.Served++ < response.FailTimes) {
+                response.StatusCode = response.FailStatus;
+                response.Body = "{\"status\":\"error\"}";
+            }
+            m_requestCount++;
+            m_lastRequest = request;
+        }
+        if (!Respond(socket, response)) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sockets.erase(socket);
+    close(socket);
+}
+
+bool LeoMockServer::ReadRequest(int socket, std::string& buffer, MockRequest& request)
+{
+    char chunk[16 * 1024];
+    size_t headEnd;
+    while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (buffer.size() > MAX_REQUEST_HEAD) {
+            return false;
+        }
+        ssize_t received = recv(socket, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(received));
+    }
+
+    size_t lineEnd = buffer.find("\r\n");
+    std::string line = buffer.substr(0, lineEnd);
+    size_t space = line.find(' ');
+    size_t secondSpace = line.find(' ', space + 1);
+    if (space == std::string::npos || secondSpace == std::string::npos) {
+        return false;
+    }
+    request.Method = line.substr(0, space);
+    request.Path = line.substr(space + 1, secondSpace - space - 1);
+    request.Headers = buffer.substr(lineEnd + 2, headEnd - lineEnd - 2);
+
+    size_t contentLength = 0;
+    std::string lowered = request.Headers;
+    std::transform(lowered.begin(), lowered.end(), lowered.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    size_t header = lowered.find("content-length:");
+    if (header != std::string::npos) {
+        contentLength = static_cast<size_t>(strtoull(lowered.c_str() + header + 15, nullptr, 10));
+    }
+
+    buffer.erase(0, headEnd + 4);
+    while (buffer.size() < contentLength) {
+        ssize_t received = recv(socket, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(received));
+    }
+    request.Body = buffer.substr(0, contentLength);
+    buffer.erase(0, contentLength);
+    return true;
+}
+
+bool LeoMockServer::Respond(int socket, const MockResponse& response)
+{
+    if (response.Drop || !Pause(response.LatencyMs)) {
+        return false;
+    }
+
+    char head[256];
+    if (response.Chunked) {
+        snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n\r\n",
+                 response.StatusCode, ReasonPhrase(response.StatusCode), response.ContentType.c_str());
+    } else {
+        // A truncated response still announces the whole length, which is what makes it partial
+        snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                 response.StatusCode, ReasonPhrase(response.StatusCode), response.ContentType.c_str(), response.Body.size());
+    }
+    if (!SendAll(socket, head, strlen(head))) {
+        return false;
+    }
+
+    size_t total = (std::min)(response.Body.size(), response.TruncateAt);
+    size_t slice = response.SliceBytes ? response.SliceBytes : (std::max)(total, static_cast<size_t>(1));
+    for (size_t offset = 0; offset < total; offset += slice) {
+        if (offset > 0 && !Pause(response.SliceDelayMs)) {
+            return false;
+        }
+        size_t length = (std::min)(slice, total - offset);
+        if (response.Chunked) {
+            char size[32];
+            snprintf(size, sizeof(size), "%zx\r\n", length);
+            std::string frame = size + response.Body.substr(offset, length) + "\r\n";
+            if (!SendAll(socket, frame.data(), frame.size())) {
+                return false;
+            }
+        } else if (!SendAll(socket, response.Body.data() + offset, length)) {
+            return false;
+        }
+    }
+
+    if (total < response.Body.size()) {
+        return false;
+    }
+    if (response.Chunked && !SendAll(socket, "0\r\n\r\n", 5)) {
+        return false;
+    }
+    return !response.CloseAfter;
+}
+
+bool LeoMockServer::SendAll(int socket, const char* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(socket, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool LeoMockServer::Pause(int ms)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (ms > 0) {
+        m_stopSignal.wait_for(lock, std::chrono::milliseconds(ms), [this] { return m_stopping; });
+    }
+    return !m_stopping;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How LeoMockServer answers a request; the defaults are a quick 200 with a small JSON body
+struct MockResponse {
+    int StatusCode;
+    std::string ContentType;
+    std::string Body;
+    int LatencyMs;              // Delay before the status line, i.e. Leo's processing time
+    bool Chunked;               // Transfer-Encoding: chunked, one chunk per SliceBytes
+    size_t SliceBytes;          // Body goes out in writes of this size (0: one write)
+    int SliceDelayMs;           // Pause between those writes
+    size_t TruncateAt;          // Partial response: hang up after this many body bytes (npos: send all)
+    bool Drop;                  // Hang up without answering
+    bool CloseAfter;            // Hang up after answering without announcing it, like an idle timeout
+    int FailTimes;              // The first FailTimes requests on the route get FailStatus instead
+    int FailStatus;
+
+    MockResponse()
+        : StatusCode(200), ContentType("application/json"), Body("{\"status\":\"ok\"}")
+        , LatencyMs(0), Chunked(false), SliceBytes(0), SliceDelayMs(0), TruncateAt(std::string::npos)
+        , Drop(false), CloseAfter(false), FailTimes(0), FailStatus(503)
+    {
+    }
+};
+
+struct MockRequest {
+    std::string Method;
+    std::string Path;
+    std::string Headers;        // Raw header lines, "\r\n" separated
+    std::string Body;
+};
+
+// Stand-in for the Leo desktop app on a loopback port, for transport tests and benchmarks.
+// HTTP/1.1 with keep-alive; every connection is served on its own thread. Responses are
+// scripted per path, with latency, error status, slow or chunked bodies, truncated
+// responses and dropped connections on demand.
+class LeoMockServer {
+public:
+    LeoMockServer();
+    ~LeoMockServer();
+
+    bool Start();                       // Listens on 127.0.0.1 on a free port
+    void Stop();                        // Closes the listener and every open connection
+    int GetPort() const { return m_port; }
+
+    void SetResponse(const MockResponse& response);                         // Paths without their own
+    void SetResponse(const std::string& path, const MockResponse& response);
+
+    int GetConnectionCount() const;     // Connections accepted since Start()
+    int GetRequestCount() const;
+    MockRequest GetLastRequest() const;
+
+private:
+    LeoMockServer(const LeoMockServer&) = delete;
+    LeoMockServer& operator=(const LeoMockServer&) = delete;
+
+    struct Route {
+        MockResponse Response;
+        int Served;
+    };
+
+    void AcceptLoop();
+    void Serve(int socket);
+    bool ReadRequest(int socket, std::string& buffer, MockRequest& request);
+    bool Respond(int socket, const MockResponse& response);
+    bool SendAll(int socket, const char* data, size_t length);
+    bool Pause(int ms);                 // False once Stop() was called
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stopSignal;
+    bool m_stopping;
+    int m_listener;
+    int m_port;
+    std::thread m_acceptThread;
+    std::vector<std::thread> m_connectionThreads;
+    std::set<int> m_sockets;            // Open connections, shut down by Stop()
+
+    Route m_default;
+    std::map<std::string, Route> m_routes;
+    int m_connectionCount;
+    int m_requestCount;
+    MockRequest m_lastRequest;
+};
+
+#endif
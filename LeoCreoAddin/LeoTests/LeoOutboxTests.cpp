@@ -0,0 +1,224 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+#include "LeoOutbox.h"
+#include "LeoUiDispatcher.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Journal layout from LeoOutbox.h: a 32-byte header, then 8-byte aligned records of a 24-byte
+// header and a payload (uint32 endpoint length, endpoint, body). With a 2-byte endpoint and a
+// 34-byte body every record is exactly 64 bytes, so record n starts at 32 + 64 * n.
+const size_t JOURNAL_HEADER_BYTES = 32;
+const size_t RECORD_HEADER_BYTES = 24;
+const size_t RECORD_BYTES = 64;
+const wchar_t* const ENDPOINT = L"/x";
+
+std::string Body(int n)
+{
+    char text[40];
+    snprintf(text, sizeof(text), "{\"n\":%04d,\"pad\":\"...............\"}", n);
+    return text;
+}
+
+size_t RecordOffset(size_t n)
+{
+    return JOURNAL_HEADER_BYTES + RECORD_BYTES * n;
+}
+
+// An outbox whose async client is never started: nothing is sent, so every record posted or
+// recovered stays pending and GetPendingCount() reports exactly what the journal holds
+struct OutboxFixture {
+    LeoWebClient Client;
+    LeoUiDispatcher Dispatcher;
+    LeoLivenessProbe Liveness;
+    LeoAsyncClient Async;
+    LeoOutbox Outbox;
+
+    OutboxFixture() : Async(Client, Dispatcher), Outbox(Async, Liveness) {}
+};
+
+CString JournalPath()
+{
+    wchar_t directory[MAX_PATH] = { 0 };
+    GetTempPathW(MAX_PATH, directory);
+    CString path;
+    path.Format(L"%sLeoOutboxTest_%lu.journal", directory, GetCurrentProcessId());
+    return path;
+}
+
+void DeleteJournal(const CString& path)
+{
+    DeleteFileW(path);
+    DeleteFileW(path + L".tmp");
+}
+
+std::vector<char> ReadJournal(const CString& path)
+{
+    std::vector<char> bytes;
+    FILE* file = _wfopen(path, L"rb");
+    if (file) {
+        char buffer[64 * 1024];
+        size_t read = 0;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        }
+        fclose(file);
+    }
+    return bytes;
+}
+
+void WriteJournal(const CString& path, const std::vector<char>& bytes)
+{
+    FILE* file = _wfopen(path, L"wb");
+    if (file) {
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+    }
+}
+
+// Writes a fresh journal with count pending records and returns its bytes
+std::vector<char> BuildJournal(const CString& path, int count)
+{
+    DeleteJournal(path);
+    {
+        OutboxFixture fixture;
+        LEO_CHECK(fixture.Outbox.Open(path));
+        for (int n = 0; n < count; ++n) {
+            LEO_CHECK(fixture.Outbox.Post(ENDPOINT, Body(n)));
+        }
+        LEO_CHECK(fixture.Outbox.GetPendingCount() == static_cast<size_t>(count));
+    }
+    return ReadJournal(path);
+}
+
+// Pending records a crashed session's journal recovers to
+size_t RecoverJournal(const CString& path, const std::vector<char>& bytes)
+{
+    WriteJournal(path, bytes);
+    OutboxFixture fixture;
+    if (!fixture.Outbox.Open(path)) {
+        return static_cast<size_t>(-1);
+    }
+    return fixture.Outbox.GetPendingCount();
+}
+
+}
+
+LEO_TEST(OutboxRecordLayout)
+{
+    // The offsets below are what the other tests tear; they must match what Append writes
+    CString path = JournalPath();
+    std::vector<char> journal = BuildJournal(path, 3);
+    LEO_CHECK(Body(0).size() == 34);
+    LEO_CHECK(journal.size() >= RecordOffset(3));
+    for (size_t n = 0; n < 3 && journal.size() >= RecordOffset(3); ++n) {
+        const char* record = journal.data() + RecordOffset(n);
+        LEO_CHECK(memcmp(record, "LREC", 4) == 0);
+        LEO_CHECK(std::string(record + RECORD_HEADER_BYTES + 6, 34) == Body(static_cast<int>(n)));
+    }
+    LEO_CHECK(journal.size() < RecordOffset(3) + 4 || memcmp(journal.data() + RecordOffset(3), "LREC", 4) != 0);
+    DeleteJournal(path);
+}
+
+LEO_TEST(OutboxRecoversPendingRecordsAcrossSessions)
+{
+    CString path = JournalPath();
+    std::vector<char> journal = BuildJournal(path, 10);
+    LEO_CHECK(RecoverJournal(path, journal) == 10);
+
+    // A second session appends after the recovered records
+    {
+        OutboxFixture fixture;
+        LEO_CHECK(fixture.Outbox.Open(path));
+        LEO_CHECK(fixture.Outbox.Post(ENDPOINT, Body(10)));
+        LEO_CHECK(fixture.Outbox.GetPendingCount() == 11);
+    }
+    LEO_CHECK(RecoverJournal(path, ReadJournal(path)) == 11);
+    DeleteJournal(path);
+}
+
+LEO_TEST(OutboxDropsTornTailAtEveryByte)
+{
+    // A crash while the last record was being written leaves any prefix of it on disk, over
+    // zeros. Recovery keeps the records before it and drops it, whatever the cut.
+    CString path = JournalPath();
+    std::vector<char> journal = BuildJournal(path, 3);
+    size_t torn = RecordOffset(2);
+    for (size_t cut = 0; cut < RECORD_BYTES; ++cut) {
+        std::vector<char> crashed = journal;
+        memset(crashed.data() + torn + cut, 0, RECORD_BYTES - cut);
+        LEO_CHECK(RecoverJournal(path, crashed) == 2);
+    }
+
+    // Everything but the magic in place: Append stores the magic last, so this is the state
+    // just before it, and the record is not there yet
+    std::vector<char> crashed = journal;
+    memset(crashed.data() + torn, 0, 4);
+    LEO_CHECK(RecoverJournal(path, crashed) == 2);
+
+    // A torn record with its magic but a payload that never fully reached the disk
+    for (size_t at = torn + RECORD_HEADER_BYTES; at < torn + RECORD_BYTES; ++at) {
+        crashed = journal;
+        crashed[at] ^= 0x5A;
+        LEO_CHECK(RecoverJournal(path, crashed) == 2);
+    }
+    DeleteJournal(path);
+}
+
+LEO_TEST(OutboxAppendsOverTornTail)
+{
+    // The next message takes the torn record's place; were it appended behind it, the next
+    // recovery would stop at the torn record and lose the new message
+    CString path = JournalPath();
+    std::vector<char> journal = BuildJournal(path, 3);
+    journal[RecordOffset(2) + RECORD_HEADER_BYTES + 10] ^= 0x5A;
+    LEO_CHECK(RecoverJournal(path, journal) == 2);
+    {
+        OutboxFixture fixture;
+        LEO_CHECK(fixture.Outbox.Open(path));
+        LEO_CHECK(fixture.Outbox.GetPendingCount() == 2);
+        LEO_CHECK(fixture.Outbox.Post(ENDPOINT, Body(99)));
+        LEO_CHECK(fixture.Outbox.Post(ENDPOINT, Body(100)));
+    }
+
+    std::vector<char> reopened = ReadJournal(path);
+    LEO_CHECK(RecoverJournal(path, reopened) == 4);
+    LEO_CHECK(reopened.size() >= RecordOffset(4));
+    if (reopened.size() >= RecordOffset(4)) {
+        LEO_CHECK(std::string(reopened.data() + RecordOffset(2) + RECORD_HEADER_BYTES + 6, 34) == Body(99));
+        LEO_CHECK(std::string(reopened.data() + RecordOffset(3) + RECORD_HEADER_BYTES + 6, 34) == Body(100));
+    }
+    DeleteJournal(path);
+}
+
+LEO_TEST(OutboxStopsAtDamageInsideTheJournal)
+{
+    // Damage to record k ends the journal there: later records could be stale or reordered,
+    // and delivery must never skip ahead of a message that was lost
+    CString path = JournalPath();
+    std::vector<char> journal = BuildJournal(path, 8);
+    LeoTestRandom random(38);
+    for (int round = 0; round < 200; ++round) {
+        size_t k = random.Below(8);
+        std::vector<char> damaged = journal;
+        damaged[RecordOffset(k) + RECORD_HEADER_BYTES + random.Below(RECORD_BYTES - RECORD_HEADER_BYTES)] ^=
+            static_cast<char>(1 + random.Below(255));
+        LEO_CHECK(RecoverJournal(path, damaged) == k);
+    }
+
+    // An unreadable header starts an empty journal rather than trusting what follows it
+    std::vector<char> foreign = journal;
+    memcpy(foreign.data(), "JUNK", 4);
+    LEO_CHECK(RecoverJournal(path, foreign) == 0);
+
+    // A Head pointing past the file falls back to the first record
+    std::vector<char> badHead = journal;
+    uint64_t head = static_cast<uint64_t>(journal.size()) * 4;
+    memcpy(badHead.data() + 8, &head, sizeof(head));
+    LEO_CHECK(RecoverJournal(path, badHead) == 8);
+    DeleteJournal(path);
+}
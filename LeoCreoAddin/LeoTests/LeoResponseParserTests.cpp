@@ -0,0 +1,272 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+#include "LeoResponseParser.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// One, two, three and four byte UTF-8 sequences: "A", "é", "€", "🔩"
+const char kMixedUtf8[] = "A caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x94\xA9";
+const wchar_t kMixedWide[] = L"A caf\u00e9 \u20ac \U0001F529";
+
+std::string JsonBody()
+{
+    return std::string("{\"status\":\"ok \xE2\x9C\x93\",\"Candidates\":[") +
+           "{\"name\":\"" + kMixedUtf8 + "\",\"localPath\":\"C:\\\\Teile\\\\M\xC3\xBCller \\\"}{\\\".prt\",\"score\":0.875}," +
+           "{\"Name\":\"\xF0\x9F\x94\xA9\xF0\x9F\x94\xA9\",\"path\":\"D:\\\\\xE2\x82\xAC.prt\",\"score\":-1e-3,\"extra\":[1,{\"x\":\"]\"}]}" +
+           "],\"message\":\"" + kMixedUtf8 + "\"}";
+}
+
+struct ParseOutcome {
+    bool FedOk;
+    bool Finished;
+    LeoResponseData Data;
+    std::vector<CandidatePart> Streamed;
+    CString Text;
+};
+
+bool SameCandidates(const std::vector<CandidatePart>& a, const std::vector<CandidatePart>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].Name != b[i].Name || a[i].Path != b[i].Path || a[i].Score != b[i].Score) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SameOutcome(const ParseOutcome& a, const ParseOutcome& b)
+{
+    return a.FedOk == b.FedOk && a.Finished == b.Finished && a.Data.Status == b.Data.Status &&
+           a.Data.Message == b.Data.Message && SameCandidates(a.Data.Candidates, b.Data.Candidates) &&
+           SameCandidates(a.Streamed, b.Streamed) && a.Text == b.Text;
+}
+
+// Feeds body in the given chunk lengths (the rest in one piece), alternating between Feed and the
+// zero-copy PrepareFeed/CommitFeed path the transports use
+ParseOutcome Parse(const std::string& body, const std::vector<size_t>& cuts, WireFormat format = WireFormat::Json)
+{
+    ResponseBuffer buffer;
+    LeoResponseParser parser(format, &buffer);
+    ParseOutcome outcome;
+    parser.SetCandidateCallback([&outcome](const CandidatePart& candidate) { outcome.Streamed.push_back(candidate); });
+
+    outcome.FedOk = true;
+    size_t pos = 0;
+    for (size_t n = 0; pos < body.size(); ++n) {
+        size_t length = n < cuts.size() ? (std::min)(cuts[n], body.size() - pos) : body.size() - pos;
+        if (n % 2 == 0) {
+            outcome.FedOk = parser.Feed(body.data() + pos, length) && outcome.FedOk;
+        } else {
+            memcpy(parser.PrepareFeed(length + 100), body.data() + pos, length);    // Asks for more than arrives
+            outcome.FedOk = parser.CommitFeed(length) && outcome.FedOk;
+        }
+        pos += length;
+    }
+    outcome.Finished = parser.Finish(outcome.Data);
+    outcome.Text = parser.Bytes().ToText();
+    return outcome;
+}
+
+ParseOutcome ParseWhole(const std::string& body, WireFormat format = WireFormat::Json)
+{
+    return Parse(body, std::vector<size_t>(), format);
+}
+
+std::string MsgPackBody()
+{
+    MsgPackWriter writer;
+    writer.WriteMapHeader(4);
+    writer.WriteString(std::string("status"));
+    writer.WriteString(std::string("ok \xE2\x9C\x93"));
+    writer.WriteString(std::string("unknown"));
+    writer.WriteArrayHeader(2);
+    writer.WriteNil();
+    writer.WriteString(std::string(kMixedUtf8));
+    writer.WriteString(std::string("candidates"));
+    writer.WriteArrayHeader(2);
+    for (int n = 0; n < 2; ++n) {
+        writer.WriteMapHeader(3);
+        writer.WriteString(std::string("name"));
+        writer.WriteString(std::string(kMixedUtf8));
+        writer.WriteString(std::string("localPath"));
+        writer.WriteString(std::string("C:\\Teile\\M\xC3\xBCller.prt"));
+        writer.WriteString(std::string("score"));
+        writer.WriteDouble(0.5 + n);
+    }
+    writer.WriteString(std::string("message"));
+    writer.WriteString(std::string(kMixedUtf8));
+    return writer.Buffer();
+}
+
+}
+
+LEO_TEST(ResponseParserDecodesUtf8Whole)
+{
+    ParseOutcome outcome = ParseWhole(JsonBody());
+    LEO_CHECK(outcome.FedOk && outcome.Finished && outcome.Data.IsValid);
+    LEO_CHECK(outcome.Data.Status == L"ok \u2713");
+    LEO_CHECK(outcome.Data.Message == kMixedWide);
+    LEO_CHECK(outcome.Data.Candidates.size() == 2);
+    if (outcome.Data.Candidates.size() == 2) {
+        LEO_CHECK(outcome.Data.Candidates[0].Name == kMixedWide);
+        LEO_CHECK(outcome.Data.Candidates[0].Path == L"C:\\Teile\\M\u00fcller \"}{\".prt");
+        LEO_CHECK(outcome.Data.Candidates[0].Score == 0.875);
+        LEO_CHECK(outcome.Data.Candidates[1].Name == L"\U0001F529\U0001F529");
+        LEO_CHECK(outcome.Data.Candidates[1].Path == L"D:\\\u20ac.prt");
+        LEO_CHECK(outcome.Data.Candidates[1].Score == -1e-3);
+    }
+    LEO_CHECK(SameCandidates(outcome.Streamed, outcome.Data.Candidates));
+}
+
+LEO_TEST(ResponseParserUtf8SplitAtEveryBoundary)
+{
+    // Two chunks cut at every byte, so every multi-byte sequence, escape and structural
+    // character lands on a chunk boundary once; the result must match the whole-body decode
+    std::string body = JsonBody();
+    ParseOutcome whole = ParseWhole(body);
+    for (size_t cut = 1; cut < body.size(); ++cut) {
+        LEO_CHECK(SameOutcome(Parse(body, std::vector<size_t>(1, cut)), whole));
+    }
+
+    // One byte at a time, and random chunkings
+    LEO_CHECK(SameOutcome(Parse(body, std::vector<size_t>(body.size(), 1)), whole));
+    LeoTestRandom random(37);
+    for (int round = 0; round < 500; ++round) {
+        std::vector<size_t> cuts;
+        for (size_t total = 0; total < body.size();) {
+            cuts.push_back(1 + random.Below(9));
+            total += cuts.back();
+        }
+        LEO_CHECK(SameOutcome(Parse(body, cuts), whole));
+    }
+}
+
+LEO_TEST(ResponseParserMsgPackSplitAtEveryBoundary)
+{
+    std::string body = MsgPackBody();
+    ParseOutcome whole = ParseWhole(body, WireFormat::MessagePack);
+    LEO_CHECK(whole.Finished);
+    LEO_CHECK(whole.Data.Status == L"ok \u2713");
+    LEO_CHECK(whole.Data.Message == kMixedWide);
+    LEO_CHECK(whole.Data.Candidates.size() == 2 && whole.Streamed.size() == 2);
+    if (whole.Data.Candidates.size() == 2) {
+        LEO_CHECK(whole.Data.Candidates[1].Name == kMixedWide);
+        LEO_CHECK(whole.Data.Candidates[1].Path == L"C:\\Teile\\M\u00fcller.prt");
+        LEO_CHECK(whole.Data.Candidates[1].Score == 1.5);
+    }
+    for (size_t cut = 1; cut < body.size(); ++cut) {
+        LEO_CHECK(SameOutcome(Parse(body, std::vector<size_t>(1, cut), WireFormat::MessagePack), whole));
+    }
+}
+
+LEO_TEST(ResponseParserStreamsCandidatesAsTheyClose)
+{
+    std::string body = JsonBody();
+    size_t firstEnd = body.find("0.875}") + 6;
+
+    ResponseBuffer buffer;
+    LeoResponseParser parser(WireFormat::Json, &buffer);
+    int streamed = 0;
+    parser.SetCandidateCallback([&streamed](const CandidatePart&) { ++streamed; });
+
+    LEO_CHECK(parser.Feed(body.data(), firstEnd - 1));
+    LEO_CHECK(streamed == 0);
+    LEO_CHECK(parser.Feed(body.data() + firstEnd - 1, 1));
+    LEO_CHECK(streamed == 1);           // Reported before the rest of the body arrived
+    LEO_CHECK(parser.Feed(body.data() + firstEnd, body.size() - firstEnd));
+    LEO_CHECK(streamed == 2);
+
+    // A root array is the candidate list itself
+    ParseOutcome array = ParseWhole("[{\"name\":\"a\"},{\"name\":\"b\",\"score\":2}]");
+    LEO_CHECK(array.Finished && array.Streamed.size() == 2);
+}
+
+LEO_TEST(ResponseParserMalformedAndInvalidUtf8)
+{
+    LEO_CHECK(!ParseWhole("]").FedOk);
+    LEO_CHECK(!ParseWhole("{\"status\":\"ok\"").Finished);
+    LEO_CHECK(!ParseWhole("{\"status\":\"ok").Finished);
+    LEO_CHECK(!ParseWhole("\x92\xA2ok", WireFormat::MessagePack).Finished);
+
+    // Malformed UTF-8 decodes to U+FFFD the same way whether or not it is split
+    std::string body = "{\"status\":\"a\xC3(b\xE2\x82z\xF0\x9F\x94\xFF\xED\xA0\x80\"}";
+    ParseOutcome whole = ParseWhole(body);
+    LEO_CHECK(whole.Finished);
+    LEO_CHECK(whole.Data.Status.GetLength() > 0);
+    for (size_t cut = 1; cut < body.size(); ++cut) {
+        LEO_CHECK(SameOutcome(Parse(body, std::vector<size_t>(1, cut)), whole));
+    }
+}
+
+LEO_TEST(ResponseBufferGrowthAndRetain)
+{
+    ResponseBuffer buffer;
+    LEO_CHECK(buffer.Empty() && buffer.Capacity() == 0);
+
+    // 5 MB in 1000-byte reads: geometric growth keeps reallocations logarithmic
+    std::string chunk(1000, 'r');
+    for (int n = 0; n < 5000; ++n) {
+        char* dest = buffer.PrepareAppend(16 * 1024);
+        memcpy(dest, chunk.data(), chunk.size());
+        buffer.CommitAppend(chunk.size());
+    }
+    LEO_CHECK(buffer.Size() == 5000 * 1000);
+    LEO_CHECK(buffer.GrowCount() <= 12);
+    LEO_CHECK(buffer.Data()[buffer.Size() - 1] == 'r');
+
+    // Above the retain cap the memory goes back; below it the capacity is kept for the next body
+    buffer.Reset();
+    LEO_CHECK(buffer.Empty() && buffer.Capacity() == 0);
+    buffer.Append(chunk.data(), chunk.size());
+    size_t capacity = buffer.Capacity();
+    size_t grows = buffer.GrowCount();
+    buffer.Reset();
+    LEO_CHECK(buffer.Capacity() == capacity);
+    buffer.Append(chunk.data(), chunk.size());
+    LEO_CHECK(buffer.GrowCount() == grows);
+    buffer.Reset(0);
+    LEO_CHECK(buffer.Capacity() == 0);
+}
+
+LEO_BENCH(ResponseParserThroughput)
+{
+    // 2000 candidates, about 1 MB, arriving in 16 KB reads as WinHttpReadData delivers them
+    std::string body = "{\"status\":\"ok\",\"candidates\":[";
+    for (int n = 0; n < 2000; ++n) {
+        char candidate[512];
+        snprintf(candidate, sizeof(candidate),
+                 "%s{\"name\":\"Bracket %d caf\xC3\xA9 \xE2\x82\xAC\",\"localPath\":\"C:\\\\Parts\\\\bracket_%d_with_a_long_folder_name\\\\"
+                 "M\xC3\xBCller_%d.prt\",\"score\":%d.%03d,\"notes\":\"%s\"}",
+                 n ? "," : "", n, n, n, n % 7, n % 1000, "reviewed in the last design cycle; dimensions checked");
+        body += candidate;
+    }
+    body += "],\"message\":\"2000 candidates\"}";
+
+    ResponseBuffer buffer;
+    double parseNs = LeoMeasureNs(50, [&] {
+        buffer.Reset();
+        LeoResponseParser parser(WireFormat::Json, &buffer);
+        for (size_t pos = 0; pos < body.size(); pos += 16 * 1024) {
+            size_t length = (std::min)(static_cast<size_t>(16 * 1024), body.size() - pos);
+            memcpy(parser.PrepareFeed(length), body.data() + pos, length);
+            parser.CommitFeed(length);
+        }
+        LeoResponseData data;
+        LeoBenchSink(parser.Finish(data) ? data.Candidates.size() : 0);
+    });
+    double textNs = LeoMeasureNs(50, [&] { LeoBenchSink(static_cast<uint64_t>(buffer.ToText().GetLength())); });
+
+    char label[96];
+    snprintf(label, sizeof(label), "stream-parse %.1f MB, 2000 candidates, 16 KB reads", body.size() / 1e6);
+    LeoBenchReport(label, body.size() * 1e3 / parseNs, "MB/s");
+    LeoBenchReport("UTF-8 decode of the whole body (ToText)", body.size() * 1e3 / textNs, "MB/s");
+    LeoBenchReport("buffer reallocations over all runs", static_cast<double>(buffer.GrowCount()), "grows");
+}
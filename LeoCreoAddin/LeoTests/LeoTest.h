@@ -0,0 +1,78 @@
+#pragma once
+
+// Minimal test and benchmark registry for LeoTests.
+//
+//   LEO_TEST(WireFormatRoundTrip) { LEO_CHECK(...); }
+//   LEO_BENCH(WireFormatDecode) { LeoBenchReport("decode", LeoMeasureNs(1000, [&] { ... }), "ns/op"); }
+//
+// A failed LEO_CHECK is reported and the test carries on, so one run shows every broken check.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+typedef void (*LeoTestFunction)();
+
+struct LeoTestRegistrar {
+    LeoTestRegistrar(const char* name, LeoTestFunction function, bool benchmark);
+};
+
+void LeoTestFail(const char* file, int line, const char* expression);
+void LeoBenchReport(const char* what, double value, const char* unit);
+
+#define LEO_TEST(name) \
+    static void name(); \
+    static LeoTestRegistrar name##Registrar(#name, name, false); \
+    static void name()
+
+#define LEO_BENCH(name) \
+    static void name(); \
+    static LeoTestRegistrar name##Registrar(#name, name, true); \
+    static void name()
+
+#define LEO_CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            LeoTestFail(__FILE__, __LINE__, #expr); \
+        } \
+    } while (0)
+
+// Runs body once to warm up, then iterations times; nanoseconds per iteration
+template <typename Body>
+double LeoMeasureNs(int iterations, Body body)
+{
+    body();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        body();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iterations;
+}
+
+// Keeps the optimizer from dropping a result a benchmark only computes
+void LeoBenchSink(uint64_t value);
+
+// Calls to the global operator new so far and the bytes they asked for, from every thread;
+// LeoTests replaces it to count
+uint64_t LeoHeapAllocations();
+uint64_t LeoHeapBytes();
+
+// xorshift64*, so fuzzed inputs are the same on every run and platform
+class LeoTestRandom {
+public:
+    explicit LeoTestRandom(uint64_t seed) : m_state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+    uint64_t Next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 0x2545F4914F6CDD1Dull;
+    }
+
+    size_t Below(size_t bound) { return bound ? static_cast<size_t>(Next() % bound) : 0; }
+
+private:
+    uint64_t m_state;
+};
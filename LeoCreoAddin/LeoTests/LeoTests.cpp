@@ -0,0 +1,142 @@
+// LeoTests: unit tests and benchmarks for the add-in's Leo client modules.
+//
+//   LeoTests                 run every test
+//   LeoTests Arena           run the tests whose name contains "Arena"
+//   LeoTests --bench [name]  run the benchmarks instead
+//
+// Exits with the number of failed tests. On Linux and macOS the Makefile next to this file
+// builds the portable modules (wire formats, JSON index, arena, body stream, response parser,
+// payload codecs, server request framing, POSIX transport against LeoMockServer); the Visual
+// Studio project adds the Windows-only ones.
+
+#include "LeoTest.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct TestCase {
+    const char* Name;
+    LeoTestFunction Function;
+    bool Benchmark;
+};
+
+std::vector<TestCase>& Registry()
+{
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+int g_failedChecks = 0;
+volatile uint64_t g_sink = 0;
+std::atomic<uint64_t> g_heapAllocations(0);
+std::atomic<uint64_t> g_heapBytes(0);
+
+}
+
+// Counting replacements for the global operator new; the array and nothrow forms forward here
+void* operator new(size_t size)
+{
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    g_heapBytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    g_heapBytes.fetch_add(size, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+LeoTestRegistrar::LeoTestRegistrar(const char* name, LeoTestFunction function, bool benchmark)
+{
+    TestCase test = { name, function, benchmark };
+    Registry().push_back(test);
+}
+
+void LeoTestFail(const char* file, int line, const char* expression)
+{
+    const char* name = strrchr(file, '/');
+    const char* windowsName = strrchr(file, '\\');
+    name = windowsName > name ? windowsName : name;
+    printf("    %s:%d: check failed: %s\n", name ? name + 1 : file, line, expression);
+    ++g_failedChecks;
+}
+
+void LeoBenchReport(const char* what, double value, const char* unit)
+{
+    printf("    %-52s %12.1f %s\n", what, value, unit);
+}
+
+void LeoBenchSink(uint64_t value)
+{
+    g_sink = g_sink + value;
+}
+
+uint64_t LeoHeapAllocations()
+{
+    return g_heapAllocations.load(std::memory_order_relaxed);
+}
+
+uint64_t LeoHeapBytes()
+{
+    return g_heapBytes.load(std::memory_order_relaxed);
+}
+
+int main(int argc, char** argv)
+{
+    bool benchmarks = false;
+    const char* filter = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            benchmarks = true;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    int run = 0;
+    int failed = 0;
+    for (const TestCase& test : Registry()) {
+        if (test.Benchmark != benchmarks || (filter && !strstr(test.Name, filter))) {
+            continue;
+        }
+        printf("[ RUN  ] %s\n", test.Name);
+        fflush(stdout);
+        int before = g_failedChecks;
+        test.Function();
+        bool ok = g_failedChecks == before;
+        printf("[ %s ] %s\n", ok ? " OK " : "FAIL", test.Name);
+        fflush(stdout);
+        ++run;
+        failed += ok ? 0 : 1;
+    }
+
+    printf("%d %s run, %d failed\n", run, benchmarks ? "benchmarks" : "tests", failed);
+    return failed;
+}
@@ -0,0 +1,405 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+
+#ifndef _WIN32
+
+#include "LeoMockServer.h"
+#include "LeoPosixTransport.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Collects the response the way LeoWebClient's sink does: straight into reserved room
+class StringSink : public HttpResponseSink {
+public:
+    StringSink() : StatusCode(0) {}
+
+    void OnStatus(int statusCode, const std::string& contentType) override
+    {
+        StatusCode = statusCode;
+        ContentType = contentType;
+        Body.clear();
+    }
+
+    char* PrepareBody(size_t bytes) override
+    {
+        m_room.resize(bytes);
+        return &m_room[0];
+    }
+
+    void CommitBody(size_t bytes) override { Body.append(m_room.data(), bytes); }
+
+    int StatusCode;
+    std::string ContentType;
+    std::string Body;
+
+private:
+    std::string m_room;
+};
+
+struct TransportFixture {
+    LeoMockServer Server;
+    LeoPosixTransport Transport;
+
+    TransportFixture()
+    {
+        Server.Start();
+        Transport.SetTarget("127.0.0.1", Server.GetPort());
+        Transport.SetTimeout(2000);
+    }
+
+    HttpTransportResult Post(const std::string& path, const std::string& body, StringSink& sink,
+                             HttpCancelToken* cancelToken = nullptr)
+    {
+        BodyProducer producer = [&body](ChunkedBodyWriter& out) { out.Write(body.data(), body.size()); };
+        HttpTransportRequest request;
+        request.Path = path;
+        request.Headers = "Content-Type: application/json\r\n";
+        request.Body = &producer;
+        request.CancelToken = cancelToken;
+        return Transport.Execute(request, sink);
+    }
+};
+
+long long ElapsedMs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+}
+
+LEO_TEST(TransportRoundTrip)
+{
+    TransportFixture fixture;
+    MockResponse response;
+    response.Body = "{\"status\":\"ok\",\"message\":\"found\"}";
+    fixture.Server.SetResponse("/receive-data", response);
+
+    StringSink sink;
+    HttpTransportResult result = fixture.Post("/receive-data", "{\"Area\":\"1.0\"}", sink);
+    LEO_CHECK(result.Completed);
+    LEO_CHECK(sink.StatusCode == 200);
+    LEO_CHECK(sink.ContentType == "application/json");
+    LEO_CHECK(sink.Body == response.Body);
+
+    MockRequest request = fixture.Server.GetLastRequest();
+    LEO_CHECK(request.Method == "POST");
+    LEO_CHECK(request.Path == "/receive-data");
+    LEO_CHECK(request.Body == "{\"Area\":\"1.0\"}");
+    LEO_CHECK(request.Headers.find("Content-Length: 14") != std::string::npos);
+}
+
+LEO_TEST(TransportLargeBodiesBothWays)
+{
+    TransportFixture fixture;
+    MockResponse response;
+    response.Body.assign(6 * 1024 * 1024 + 17, 'r');
+    response.SliceBytes = 100 * 1000;
+    fixture.Server.SetResponse(response);
+
+    // Spans several HTTP_BODY_CHUNK_SIZE writes on the way out
+    std::string body(3 * 1024 * 1024 + 5, 'q');
+    StringSink sink;
+    HttpTransportResult result = fixture.Post("/big", body, sink);
+    LEO_CHECK(result.Completed);
+    LEO_CHECK(sink.Body == response.Body);
+    LEO_CHECK(fixture.Server.GetLastRequest().Body == body);
+}
+
+LEO_TEST(TransportKeepsConnectionAlive)
+{
+    TransportFixture fixture;
+    StringSink sink;
+    for (int i = 0; i < 20; ++i) {
+        LEO_CHECK(fixture.Post("/receive-data", "{}", sink).Completed);
+    }
+    LEO_CHECK(fixture.Server.GetRequestCount() == 20);
+    LEO_CHECK(fixture.Server.GetConnectionCount() == 1);
+}
+
+LEO_TEST(TransportReconnectsAfterIdleClose)
+{
+    TransportFixture fixture;
+    MockResponse closing;
+    closing.CloseAfter = true;
+    fixture.Server.SetResponse(closing);
+
+    // The server hangs up after each answer without saying so; the next request finds the
+    // pooled socket dead before any response byte and retries once on a new connection
+    StringSink sink;
+    for (int i = 0; i < 3; ++i) {
+        HttpTransportResult result = fixture.Post("/receive-data", "{}", sink);
+        LEO_CHECK(result.Completed);
+        LEO_CHECK(sink.StatusCode == 200);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    LEO_CHECK(fixture.Server.GetRequestCount() == 3);
+    LEO_CHECK(fixture.Server.GetConnectionCount() == 3);
+}
+
+LEO_TEST(TransportChunkedResponse)
+{
+    TransportFixture fixture;
+    MockResponse response;
+    response.ContentType = "application/msgpack";
+    response.Body = "0123456789abcdefghijklmnopqrstuvwxyz";
+    response.Chunked = true;
+    response.SliceBytes = 7;
+    response.SliceDelayMs = 5;
+    fixture.Server.SetResponse(response);
+
+    StringSink sink;
+    HttpTransportResult result = fixture.Post("/receive-data", "{}", sink);
+    LEO_CHECK(result.Completed);
+    LEO_CHECK(sink.ContentType == "application/msgpack");
+    LEO_CHECK(sink.Body == response.Body);
+
+    // The connection stays usable after the last chunk
+    LEO_CHECK(fixture.Post("/receive-data", "{}", sink).Completed);
+    LEO_CHECK(fixture.Server.GetConnectionCount() == 1);
+}
+
+LEO_TEST(TransportErrorStatusIsACompletedExchange)
+{
+    TransportFixture fixture;
+    MockResponse response;
+    response.FailTimes = 2;
+    response.FailStatus = 503;
+    fixture.Server.SetResponse(response);
+
+    StringSink sink;
+    HttpTransportResult result = fixture.Post("/receive-data", "{}", sink);
+    LEO_CHECK(result.Completed);
+    LEO_CHECK(sink.StatusCode == 503);
+    LEO_CHECK(fixture.Post("/receive-data", "{}", sink).Completed && sink.StatusCode == 503);
+    LEO_CHECK(fixture.Post("/receive-data", "{}", sink).Completed && sink.StatusCode == 200);
+}
+
+LEO_TEST(TransportPartialResponseFails)
+{
+    TransportFixture fixture;
+    MockResponse response;
+    response.Body.assign(1000, 'p');
+    response.TruncateAt = 400;
+    fixture.Server.SetResponse("/partial", response);
+
+    StringSink sink;
+    HttpTransportResult result = fixture.Post("/partial", "{}", sink);
+    LEO_CHECK(!result.Completed);
+    LEO_CHECK(!result.Cancelled);
+    LEO_CHECK(!result.Error.empty());
+    LEO_CHECK(sink.Body.size() == 400);
+
+    // Nothing of the broken exchange leaks into the next one
+    LEO_CHECK(fixture.Post("/receive-data", "{}", sink).Completed);
+    LEO_CHECK(sink.Body == MockResponse().Body);
+}
+
+LEO_TEST(TransportDroppedRequestFails)
+{
+    TransportFixture fixture;
+    MockResponse response;
+    response.Drop = true;
+    fixture.Server.SetResponse(response);
+
+    StringSink sink;
+    HttpTransportResult result = fixture.Post("/receive-data", "{}", sink);
+    LEO_CHECK(!result.Completed);
+    LEO_CHECK(!result.Cancelled);
+}
+
+LEO_TEST(TransportTimesOutOnSlowServer)
+{
+    TransportFixture fixture;
+    fixture.Transport.SetTimeout(200);
+    MockResponse response;
+    response.LatencyMs = 2000;
+    fixture.Server.SetResponse(response);
+
+    StringSink sink;
+    auto start = std::chrono::steady_clock::now();
+    HttpTransportResult result = fixture.Post("/receive-data", "{}", sink);
+    long long elapsed = ElapsedMs(start);
+    LEO_CHECK(!result.Completed);
+    LEO_CHECK(result.Error.find("Timed out") != std::string::npos);
+    LEO_CHECK(elapsed >= 150 && elapsed < 1500);
+}
+
+LEO_TEST(TransportCancelDuringLatency)
+{
+    TransportFixture fixture;
+    MockResponse response;
+    response.LatencyMs = 3000;
+    fixture.Server.SetResponse(response);
+
+    HttpCancelToken token;
+    std::thread canceller([&token] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        token.Cancel();
+    });
+    StringSink sink;
+    auto start = std::chrono::steady_clock::now();
+    HttpTransportResult result = fixture.Post("/receive-data", "{}", sink, &token);
+    long long elapsed = ElapsedMs(start);
+    canceller.join();
+
+    LEO_CHECK(!result.Completed);
+    LEO_CHECK(result.Cancelled);
+    LEO_CHECK(elapsed < 1000);
+}
+
+LEO_TEST(TransportCancelBeforeExecuteSendsNothing)
+{
+    // The cancel lands before the transport has a socket to shut down; it must not be lost
+    TransportFixture fixture;
+    HttpCancelToken token;
+    token.Cancel();
+
+    StringSink sink;
+    HttpTransportResult result = fixture.Post("/receive-data", "{}", sink, &token);
+    LEO_CHECK(!result.Completed);
+    LEO_CHECK(result.Cancelled);
+    LEO_CHECK(fixture.Server.GetRequestCount() == 0);
+    LEO_CHECK(fixture.Server.GetConnectionCount() == 0);
+}
+
+LEO_TEST(TransportCancelAfterExchangeLeavesConnectionAlone)
+{
+    TransportFixture fixture;
+    StringSink sink;
+    HttpCancelToken first;
+    LEO_CHECK(fixture.Post("/receive-data", "{}", sink, &first).Completed);
+
+    // Cancelling a finished request neither shuts the pooled socket nor touches the next request
+    first.Cancel();
+    HttpCancelToken second;
+    HttpTransportResult result = fixture.Post("/receive-data", "{}", sink, &second);
+    LEO_CHECK(result.Completed);
+    LEO_CHECK(!result.Cancelled);
+    LEO_CHECK(fixture.Server.GetConnectionCount() == 1);
+}
+
+LEO_TEST(TransportCancelRaceNeverWaitsForTheServer)
+{
+    // Cancels fired at random points from just before Execute() to well into the exchange:
+    // whatever the timing, the request ends long before the server's 2 s latency is up
+    TransportFixture fixture;
+    fixture.Transport.SetTimeout(5000);
+    MockResponse response;
+    response.LatencyMs = 2000;
+    fixture.Server.SetResponse(response);
+
+    LeoTestRandom random(32);
+    StringSink sink;
+    for (int round = 0; round < 40; ++round) {
+        HttpCancelToken token;
+        int delayUs = static_cast<int>(random.Below(3000));
+        std::thread canceller([&token, delayUs] {
+            std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+            token.Cancel();
+        });
+        auto start = std::chrono::steady_clock::now();
+        HttpTransportResult result = fixture.Post("/receive-data", "{}", sink, &token);
+        long long elapsed = ElapsedMs(start);
+        canceller.join();
+
+        LEO_CHECK(result.Cancelled);
+        LEO_CHECK(elapsed < 1000);
+    }
+}
+
+LEO_TEST(CancelTokenWaitWakesOnCancel)
+{
+    HttpCancelToken token;
+    LEO_CHECK(!token.WaitFor(10));
+
+    std::thread canceller([&token] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        token.Cancel();
+    });
+    auto start = std::chrono::steady_clock::now();
+    LEO_CHECK(token.WaitFor(5000));
+    LEO_CHECK(ElapsedMs(start) < 1000);
+    canceller.join();
+
+    // Stays cancelled; arming afterwards is refused
+    LEO_CHECK(token.IsCancelled());
+    LEO_CHECK(token.WaitFor(5000));
+    LEO_CHECK(!token.Arm([] {}));
+}
+
+LEO_TEST(TransportConnectionRefused)
+{
+    LeoMockServer server;
+    server.Start();
+    int port = server.GetPort();
+    server.Stop();
+
+    LeoPosixTransport transport;
+    transport.SetTarget("127.0.0.1", port);
+    transport.SetTimeout(500);
+    HttpTransportRequest request;
+    request.Path = "/receive-data";
+    StringSink sink;
+    HttpTransportResult result = transport.Execute(request, sink);
+    LEO_CHECK(!result.Completed);
+    LEO_CHECK(result.Error.find("Failed to connect") != std::string::npos);
+}
+
+LEO_BENCH(TransportRequestRate)
+{
+    TransportFixture fixture;
+    StringSink sink;
+    std::string body(512, 'x');
+
+    double smallNs = LeoMeasureNs(2000, [&] { fixture.Post("/receive-data", body, sink); });
+    LeoBenchReport("POST 512 B, 16 B response, kept-alive", smallNs / 1000.0, "us/request");
+
+    MockResponse large;
+    large.Body.assign(4 * 1024 * 1024, 'r');
+    fixture.Server.SetResponse("/large", large);
+    double largeNs = LeoMeasureNs(20, [&] { fixture.Post("/large", body, sink); });
+    LeoBenchReport("4 MB response", largeNs / 1e6, "ms/request");
+    LeoBenchReport("4 MB response throughput", 4.0 * 1e9 / largeNs, "MB/s");
+
+    // Injected latency shows up one for one; the transport adds no waits of its own
+    MockResponse slow;
+    slow.LatencyMs = 5;
+    fixture.Server.SetResponse("/slow", slow);
+    double slowNs = LeoMeasureNs(50, [&] { fixture.Post("/slow", body, sink); });
+    LeoBenchReport("5 ms server latency", slowNs / 1e6, "ms/request");
+}
+
+LEO_BENCH(TransportConnectionReuse)
+{
+    // One face query per iteration, as SendFaceMeasurementData sends it: the pooled connection
+    // against a fresh connect per call, which is what a new session per query used to cost
+    TransportFixture fixture;
+    MockResponse response;
+    response.Body = "{\"status\":\"ok\",\"message\":\"3 candidates\",\"candidates\":[]}";
+    fixture.Server.SetResponse("/receive-data", response);
+    StringSink sink;
+    std::string face = "{\"Area\":\"1234.5678\",\"Perimeter\":\"140.25\",\"Radius\":\"12.5\","
+                       "\"Diameter\":\"25\",\"CenterPoint\":\"(1.0, 2.0, 3.0)\",\"Normal\":\"(0, 0, 1)\","
+                       "\"IsHole\":\"true\",\"SurfaceType\":\"Cylinder\"}";
+
+    const int queries = 2000;
+    double pooledNs = LeoMeasureNs(queries, [&] { fixture.Post("/receive-data", face, sink); });
+    int pooledConnections = fixture.Server.GetConnectionCount();
+
+    double freshNs = LeoMeasureNs(queries, [&] {
+        fixture.Transport.Reset();
+        fixture.Post("/receive-data", face, sink);
+    });
+    int freshConnections = fixture.Server.GetConnectionCount() - pooledConnections;
+
+    LeoBenchReport("face query, pooled keep-alive connection", pooledNs / 1000.0, "us/query");
+    LeoBenchReport("  opened", static_cast<double>(pooledConnections), "connections");
+    LeoBenchReport("face query, new connection per query", freshNs / 1000.0, "us/query");
+    LeoBenchReport("  opened", static_cast<double>(freshConnections), "connections");
+}
+
+#endif
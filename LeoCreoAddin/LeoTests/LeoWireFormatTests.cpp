@@ -0,0 +1,582 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+#include "LeoWireFormat.h"
+#include "LeoBodyStream.h"
+#include "LeoJsonIndex.h"
+#include "LeoPayload.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+LEO_TEST(MsgPackScalarsRoundTrip)
+{
+    const int64_t ints[] = { 0, 1, 127, 128, 255, 256, 65535, 65536, -1, -32, -33, -128, -129,
+                             std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min() };
+    const double doubles[] = { 0.0, -0.0, 1.5, -2.25, 1e-300, 1e300, 0.1 + 0.2,
+                               std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min() };
+
+    MsgPackWriter writer;
+    for (int64_t value : ints) {
+        writer.WriteInt(value);
+    }
+    for (double value : doubles) {
+        writer.WriteDouble(value);
+    }
+    writer.WriteBool(true);
+    writer.WriteBool(false);
+    writer.WriteNil();
+
+    const std::string& bytes = writer.Buffer();
+    MsgPackReader reader(bytes.data(), bytes.size());
+    for (int64_t expected : ints) {
+        int64_t value = 0;
+        LEO_CHECK(reader.PeekType() == MsgPackReader::ValueType::Int);
+        LEO_CHECK(reader.ReadInt(value) && value == expected);
+    }
+    for (double expected : doubles) {
+        double value = 0.0;
+        LEO_CHECK(reader.ReadDouble(value));
+        LEO_CHECK(memcmp(&value, &expected, sizeof(value)) == 0);     // Bit-exact, sign of zero included
+    }
+    bool flag = false;
+    LEO_CHECK(reader.ReadBool(flag) && flag);
+    LEO_CHECK(reader.ReadBool(flag) && !flag);
+    LEO_CHECK(reader.ReadNil());
+    LEO_CHECK(reader.AtEnd());
+}
+
+LEO_TEST(MsgPackStringsAndHeadersAtSizeBoundaries)
+{
+    // Each length sits on either side of a fixstr / str8 / str16 / str32 boundary
+    const size_t lengths[] = { 0, 1, 31, 32, 255, 256, 65535, 65536, 100000 };
+    const uint32_t counts[] = { 0, 1, 15, 16, 65535, 65536, 70000 };
+
+    MsgPackWriter writer;
+    for (size_t length : lengths) {
+        writer.WriteString(std::string(length, static_cast<char>('a' + length % 26)));
+    }
+    for (uint32_t count : counts) {
+        writer.WriteArrayHeader(count);
+        writer.WriteMapHeader(count);
+    }
+    writer.WriteString(std::string("caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x94\xA9"));
+
+    const std::string& bytes = writer.Buffer();
+    MsgPackReader reader(bytes.data(), bytes.size());
+    for (size_t length : lengths) {
+        std::string text;
+        LEO_CHECK(reader.PeekType() == MsgPackReader::ValueType::String);
+        LEO_CHECK(reader.ReadString(text) && text == std::string(length, static_cast<char>('a' + length % 26)));
+    }
+    for (uint32_t expected : counts) {
+        uint32_t count = 0;
+        LEO_CHECK(reader.ReadArrayHeader(count) && count == expected);
+        LEO_CHECK(reader.ReadMapHeader(count) && count == expected);
+    }
+    std::string text;
+    LEO_CHECK(reader.ReadString(text) && text == "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x94\xA9");
+    LEO_CHECK(reader.AtEnd());
+}
+
+LEO_TEST(MsgPackReadsForeignEncodings)
+{
+    // Encodings the writer never produces but Leo may: float32, uint/int of every width, bin
+    const unsigned char bytes[] = {
+        0xCA, 0x3F, 0xC0, 0x00, 0x00,                   // float32 1.5
+        0xCC, 0xFF,                                     // uint8 255
+        0xCD, 0x01, 0x00,                               // uint16 256
+        0xCE, 0x00, 0x01, 0x00, 0x00,                   // uint32 65536
+        0xD0, 0x80,                                     // int8 -128
+        0xD1, 0xFF, 0x00,                               // int16 -256
+        0xD2, 0xFF, 0xFF, 0x00, 0x00,                   // int32 -65536
+        0xC4, 0x03, 1, 2, 3,                            // bin8
+        0x07                                            // positive fixint, read as a double
+    };
+    MsgPackReader reader(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    double d = 0.0;
+    int64_t i = 0;
+    LEO_CHECK(reader.ReadDouble(d) && d == 1.5);
+    LEO_CHECK(reader.ReadInt(i) && i == 255);
+    LEO_CHECK(reader.ReadInt(i) && i == 256);
+    LEO_CHECK(reader.ReadInt(i) && i == 65536);
+    LEO_CHECK(reader.ReadInt(i) && i == -128);
+    LEO_CHECK(reader.ReadInt(i) && i == -256);
+    LEO_CHECK(reader.ReadInt(i) && i == -65536);
+    LEO_CHECK(reader.PeekType() == MsgPackReader::ValueType::Binary);
+    LEO_CHECK(reader.Skip());
+    LEO_CHECK(reader.ReadDouble(d) && d == 7.0);
+    LEO_CHECK(reader.AtEnd());
+}
+
+LEO_TEST(MsgPackMismatchLeavesCursor)
+{
+    MsgPackWriter writer;
+    writer.WriteString(std::string("name"));
+    const std::string& bytes = writer.Buffer();
+    MsgPackReader reader(bytes.data(), bytes.size());
+
+    int64_t i = 0;
+    double d = 0.0;
+    bool b = false;
+    uint32_t count = 0;
+    LEO_CHECK(!reader.ReadInt(i));
+    LEO_CHECK(!reader.ReadDouble(d));
+    LEO_CHECK(!reader.ReadBool(b));
+    LEO_CHECK(!reader.ReadNil());
+    LEO_CHECK(!reader.ReadMapHeader(count));
+    LEO_CHECK(!reader.ReadArrayHeader(count));
+    LEO_CHECK(reader.Position() == 0);
+    std::string text;
+    LEO_CHECK(reader.ReadString(text) && text == "name");
+}
+
+static std::string NestedDocument()
+{
+    MsgPackWriter writer;
+    writer.WriteMapHeader(3);
+    writer.WriteString(std::string("status"));
+    writer.WriteString(std::string("ok"));
+    writer.WriteString(std::string("candidates"));
+    writer.WriteArrayHeader(2);
+    for (int n = 0; n < 2; ++n) {
+        writer.WriteMapHeader(3);
+        writer.WriteString(std::string("name"));
+        writer.WriteString(std::string(40, 'n'));
+        writer.WriteString(std::string("score"));
+        writer.WriteDouble(0.5 + n);
+        writer.WriteString(std::string("tags"));
+        writer.WriteArrayHeader(3);
+        writer.WriteNil();
+        writer.WriteBool(true);
+        writer.WriteInt(-1000);
+    }
+    writer.WriteString(std::string("message"));
+    writer.WriteString(std::string(300, 'm'));
+    return writer.Buffer();
+}
+
+LEO_TEST(MsgPackSkipNestedDocument)
+{
+    std::string document = NestedDocument();
+    document.push_back(static_cast<char>(0xC0));
+
+    MsgPackReader reader(document.data(), document.size());
+    LEO_CHECK(reader.Skip());
+    LEO_CHECK(reader.Position() == document.size() - 1);
+    LEO_CHECK(reader.ReadNil());
+}
+
+LEO_TEST(MsgPackSkipTruncatedRestoresCursor)
+{
+    // Every proper prefix of a valid document is truncated somewhere inside a nested value
+    std::string document = NestedDocument();
+    for (size_t length = 0; length < document.size(); ++length) {
+        MsgPackReader reader(document.data(), length);
+        bool skipped = reader.Skip();
+        LEO_CHECK(!skipped);
+        LEO_CHECK(reader.Position() == 0);
+        if (skipped) {
+            break;
+        }
+    }
+}
+
+LEO_TEST(MsgPackSkipDeepNestingWithoutRecursion)
+{
+    // A million nested one-element arrays used to take one stack frame each
+    const size_t depth = 1000 * 1000;
+    std::string deep(depth, static_cast<char>(0x91));
+    MsgPackReader truncated(deep.data(), deep.size());
+    LEO_CHECK(!truncated.Skip());
+    LEO_CHECK(truncated.Position() == 0);
+
+    deep.push_back(static_cast<char>(0xC0));
+    MsgPackReader complete(deep.data(), deep.size());
+    LEO_CHECK(complete.Skip());
+    LEO_CHECK(complete.AtEnd());
+
+    // Maps nest the same way through their values
+    std::string maps;
+    for (size_t n = 0; n < depth; ++n) {
+        maps += "\x81\xA1k";
+    }
+    maps.push_back(static_cast<char>(0xC0));
+    MsgPackReader mapReader(maps.data(), maps.size());
+    LEO_CHECK(mapReader.Skip());
+    LEO_CHECK(mapReader.AtEnd());
+}
+
+LEO_TEST(MsgPackSkipRejectsHugeCounts)
+{
+    // array32 / map32 headers claiming four billion entries on a few bytes of input fail at once
+    const unsigned char array32[] = { 0xDD, 0xFF, 0xFF, 0xFF, 0xFF, 0xC0, 0xC0 };
+    MsgPackReader arrayReader(reinterpret_cast<const char*>(array32), sizeof(array32));
+    LEO_CHECK(!arrayReader.Skip());
+    LEO_CHECK(arrayReader.Position() == 0);
+
+    const unsigned char map32[] = { 0x91, 0xDF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC0 };
+    MsgPackReader mapReader(reinterpret_cast<const char*>(map32), sizeof(map32));
+    LEO_CHECK(!mapReader.Skip());
+    LEO_CHECK(mapReader.Position() == 0);
+
+    const unsigned char badTag[] = { 0x92, 0xC0, 0xC1 };     // 0xC1 is never used
+    MsgPackReader badReader(reinterpret_cast<const char*>(badTag), sizeof(badTag));
+    LEO_CHECK(!badReader.Skip());
+    LEO_CHECK(badReader.Position() == 0);
+}
+
+LEO_TEST(MsgPackSkipFuzz)
+{
+    // Random bytes: Skip either consumes a prefix or fails with the cursor where it was
+    LeoTestRandom random(26);
+    std::string data;
+    for (int round = 0; round < 20000; ++round) {
+        data.resize(1 + random.Below(64));
+        for (char& c : data) {
+            // Bias towards container and string tags so values nest
+            static const unsigned char tags[] = { 0x91, 0x92, 0x9F, 0x81, 0x8F, 0xDC, 0xDE, 0xA3, 0xD9, 0xC0, 0xC4, 0xCB };
+            c = static_cast<char>(random.Below(3) == 0 ? tags[random.Below(sizeof(tags))] : random.Next());
+        }
+        MsgPackReader reader(data.data(), data.size());
+        if (!reader.Skip()) {
+            LEO_CHECK(reader.Position() == 0);
+        } else {
+            LEO_CHECK(reader.Position() > 0 && reader.Position() <= data.size());
+        }
+    }
+}
+
+LEO_BENCH(MsgPackEncodeDecode)
+{
+    std::string document;
+    double encodeNs = LeoMeasureNs(20000, [&] { document = NestedDocument(); });
+    LeoBenchReport("encode nested document", encodeNs, "ns/op");
+
+    double skipNs = LeoMeasureNs(20000, [&] {
+        MsgPackReader reader(document.data(), document.size());
+        LeoBenchSink(reader.Skip());
+    });
+    LeoBenchReport("skip nested document", skipNs, "ns/op");
+
+    std::string deep(1000 * 1000, static_cast<char>(0x91));
+    deep.push_back(static_cast<char>(0xC0));
+    double deepNs = LeoMeasureNs(20, [&] {
+        MsgPackReader reader(deep.data(), deep.size());
+        LeoBenchSink(reader.Skip());
+    });
+    LeoBenchReport("skip 1M nested arrays", deepNs / 1e6, "ms/op");
+
+    MsgPackWriter writer;
+    for (int n = 0; n < 1000; ++n) {
+        writer.WriteDouble(n * 0.25);
+    }
+    const std::string& doubles = writer.Buffer();
+    double readNs = LeoMeasureNs(2000, [&] {
+        MsgPackReader reader(doubles.data(), doubles.size());
+        double sum = 0.0, value = 0.0;
+        while (reader.ReadDouble(value)) {
+            sum += value;
+        }
+        LeoBenchSink(static_cast<uint64_t>(sum));
+    });
+    LeoBenchReport("read float64", readNs / 1000.0, "ns/value");
+}
+
+// A synthetic assembly upload: full-precision coordinates, arbitrary rotations and names with
+// characters that need escaping or several UTF-8 bytes
+static AssemblyData SyntheticAssembly(size_t children, size_t locationsPerChild, uint64_t seed)
+{
+    LeoTestRandom random(seed);
+    auto coordinate = [&] { return (static_cast<double>(random.Next() % 2000000) - 1000000.0) / 7.0; };
+
+    AssemblyData data;
+    data.AssemblyRoot = _T("C:\\Leo\\Assemblies\\GEARBOX_ASM.asm");
+    data.UserInstruction = _T("Place every fastener \"as designed\"\nKeep the \x00E9\x0107\x4E2D spacing");
+    data.ChildrenList.resize(children);
+    for (size_t i = 0; i < children; ++i) {
+        Child& child = data.ChildrenList[i];
+        wchar_t text[128];
+        swprintf(text, 128, L"BOLT_M%zu_\x00D8%zu.prt", 4 + i % 20, i);
+        child.Name = text;
+        swprintf(text, 128, L"C:\\Leo\\Downloads\\BOLT_M%zu_\x00D8%zu.prt", 4 + i % 20, i);
+        child.LocalPath = text;
+        child.Locations.resize(locationsPerChild);
+        for (LocationWrapper& location : child.Locations) {
+            location.Loc = Location(coordinate(), coordinate(), coordinate());
+            for (auto& row : location.Orientation) {
+                for (double& cell : row) {
+                    cell = coordinate() / 1e5;
+                }
+            }
+        }
+    }
+    return data;
+}
+
+static std::string EncodeAssembly(void (*encode)(ChunkedBodyWriter&, const AssemblyData&), const AssemblyData& data)
+{
+    std::string body;
+    ChunkedBodyWriter writer([&body](const char* chunk, size_t length) {
+        body.append(chunk, length);
+        return true;
+    });
+    encode(writer, data);
+    writer.Flush();
+    return body;
+}
+
+static CString Utf8ToWide(const char* data, size_t length)
+{
+    CString result;
+    int wideLen = MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(length), NULL, 0);
+    if (wideLen > 0) {
+        MultiByteToWideChar(CP_UTF8, 0, data, static_cast<int>(length), result.GetBuffer(wideLen), wideLen);
+        result.ReleaseBuffer(wideLen);
+    }
+    return result;
+}
+
+static bool KeyIs(const char* key, size_t keyLength, const char* expected)
+{
+    return keyLength == strlen(expected) && memcmp(key, expected, keyLength) == 0;
+}
+
+// Decoders for what Leo receives, so both encodings are checked value by value and timed end to end
+
+static bool DecodeAssemblyJson(const std::string& body, RequestArena& arena, AssemblyData& data)
+{
+    JsonStructuralIndex index(&arena);
+    if (!index.Build(body.data(), body.size())) {
+        return false;
+    }
+    JsonIndexReader reader(index);
+    JsonValue root;
+    if (!reader.IsWellFormed() || !reader.Root(root)) {
+        return false;
+    }
+
+    ArenaString text((ArenaAllocator<char>(&arena)));
+    auto getString = [&](const JsonValue& value, CString& out) {
+        text.clear();
+        if (!reader.GetString(value, text)) {
+            return false;
+        }
+        out = Utf8ToWide(text.data(), text.size());
+        return true;
+    };
+    auto getMatrix = [&](const JsonValue& value, std::vector<std::vector<double>>& matrix) {
+        size_t row = 0;
+        return reader.ForEachElement(value, [&](const JsonValue& rowValue) {
+            if (row >= matrix.size()) {
+                return false;
+            }
+            size_t column = 0;
+            bool ok = reader.ForEachElement(rowValue, [&](const JsonValue& cell) {
+                return column < matrix[row].size() && reader.GetDouble(cell, matrix[row][column++]);
+            });
+            row++;
+            return ok;
+        });
+    };
+
+    return reader.ForEachMember(root, [&](const char* key, size_t keyLength, const JsonValue& value) {
+        if (KeyIs(key, keyLength, "AssemblyRoot")) {
+            return getString(value, data.AssemblyRoot);
+        }
+        if (KeyIs(key, keyLength, "UserInstruction")) {
+            return getString(value, data.UserInstruction);
+        }
+        return KeyIs(key, keyLength, "ChildrenList") && reader.ForEachElement(value, [&](const JsonValue& childValue) {
+            data.ChildrenList.emplace_back();
+            Child& child = data.ChildrenList.back();
+            return reader.ForEachMember(childValue, [&](const char* childKey, size_t childKeyLength, const JsonValue& member) {
+                if (KeyIs(childKey, childKeyLength, "Name")) {
+                    return getString(member, child.Name);
+                }
+                if (KeyIs(childKey, childKeyLength, "LocalPath")) {
+                    return getString(member, child.LocalPath);
+                }
+                return KeyIs(childKey, childKeyLength, "Locations") && reader.ForEachElement(member, [&](const JsonValue& locationValue) {
+                    child.Locations.emplace_back();
+                    LocationWrapper& location = child.Locations.back();
+                    return reader.ForEachMember(locationValue, [&](const char* locationKey, size_t locationKeyLength, const JsonValue& field) {
+                        if (KeyIs(locationKey, locationKeyLength, "Orientation")) {
+                            return getMatrix(field, location.Orientation);
+                        }
+                        double* axes[3] = { &location.Loc.X, &location.Loc.Y, &location.Loc.Z };
+                        int axis = 0;
+                        return KeyIs(locationKey, locationKeyLength, "Loc") && reader.ForEachMember(field, [&](const char*, size_t, const JsonValue& coordinate) {
+                            return axis < 3 && reader.GetDouble(coordinate, *axes[axis++]);
+                        });
+                    });
+                });
+            });
+        });
+    });
+}
+
+static bool ReadMsgPackCString(MsgPackReader& reader, CString& out)
+{
+    const char* str = nullptr;
+    uint32_t length = 0;
+    if (!reader.ReadString(str, length)) {
+        return false;
+    }
+    out = Utf8ToWide(str, length);
+    return true;
+}
+
+// Expects the member order WriteAssemblyDataMsgPack produces
+static bool ExpectMsgPackKey(MsgPackReader& reader, const char* expected)
+{
+    const char* key = nullptr;
+    uint32_t keyLength = 0;
+    return reader.ReadString(key, keyLength) && KeyIs(key, keyLength, expected);
+}
+
+static bool DecodeAssemblyMsgPack(const std::string& body, AssemblyData& data)
+{
+    MsgPackReader reader(body.data(), body.size());
+    uint32_t count = 0, children = 0;
+    if (!reader.ReadMapHeader(count) || count != 3
+        || !ExpectMsgPackKey(reader, "AssemblyRoot") || !ReadMsgPackCString(reader, data.AssemblyRoot)
+        || !ExpectMsgPackKey(reader, "UserInstruction") || !ReadMsgPackCString(reader, data.UserInstruction)
+        || !ExpectMsgPackKey(reader, "ChildrenList") || !reader.ReadArrayHeader(children)) {
+        return false;
+    }
+
+    data.ChildrenList.resize(children);
+    for (Child& child : data.ChildrenList) {
+        uint32_t locations = 0;
+        if (!reader.ReadMapHeader(count) || count != 3
+            || !ExpectMsgPackKey(reader, "Name") || !ReadMsgPackCString(reader, child.Name)
+            || !ExpectMsgPackKey(reader, "LocalPath") || !ReadMsgPackCString(reader, child.LocalPath)
+            || !ExpectMsgPackKey(reader, "Locations") || !reader.ReadArrayHeader(locations)) {
+            return false;
+        }
+
+        child.Locations.resize(locations);
+        for (LocationWrapper& location : child.Locations) {
+            uint32_t rows = 0;
+            if (!reader.ReadMapHeader(count) || count != 2 || !ExpectMsgPackKey(reader, "Loc")
+                || !reader.ReadMapHeader(count) || count != 3
+                || !ExpectMsgPackKey(reader, "x") || !reader.ReadDouble(location.Loc.X)
+                || !ExpectMsgPackKey(reader, "y") || !reader.ReadDouble(location.Loc.Y)
+                || !ExpectMsgPackKey(reader, "z") || !reader.ReadDouble(location.Loc.Z)
+                || !ExpectMsgPackKey(reader, "Orientation") || !reader.ReadArrayHeader(rows) || rows != 3) {
+                return false;
+            }
+            for (auto& row : location.Orientation) {
+                uint32_t columns = 0;
+                if (!reader.ReadArrayHeader(columns) || columns != 3) {
+                    return false;
+                }
+                for (double& cell : row) {
+                    if (!reader.ReadDouble(cell)) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return reader.AtEnd();
+}
+
+static bool SameAssembly(const AssemblyData& a, const AssemblyData& b)
+{
+    if (a.AssemblyRoot != b.AssemblyRoot || a.UserInstruction != b.UserInstruction
+        || a.ChildrenList.size() != b.ChildrenList.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.ChildrenList.size(); ++i) {
+        const Child& x = a.ChildrenList[i];
+        const Child& y = b.ChildrenList[i];
+        if (x.Name != y.Name || x.LocalPath != y.LocalPath || x.Locations.size() != y.Locations.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < x.Locations.size(); ++j) {
+            // Bit-exact: both encodings must round-trip every double
+            const LocationWrapper& p = x.Locations[j];
+            const LocationWrapper& q = y.Locations[j];
+            if (memcmp(&p.Loc, &q.Loc, sizeof(p.Loc)) != 0) {
+                return false;
+            }
+            for (size_t r = 0; r < 3; ++r) {
+                if (memcmp(p.Orientation[r].data(), q.Orientation[r].data(), 3 * sizeof(double)) != 0) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+LEO_TEST(AssemblyPayloadRoundTripsInBothEncodings)
+{
+    const size_t shapes[][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 7, 3 }, { 200, 2 } };
+    for (const auto& shape : shapes) {
+        AssemblyData data = SyntheticAssembly(shape[0], shape[1], 26 + shape[0]);
+
+        RequestArena arena;
+        AssemblyData fromJson;
+        LEO_CHECK(DecodeAssemblyJson(EncodeAssembly(WriteAssemblyDataJson, data), arena, fromJson));
+        LEO_CHECK(SameAssembly(data, fromJson));
+
+        AssemblyData fromMsgPack;
+        std::string msgpack = EncodeAssembly(WriteAssemblyDataMsgPack, data);
+        LEO_CHECK(DecodeAssemblyMsgPack(msgpack, fromMsgPack));
+        LEO_CHECK(SameAssembly(data, fromMsgPack));
+
+        MsgPackReader skipper(msgpack.data(), msgpack.size());
+        LEO_CHECK(skipper.Skip() && skipper.AtEnd());
+    }
+}
+
+LEO_BENCH(AssemblyPayloadJsonVsMsgPack)
+{
+    // The largest upload the add-in makes: MAX_ASSEMBLY_COMPONENTS children, a few placements each
+    const size_t children = 1000, locationsPerChild = 4;
+    AssemblyData data = SyntheticAssembly(children, locationsPerChild, 26);
+    const double values = static_cast<double>(children * locationsPerChild);
+
+    std::string json = EncodeAssembly(WriteAssemblyDataJson, data);
+    std::string msgpack = EncodeAssembly(WriteAssemblyDataMsgPack, data);
+    LeoBenchReport("JSON size", json.size() / 1024.0, "KB");
+    LeoBenchReport("MsgPack size", msgpack.size() / 1024.0, "KB");
+    LeoBenchReport("MsgPack / JSON size", 100.0 * msgpack.size() / json.size(), "%");
+
+    // Encoding into a counting writer, as Content-Length is measured before the upload
+    double jsonEncodeNs = LeoMeasureNs(20, [&] {
+        ChunkedBodyWriter counter(nullptr);
+        WriteAssemblyDataJson(counter, data);
+        LeoBenchSink(counter.BytesWritten());
+    });
+    double msgpackEncodeNs = LeoMeasureNs(20, [&] {
+        ChunkedBodyWriter counter(nullptr);
+        WriteAssemblyDataMsgPack(counter, data);
+        LeoBenchSink(counter.BytesWritten());
+    });
+    LeoBenchReport("JSON encode", jsonEncodeNs / 1e6, "ms/op");
+    LeoBenchReport("MsgPack encode", msgpackEncodeNs / 1e6, "ms/op");
+    LeoBenchReport("JSON encode", jsonEncodeNs / values, "ns/location");
+    LeoBenchReport("MsgPack encode", msgpackEncodeNs / values, "ns/location");
+
+    // Decoding every value back into an AssemblyData
+    RequestArena arena;
+    double jsonDecodeNs = LeoMeasureNs(20, [&] {
+        AssemblyData decoded;
+        LeoBenchSink(DecodeAssemblyJson(json, arena, decoded));
+        arena.Reset();
+    });
+    double msgpackDecodeNs = LeoMeasureNs(20, [&] {
+        AssemblyData decoded;
+        LeoBenchSink(DecodeAssemblyMsgPack(msgpack, decoded));
+    });
+    LeoBenchReport("JSON decode", jsonDecodeNs / 1e6, "ms/op");
+    LeoBenchReport("MsgPack decode", msgpackDecodeNs / 1e6, "ms/op");
+    LeoBenchReport("JSON decode", json.size() * 1e3 / jsonDecodeNs, "MB/s");
+    LeoBenchReport("MsgPack decode", msgpack.size() * 1e3 / msgpackDecodeNs, "MB/s");
+}
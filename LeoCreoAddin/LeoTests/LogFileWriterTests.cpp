@@ -0,0 +1,314 @@
+#include "stdafx.h"
+#include "LeoTest.h"
+#include "LogFileWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int LINES_PER_BATCH = 256;        // A quarter of a thread's ring, so no timed line waits for room
+const char* const TYPICAL_LINE = "SUCCESS: ProMdlnameRetrieve - Model handle retrieved for part bracket_left_rev_b.prt";
+
+std::wstring TestDirectory()
+{
+    wchar_t directory[MAX_PATH] = { 0 };
+    GetTempPathW(MAX_PATH, directory);
+    std::wstring path = std::wstring(directory) + L"LeoTestsLog";
+    CreateDirectoryW(path.c_str(), NULL);
+    return path;
+}
+
+// Sends the log to its own file in the temp folder, with no rotation to split it
+std::wstring UseTestLog(const wchar_t* name)
+{
+    LogFileOptions options;
+    options.Directory = TestDirectory();
+    options.FileName = name;
+    options.RotateBytes = 0;
+    options.RotateHours = 0;
+    std::wstring path = options.Directory + L"\\" + name;
+    DeleteFileW(path.c_str());
+    LogFileWriter::Configure(options);
+    return path;
+}
+
+std::string ReadFile(const std::wstring& path)
+{
+    std::string text;
+    FILE* file = _wfopen(path.c_str(), L"rb");
+    if (file) {
+        char buffer[64 * 1024];
+        size_t read = 0;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            text.append(buffer, read);
+        }
+        fclose(file);
+    }
+    return text;
+}
+
+// WriteLog as it was before the ring buffer: open, stamp, write and close the file on every line
+void SynchronousWriteLog(const std::wstring& path, const char* line)
+{
+    FILE* file = _wfopen(path.c_str(), L"a");
+    if (file) {
+        time_t now;
+        time(&now);
+        char timeText[26];
+        strncpy(timeText, ctime(&now), 24);
+        timeText[24] = '\0';
+        fprintf(file, "[%s] %s\n\n", timeText, line);
+        fclose(file);
+    }
+}
+
+// The statements a successful OpenFileInCreo logs when it places a part in an assembly,
+// followed by ApplyLocationAndOrientation's, in the same order and with the same arguments
+void LogPartPlacement(int n)
+{
+    CString message;
+    LogFileWriter::WriteLog("=== Opening File in Creo ===");
+    message.Format(_T("Processing file: %s"), _T("C:\\Users\\designer\\Downloads\\Leo\\bracket_left_rev_b.prt"));
+    LogFileWriter::WriteLog((const char*)CT2A(message));
+    message.Format(_T("File type: %d, Model type: %d, Subtype: %d"), 1, 2, n);
+    LogFileWriter::WriteLog((const char*)CT2A(message));
+    message.Format(_T("Model name: %s"), _T("bracket_left_rev_b"));
+    LogFileWriter::WriteLog((const char*)CT2A(message));
+    LogFileWriter::WriteLog("Opening file in CURRENT SESSION...");
+    LogFileWriter::WriteLog("Changing to file directory...");
+    LogFileWriter::WriteLog("Directory changed successfully");
+    LogFileWriter::WriteLog("Loading model by name...");
+    LogFileWriter::WriteLog("SUCCESS: ProMdlnameRetrieve - Model handle retrieved");
+    LogFileWriter::WriteLog("SUCCESS: Current assembly found - Adding component to assembly");
+    LogFileWriter::WriteLog("SUCCESS: Using provided orientation matrix from JSON");
+    LEO_DEBUG(Geometry, "SUCCESS: Transformation matrix created - Location: [%.3f, %.3f, %.3f], Orientation: [%.3f,%.3f,%.3f; %.3f,%.3f,%.3f; %.3f,%.3f,%.3f]",
+        12.5, -40.25, 300.0, 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0);
+    LogFileWriter::WriteLog("SUCCESS: ProAsmcompAssemble - Component added to assembly");
+    LogFileWriter::WriteLog("SUCCESS: ProAsmcompRegenerate - Assembly regenerated");
+    LogFileWriter::WriteLog("SUCCESS: ProWindowRepaint - Model tree refreshed");
+    LogFileWriter::WriteLog("SUCCESS: ProTreetoolRefresh - Model tree refreshed");
+    LogFileWriter::WriteLog("SUCCESS: ProMdlDisplay - Assembly display refreshed");
+    LogFileWriter::WriteLog("SUCCESS: ProWindowActivate - Window brought to front");
+    LogFileWriter::WriteLog("SUCCESS: ProWindowRepaint - Additional window refresh");
+    LogFileWriter::WriteLog("SUCCESS: Final ProWindowRepaint - Complete refresh done");
+    LogFileWriter::WriteLog("SUCCESS: Component added with enhanced refresh - Should be immediately visible");
+
+    LEO_DEBUG(Geometry, "=== Applying Location and Orientation ===");
+    LEO_DEBUG(Geometry, _T("Location: X=%.6f, Y=%.6f, Z=%.6f"), 12.5, -40.25, 300.0);
+    LEO_TRACE(Geometry, "Orientation Matrix:");
+    for (int i = 0; i < 3; i++) {
+        LEO_TRACE(Geometry, _T("  [%.6f, %.6f, %.6f]"), i == 0 ? 1.0 : 0.0, i == 1 ? 1.0 : 0.0, i == 2 ? 1.0 : 0.0);
+    }
+    LEO_DEBUG(Geometry, "Current model is an assembly - position could be applied as component placement");
+    LEO_DEBUG(Geometry, "Location and orientation information processed successfully");
+    LEO_TRACE(Geometry, "IMPLEMENTATION NOTES:");
+    LEO_TRACE(Geometry, "- File opened and displayed in Creo successfully");
+    LEO_TRACE(Geometry, "- Location and orientation data captured and validated");
+    LEO_TRACE(Geometry, "- For component placement in assemblies, additional implementation needed:");
+    LEO_TRACE(Geometry, "  * Use ProAsmcompMdlnameCreateCopy to add as assembly component");
+    LEO_TRACE(Geometry, "  * Use constraint-based placement system for precise positioning");
+    LEO_TRACE(Geometry, "  * Apply transformation matrix from orientation data");
+    LEO_TRACE(Geometry, "=====================================");
+}
+
+// Nanoseconds per line: batches of LINES_PER_BATCH calls, with the writer drained between
+// batches outside the timing, so this is the caller's cost and not the disk's
+template <typename Body>
+double PerLineNs(int batches, Body body)
+{
+    double totalNs = 0;
+    for (int batch = 0; batch < batches; ++batch) {
+        LogFileWriter::Flush();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < LINES_PER_BATCH; ++i) {
+            body(i);
+        }
+        totalNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    LogFileWriter::Flush();
+    return totalNs / (static_cast<double>(batches) * LINES_PER_BATCH);
+}
+
+// Messages of a text log, without the time stamp and thread id in front of each
+std::vector<std::string> LoggedMessages(const std::string& text)
+{
+    std::vector<std::string> messages;
+    for (size_t at = 0, end = 0; (end = text.find("\n\n", at)) != std::string::npos; at = end + 2) {
+        size_t stamp = text.find("] [", at);
+        size_t thread = stamp < end ? text.find("] ", stamp + 3) : std::string::npos;
+        messages.push_back(thread < end ? text.substr(thread + 2, end - thread - 2) : text.substr(at, end - at));
+    }
+    return messages;
+}
+
+double Median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0.0 : values[values.size() / 2];
+}
+
+}
+
+LEO_TEST(LogWriterKeepsEveryLineIntactAndInThreadOrder)
+{
+    // Lines from several threads at once, some spanning many slots. Every line is either in the
+    // file whole and after the previous line of its thread, or counted as dropped.
+    std::wstring path = UseTestLog(L"LeoTestsOrder.log");
+    const int threads = 4;
+    const int lines = 5000;
+    long long droppedBefore = LogFileWriter::GetDroppedCount();
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; ++t) {
+        writers.emplace_back([t] {
+            std::string line;
+            for (int n = 0; n < lines; ++n) {
+                char prefix[32];
+                snprintf(prefix, sizeof(prefix), "LWT %d %d ", t, n);
+                size_t body = n % 97 == 0 ? 5000 : (n % 13 == 0 ? 600 : 40);
+                line.assign(prefix);
+                line.append(body, static_cast<char>('a' + t));
+                LogFileWriter::WriteLog(line.c_str());
+            }
+        });
+    }
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+    LogFileWriter::Flush();
+    long long dropped = LogFileWriter::GetDroppedCount() - droppedBefore;
+
+    std::string text = ReadFile(path);
+    std::vector<int> next(threads, 0);
+    long long found = 0;
+    bool intact = true;
+    for (size_t at = text.find("LWT "); at != std::string::npos; at = text.find("LWT ", at + 1)) {
+        int t = -1;
+        int n = -1;
+        if (sscanf(text.c_str() + at, "LWT %d %d ", &t, &n) != 2 || t < 0 || t >= threads || n < next[t]) {
+            intact = false;
+            break;
+        }
+        next[t] = n + 1;
+
+        size_t start = text.find(' ', text.find(' ', at + 4) + 1) + 1;
+        size_t end = text.find('\n', start);
+        size_t body = n % 97 == 0 ? 5000 : (n % 13 == 0 ? 600 : 40);
+        if (end == std::string::npos || end - start != body ||
+            text.find_first_not_of(static_cast<char>('a' + t), start) != end) {
+            intact = false;
+            break;
+        }
+        ++found;
+    }
+    LEO_CHECK(intact);
+    LEO_CHECK(found + dropped == threads * lines);
+    LEO_CHECK(found > 0);
+    DeleteFileW(path.c_str());
+}
+
+LEO_BENCH(LogWriterPerCallCost)
+{
+    std::wstring path = UseTestLog(L"LeoTestsBench.log");
+    LogFileWriter::SetLevel(LEO_LOG_LEVEL_INFO);
+    LogFileWriter::WriteLog("warm up");
+    LogFileWriter::Flush();
+
+    double writeLogNs = PerLineNs(400, [](int) { LogFileWriter::WriteLog(TYPICAL_LINE); });
+
+    LogFileWriter::SetRateLimit(0, 0);
+    double statementNs = PerLineNs(400, [](int i) {
+        LEO_INFO(Http, "POST %s answered %d after %d ms (%d bytes)", "/api/face-search", 200, i, 4096);
+    });
+    LogFileWriter::SetBinary(true);
+    double binaryNs = PerLineNs(400, [](int i) {
+        LEO_INFO(Http, "POST %s answered %d after %d ms (%d bytes)", "/api/face-search", 200, i, 4096);
+    });
+    LogFileWriter::SetBinary(false);
+
+    // One statement past its burst: over the limit, it is neither formatted nor queued
+    LogFileWriter::SetRateLimit(1, 1);
+    double limitedNs = PerLineNs(400, [](int i) { LEO_INFO(Http, "Element ID %d has no surface", i); });
+    LogFileWriter::SetRateLimit(LOG_SITE_RATE, LOG_SITE_BURST);
+
+    double disabledNs = PerLineNs(400, [](int i) { LEO_LOG(LEO_LOG_LEVEL_TRACE, Geometry, "Edge %d skipped", i); });
+
+    // Four threads logging at once, each timing its own calls
+    const int threads = 4;
+    std::atomic<long long> contendedNs(0);
+    std::atomic<int> ready(0);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; ++t) {
+        writers.emplace_back([&] {
+            ready++;
+            while (ready < threads) {
+                std::this_thread::yield();
+            }
+            double ns = PerLineNs(200, [](int) { LogFileWriter::WriteLog(TYPICAL_LINE); });
+            contendedNs += static_cast<long long>(ns);
+        });
+    }
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+
+    std::wstring oldPath = TestDirectory() + L"\\LeoTestsSynchronous.log";
+    double synchronousNs = LeoMeasureNs(2000, [&] { SynchronousWriteLog(oldPath, TYPICAL_LINE); });
+    DeleteFileW(oldPath.c_str());
+
+    LeoBenchReport("WriteLog, 85-character line", writeLogNs, "ns/call");
+    LeoBenchReport("LEO_INFO with 4 arguments, text", statementNs, "ns/call");
+    LeoBenchReport("LEO_INFO with 4 arguments, binary", binaryNs, "ns/call");
+    LeoBenchReport("LEO_INFO over its rate limit", limitedNs, "ns/call");
+    LeoBenchReport("statement below the runtime level", disabledNs, "ns/call");
+    LeoBenchReport("WriteLog, 4 threads at once", static_cast<double>(contendedNs) / threads, "ns/call");
+    LeoBenchReport("open, write and close per line (before the ring)", synchronousNs, "ns/call");
+    LeoBenchReport("lines dropped for a full ring", static_cast<double>(LogFileWriter::GetDroppedCount()), "lines");
+    DeleteFileW(path.c_str());
+}
+
+LEO_BENCH(LogWriterOpenFileInCreo)
+{
+    // What placing a downloaded part costs the UI thread in logging, at the DEBUG and TRACE
+    // levels a support session turns on; the statements compiled out of Release cost nothing
+    std::wstring path = UseTestLog(L"LeoTestsPlacement.log");
+    LogFileWriter::SetLevel(LEO_LOG_LEVEL_TRACE);
+    LogPartPlacement(0);
+    LogFileWriter::Flush();
+    std::vector<std::string> lines = LoggedMessages(ReadFile(path));
+
+    std::vector<double> ringUs;
+    for (int run = 0; run < 200; ++run) {
+        LogFileWriter::Flush();
+        auto start = std::chrono::steady_clock::now();
+        LogPartPlacement(run);
+        ringUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    LogFileWriter::Flush();
+    LogFileWriter::SetLevel(LEO_LOG_LEVEL_INFO);
+
+    // The same lines through the old synchronous writer
+    std::wstring oldPath = TestDirectory() + L"\\LeoTestsPlacementSynchronous.log";
+    std::vector<double> synchronousUs;
+    for (int run = 0; run < 50; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (const std::string& line : lines) {
+            SynchronousWriteLog(oldPath, line.c_str());
+        }
+        synchronousUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    DeleteFileW(oldPath.c_str());
+
+    char label[96];
+    snprintf(label, sizeof(label), "OpenFileInCreo placement, %d lines, median", static_cast<int>(lines.size()));
+    LeoBenchReport(label, Median(ringUs), "us");
+    LeoBenchReport("same lines, open, write and close per line", Median(synchronousUs), "us");
+    DeleteFileW(path.c_str());
+}